@@ -0,0 +1,548 @@
+/*
+
+QPEAggregate.c
+
+Authors:
+    Aidan Levy
+    Maddie Powell
+    Nick Corcoran
+    Austin Phalines
+    Dean Bullock
+
+Creation Date: 10-14-2026
+
+Description:
+
+Hash aggregation for aggregate queries (QPEAggregate.h), shared by the
+engines. agg_add() looks up the group of a matching row by its GROUP BY
+value and folds the row into it; agg_scan() and agg_query() feed it the
+matching rows of a row range or of a whole plan (ID range, index lookup or
+full scan) over an ID-ordered array. Both layouts aggregate from that array:
+only the final groups are ever formatted, so there is nothing for the column
+store's bitmap kernels to save.
+
+The groups live in one array, in the order they were first seen, and the
+hash only holds their positions, so merging tables and shipping groups
+between processes work on plain AggGroup arrays. agg_format() sorts them by
+key right before printing.
+
+*/
+
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "QPEAggregate.h"
+
+/*
+Function Prototypes
+*/
+static bool string_group(const Query *q);
+static int stat_of(ColumnId col);
+static void group_reset(AggGroup *g);
+static void group_key(const Query *q, const CarInventory *car, int *ikey,
+                      const char **skey);
+static size_t key_hash(int ikey, const char *skey);
+static bool grow_slots(AggTable *t);
+static AggGroup *find_group(AggTable *t, int ikey, const char *skey);
+static int compare_ikey(const void *a, const void *b);
+static int compare_skey(const void *a, const void *b);
+
+/*
+Name: string_group():
+Parameters: const Query *q
+Return: bool
+Description:
+
+Returns true if q groups by one of the string columns (Model, Color or
+Dealer), whose values are kept in skey rather than ikey.
+*/
+static bool string_group(const Query *q) {
+  return q->group_col == COL_MODEL || q->group_col == COL_COLOR ||
+         q->group_col == COL_DEALER;
+}
+
+/*
+Name: stat_of():
+Parameters: ColumnId col
+Return: int
+Description:
+
+Maps an integer column to its slot in the sum/min/max arrays of an AggGroup.
+*/
+static int stat_of(ColumnId col) {
+  switch (col) {
+  case COL_ID:
+    return 0;
+  case COL_YEARMAKE:
+    return 1;
+  default:
+    return 2;
+  }
+}
+
+/*
+Name: group_reset():
+Parameters: AggGroup *g
+Return: void
+Description:
+
+Clears g to an empty group: no rows, zero sums, and minimums and maximums
+that any value replaces, so combining it with another group is a no-op.
+*/
+static void group_reset(AggGroup *g) {
+  memset(g, 0, sizeof(*g));
+  for (int s = 0; s < QPE_AGG_STATS; s++) {
+    g->min[s] = INT_MAX;
+    g->max[s] = INT_MIN;
+  }
+}
+
+/*
+Name: group_key():
+Parameters: const Query *q, const CarInventory *car, int *ikey,
+            const char **skey
+Return: void
+Description:
+
+Reads the GROUP BY value of car: *skey for a string column, otherwise
+*ikey (and *skey stays NULL).
+*/
+static void group_key(const Query *q, const CarInventory *car, int *ikey,
+                      const char **skey) {
+  switch (q->group_col) {
+  case COL_ID:
+    *ikey = car->ID;
+    break;
+  case COL_YEARMAKE:
+    *ikey = car->YearMake;
+    break;
+  case COL_PRICE:
+    *ikey = car->Price;
+    break;
+  case COL_MODEL:
+    *skey = car->Model;
+    break;
+  case COL_COLOR:
+    *skey = car->Color;
+    break;
+  case COL_DEALER:
+    *skey = car->Dealer;
+    break;
+  default:
+    break;
+  }
+}
+
+/*
+Name: key_hash():
+Parameters: int ikey, const char *skey
+Return: size_t
+Description:
+
+FNV-1a hash of a string key, or a multiplicative hash of an integer key
+when skey is NULL.
+*/
+static size_t key_hash(int ikey, const char *skey) {
+  unsigned int h = 2166136261u;
+  if (skey == NULL) {
+    return (size_t)((unsigned int)ikey * 2654435761u);
+  }
+  for (; *skey; skey++) {
+    h ^= (unsigned char)*skey;
+    h *= 16777619u;
+  }
+  return (size_t)h;
+}
+
+/*
+Name: grow_slots():
+Parameters: AggTable *t
+Return: bool
+Description:
+
+Doubles the hash (at least 32 slots) and reinserts every group, keeping the
+table at most half full. Returns false on allocation failure, leaving the
+old hash in place.
+*/
+static bool grow_slots(AggTable *t) {
+  size_t num_slots = t->num_slots ? t->num_slots * 2 : 32;
+  bool strings = string_group(t->q);
+  size_t *slots;
+  size_t mask;
+
+  while (num_slots < (t->num_groups + 1) * 2) {
+    num_slots *= 2;
+  }
+  mask = num_slots - 1;
+  slots = calloc(num_slots, sizeof(size_t));
+  if (slots == NULL) {
+    return false;
+  }
+  for (size_t i = 0; i < t->num_groups; i++) {
+    const AggGroup *g = &t->groups[i];
+    size_t h = key_hash(g->ikey, strings ? g->skey : NULL) & mask;
+    while (slots[h] != 0) {
+      h = (h + 1) & mask;
+    }
+    slots[h] = i + 1;
+  }
+  free(t->slots);
+  t->slots = slots;
+  t->num_slots = num_slots;
+  return true;
+}
+
+/*
+Name: find_group():
+Parameters: AggTable *t, int ikey, const char *skey
+Return: AggGroup *
+Description:
+
+Returns the group for the given key (skey for a string GROUP BY column,
+ikey otherwise), appending an empty one if the key is new, or the only group
+of a query without GROUP BY. Returns NULL on allocation failure.
+*/
+static AggGroup *find_group(AggTable *t, int ikey, const char *skey) {
+  AggGroup *g;
+  size_t mask;
+  size_t h;
+
+  if (t->q->group_col == COL_UNKNOWN) {
+    return &t->groups[0];
+  }
+  if ((t->num_groups + 1) * 2 > t->num_slots && !grow_slots(t)) {
+    return NULL;
+  }
+
+  mask = t->num_slots - 1;
+  for (h = key_hash(ikey, skey) & mask; t->slots[h] != 0; h = (h + 1) & mask) {
+    g = &t->groups[t->slots[h] - 1];
+    if (skey ? strcmp(g->skey, skey) == 0 : g->ikey == ikey) {
+      return g;
+    }
+  }
+
+  if (t->num_groups == t->cap_groups) {
+    size_t cap = t->cap_groups ? t->cap_groups * 2 : 16;
+    AggGroup *groups = realloc(t->groups, cap * sizeof(AggGroup));
+    if (groups == NULL) {
+      return NULL;
+    }
+    t->groups = groups;
+    t->cap_groups = cap;
+  }
+  g = &t->groups[t->num_groups++];
+  group_reset(g);
+  g->ikey = ikey;
+  if (skey != NULL) {
+    strncpy(g->skey, skey, sizeof(g->skey) - 1);
+  }
+  t->slots[h] = t->num_groups;
+  return g;
+}
+
+/*
+Name: agg_init():
+Parameters: AggTable *t, const Query *q
+Return: bool
+Description:
+
+Prepares an empty table for the aggregate query q. Without GROUP BY its one
+group is allocated now; otherwise nothing is until the first row. Returns
+false on allocation failure; agg_free() is safe either way.
+*/
+bool agg_init(AggTable *t, const Query *q) {
+  memset(t, 0, sizeof(*t));
+  t->q = q;
+  if (q->group_col != COL_UNKNOWN) {
+    return true;
+  }
+  t->groups = malloc(sizeof(AggGroup));
+  if (t->groups == NULL) {
+    return false;
+  }
+  group_reset(&t->groups[0]);
+  t->num_groups = 1;
+  t->cap_groups = 1;
+  return true;
+}
+
+/*
+Name: agg_free():
+Parameters: AggTable *t
+Return: void
+Description:
+
+Releases the groups and the hash of t.
+*/
+void agg_free(AggTable *t) {
+  free(t->groups);
+  free(t->slots);
+  t->groups = NULL;
+  t->slots = NULL;
+  t->num_groups = 0;
+  t->cap_groups = 0;
+  t->num_slots = 0;
+}
+
+/*
+Name: agg_add():
+Parameters: AggTable *t, const CarInventory *car
+Return: bool
+Description:
+
+Folds a row that matched the query into its group. Returns false if a new
+group could not be allocated.
+*/
+bool agg_add(AggTable *t, const CarInventory *car) {
+  const int vals[QPE_AGG_STATS] = {car->ID, car->YearMake, car->Price};
+  const char *skey = NULL;
+  int ikey = 0;
+  AggGroup *g;
+
+  group_key(t->q, car, &ikey, &skey);
+  g = find_group(t, ikey, skey);
+  if (g == NULL) {
+    return false;
+  }
+  g->count++;
+  for (int s = 0; s < QPE_AGG_STATS; s++) {
+    g->sum[s] += vals[s];
+    if (vals[s] < g->min[s]) {
+      g->min[s] = vals[s];
+    }
+    if (vals[s] > g->max[s]) {
+      g->max[s] = vals[s];
+    }
+  }
+  return true;
+}
+
+/*
+Name: agg_combine():
+Parameters: AggGroup *into, const AggGroup *from
+Return: void
+Description:
+
+Adds the partial group from to into (same key): counts and sums add up,
+minimums and maximums take the smaller and larger value. The key of into is
+left alone, so this is also the element-wise MPI reduction of qpe_mpi.
+*/
+void agg_combine(AggGroup *into, const AggGroup *from) {
+  into->count += from->count;
+  for (int s = 0; s < QPE_AGG_STATS; s++) {
+    into->sum[s] += from->sum[s];
+    if (from->min[s] < into->min[s]) {
+      into->min[s] = from->min[s];
+    }
+    if (from->max[s] > into->max[s]) {
+      into->max[s] = from->max[s];
+    }
+  }
+}
+
+/*
+Name: agg_merge_groups():
+Parameters: AggTable *t, const AggGroup *groups, size_t count
+Return: bool
+Description:
+
+Combines count partial groups (from another table, thread or rank over the
+same query) into t, each into the group with the same key. Returns false on
+allocation failure.
+*/
+bool agg_merge_groups(AggTable *t, const AggGroup *groups, size_t count) {
+  bool strings = string_group(t->q);
+  for (size_t i = 0; i < count; i++) {
+    AggGroup *g =
+        find_group(t, groups[i].ikey, strings ? groups[i].skey : NULL);
+    if (g == NULL) {
+      return false;
+    }
+    agg_combine(g, &groups[i]);
+  }
+  return true;
+}
+
+/*
+Name: agg_merge():
+Parameters: AggTable *dst, const AggTable *src
+Return: bool
+Description:
+
+Combines every group of src into dst; both tables belong to the same query.
+Returns false on allocation failure.
+*/
+bool agg_merge(AggTable *dst, const AggTable *src) {
+  return agg_merge_groups(dst, src->groups, src->num_groups);
+}
+
+/*
+Name: agg_scan():
+Parameters: AggTable *t, const CarInventory *rows, size_t begin, size_t end
+Return: bool
+Description:
+
+Tests rows [begin, end) against the query's WHERE clause and aggregates the
+matches. Returns false on allocation failure.
+*/
+bool agg_scan(AggTable *t, const CarInventory *rows, size_t begin,
+              size_t end) {
+  for (size_t i = begin; i < end; i++) {
+    if (match_where(&rows[i], &t->q->where) && !agg_add(t, &rows[i])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/*
+Name: agg_query():
+Parameters: AggTable *t, const CarInventory *rows, size_t count,
+            const SecondaryIndex *index, const QueryPlan *plan,
+            size_t *scanned
+Return: bool
+Description:
+
+Aggregates the whole query over the ID-ordered rows along its plan: a
+PLAN_ID_RANGE plan binary searches the lower bound and stops past the upper
+one, an index plan tests only the candidate rows (falling back to a full
+scan if the lookup fails or index is NULL), and a full scan tests every row.
+Adds the rows tested to *scanned and returns false on allocation failure.
+*/
+bool agg_query(AggTable *t, const CarInventory *rows, size_t count,
+               const SecondaryIndex *index, const QueryPlan *plan,
+               size_t *scanned) {
+  PostingList hits;
+
+  if (plan->path == PLAN_ID_RANGE) {
+    size_t lo = 0;
+    size_t hi = count;
+    size_t end;
+    while (lo < hi) {
+      size_t mid = lo + (hi - lo) / 2;
+      if (rows[mid].ID < plan->id_lo) {
+        lo = mid + 1;
+      } else {
+        hi = mid;
+      }
+    }
+    for (end = lo; end < count && rows[end].ID <= plan->id_hi; end++) {
+    }
+    *scanned += end - lo;
+    return agg_scan(t, rows, lo, end);
+  }
+
+  if (plan->path != PLAN_FULL_SCAN && index != NULL &&
+      index_lookup(index, &plan->probe, &hits)) {
+    bool ok = true;
+    *scanned += hits.count;
+    for (size_t i = 0; ok && i < hits.count; i++) {
+      const CarInventory *car = &rows[hits.rows[i]];
+      if (match_where(car, &t->q->where)) {
+        ok = agg_add(t, car);
+      }
+    }
+    posting_list_free(&hits);
+    return ok;
+  }
+
+  *scanned += count;
+  return agg_scan(t, rows, 0, count);
+}
+
+/*
+Name: compare_ikey():
+Parameters: const void *a, const void *b
+Return: int
+Description:
+
+qsort comparator ordering AggGroups by integer key.
+*/
+static int compare_ikey(const void *a, const void *b) {
+  const AggGroup *ga = (const AggGroup *)a;
+  const AggGroup *gb = (const AggGroup *)b;
+  return (ga->ikey > gb->ikey) - (ga->ikey < gb->ikey);
+}
+
+/*
+Name: compare_skey():
+Parameters: const void *a, const void *b
+Return: int
+Description:
+
+qsort comparator ordering AggGroups by string key.
+*/
+static int compare_skey(const void *a, const void *b) {
+  return strcmp(((const AggGroup *)a)->skey, ((const AggGroup *)b)->skey);
+}
+
+/*
+Name: agg_format():
+Parameters: AggTable *t, Buffer *out
+Return: bool
+Description:
+
+Sorts the groups by key and appends one line per group to out: the SELECT
+entries in order, separated by spaces, with AVG to two decimals and NULL for
+the AVG, MIN or MAX of an empty group. Sorting invalidates the hash, which
+is dropped (a later agg_add() rebuilds it). Returns false on allocation
+failure.
+*/
+bool agg_format(AggTable *t, Buffer *out) {
+  const Query *q = t->q;
+  bool strings = string_group(q);
+
+  if (q->group_col != COL_UNKNOWN) {
+    qsort(t->groups, t->num_groups, sizeof(AggGroup),
+          strings ? compare_skey : compare_ikey);
+    free(t->slots);
+    t->slots = NULL;
+    t->num_slots = 0;
+  }
+
+  for (size_t i = 0; i < t->num_groups; i++) {
+    const AggGroup *g = &t->groups[i];
+    bool ok = true;
+    for (int k = 0; ok && k < q->num_select_attrs; k++) {
+      int s = stat_of((ColumnId)q->select_cols[k]);
+      if (k > 0) {
+        ok = buffer_append(out, " ", 1);
+      }
+      switch (q->select_aggs[k]) {
+      case AGG_NONE:
+        if (q->select_cols[k] == COL_UNKNOWN) {
+          break;
+        }
+        ok = ok && (strings ? buffer_appendf(out, "%s", g->skey)
+                            : buffer_appendf(out, "%d", g->ikey));
+        break;
+      case AGG_COUNT:
+        ok = ok && buffer_appendf(out, "%lld", g->count);
+        break;
+      case AGG_SUM:
+        ok = ok && buffer_appendf(out, "%lld", g->sum[s]);
+        break;
+      case AGG_AVG:
+        ok = ok && (g->count > 0
+                        ? buffer_appendf(out, "%.2f",
+                                         (double)g->sum[s] / (double)g->count)
+                        : buffer_append(out, "NULL", 4));
+        break;
+      case AGG_MIN:
+        ok = ok && (g->count > 0 ? buffer_appendf(out, "%d", g->min[s])
+                                 : buffer_append(out, "NULL", 4));
+        break;
+      default:
+        ok = ok && (g->count > 0 ? buffer_appendf(out, "%d", g->max[s])
+                                 : buffer_append(out, "NULL", 4));
+        break;
+      }
+    }
+    if (!ok || !buffer_append(out, "\n", 1)) {
+      return false;
+    }
+  }
+  return true;
+}
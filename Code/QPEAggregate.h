@@ -0,0 +1,72 @@
+/*
+
+QPEAggregate.h
+
+Evaluation of aggregate queries (see QPEQuery.h): COUNT(*), and COUNT, SUM,
+AVG, MIN and MAX over one column, optionally with GROUP BY <column>. The
+matching rows are never formatted. Each one is folded into an AggTable, a
+hash table from the GROUP BY value to an AggGroup, and only the final groups
+are formatted, one result line per group in ascending GROUP BY order.
+
+An AggGroup keeps the row count and the sum, minimum and maximum of each
+integer column. That is all any aggregate needs, and it means two partial
+groups combine field by field, in any order: the engines give every thread,
+chunk or rank its own table and merge them at the end with agg_merge(),
+agg_merge_groups() or agg_combine(). A query without GROUP BY has exactly
+one group, created by agg_init(), so a query that matches nothing still
+prints COUNT 0 (and NULL for AVG, MIN and MAX).
+
+*/
+
+#ifndef QPE_AGGREGATE_H
+#define QPE_AGGREGATE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "QPEBuffer.h"
+#include "QPEIndex.h"
+#include "QPEPlan.h"
+#include "QPEQuery.h"
+
+/* Integer columns an AggGroup tracks: ID, YearMake and Price. */
+#define QPE_AGG_STATS 3
+
+/*
+Struct Definitions
+*/
+typedef struct {
+  int ikey;      /* GROUP BY value of an integer column */
+  char skey[20]; /* GROUP BY value of a string column */
+  long long count;
+  long long sum[QPE_AGG_STATS];
+  int min[QPE_AGG_STATS];
+  int max[QPE_AGG_STATS];
+} AggGroup;
+
+typedef struct {
+  const Query *q;
+  AggGroup *groups;
+  size_t num_groups;
+  size_t cap_groups;
+  size_t *slots; /* open addressing hash: GROUP BY value -> group + 1 */
+  size_t num_slots;
+} AggTable;
+
+/*
+Function Prototypes
+*/
+bool agg_init(AggTable *t, const Query *q);
+void agg_free(AggTable *t);
+bool agg_add(AggTable *t, const CarInventory *car);
+void agg_combine(AggGroup *into, const AggGroup *from);
+bool agg_merge_groups(AggTable *t, const AggGroup *groups, size_t count);
+bool agg_merge(AggTable *dst, const AggTable *src);
+bool agg_scan(AggTable *t, const CarInventory *rows, size_t begin,
+              size_t end);
+bool agg_query(AggTable *t, const CarInventory *rows, size_t count,
+               const SecondaryIndex *index, const QueryPlan *plan,
+               size_t *scanned);
+bool agg_format(AggTable *t, Buffer *out);
+
+#endif
@@ -0,0 +1,159 @@
+/*
+
+QPEArena.c
+
+Authors:
+    Aidan Levy
+    Maddie Powell
+    Nick Corcoran
+    Austin Phalines
+    Dean Bullock
+
+Creation Date: 10-14-2026
+
+Description:
+
+Bump allocator behind the per-query scratch arrays of qpe_mpi and qpe_hybrid
+(see QPEArena.h). An allocation moves the fill mark of the newest block, and
+a new block is only chained in when it does not fit. arena_reset() folds the
+chain into a single block as large as all of them together, so after the
+busiest query every later one is served from that block without malloc.
+
+This is a partial adoption: only qpe_mpi's gather_results() arrays come from
+an Arena. The engines' result Buffers (qpe_seq's output Buffer, qpe_mpi's
+results, qpe_hybrid's chunk parts and qpe_omp's PartPool) are kept for the
+whole run and emptied between queries, but still grow with realloc(). A bump
+allocator cannot grow an allocation in place, so moving them here would mean
+copying on every growth.
+
+*/
+
+#include <stdlib.h>
+
+#include "QPEArena.h"
+
+/* The block header, padded so the first allocation stays aligned. */
+#define QPE_ARENA_HEADER                                                      \
+  ((sizeof(ArenaBlock) + QPE_ARENA_ALIGN - 1) & ~(size_t)(QPE_ARENA_ALIGN - 1))
+
+/*
+Function Prototypes
+*/
+static ArenaBlock *arena_block_new(size_t cap, ArenaBlock *next);
+
+/*
+Name: arena_init():
+Parameters: Arena *a
+Return: void
+Description:
+
+Initializes an empty Arena; no memory is allocated until arena_alloc().
+*/
+void arena_init(Arena *a) {
+  a->head = NULL;
+  a->used = 0;
+  a->peak = 0;
+}
+
+/*
+Name: arena_block_new():
+Parameters: size_t cap, ArenaBlock *next
+Return: ArenaBlock *
+Description:
+
+Allocates an empty block with cap usable bytes, chained in front of next.
+Returns NULL on allocation failure.
+*/
+static ArenaBlock *arena_block_new(size_t cap, ArenaBlock *next) {
+  ArenaBlock *block = malloc(QPE_ARENA_HEADER + cap);
+
+  if (block == NULL) {
+    return NULL;
+  }
+  block->next = next;
+  block->cap = cap;
+  block->used = 0;
+  return block;
+}
+
+/*
+Name: arena_alloc():
+Parameters: Arena *a, size_t bytes
+Return: void *
+Description:
+
+Returns bytes of uninitialized memory aligned to QPE_ARENA_ALIGN, valid until
+the next arena_reset() or arena_free(), or NULL when out of memory. A request
+that does not fit the current block starts a new one of at least
+QPE_ARENA_BLOCK bytes.
+*/
+void *arena_alloc(Arena *a, size_t bytes) {
+  ArenaBlock *block = a->head;
+  char *p;
+
+  bytes = (bytes + QPE_ARENA_ALIGN - 1) & ~(size_t)(QPE_ARENA_ALIGN - 1);
+  if (block == NULL || block->cap - block->used < bytes) {
+    block = arena_block_new(bytes > QPE_ARENA_BLOCK ? bytes : QPE_ARENA_BLOCK,
+                            a->head);
+    if (block == NULL) {
+      return NULL;
+    }
+    a->head = block;
+  }
+  p = (char *)block + QPE_ARENA_HEADER + block->used;
+  block->used += bytes;
+  a->used += bytes;
+  if (a->used > a->peak) {
+    a->peak = a->used;
+  }
+  return p;
+}
+
+/*
+Name: arena_reset():
+Parameters: Arena *a
+Return: void
+Description:
+
+Releases every allocation at once. A single block is kept as it is; a chain
+of blocks is replaced by one block of their combined size, so the next round
+of the same allocations fits without growing. If that block cannot be
+allocated the Arena simply starts empty.
+*/
+void arena_reset(Arena *a) {
+  size_t total = 0;
+
+  a->used = 0;
+  if (a->head == NULL) {
+    return;
+  }
+  if (a->head->next == NULL) {
+    a->head->used = 0;
+    return;
+  }
+  for (ArenaBlock *block = a->head; block != NULL; block = block->next) {
+    total += block->cap;
+  }
+  arena_free(a);
+  a->head = arena_block_new(total, NULL);
+}
+
+/*
+Name: arena_free():
+Parameters: Arena *a
+Return: void
+Description:
+
+Frees every block of the Arena, leaving it empty and ready for reuse.
+*/
+void arena_free(Arena *a) {
+  ArenaBlock *block = a->head;
+
+  while (block != NULL) {
+    ArenaBlock *next = block->next;
+    free(block);
+    block = next;
+  }
+  a->head = NULL;
+  a->used = 0;
+}
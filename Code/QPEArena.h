@@ -0,0 +1,49 @@
+/*
+
+QPEArena.h
+
+Bump allocator for per-query scratch memory (see QPEArena.c). Allocations are
+carved out of large blocks and never freed one by one; arena_reset() hands
+all of them back at once between queries, keeping the memory, so a loop that
+allocates the same amount per query stops calling malloc after the first.
+So far only qpe_mpi's gather arrays use it; the engines' result Buffers are
+reused across queries but grow with realloc().
+
+*/
+
+#ifndef QPE_ARENA_H
+#define QPE_ARENA_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Every allocation is aligned to this many bytes. */
+#define QPE_ARENA_ALIGN 16
+
+/* Smallest block an Arena allocates. */
+#define QPE_ARENA_BLOCK ((size_t)64 << 10)
+
+/*
+Struct Definitions
+*/
+typedef struct ArenaBlock {
+  struct ArenaBlock *next; /* older, full blocks */
+  size_t cap;              /* usable bytes after the header */
+  size_t used;
+} ArenaBlock;
+
+typedef struct {
+  ArenaBlock *head; /* block being filled, NULL before the first allocation */
+  size_t used;      /* bytes handed out since the last reset */
+  size_t peak;      /* the most bytes in use at once */
+} Arena;
+
+/*
+Function Prototypes
+*/
+void arena_init(Arena *a);
+void *arena_alloc(Arena *a, size_t bytes);
+void arena_reset(Arena *a);
+void arena_free(Arena *a);
+
+#endif
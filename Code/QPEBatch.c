@@ -0,0 +1,390 @@
+/*
+
+QPEBatch.c
+
+Authors:
+    Aidan Levy
+    Maddie Powell
+    Nick Corcoran
+    Austin Phalines
+    Dean Bullock
+
+Creation Date: 10-14-2026
+
+Description:
+
+Builds the Model groups of a query batch (QPEBatch.h) and evaluates them in
+one pass, a record at a time for the row layout or a block at a time for the
+column store. Within each query the matches are appended in scan order, so
+every per-query Buffer holds exactly what a separate scan would have printed.
+
+*/
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "QPEBatch.h"
+#include "QPEIndex.h"
+
+typedef struct {
+  const ColumnTable *table;
+  const Query *q;
+  Buffer *buf;
+} BatchEmitCtx;
+
+/*
+Function Prototypes
+*/
+static unsigned int fold_hash(const char *s);
+static int find_group(const QueryBatch *batch, const char *model);
+static int add_group(QueryBatch *batch, const char *model);
+static bool bind_columns(QueryBatch *batch, const ColumnTable *table);
+static bool batch_emit_cb(size_t row, void *udata);
+
+/*
+Name: fold_hash():
+Parameters: const char *s
+Return: unsigned int
+Description:
+
+FNV-1a hash of a string with every letter lowered first, so values that
+strcasecmp() treats as equal land in the same slot.
+*/
+static unsigned int fold_hash(const char *s) {
+  unsigned int h = 2166136261u;
+  while (*s) {
+    h ^= (unsigned char)tolower((unsigned char)*s++);
+    h *= 16777619u;
+  }
+  return h;
+}
+
+/*
+Name: find_group():
+Parameters: const QueryBatch *batch, const char *model
+Return: int
+Description:
+
+Returns the group whose Model literal equals model (ignoring case), or 0 when
+no batched query names it.
+*/
+static int find_group(const QueryBatch *batch, const char *model) {
+  unsigned int mask = (unsigned)batch->num_slots - 1;
+  unsigned int h = fold_hash(model) & mask;
+
+  while (batch->slots[h] != 0) {
+    int g = batch->slots[h];
+    if (strcasecmp(batch->keys[g], model) == 0) {
+      return g;
+    }
+    h = (h + 1) & mask;
+  }
+  return 0;
+}
+
+/*
+Name: add_group():
+Parameters: QueryBatch *batch, const char *model
+Return: int
+Description:
+
+Returns the group for model, opening a new one if this is the first query
+that names it. The slot table is sized in batch_init() so it never fills.
+*/
+static int add_group(QueryBatch *batch, const char *model) {
+  unsigned int mask = (unsigned)batch->num_slots - 1;
+  unsigned int h = fold_hash(model) & mask;
+  int g = find_group(batch, model);
+
+  if (g != 0) {
+    return g;
+  }
+  while (batch->slots[h] != 0) {
+    h = (h + 1) & mask;
+  }
+  g = batch->num_groups++;
+  strncpy(batch->keys[g], model, 19);
+  batch->keys[g][19] = '\0';
+  batch->slots[h] = g;
+  return g;
+}
+
+/*
+Name: batch_init():
+Parameters: QueryBatch *batch, const Query *queries, const int *members,
+            int num_members, const ColumnTable *table
+Return: bool
+Description:
+
+Groups queries[members[0..num_members-1]] by Model literal, keeping query
+order inside every group. When table is not NULL the WHERE clauses are also
+bound to the column store for batch_scan_columnar(); the predicates must not
+change afterwards. Returns false on allocation failure.
+*/
+bool batch_init(QueryBatch *batch, const Query *queries, const int *members,
+                int num_members, const ColumnTable *table) {
+  int *group_of = NULL;
+  int *next = NULL;
+
+  memset(batch, 0, sizeof(*batch));
+  batch->queries = queries;
+  batch->num_members = num_members;
+  batch->num_groups = 1;
+  batch->num_slots = 16;
+  while (batch->num_slots < 2 * num_members) {
+    batch->num_slots *= 2;
+  }
+
+  batch->members = malloc((size_t)(num_members + 1) * sizeof(int));
+  batch->group_start = calloc((size_t)num_members + 2, sizeof(int));
+  batch->keys = calloc((size_t)num_members + 1, sizeof(batch->keys[0]));
+  batch->slots = calloc((size_t)batch->num_slots, sizeof(int));
+  group_of = malloc((size_t)(num_members + 1) * sizeof(int));
+  next = calloc((size_t)num_members + 2, sizeof(int));
+  if (!batch->members || !batch->group_start || !batch->keys ||
+      !batch->slots || !group_of || !next) {
+    free(group_of);
+    free(next);
+    batch_free(batch);
+    return false;
+  }
+
+  for (int m = 0; m < num_members; m++) {
+    IndexProbe probe;
+    index_probe_init(&probe, &queries[members[m]].where);
+    group_of[m] = probe.model ? add_group(batch, probe.model) : 0;
+    batch->group_start[group_of[m] + 1]++;
+  }
+  for (int g = 0; g < batch->num_groups; g++) {
+    batch->group_start[g + 1] += batch->group_start[g];
+    next[g] = batch->group_start[g];
+  }
+  for (int m = 0; m < num_members; m++) {
+    batch->members[next[group_of[m]]++] = members[m];
+  }
+  free(group_of);
+  free(next);
+
+  if (table && !bind_columns(batch, table)) {
+    batch_free(batch);
+    return false;
+  }
+  return true;
+}
+
+/*
+Name: bind_columns():
+Parameters: QueryBatch *batch, const ColumnTable *table
+Return: bool
+Description:
+
+Maps every Model dictionary code to its group and binds each member's WHERE
+clause to the column store.
+*/
+static bool bind_columns(QueryBatch *batch, const ColumnTable *table) {
+  const Dictionary *dict = &table->dicts[DICT_MODEL];
+
+  batch->table = table;
+  batch->code_group = calloc((size_t)dict->count + 1, sizeof(int));
+  batch->filters =
+      calloc((size_t)batch->num_members + 1, sizeof(ColumnFilter));
+  if (!batch->code_group || !batch->filters) {
+    return false;
+  }
+  for (int code = 0; code < dict->count; code++) {
+    batch->code_group[code] = find_group(batch, dict->values[code]);
+  }
+  for (int k = 0; k < batch->num_members; k++) {
+    const Query *q = &batch->queries[batch->members[k]];
+    if (!column_filter_init(&batch->filters[k], table, &q->where)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/*
+Name: batch_free():
+Parameters: QueryBatch *batch
+Return: void
+Description:
+
+Releases the groups and any column bindings; safe on a partly built batch.
+*/
+void batch_free(QueryBatch *batch) {
+  if (batch->filters) {
+    for (int k = 0; k < batch->num_members; k++) {
+      column_filter_free(&batch->filters[k]);
+    }
+  }
+  free(batch->filters);
+  free(batch->code_group);
+  free(batch->slots);
+  free(batch->keys);
+  free(batch->group_start);
+  free(batch->members);
+  memset(batch, 0, sizeof(*batch));
+}
+
+/*
+Name: batch_row():
+Parameters: const QueryBatch *batch, const CarInventory *car, Buffer *outs
+Return: bool
+Description:
+
+Tests one record against the queries without a Model= literal and against
+the group of car->Model, appending every match to outs[query index]. Returns
+false if a result could not be buffered.
+*/
+bool batch_row(const QueryBatch *batch, const CarInventory *car,
+               Buffer *outs) {
+  return batch_row_tagged(batch, car, outs, NULL);
+}
+
+/*
+Name: batch_row_tagged():
+Parameters: const QueryBatch *batch, const CarInventory *car, Buffer *outs,
+            Buffer *tags
+Return: bool
+Description:
+
+batch_row() that also appends a BatchTag for every match to tags[query
+index] when tags is not NULL, so the lines can later be merged by ID
+(QPEStream.c). Returns false if a result could not be buffered.
+*/
+bool batch_row_tagged(const QueryBatch *batch, const CarInventory *car,
+                      Buffer *outs, Buffer *tags) {
+  int g = find_group(batch, car->Model);
+  int groups[2] = {0, g};
+
+  for (int i = 0; i < (g != 0 ? 2 : 1); i++) {
+    for (int k = batch->group_start[groups[i]];
+         k < batch->group_start[groups[i] + 1]; k++) {
+      int qi = batch->members[k];
+      const Query *q = &batch->queries[qi];
+      size_t before = outs[qi].len;
+      BatchTag tag;
+
+      if (!match_where(car, &q->where)) {
+        continue;
+      }
+      if (!append_selected(car, q, &outs[qi])) {
+        return false;
+      }
+      tag.id = car->ID;
+      tag.len = (int)(outs[qi].len - before);
+      if (tags != NULL &&
+          !buffer_append(&tags[qi], (const char *)&tag, sizeof(tag))) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+/*
+Name: batch_scratch_init():
+Parameters: BatchScratch *scratch, const QueryBatch *batch
+Return: bool
+Description:
+
+Allocates one thread's filter bitmaps for every member of a column-bound
+batch. Returns false on allocation failure.
+*/
+bool batch_scratch_init(BatchScratch *scratch, const QueryBatch *batch) {
+  scratch->stamp = 0;
+  scratch->scratch =
+      calloc((size_t)batch->num_members + 1, sizeof(FilterScratch));
+  scratch->seen = calloc((size_t)batch->num_groups, sizeof(int));
+  if (!scratch->scratch || !scratch->seen) {
+    return false;
+  }
+  for (int k = 0; k < batch->num_members; k++) {
+    if (!filter_scratch_init(&scratch->scratch[k], &batch->filters[k])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/*
+Name: batch_scratch_free():
+Parameters: BatchScratch *scratch, const QueryBatch *batch
+Return: void
+Description:
+
+Releases the bitmaps allocated by batch_scratch_init().
+*/
+void batch_scratch_free(BatchScratch *scratch, const QueryBatch *batch) {
+  if (scratch->scratch) {
+    for (int k = 0; k < batch->num_members; k++) {
+      filter_scratch_free(&scratch->scratch[k]);
+    }
+  }
+  free(scratch->scratch);
+  free(scratch->seen);
+  scratch->scratch = NULL;
+  scratch->seen = NULL;
+}
+
+/*
+Name: batch_emit_cb():
+Parameters: size_t row, void *udata
+Return: bool
+Description:
+
+filter_scan() callback that decodes a matching row and formats it into the
+query's Buffer.
+*/
+static bool batch_emit_cb(size_t row, void *udata) {
+  BatchEmitCtx *ctx = (BatchEmitCtx *)udata;
+  CarInventory car;
+  column_table_get(ctx->table, row, &car);
+  return append_selected(&car, ctx->q, ctx->buf);
+}
+
+/*
+Name: batch_scan_columnar():
+Parameters: const QueryBatch *batch, BatchScratch *scratch, size_t begin,
+            size_t end, Buffer *outs
+Return: bool
+Description:
+
+Filters rows [begin, end) of the bound column store one QPE_FILTER_BLOCK
+block at a time. The block's Model codes are read once to find the groups
+present in it; only those groups' kernels (and group 0's) run over the block
+while it is still in cache. Returns false if a result could not be buffered.
+*/
+bool batch_scan_columnar(const QueryBatch *batch, BatchScratch *scratch,
+                         size_t begin, size_t end, Buffer *outs) {
+  const uint16_t *model = batch->table->model;
+
+  for (size_t start = begin; start < end; start += QPE_FILTER_BLOCK) {
+    size_t n = end - start < QPE_FILTER_BLOCK ? end - start : QPE_FILTER_BLOCK;
+    int stamp = ++scratch->stamp;
+
+    scratch->seen[0] = stamp;
+    for (size_t i = 0; i < n; i++) {
+      scratch->seen[batch->code_group[model[start + i]]] = stamp;
+    }
+
+    for (int g = 0; g < batch->num_groups; g++) {
+      if (scratch->seen[g] != stamp) {
+        continue;
+      }
+      for (int k = batch->group_start[g]; k < batch->group_start[g + 1]; k++) {
+        int qi = batch->members[k];
+        BatchEmitCtx ctx = {.table = batch->table,
+                            .q = &batch->queries[qi],
+                            .buf = &outs[qi]};
+        if (!filter_scan(&scratch->scratch[k], start, start + n, batch_emit_cb,
+                         &ctx)) {
+          return false;
+        }
+      }
+    }
+  }
+  return true;
+}
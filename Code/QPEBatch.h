@@ -0,0 +1,74 @@
+/*
+
+QPEBatch.h
+
+Shared-scan evaluation of a batch of queries (--batch). Instead of one full
+pass over the table per query, the batch streams the records once and tests
+every record (or column-store block) against all batched WHERE clauses,
+appending matches to one output Buffer per query.
+
+Queries are grouped by their Model= conjunct (the literal index_probe_init()
+finds in the top-level AND chain). Each record's Model is looked up once, so
+only the queries of that model's group plus the queries without a Model=
+literal (group 0) are evaluated for it. On the column store the lookup is a
+per-code table, and a block only runs the groups whose model codes occur in
+it.
+
+*/
+
+#ifndef QPE_BATCH_H
+#define QPE_BATCH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "QPEBuffer.h"
+#include "QPEColumn.h"
+#include "QPEFilter.h"
+#include "QPEQuery.h"
+
+/*
+Struct Definitions
+*/
+typedef struct {
+  const Query *queries; /* caller's array; members index into it */
+  int num_members;
+  int *members;     /* query indices, grouped: see group_start */
+  int *group_start; /* group g owns members[group_start[g]..group_start[g+1]) */
+  int num_groups;   /* group 0 holds the queries without a Model= literal */
+  char (*keys)[20]; /* Model literal of each group (keys[0] unused) */
+  int *slots;       /* open addressing hash: Model -> group (0 = empty) */
+  int num_slots;
+  const ColumnTable *table; /* bound column store, NULL for row layout */
+  int *code_group;          /* Model dictionary code -> group (0 = none) */
+  ColumnFilter *filters;    /* per member, bound to table */
+} QueryBatch;
+
+typedef struct {
+  FilterScratch *scratch; /* per member */
+  int *seen;              /* per group: last block stamp that contained it */
+  int stamp;
+} BatchScratch;
+
+/* One per match batch_row_tagged() buffers: the row's ID and line length. */
+typedef struct {
+  int id;
+  int len;
+} BatchTag;
+
+/*
+Function Prototypes
+*/
+bool batch_init(QueryBatch *batch, const Query *queries, const int *members,
+                int num_members, const ColumnTable *table);
+void batch_free(QueryBatch *batch);
+bool batch_row(const QueryBatch *batch, const CarInventory *car,
+               Buffer *outs);
+bool batch_row_tagged(const QueryBatch *batch, const CarInventory *car,
+                      Buffer *outs, Buffer *tags);
+bool batch_scratch_init(BatchScratch *scratch, const QueryBatch *batch);
+void batch_scratch_free(BatchScratch *scratch, const QueryBatch *batch);
+bool batch_scan_columnar(const QueryBatch *batch, BatchScratch *scratch,
+                         size_t begin, size_t end, Buffer *outs);
+
+#endif
@@ -0,0 +1,250 @@
+/*
+
+QPEBuffer.c
+
+Authors:
+    Aidan Levy
+    Maddie Powell
+    Nick Corcoran
+    Austin Phalines
+    Dean Bullock
+
+Creation Date: 10-14-2026
+
+Description:
+
+Growable output buffers shared by the engines. Results are formatted into a
+Buffer first and written out in one piece: MPI ranks print theirs in rank
+order, and OpenMP threads each flush their own without taking a lock.
+
+*/
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "QPEBuffer.h"
+
+/*
+Name: buffer_init():
+Parameters: Buffer *buf
+Return: void
+Description:
+
+Initializes a Buffer by zeroing its metadata so subsequent append operations
+can grow it dynamically.
+*/
+void buffer_init(Buffer *buf) {
+  buf->data = NULL;
+  buf->len = 0;
+  buf->cap = 0;
+}
+
+/*
+Name: buffer_free():
+Parameters: Buffer *buf
+Return: void
+Description:
+
+Releases any allocated storage backing the buffer and resets the bookkeeping
+fields.
+*/
+void buffer_free(Buffer *buf) {
+  free(buf->data);
+  buf->data = NULL;
+  buf->len = 0;
+  buf->cap = 0;
+}
+
+/*
+Name: buffer_reserve():
+Parameters: Buffer *buf, size_t needed
+Return: bool
+Description:
+
+Ensures the buffer has at least the requested capacity by reallocating in
+doubling chunks; returns false on allocation failure.
+*/
+bool buffer_reserve(Buffer *buf, size_t needed) {
+  if (needed <= buf->cap) {
+    return true;
+  }
+  size_t new_cap = buf->cap ? buf->cap : 256;
+  while (new_cap < needed) {
+    new_cap *= 2;
+  }
+  char *tmp = realloc(buf->data, new_cap);
+  if (!tmp) {
+    return false;
+  }
+  buf->data = tmp;
+  buf->cap = new_cap;
+  return true;
+}
+
+/*
+Name: buffer_append():
+Parameters: Buffer *buf, const char *data, size_t len
+Return: bool
+Description:
+
+Appends raw bytes to the buffer, automatically reserving extra capacity and
+maintaining a trailing null terminator.
+*/
+bool buffer_append(Buffer *buf, const char *data, size_t len) {
+  if (!buffer_reserve(buf, buf->len + len + 1)) {
+    return false;
+  }
+  if (len > 0) {
+    memcpy(buf->data + buf->len, data, len);
+  }
+  buf->len += len;
+  buf->data[buf->len] = '\0';
+  return true;
+}
+
+/*
+Name: buffer_appendf():
+Parameters: Buffer *buf, const char *fmt, ...
+Return: bool
+Description:
+
+Formats text using printf semantics directly into the buffer's append position,
+growing the storage when required.
+*/
+bool buffer_appendf(Buffer *buf, const char *fmt, ...) {
+  va_list ap;
+  va_start(ap, fmt);
+  int needed = vsnprintf(NULL, 0, fmt, ap);
+  va_end(ap);
+  if (needed < 0) {
+    return false;
+  }
+  size_t total = buf->len + (size_t)needed + 1;
+  if (!buffer_reserve(buf, total)) {
+    return false;
+  }
+  va_start(ap, fmt);
+  vsnprintf(buf->data + buf->len, buf->cap - buf->len, fmt, ap);
+  va_end(ap);
+  buf->len += (size_t)needed;
+  return true;
+}
+
+/*
+Name: buffer_flush():
+Parameters: Buffer *buf, FILE *out
+Return: bool
+Description:
+
+Writes the buffered bytes to out with a single fwrite() and empties the buffer
+while keeping its storage for reuse. Returns false on a short write.
+*/
+bool buffer_flush(Buffer *buf, FILE *out) {
+  bool ok = true;
+  if (buf->len > 0) {
+    ok = fwrite(buf->data, 1, buf->len, out) == buf->len;
+    buf->len = 0;
+  }
+  return ok;
+}
+
+/*
+Name: put_int():
+Parameters: char *out, int value
+Return: char *
+Description:
+
+Writes value in decimal to out without printf and returns the end of the
+digits (at most 11 bytes).
+*/
+static char *put_int(char *out, int value) {
+  char digits[12];
+  unsigned int u = value < 0 ? 0u - (unsigned int)value : (unsigned int)value;
+  size_t len = 0;
+
+  do {
+    digits[len++] = (char)('0' + u % 10);
+    u /= 10;
+  } while (u > 0);
+  if (value < 0) {
+    *out++ = '-';
+  }
+  while (len > 0) {
+    *out++ = digits[--len];
+  }
+  return out;
+}
+
+/*
+Name: put_str():
+Parameters: char *out, const char *s
+Return: char *
+Description:
+
+Copies one of CarInventory's string fields to out with memcpy() and returns
+the end of the copy (at most 19 bytes).
+*/
+static char *put_str(char *out, const char *s) {
+  size_t len = strlen(s);
+  memcpy(out, s, len);
+  return out + len;
+}
+
+/*
+Name: append_selected():
+Parameters: const CarInventory *car, const Query *q, Buffer *buf
+Return: bool
+Description:
+
+Formats either all attributes or the requested subset into the provided Buffer,
+appending a newline so the row can be written out later with the rest of the
+buffer. The subset is read from q->select_cols, resolved when the query was
+loaded, so no attribute names are compared per row. Room for the longest
+row is reserved once, then the fields are written in place with put_int()
+and put_str() instead of a printf call per field.
+*/
+bool append_selected(const CarInventory *car, const Query *q, Buffer *buf) {
+  static const unsigned char all_cols[6] = {COL_ID,    COL_MODEL, COL_YEARMAKE,
+                                            COL_COLOR, COL_PRICE, COL_DEALER};
+  const unsigned char *cols = q->select_all ? all_cols : q->select_cols;
+  int num_cols = q->select_all ? 6 : q->num_select_attrs;
+  char *out;
+
+  if (!buffer_reserve(buf, buf->len + QPE_ROW_MAX + 1)) {
+    return false;
+  }
+  out = buf->data + buf->len;
+  for (int i = 0; i < num_cols; ++i) {
+    if (i > 0) {
+      *out++ = ' ';
+    }
+    switch (cols[i]) {
+    case COL_ID:
+      out = put_int(out, car->ID);
+      break;
+    case COL_MODEL:
+      out = put_str(out, car->Model);
+      break;
+    case COL_YEARMAKE:
+      out = put_int(out, car->YearMake);
+      break;
+    case COL_COLOR:
+      out = put_str(out, car->Color);
+      break;
+    case COL_PRICE:
+      out = put_int(out, car->Price);
+      break;
+    case COL_DEALER:
+      out = put_str(out, car->Dealer);
+      break;
+    default:
+      break;
+    }
+  }
+  *out++ = '\n';
+  *out = '\0';
+  buf->len = (size_t)(out - buf->data);
+  return true;
+}
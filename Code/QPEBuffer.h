@@ -0,0 +1,45 @@
+/*
+
+QPEBuffer.h
+
+Growable byte buffer used to collect formatted query results before they are
+written to stdout in one call (see QPEBuffer.c).
+
+*/
+
+#ifndef QPE_BUFFER_H
+#define QPE_BUFFER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#include "QPEQuery.h"
+
+/*
+Longest row append_selected() can format: six fields of at most 19
+characters (an int takes at most 11), five separators and the newline.
+*/
+#define QPE_ROW_MAX 128
+
+/*
+Struct Definitions
+*/
+typedef struct {
+  char *data;
+  size_t len;
+  size_t cap;
+} Buffer;
+
+/*
+Function Prototypes
+*/
+void buffer_init(Buffer *buf);
+void buffer_free(Buffer *buf);
+bool buffer_reserve(Buffer *buf, size_t needed);
+bool buffer_append(Buffer *buf, const char *data, size_t len);
+bool buffer_appendf(Buffer *buf, const char *fmt, ...);
+bool buffer_flush(Buffer *buf, FILE *out);
+bool append_selected(const CarInventory *car, const Query *q, Buffer *buf);
+
+#endif
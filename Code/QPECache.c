@@ -0,0 +1,573 @@
+/*
+
+QPECache.c
+
+Authors:
+    Aidan Levy
+    Maddie Powell
+    Nick Corcoran
+    Austin Phalines
+    Dean Bullock
+
+Creation Date: 10-14-2026
+
+Description:
+
+Result cache for --cache (see QPECache.h). An entry is found by a 64-bit
+FNV-1a hash of the database identity and the query's canonical form, first
+among the entries in memory, then as the file named by the hash in the
+cache directory. The file starts with a text header:
+
+    QPECACHE 2
+    <database identity>
+    <canonical query>
+    <result bytes>
+
+followed by the result lines themselves. Both the identity and the query are
+compared on every hit, so a hash collision costs a miss, never a wrong
+answer. Entries are written to a temporary file and renamed into place, so
+runs sharing the directory never read half an entry.
+
+Every in-memory entry also keeps a copy of its query's compiled WHERE clause.
+Appended rows can only change the result of a query they match, since rows
+are never updated in place and new IDs sort after all others, so that is all
+cache_refresh() needs to tell a stale entry from one it can keep.
+
+*/
+
+#include <dirent.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "QPECache.h"
+
+#define QPE_CACHE_MAGIC "QPECACHE 2\n"
+
+/*
+Function Prototypes
+*/
+static void format_identity(char *out, size_t cap, unsigned long long device,
+                            unsigned long long inode, long long size,
+                            const struct timespec *mtime);
+static unsigned long long hash_key(const char *identity, const char *key);
+static bool entry_path(const QueryCache *c, unsigned long long hash,
+                       const char *suffix, char *out, size_t cap);
+static bool read_line(FILE *f, char *out, size_t cap);
+static bool read_header(FILE *f, const QueryCache *c, char *key, size_t cap,
+                        size_t *len);
+static void prune_entries(QueryCache *c);
+static CacheEntry *find_entry(QueryCache *c, unsigned long long hash,
+                              const char *key);
+static CacheEntry *add_entry(QueryCache *c, unsigned long long hash,
+                             const char *key, const Predicate *where,
+                             char *data, size_t len);
+static CacheEntry *load_entry(QueryCache *c, unsigned long long hash,
+                              const char *key, const Predicate *where);
+static void free_entry(CacheEntry *e);
+static bool entry_affected(const CacheEntry *e, const CarInventory *added,
+                           size_t count);
+static void write_entry(QueryCache *c, const CacheEntry *e);
+
+/*
+Name: format_identity():
+Parameters: char *out, size_t cap, unsigned long long device,
+            unsigned long long inode, long long size,
+            const struct timespec *mtime
+Return: void
+Description:
+
+Writes the identity "device:inode:size:mtime" of a database file version.
+*/
+static void format_identity(char *out, size_t cap, unsigned long long device,
+                            unsigned long long inode, long long size,
+                            const struct timespec *mtime) {
+  snprintf(out, cap, "%llu:%llu:%lld:%lld.%09ld", device, inode, size,
+           (long long)mtime->tv_sec, (long)mtime->tv_nsec);
+}
+
+/*
+Name: hash_key():
+Parameters: const char *identity, const char *key
+Return: unsigned long long
+Description:
+
+64-bit FNV-1a hash of the database identity, a newline and the canonical
+query.
+*/
+static unsigned long long hash_key(const char *identity, const char *key) {
+  unsigned long long h = 14695981039346656037ULL;
+  for (const char *s = identity; *s; s++) {
+    h = (h ^ (unsigned char)*s) * 1099511628211ULL;
+  }
+  h = (h ^ '\n') * 1099511628211ULL;
+  for (const char *s = key; *s; s++) {
+    h = (h ^ (unsigned char)*s) * 1099511628211ULL;
+  }
+  return h;
+}
+
+/*
+Name: entry_path():
+Parameters: const QueryCache *c, unsigned long long hash, const char *suffix,
+            char *out, size_t cap
+Return: bool
+Description:
+
+Writes the path of the entry file for hash, with suffix appended, to out.
+Returns false if it does not fit.
+*/
+static bool entry_path(const QueryCache *c, unsigned long long hash,
+                       const char *suffix, char *out, size_t cap) {
+  int len = snprintf(out, cap, "%s/%016llx%s", c->dir, hash, suffix);
+  return len > 0 && (size_t)len < cap;
+}
+
+/*
+Name: read_line():
+Parameters: FILE *f, char *out, size_t cap
+Return: bool
+Description:
+
+Reads one header line into out without its newline. Returns false at end of
+file or if the line does not fit.
+*/
+static bool read_line(FILE *f, char *out, size_t cap) {
+  size_t len;
+  if (fgets(out, (int)cap, f) == NULL) {
+    return false;
+  }
+  len = strlen(out);
+  if (len == 0 || out[len - 1] != '\n') {
+    return false;
+  }
+  out[len - 1] = '\0';
+  return true;
+}
+
+/*
+Name: read_header():
+Parameters: FILE *f, const QueryCache *c, char *key, size_t cap, size_t *len
+Return: bool
+Description:
+
+Reads the header of an entry file into key (its canonical query) and *len
+(its result bytes). Returns false unless the file is a cache entry written
+for the database c was opened for; with key NULL only that much is checked.
+*/
+static bool read_header(FILE *f, const QueryCache *c, char *key, size_t cap,
+                        size_t *len) {
+  char line[QPE_QUERY_CANONICAL_MAX];
+  char *end;
+
+  if (!read_line(f, line, sizeof(line)) ||
+      strcmp(line, "QPECACHE 2") != 0 ||
+      !read_line(f, line, sizeof(line)) || strcmp(line, c->identity) != 0) {
+    return false;
+  }
+  if (key == NULL) {
+    return true;
+  }
+  if (!read_line(f, key, cap) || !read_line(f, line, sizeof(line))) {
+    return false;
+  }
+  *len = (size_t)strtoull(line, &end, 10);
+  return end != line && *end == '\0';
+}
+
+/*
+Name: cache_open():
+Parameters: QueryCache *c, const char *db_file, const char *dir
+Return: bool
+Description:
+
+Opens the result cache for db_file, keeping entry files in dir, or in
+db_file's name followed by ".qcache" when dir is NULL. The directory is
+created if needed and stripped of entries for other versions of the file;
+if it cannot be created the cache works in memory only. Returns false, after
+a warning, if db_file cannot be examined.
+*/
+bool cache_open(QueryCache *c, const char *db_file, const char *dir) {
+  struct stat st;
+
+  memset(c, 0, sizeof(*c));
+  if (stat(db_file, &st) != 0) {
+    fprintf(stderr, "Warning: cannot stat %s, --cache ignored\n", db_file);
+    return false;
+  }
+  format_identity(c->identity, sizeof(c->identity),
+                  (unsigned long long)st.st_dev, (unsigned long long)st.st_ino,
+                  (long long)st.st_size, &st.st_mtim);
+
+  if (dir != NULL) {
+    c->dir = strdup(dir);
+  } else {
+    c->dir = malloc(strlen(db_file) + sizeof(".qcache"));
+    if (c->dir != NULL) {
+      strcpy(c->dir, db_file);
+      strcat(c->dir, ".qcache");
+    }
+  }
+  if (c->dir == NULL) {
+    return true;
+  }
+  if (mkdir(c->dir, 0777) != 0 && errno != EEXIST) {
+    fprintf(stderr,
+            "Warning: cannot create %s, caching results in memory only\n",
+            c->dir);
+    free(c->dir);
+    c->dir = NULL;
+    return true;
+  }
+  prune_entries(c);
+  return true;
+}
+
+/*
+Name: prune_entries():
+Parameters: QueryCache *c
+Return: void
+Description:
+
+Deletes every entry file in the cache directory that was not written for the
+current version of the database (or is not an entry at all). Temporary files
+are left alone, as another run may still be writing them.
+*/
+static void prune_entries(QueryCache *c) {
+  DIR *d = opendir(c->dir);
+  struct dirent *de;
+  char path[4096];
+
+  if (d == NULL) {
+    return;
+  }
+  while ((de = readdir(d)) != NULL) {
+    FILE *f;
+    bool current;
+    if (strlen(de->d_name) != 16 ||
+        strspn(de->d_name, "0123456789abcdef") != 16) {
+      continue;
+    }
+    if (snprintf(path, sizeof(path), "%s/%s", c->dir, de->d_name) >=
+        (int)sizeof(path)) {
+      continue;
+    }
+    f = fopen(path, "rb");
+    if (f == NULL) {
+      continue;
+    }
+    current = read_header(f, c, NULL, 0, NULL);
+    fclose(f);
+    if (!current) {
+      unlink(path);
+    }
+  }
+  closedir(d);
+}
+
+/*
+Name: find_entry():
+Parameters: QueryCache *c, unsigned long long hash, const char *key
+Return: CacheEntry *
+Description:
+
+The in-memory entry for key, or NULL.
+*/
+static CacheEntry *find_entry(QueryCache *c, unsigned long long hash,
+                              const char *key) {
+  for (size_t i = 0; i < c->num_entries; i++) {
+    if (c->entries[i].hash == hash && strcmp(c->entries[i].key, key) == 0) {
+      return &c->entries[i];
+    }
+  }
+  return NULL;
+}
+
+/*
+Name: add_entry():
+Parameters: QueryCache *c, unsigned long long hash, const char *key,
+            const Predicate *where, char *data, size_t len
+Return: CacheEntry *
+Description:
+
+Adds an in-memory entry, with a copy of the query's WHERE clause, that takes
+ownership of the malloc'd data. Returns NULL, freeing data, when out of
+memory.
+*/
+static CacheEntry *add_entry(QueryCache *c, unsigned long long hash,
+                             const char *key, const Predicate *where,
+                             char *data, size_t len) {
+  CacheEntry *e;
+
+  if (c->num_entries == c->cap_entries) {
+    size_t cap = c->cap_entries ? c->cap_entries * 2 : 16;
+    CacheEntry *grown = realloc(c->entries, cap * sizeof(CacheEntry));
+    if (grown == NULL) {
+      free(data);
+      return NULL;
+    }
+    c->entries = grown;
+    c->cap_entries = cap;
+  }
+  e = &c->entries[c->num_entries];
+  e->key = strdup(key);
+  e->where = malloc(sizeof(Predicate));
+  if (e->key == NULL || e->where == NULL) {
+    free(e->key);
+    free(e->where);
+    free(data);
+    return NULL;
+  }
+  *e->where = *where;
+  e->hash = hash;
+  e->data = data;
+  e->len = len;
+  c->num_entries++;
+  return e;
+}
+
+/*
+Name: load_entry():
+Parameters: QueryCache *c, unsigned long long hash, const char *key,
+            const Predicate *where
+Return: CacheEntry *
+Description:
+
+Reads the entry file for key into memory. Returns NULL if there is none,
+or the file belongs to another query or database version, or cannot be read.
+*/
+static CacheEntry *load_entry(QueryCache *c, unsigned long long hash,
+                              const char *key, const Predicate *where) {
+  char path[4096];
+  char stored[QPE_QUERY_CANONICAL_MAX];
+  size_t len = 0;
+  char *data = NULL;
+  FILE *f;
+
+  if (c->dir == NULL || !entry_path(c, hash, "", path, sizeof(path))) {
+    return NULL;
+  }
+  f = fopen(path, "rb");
+  if (f == NULL) {
+    return NULL;
+  }
+  if (read_header(f, c, stored, sizeof(stored), &len) &&
+      strcmp(stored, key) == 0 && len <= QPE_CACHE_MAX_RESULT) {
+    data = malloc(len + 1);
+    if (data != NULL && fread(data, 1, len, f) != len) {
+      free(data);
+      data = NULL;
+    }
+  }
+  fclose(f);
+  return data != NULL ? add_entry(c, hash, key, where, data, len) : NULL;
+}
+
+/*
+Name: write_entry():
+Parameters: QueryCache *c, const CacheEntry *e
+Return: void
+Description:
+
+Writes e to its entry file through a temporary file named after the process,
+then renamed over the entry. If that fails the cache stops writing files,
+after a warning, and works in memory only.
+*/
+static void write_entry(QueryCache *c, const CacheEntry *e) {
+  char path[4096];
+  char tmp[4096];
+  char suffix[32];
+  FILE *f;
+  bool ok;
+
+  snprintf(suffix, sizeof(suffix), ".tmp.%ld", (long)getpid());
+  if (!entry_path(c, e->hash, "", path, sizeof(path)) ||
+      !entry_path(c, e->hash, suffix, tmp, sizeof(tmp))) {
+    return;
+  }
+  f = fopen(tmp, "wb");
+  ok = f != NULL;
+  if (ok) {
+    fprintf(f, QPE_CACHE_MAGIC "%s\n%s\n%zu\n", c->identity, e->key, e->len);
+    ok = fwrite(e->data, 1, e->len, f) == e->len;
+    ok = fclose(f) == 0 && ok;
+  }
+  if (ok && rename(tmp, path) == 0) {
+    return;
+  }
+  unlink(tmp);
+  fprintf(stderr,
+          "Warning: cannot write to %s, caching results in memory only\n",
+          c->dir);
+  free(c->dir);
+  c->dir = NULL;
+}
+
+/*
+Name: cache_plan():
+Parameters: QueryCache *c, const Query *q, QueryPlan *plan
+Return: bool
+Description:
+
+Looks q up, in memory and then on disk, and on a hit turns plan into
+PLAN_CACHED with the stored lines, which stay valid until cache_close().
+Counts the lookup as a hit or a miss and returns whether it hit.
+*/
+bool cache_plan(QueryCache *c, const Query *q, QueryPlan *plan) {
+  char key[QPE_QUERY_CANONICAL_MAX];
+  unsigned long long hash;
+  CacheEntry *e = NULL;
+
+  if (query_canonical(q, key, sizeof(key)) > 0) {
+    hash = hash_key(c->identity, key);
+    e = find_entry(c, hash, key);
+    if (e == NULL) {
+      e = load_entry(c, hash, key, &q->where);
+    }
+  }
+  if (e == NULL) {
+    c->misses++;
+    return false;
+  }
+  c->hits++;
+  plan->path = PLAN_CACHED;
+  plan->cached = e->data;
+  plan->cached_len = e->len;
+  plan->candidates = 0.0;
+  plan->cost = 0.0;
+  return true;
+}
+
+/*
+Name: cache_store():
+Parameters: QueryCache *c, const Query *q, const char *data, size_t len
+Return: void
+Description:
+
+Records len bytes at data as q's result lines, in memory and in the cache
+directory. Results over QPE_CACHE_MAX_RESULT, and queries already cached,
+are skipped; running out of memory only means the result is not cached.
+*/
+void cache_store(QueryCache *c, const Query *q, const char *data, size_t len) {
+  char key[QPE_QUERY_CANONICAL_MAX];
+  unsigned long long hash;
+  CacheEntry *e;
+  char *copy;
+
+  if (len > QPE_CACHE_MAX_RESULT || query_canonical(q, key, sizeof(key)) == 0) {
+    return;
+  }
+  hash = hash_key(c->identity, key);
+  if (find_entry(c, hash, key) != NULL) {
+    return;
+  }
+  copy = malloc(len + 1);
+  if (copy == NULL) {
+    return;
+  }
+  if (len > 0) {
+    memcpy(copy, data, len);
+  }
+  e = add_entry(c, hash, key, &q->where, copy, len);
+  if (e != NULL && c->dir != NULL) {
+    write_entry(c, e);
+  }
+}
+
+/*
+Name: entry_affected():
+Parameters: const CacheEntry *e, const CarInventory *added, size_t count
+Return: bool
+Description:
+
+Whether any of the count appended rows matches e's WHERE clause, so that the
+stored lines may no longer be the query's answer.
+*/
+static bool entry_affected(const CacheEntry *e, const CarInventory *added,
+                           size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    if (match_where(&added[i], e->where)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/*
+Name: cache_refresh():
+Parameters: QueryCache *c, const LoadedTable *table,
+            const CarInventory *added, size_t count
+Return: size_t
+Description:
+
+Moves the cache to the database version table now holds. With added, the
+count rows appended to the table since the last version, every entry none
+of them matches is kept under the new identity (and its file rewritten);
+with added NULL, after a full reload, no entry is kept. Files of the old
+version are deleted. Returns the number of entries dropped.
+*/
+size_t cache_refresh(QueryCache *c, const LoadedTable *table,
+                     const CarInventory *added, size_t count) {
+  size_t kept = 0;
+  size_t dropped = 0;
+
+  format_identity(c->identity, sizeof(c->identity), table->device,
+                  table->inode, (long long)table->bytes, &table->mtime);
+  for (size_t i = 0; i < c->num_entries; i++) {
+    CacheEntry *e = &c->entries[i];
+    if (added == NULL || entry_affected(e, added, count)) {
+      free_entry(e);
+      dropped++;
+      continue;
+    }
+    e->hash = hash_key(c->identity, e->key);
+    c->entries[kept++] = *e;
+    if (c->dir != NULL) {
+      write_entry(c, &c->entries[kept - 1]);
+    }
+  }
+  c->num_entries = kept;
+  c->dropped += (long long)dropped;
+  if (c->dir != NULL) {
+    prune_entries(c);
+  }
+  return dropped;
+}
+
+/*
+Name: free_entry():
+Parameters: CacheEntry *e
+Return: void
+Description:
+
+Releases what an in-memory entry owns.
+*/
+static void free_entry(CacheEntry *e) {
+  free(e->key);
+  free(e->where);
+  free(e->data);
+}
+
+/*
+Name: cache_close():
+Parameters: QueryCache *c
+Return: void
+Description:
+
+Releases the in-memory entries; the entry files stay for later runs. Does
+nothing when c is NULL.
+*/
+void cache_close(QueryCache *c) {
+  if (c == NULL) {
+    return;
+  }
+  for (size_t i = 0; i < c->num_entries; i++) {
+    free_entry(&c->entries[i]);
+  }
+  free(c->entries);
+  free(c->dir);
+  memset(c, 0, sizeof(*c));
+}
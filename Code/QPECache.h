@@ -0,0 +1,69 @@
+/*
+
+QPECache.h
+
+Result cache for --cache (see QPECache.c). The formatted result lines of a
+query are stored under its query_canonical() form (QPEQuery.h) together with
+the identity of the database file: its device, inode, size and modification
+time. A later query with the same canonical form, against the same unchanged
+file, is planned as PLAN_CACHED and answered with the stored lines without
+touching the table.
+
+Entries are kept in memory until cache_close(), and one file per entry is
+written to a directory next to the database (<db file>.qcache unless
+--cache=DIR names another), so later runs hit as well. Opening the cache
+deletes the files written for any other version of the database.
+
+When --serve follows rows appended to the file (QPERefresh.h), cache_refresh()
+moves the cache to the file's new identity: entries whose WHERE clause
+matches none of the new rows still hold the right answer and are kept, the
+others are dropped. After a full reload every entry is dropped.
+
+*/
+
+#ifndef QPE_CACHE_H
+#define QPE_CACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "QPELoad.h"
+#include "QPEPlan.h"
+#include "QPEQuery.h"
+
+/* Results longer than this are not cached. */
+#define QPE_CACHE_MAX_RESULT ((size_t)64 << 20)
+
+/*
+Struct Definitions
+*/
+typedef struct {
+  unsigned long long hash; /* of the database identity and the key */
+  char *key;               /* query_canonical() form */
+  Predicate *where;        /* the query's WHERE clause */
+  char *data;              /* result lines */
+  size_t len;
+} CacheEntry;
+
+typedef struct {
+  char *dir;         /* entry files, NULL once caching is memory only */
+  char identity[96]; /* device:inode:size:mtime of the database file */
+  CacheEntry *entries;
+  size_t num_entries;
+  size_t cap_entries;
+  long long hits;
+  long long misses;
+  long long dropped; /* entries cache_refresh() found out of date */
+} QueryCache;
+
+/*
+Function Prototypes
+*/
+bool cache_open(QueryCache *c, const char *db_file, const char *dir);
+bool cache_plan(QueryCache *c, const Query *q, QueryPlan *plan);
+void cache_store(QueryCache *c, const Query *q, const char *data, size_t len);
+size_t cache_refresh(QueryCache *c, const LoadedTable *table,
+                     const CarInventory *added, size_t count);
+void cache_close(QueryCache *c);
+
+#endif
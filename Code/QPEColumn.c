@@ -0,0 +1,556 @@
+/*
+
+QPEColumn.c
+
+Authors:
+    Aidan Levy
+    Maddie Powell
+    Nick Corcoran
+    Austin Phalines
+    Dean Bullock
+
+Creation Date: 10-14-2026
+
+Description:
+
+Builds and scans the columnar (struct-of-arrays) layout selected with
+--layout=columnar. Rows are appended in B-tree (ID) order, string attributes
+are assigned dictionary codes in first-seen order, and matching rows are
+decoded back into a CarInventory only when they have to be printed.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "QPEColumn.h"
+
+/*
+Function Prototypes
+*/
+static unsigned int dict_hash(const char *s);
+static bool dict_grow_slots(Dictionary *dict);
+static bool grow_columns(ColumnTable *table, size_t needed);
+static bool append_iter(const void *item, void *udata);
+static bool eval_column_node(const ColumnFilter *filter, int idx, size_t row);
+
+/*
+Name: dict_init():
+Parameters: Dictionary *dict
+Return: bool
+Description:
+
+Allocates an empty dictionary with a small hash table; returns false when the
+allocation fails.
+*/
+bool dict_init(Dictionary *dict) {
+  dict->count = 0;
+  dict->cap = 16;
+  dict->num_slots = 32;
+  dict->values = malloc(sizeof(*dict->values) * (size_t)dict->cap);
+  dict->slots = calloc((size_t)dict->num_slots, sizeof(int));
+  return dict->values && dict->slots;
+}
+
+/*
+Name: dict_free():
+Parameters: Dictionary *dict
+Return: void
+Description:
+
+Releases the value array and hash slots owned by the dictionary.
+*/
+void dict_free(Dictionary *dict) {
+  free(dict->values);
+  free(dict->slots);
+  dict->values = NULL;
+  dict->slots = NULL;
+  dict->count = 0;
+}
+
+/*
+Name: dict_hash():
+Parameters: const char *s
+Return: unsigned int
+Description:
+
+FNV-1a hash of a NUL-terminated string, used to place values in the dictionary
+hash table.
+*/
+static unsigned int dict_hash(const char *s) {
+  unsigned int h = 2166136261u;
+  while (*s) {
+    h ^= (unsigned char)*s++;
+    h *= 16777619u;
+  }
+  return h;
+}
+
+/*
+Name: dict_grow_slots():
+Parameters: Dictionary *dict
+Return: bool
+Description:
+
+Doubles the hash table and reinserts every existing code so the load factor
+stays at or below one half.
+*/
+static bool dict_grow_slots(Dictionary *dict) {
+  int num_slots = dict->num_slots * 2;
+  int *slots = calloc((size_t)num_slots, sizeof(int));
+  if (!slots) {
+    return false;
+  }
+  for (int code = 0; code < dict->count; code++) {
+    unsigned int h = dict_hash(dict->values[code]) & (unsigned)(num_slots - 1);
+    while (slots[h] != 0) {
+      h = (h + 1) & (unsigned)(num_slots - 1);
+    }
+    slots[h] = code + 1;
+  }
+  free(dict->slots);
+  dict->slots = slots;
+  dict->num_slots = num_slots;
+  return true;
+}
+
+/*
+Name: dict_encode():
+Parameters: Dictionary *dict, const char *s
+Return: int
+Description:
+
+Returns the code for s, adding it to the dictionary when it has not been seen
+before. Returns -1 on allocation failure or once QPE_MAX_DICT_CODES distinct
+values exist.
+*/
+int dict_encode(Dictionary *dict, const char *s) {
+  unsigned int mask = (unsigned)(dict->num_slots - 1);
+  unsigned int h = dict_hash(s) & mask;
+
+  while (dict->slots[h] != 0) {
+    int code = dict->slots[h] - 1;
+    if (strcmp(dict->values[code], s) == 0) {
+      return code;
+    }
+    h = (h + 1) & mask;
+  }
+
+  if (dict->count >= QPE_MAX_DICT_CODES) {
+    return -1;
+  }
+  if (dict->count >= dict->cap) {
+    int cap = dict->cap * 2;
+    char(*values)[20] = realloc(dict->values, sizeof(*values) * (size_t)cap);
+    if (!values) {
+      return -1;
+    }
+    dict->values = values;
+    dict->cap = cap;
+  }
+
+  int code = dict->count++;
+  strncpy(dict->values[code], s, sizeof(dict->values[code]) - 1);
+  dict->values[code][sizeof(dict->values[code]) - 1] = '\0';
+  dict->slots[h] = code + 1;
+
+  if (dict->count * 2 > dict->num_slots && !dict_grow_slots(dict)) {
+    return -1;
+  }
+  return code;
+}
+
+/*
+Name: column_table_new():
+Parameters: size_t capacity
+Return: ColumnTable *
+Description:
+
+Allocates an empty column store with room for capacity rows (it grows on
+demand) and empty Model/Color/Dealer dictionaries.
+*/
+ColumnTable *column_table_new(size_t capacity) {
+  ColumnTable *table = calloc(1, sizeof(ColumnTable));
+  if (!table) {
+    return NULL;
+  }
+  for (int d = 0; d < NUM_DICTS; d++) {
+    if (!dict_init(&table->dicts[d])) {
+      column_table_free(table);
+      return NULL;
+    }
+  }
+  if (!grow_columns(table, capacity > 0 ? capacity : 1)) {
+    column_table_free(table);
+    return NULL;
+  }
+  return table;
+}
+
+/*
+Name: column_table_free():
+Parameters: ColumnTable *table
+Return: void
+Description:
+
+Releases every column array and dictionary owned by the table.
+*/
+void column_table_free(ColumnTable *table) {
+  if (!table) {
+    return;
+  }
+  free(table->id);
+  free(table->year_make);
+  free(table->price);
+  free(table->model);
+  free(table->color);
+  free(table->dealer);
+  for (int d = 0; d < NUM_DICTS; d++) {
+    dict_free(&table->dicts[d]);
+  }
+  free(table);
+}
+
+/*
+Name: grow_columns():
+Parameters: ColumnTable *table, size_t needed
+Return: bool
+Description:
+
+Ensures every column array can hold at least needed rows, doubling the
+capacity as required; returns false on allocation failure.
+*/
+static bool grow_columns(ColumnTable *table, size_t needed) {
+  if (needed <= table->cap) {
+    return true;
+  }
+  size_t cap = table->cap ? table->cap : 1024;
+  while (cap < needed) {
+    cap *= 2;
+  }
+
+  int32_t *id = realloc(table->id, cap * sizeof(int32_t));
+  if (id) {
+    table->id = id;
+  }
+  int32_t *year_make = realloc(table->year_make, cap * sizeof(int32_t));
+  if (year_make) {
+    table->year_make = year_make;
+  }
+  int32_t *price = realloc(table->price, cap * sizeof(int32_t));
+  if (price) {
+    table->price = price;
+  }
+  uint16_t *model = realloc(table->model, cap * sizeof(uint16_t));
+  if (model) {
+    table->model = model;
+  }
+  uint16_t *color = realloc(table->color, cap * sizeof(uint16_t));
+  if (color) {
+    table->color = color;
+  }
+  uint16_t *dealer = realloc(table->dealer, cap * sizeof(uint16_t));
+  if (dealer) {
+    table->dealer = dealer;
+  }
+
+  if (!id || !year_make || !price || !model || !color || !dealer) {
+    return false;
+  }
+  table->cap = cap;
+  return true;
+}
+
+/*
+Name: column_table_append():
+Parameters: ColumnTable *table, const CarInventory *car
+Return: bool
+Description:
+
+Appends one record to the end of every column, encoding its string attributes.
+Returns false when memory or dictionary capacity runs out.
+*/
+bool column_table_append(ColumnTable *table, const CarInventory *car) {
+  if (!grow_columns(table, table->count + 1)) {
+    return false;
+  }
+
+  int model = dict_encode(&table->dicts[DICT_MODEL], car->Model);
+  int color = dict_encode(&table->dicts[DICT_COLOR], car->Color);
+  int dealer = dict_encode(&table->dicts[DICT_DEALER], car->Dealer);
+  if (model < 0 || color < 0 || dealer < 0) {
+    return false;
+  }
+
+  size_t row = table->count++;
+  table->id[row] = car->ID;
+  table->year_make[row] = car->YearMake;
+  table->price[row] = car->Price;
+  table->model[row] = (uint16_t)model;
+  table->color[row] = (uint16_t)color;
+  table->dealer[row] = (uint16_t)dealer;
+  return true;
+}
+
+/*
+Name: append_iter():
+Parameters: const void *item, void *udata
+Return: bool
+Description:
+
+btree_ascend callback that appends each record to the ColumnTable passed in
+udata, stopping the traversal if an append fails.
+*/
+static bool append_iter(const void *item, void *udata) {
+  return column_table_append((ColumnTable *)udata, (const CarInventory *)item);
+}
+
+/*
+Name: column_table_from_btree():
+Parameters: struct btree *tree
+Return: ColumnTable *
+Description:
+
+Builds a column store holding every record of the B-tree in ascending ID
+order, or returns NULL (after printing the reason) if it cannot be built.
+*/
+ColumnTable *column_table_from_btree(struct btree *tree) {
+  ColumnTable *table = column_table_new(btree_count(tree));
+  if (!table) {
+    fprintf(stderr, "Error: out of memory allocating column store\n");
+    return NULL;
+  }
+  if (!btree_ascend(tree, NULL, append_iter, table)) {
+    fprintf(stderr, "Error: failed to build column store (more than %d "
+                    "distinct strings in a column or out of memory)\n",
+            QPE_MAX_DICT_CODES);
+    column_table_free(table);
+    return NULL;
+  }
+  return table;
+}
+
+/*
+Name: column_table_from_array():
+Parameters: const CarInventory *arr, size_t count
+Return: ColumnTable *
+Description:
+
+Builds a column store from a contiguous slice of records (used by QPEMPI.c on
+each rank's partition), or returns NULL if it cannot be built.
+*/
+ColumnTable *column_table_from_array(const CarInventory *arr, size_t count) {
+  ColumnTable *table = column_table_new(count);
+  if (!table) {
+    fprintf(stderr, "Error: out of memory allocating column store\n");
+    return NULL;
+  }
+  for (size_t i = 0; i < count; i++) {
+    if (!column_table_append(table, &arr[i])) {
+      fprintf(stderr, "Error: failed to build column store (more than %d "
+                      "distinct strings in a column or out of memory)\n",
+              QPE_MAX_DICT_CODES);
+      column_table_free(table);
+      return NULL;
+    }
+  }
+  return table;
+}
+
+/*
+Name: column_table_get():
+Parameters: const ColumnTable *table, size_t row, CarInventory *out
+Return: void
+Description:
+
+Decodes one row back into a CarInventory record so the existing output
+routines can print it.
+*/
+void column_table_get(const ColumnTable *table, size_t row, CarInventory *out) {
+  out->ID = table->id[row];
+  out->YearMake = table->year_make[row];
+  out->Price = table->price[row];
+  memcpy(out->Model, table->dicts[DICT_MODEL].values[table->model[row]],
+         sizeof(out->Model));
+  memcpy(out->Color, table->dicts[DICT_COLOR].values[table->color[row]],
+         sizeof(out->Color));
+  memcpy(out->Dealer, table->dicts[DICT_DEALER].values[table->dealer[row]],
+         sizeof(out->Dealer));
+}
+
+/*
+Name: column_filter_init():
+Parameters: ColumnFilter *filter, const ColumnTable *table,
+            const Predicate *pred
+Return: bool
+Description:
+
+Binds a compiled predicate to a column store: integer comparisons get a direct
+pointer to their column, and string comparisons are evaluated once against
+every dictionary entry to produce a per-code match table. AND/OR nodes whose
+children test the same string column are merged into one table (children are
+always compiled before their parent, so one forward pass suffices). Returns
+false on allocation failure.
+*/
+bool column_filter_init(ColumnFilter *filter, const ColumnTable *table,
+                        const Predicate *pred) {
+  int depth[QPE_MAX_PRED_NODES];
+
+  memset(filter, 0, sizeof(*filter));
+  filter->pred = pred;
+
+  for (int i = 0; i < pred->num_nodes; i++) {
+    const PredNode *n = &pred->nodes[i];
+    ColumnNode *cn = &filter->nodes[i];
+    depth[i] = 1;
+
+    if (n->kind == PRED_INT_CMP) {
+      if (n->column == COL_ID) {
+        cn->ints = table->id;
+      } else if (n->column == COL_YEARMAKE) {
+        cn->ints = table->year_make;
+      } else {
+        cn->ints = table->price;
+      }
+    } else if (n->kind == PRED_STR_CMP) {
+      const Dictionary *dict;
+      if (n->column == COL_MODEL) {
+        dict = &table->dicts[DICT_MODEL];
+        cn->codes = table->model;
+      } else if (n->column == COL_COLOR) {
+        dict = &table->dicts[DICT_COLOR];
+        cn->codes = table->color;
+      } else {
+        dict = &table->dicts[DICT_DEALER];
+        cn->codes = table->dealer;
+      }
+
+      cn->num_codes = dict->count;
+      cn->match = malloc(dict->count > 0 ? (size_t)dict->count : 1);
+      if (!cn->match) {
+        column_filter_free(filter);
+        return false;
+      }
+      for (int code = 0; code < dict->count; code++) {
+        int cmp = strcasecmp(dict->values[code], pred->strpool + n->str);
+        cn->match[code] = apply_op((CompareOp)n->op, cmp) ? 1 : 0;
+      }
+    } else if (n->kind == PRED_AND || n->kind == PRED_OR) {
+      const ColumnNode *l = &filter->nodes[n->left];
+      const ColumnNode *r = &filter->nodes[n->right];
+
+      if (l->codes != NULL && l->codes == r->codes) {
+        cn->codes = l->codes;
+        cn->num_codes = l->num_codes;
+        cn->match = malloc(cn->num_codes > 0 ? (size_t)cn->num_codes : 1);
+        if (!cn->match) {
+          column_filter_free(filter);
+          return false;
+        }
+        for (int code = 0; code < cn->num_codes; code++) {
+          cn->match[code] = (n->kind == PRED_AND)
+                                ? (l->match[code] & r->match[code])
+                                : (l->match[code] | r->match[code]);
+        }
+      } else {
+        int dl = depth[n->left];
+        int dr = depth[n->right];
+        depth[i] = 1 + (dl > dr ? dl : dr);
+      }
+    }
+
+    if (cn->match) {
+      for (int code = 0; code < cn->num_codes; code++) {
+        if (cn->match[code]) {
+          if (cn->num_in < QPE_MAX_IN_CODES) {
+            cn->in_codes[cn->num_in] = (uint16_t)code;
+          }
+          cn->num_in++;
+        }
+      }
+    }
+  }
+
+  filter->depth = (pred->root >= 0) ? depth[pred->root] : 0;
+  return true;
+}
+
+/*
+Name: column_filter_free():
+Parameters: ColumnFilter *filter
+Return: void
+Description:
+
+Releases the per-code match tables allocated by column_filter_init().
+*/
+void column_filter_free(ColumnFilter *filter) {
+  for (int i = 0; i < QPE_MAX_PRED_NODES; i++) {
+    free(filter->nodes[i].match);
+    filter->nodes[i].match = NULL;
+  }
+}
+
+/*
+Name: eval_column_node():
+Parameters: const ColumnFilter *filter, int idx, size_t row
+Return: bool
+Description:
+
+Column-store counterpart of the row evaluator in QPEQuery.c: reads integer
+operands from their column and resolves string comparisons (including merged
+single-column subtrees) with one lookup in the node's per-code match table.
+*/
+static bool eval_column_node(const ColumnFilter *filter, int idx, size_t row) {
+  const PredNode *n = &filter->pred->nodes[idx];
+  const ColumnNode *cn = &filter->nodes[idx];
+
+  if (cn->codes) {
+    return cn->match[cn->codes[row]] != 0;
+  }
+
+  switch (n->kind) {
+  case PRED_INT_CMP: {
+    int32_t lhs = cn->ints[row];
+    switch (n->op) {
+    case OP_EQ:
+      return lhs == n->ival;
+    case OP_NE:
+      return lhs != n->ival;
+    case OP_GT:
+      return lhs > n->ival;
+    case OP_LT:
+      return lhs < n->ival;
+    case OP_GE:
+      return lhs >= n->ival;
+    default:
+      return lhs <= n->ival;
+    }
+  }
+  case PRED_AND:
+    return eval_column_node(filter, n->left, row) &&
+           eval_column_node(filter, n->right, row);
+  case PRED_OR:
+    return eval_column_node(filter, n->left, row) ||
+           eval_column_node(filter, n->right, row);
+  default:
+    return n->truth != 0;
+  }
+}
+
+/*
+Name: column_match():
+Parameters: const ColumnFilter *filter, size_t row
+Return: int
+Description:
+
+Returns 1 when the given row of the bound column store satisfies the filter's
+predicate (or the WHERE clause was empty) and 0 otherwise.
+*/
+int column_match(const ColumnFilter *filter, size_t row) {
+  if (filter->pred->root < 0) {
+    return 1;
+  }
+  return eval_column_node(filter, filter->pred->root, row) ? 1 : 0;
+}
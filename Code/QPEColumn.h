@@ -0,0 +1,92 @@
+/*
+
+QPEColumn.h
+
+Optional struct-of-arrays (columnar) copy of the CarInventory table. Integer
+attributes are stored as int32_t arrays; Model, Color and Dealer are
+dictionary-encoded into uint16_t code arrays, since each draws from a small
+vocabulary (see Code/dataGen.c).
+
+A compiled Predicate is bound to a table with column_filter_init(), which
+resolves every string comparison once into a per-code truth table, so the scan
+only compares integers over contiguous memory. AND/OR subtrees that only test
+one string column (such as Color="Red" OR Color="Blue") collapse into a single
+truth table and, when few codes qualify, an explicit IN list for the SIMD
+kernels in QPEFilter.c.
+
+The Dictionary functions are public so the zone maps (QPEZone.h) can encode
+the same string columns for their per-block code sets.
+
+*/
+
+#ifndef QPE_COLUMN_H
+#define QPE_COLUMN_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "../btree/btree.h"
+#include "QPEQuery.h"
+
+#define QPE_MAX_DICT_CODES 65536
+#define QPE_MAX_IN_CODES 8
+
+/*
+Struct Definitions
+*/
+typedef struct {
+  char (*values)[20]; /* code -> string */
+  int count;
+  int cap;
+  int *slots; /* open addressing hash: string -> code + 1 (0 = empty) */
+  int num_slots;
+} Dictionary;
+
+typedef enum { DICT_MODEL, DICT_COLOR, DICT_DEALER, NUM_DICTS } DictId;
+
+typedef struct {
+  size_t count;
+  size_t cap;
+  int32_t *id;
+  int32_t *year_make;
+  int32_t *price;
+  uint16_t *model;
+  uint16_t *color;
+  uint16_t *dealer;
+  Dictionary dicts[NUM_DICTS];
+} ColumnTable;
+
+typedef struct {
+  const int32_t *ints;   /* PRED_INT_CMP operand column */
+  const uint16_t *codes; /* code column when the node tests one string column */
+  unsigned char *match;  /* per code: 1 when the (sub)expression holds */
+  int num_codes;         /* dictionary size backing match */
+  int num_in;            /* codes with match[code] == 1 */
+  uint16_t in_codes[QPE_MAX_IN_CODES]; /* those codes if num_in fits */
+} ColumnNode;
+
+typedef struct {
+  const Predicate *pred;
+  int depth; /* height of the compiled tree, 0 when the clause is empty */
+  ColumnNode nodes[QPE_MAX_PRED_NODES];
+} ColumnFilter;
+
+/*
+Function Prototypes
+*/
+bool dict_init(Dictionary *dict);
+void dict_free(Dictionary *dict);
+int dict_encode(Dictionary *dict, const char *s);
+ColumnTable *column_table_new(size_t capacity);
+void column_table_free(ColumnTable *table);
+bool column_table_append(ColumnTable *table, const CarInventory *car);
+ColumnTable *column_table_from_btree(struct btree *tree);
+ColumnTable *column_table_from_array(const CarInventory *arr, size_t count);
+void column_table_get(const ColumnTable *table, size_t row, CarInventory *out);
+bool column_filter_init(ColumnFilter *filter, const ColumnTable *table,
+                        const Predicate *pred);
+void column_filter_free(ColumnFilter *filter);
+int column_match(const ColumnFilter *filter, size_t row);
+
+#endif
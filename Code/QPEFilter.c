@@ -0,0 +1,701 @@
+/*
+
+QPEFilter.c
+
+Authors:
+    Aidan Levy
+    Maddie Powell
+    Nick Corcoran
+    Austin Phalines
+    Dean Bullock
+
+Creation Date: 10-14-2026
+
+Description:
+
+Selection-bitmap evaluation of a ColumnFilter. Three kernel shapes cover every
+leaf a compiled WHERE clause can produce over the column store:
+
+- int32_cmp: an int32_t column against a literal (ID, YearMake, Price)
+- code_in:   a code column against a short list of qualifying codes, which is
+             what Model="X" and (Color="A" OR Color="B" ...) reduce to
+- code_lut:  a code column looked up in a per-code match table, used when too
+             many codes qualify for an IN list
+
+Each shape has a scalar implementation plus SSE4.1 and AVX2 versions on x86
+(compiled with target attributes and selected through __builtin_cpu_supports,
+so the binaries still run on older CPUs) and a NEON version on AArch64. The
+code_lut kernel is a byte gather and stays scalar everywhere.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "QPEFilter.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define QPE_FILTER_X86 1
+#include <immintrin.h>
+#endif
+
+#if defined(__aarch64__)
+#define QPE_FILTER_NEON 1
+#include <arm_neon.h>
+#endif
+
+/*
+Function Prototypes
+*/
+static void scalar_int32_cmp(const int32_t *col, size_t n, CompareOp op,
+                             int32_t lit, uint64_t *out);
+static void scalar_code_in(const uint16_t *col, size_t n, const uint16_t *codes,
+                           int num_codes, uint64_t *out);
+static void scalar_code_lut(const uint16_t *col, size_t n,
+                            const unsigned char *match, uint64_t *out);
+static void fill_bits(uint64_t *out, size_t n, bool value);
+static bool all_clear(const uint64_t *bits, size_t words);
+static void eval_bitmap(FilterScratch *scratch, int idx, size_t start,
+                        size_t n, int level);
+
+static const char *const isa_names[NUM_ISAS] = {"scalar", "sse4", "avx2",
+                                                "neon"};
+
+/*
+Scalar kernels
+*/
+/*
+Name: scalar_int32_cmp():
+Parameters: const int32_t *col, size_t n, CompareOp op, int32_t lit,
+            uint64_t *out
+Return: void
+Description:
+
+Portable int32_cmp kernel and the tail handler for the SIMD versions. Each
+operator gets its own loop so the comparison is not re-dispatched per row.
+*/
+static void scalar_int32_cmp(const int32_t *col, size_t n, CompareOp op,
+                             int32_t lit, uint64_t *out) {
+  size_t words = (n + 63) / 64;
+
+#define SCALAR_CMP_LOOP(EXPR)                                                  \
+  for (size_t w = 0; w < words; w++) {                                         \
+    const int32_t *p = col + w * 64;                                           \
+    size_t len = (n - w * 64 < 64) ? n - w * 64 : 64;                          \
+    uint64_t word = 0;                                                         \
+    for (size_t i = 0; i < len; i++) {                                         \
+      word |= (uint64_t)(EXPR) << i;                                           \
+    }                                                                          \
+    out[w] = word;                                                             \
+  }
+
+  switch (op) {
+  case OP_EQ:
+    SCALAR_CMP_LOOP(p[i] == lit);
+    break;
+  case OP_NE:
+    SCALAR_CMP_LOOP(p[i] != lit);
+    break;
+  case OP_GT:
+    SCALAR_CMP_LOOP(p[i] > lit);
+    break;
+  case OP_LT:
+    SCALAR_CMP_LOOP(p[i] < lit);
+    break;
+  case OP_GE:
+    SCALAR_CMP_LOOP(p[i] >= lit);
+    break;
+  case OP_LE:
+    SCALAR_CMP_LOOP(p[i] <= lit);
+    break;
+  }
+
+#undef SCALAR_CMP_LOOP
+}
+
+/*
+Name: scalar_code_in():
+Parameters: const uint16_t *col, size_t n, const uint16_t *codes,
+            int num_codes, uint64_t *out
+Return: void
+Description:
+
+Portable code_in kernel: sets the bit of every row whose code equals one of
+the listed codes.
+*/
+static void scalar_code_in(const uint16_t *col, size_t n, const uint16_t *codes,
+                           int num_codes, uint64_t *out) {
+  size_t words = (n + 63) / 64;
+  for (size_t w = 0; w < words; w++) {
+    const uint16_t *p = col + w * 64;
+    size_t len = (n - w * 64 < 64) ? n - w * 64 : 64;
+    uint64_t word = 0;
+    for (size_t i = 0; i < len; i++) {
+      bool hit = false;
+      for (int k = 0; k < num_codes; k++) {
+        hit |= (p[i] == codes[k]);
+      }
+      word |= (uint64_t)hit << i;
+    }
+    out[w] = word;
+  }
+}
+
+/*
+Name: scalar_code_lut():
+Parameters: const uint16_t *col, size_t n, const unsigned char *match,
+            uint64_t *out
+Return: void
+Description:
+
+code_lut kernel shared by every ISA: looks each row's code up in the 0/1 match
+table.
+*/
+static void scalar_code_lut(const uint16_t *col, size_t n,
+                            const unsigned char *match, uint64_t *out) {
+  size_t words = (n + 63) / 64;
+  for (size_t w = 0; w < words; w++) {
+    const uint16_t *p = col + w * 64;
+    size_t len = (n - w * 64 < 64) ? n - w * 64 : 64;
+    uint64_t word = 0;
+    for (size_t i = 0; i < len; i++) {
+      word |= (uint64_t)match[p[i]] << i;
+    }
+    out[w] = word;
+  }
+}
+
+static const FilterKernels scalar_kernels = {"scalar", scalar_int32_cmp,
+                                             scalar_code_in, scalar_code_lut};
+
+#ifdef QPE_FILTER_X86
+/*
+SSE4.1 kernels
+*/
+/*
+Name: sse4_int32_cmp():
+Parameters: const int32_t *col, size_t n, CompareOp op, int32_t lit,
+            uint64_t *out
+Return: void
+Description:
+
+Compares four rows per instruction and gathers the lane masks with
+_mm_movemask_ps. <, >= are computed as swapped >, and !=, <=, >= as the
+complement of ==, >, <.
+*/
+__attribute__((target("sse4.1"))) static void
+sse4_int32_cmp(const int32_t *col, size_t n, CompareOp op, int32_t lit,
+               uint64_t *out) {
+  const __m128i vlit = _mm_set1_epi32(lit);
+  const uint64_t flip =
+      (op == OP_NE || op == OP_LE || op == OP_GE) ? ~(uint64_t)0 : 0;
+  size_t full = n / 64;
+
+#define SSE4_CMP_LOOP(CMP)                                                     \
+  for (size_t w = 0; w < full; w++) {                                          \
+    const int32_t *p = col + w * 64;                                           \
+    uint64_t word = 0;                                                         \
+    for (int j = 0; j < 16; j++) {                                             \
+      __m128i v = _mm_loadu_si128((const __m128i *)(p + j * 4));               \
+      __m128i m = CMP;                                                         \
+      word |= (uint64_t)(unsigned)_mm_movemask_ps(_mm_castsi128_ps(m))         \
+              << (j * 4);                                                      \
+    }                                                                          \
+    out[w] = word ^ flip;                                                      \
+  }
+
+  if (op == OP_EQ || op == OP_NE) {
+    SSE4_CMP_LOOP(_mm_cmpeq_epi32(v, vlit));
+  } else if (op == OP_GT || op == OP_LE) {
+    SSE4_CMP_LOOP(_mm_cmpgt_epi32(v, vlit));
+  } else {
+    SSE4_CMP_LOOP(_mm_cmplt_epi32(v, vlit));
+  }
+
+#undef SSE4_CMP_LOOP
+
+  if (n > full * 64) {
+    scalar_int32_cmp(col + full * 64, n - full * 64, op, lit, out + full);
+  }
+}
+
+/*
+Name: sse4_code_in():
+Parameters: const uint16_t *col, size_t n, const uint16_t *codes,
+            int num_codes, uint64_t *out
+Return: void
+Description:
+
+Tests sixteen codes per step: two 8-lane equality masks (ORed across the IN
+list) are narrowed with _mm_packs_epi16 so one _mm_movemask_epi8 yields sixteen
+row bits in order.
+*/
+__attribute__((target("sse4.1"))) static void
+sse4_code_in(const uint16_t *col, size_t n, const uint16_t *codes,
+             int num_codes, uint64_t *out) {
+  __m128i vcodes[QPE_MAX_IN_CODES];
+  size_t full = n / 64;
+
+  for (int k = 0; k < num_codes; k++) {
+    vcodes[k] = _mm_set1_epi16((short)codes[k]);
+  }
+
+  for (size_t w = 0; w < full; w++) {
+    const uint16_t *p = col + w * 64;
+    uint64_t word = 0;
+    for (int j = 0; j < 4; j++) {
+      __m128i a = _mm_loadu_si128((const __m128i *)(p + j * 16));
+      __m128i b = _mm_loadu_si128((const __m128i *)(p + j * 16 + 8));
+      __m128i ha = _mm_setzero_si128();
+      __m128i hb = _mm_setzero_si128();
+      for (int k = 0; k < num_codes; k++) {
+        ha = _mm_or_si128(ha, _mm_cmpeq_epi16(a, vcodes[k]));
+        hb = _mm_or_si128(hb, _mm_cmpeq_epi16(b, vcodes[k]));
+      }
+      unsigned mask = (unsigned)_mm_movemask_epi8(_mm_packs_epi16(ha, hb));
+      word |= (uint64_t)mask << (j * 16);
+    }
+    out[w] = word;
+  }
+
+  if (n > full * 64) {
+    scalar_code_in(col + full * 64, n - full * 64, codes, num_codes,
+                   out + full);
+  }
+}
+
+static const FilterKernels sse4_kernels = {"sse4", sse4_int32_cmp, sse4_code_in,
+                                           scalar_code_lut};
+
+/*
+AVX2 kernels
+*/
+/*
+Name: avx2_int32_cmp():
+Parameters: const int32_t *col, size_t n, CompareOp op, int32_t lit,
+            uint64_t *out
+Return: void
+Description:
+
+AVX2 form of sse4_int32_cmp(): eight rows per compare, eight compares per
+64-row bitmap word.
+*/
+__attribute__((target("avx2"))) static void
+avx2_int32_cmp(const int32_t *col, size_t n, CompareOp op, int32_t lit,
+               uint64_t *out) {
+  const __m256i vlit = _mm256_set1_epi32(lit);
+  const uint64_t flip =
+      (op == OP_NE || op == OP_LE || op == OP_GE) ? ~(uint64_t)0 : 0;
+  size_t full = n / 64;
+
+#define AVX2_CMP_LOOP(CMP)                                                     \
+  for (size_t w = 0; w < full; w++) {                                          \
+    const int32_t *p = col + w * 64;                                           \
+    uint64_t word = 0;                                                         \
+    for (int j = 0; j < 8; j++) {                                              \
+      __m256i v = _mm256_loadu_si256((const __m256i *)(p + j * 8));            \
+      __m256i m = CMP;                                                         \
+      word |= (uint64_t)(unsigned)_mm256_movemask_ps(_mm256_castsi256_ps(m))   \
+              << (j * 8);                                                      \
+    }                                                                          \
+    out[w] = word ^ flip;                                                      \
+  }
+
+  if (op == OP_EQ || op == OP_NE) {
+    AVX2_CMP_LOOP(_mm256_cmpeq_epi32(v, vlit));
+  } else if (op == OP_GT || op == OP_LE) {
+    AVX2_CMP_LOOP(_mm256_cmpgt_epi32(v, vlit));
+  } else {
+    AVX2_CMP_LOOP(_mm256_cmpgt_epi32(vlit, v));
+  }
+
+#undef AVX2_CMP_LOOP
+
+  if (n > full * 64) {
+    scalar_int32_cmp(col + full * 64, n - full * 64, op, lit, out + full);
+  }
+}
+
+/*
+Name: avx2_code_in():
+Parameters: const uint16_t *col, size_t n, const uint16_t *codes,
+            int num_codes, uint64_t *out
+Return: void
+Description:
+
+Tests thirty-two codes per step. _mm256_packs_epi16 narrows within 128-bit
+lanes, so the packed result is reordered with _mm256_permute4x64_epi64 before
+_mm256_movemask_epi8 to keep row bits in order.
+*/
+__attribute__((target("avx2"))) static void
+avx2_code_in(const uint16_t *col, size_t n, const uint16_t *codes,
+             int num_codes, uint64_t *out) {
+  __m256i vcodes[QPE_MAX_IN_CODES];
+  size_t full = n / 64;
+
+  for (int k = 0; k < num_codes; k++) {
+    vcodes[k] = _mm256_set1_epi16((short)codes[k]);
+  }
+
+  for (size_t w = 0; w < full; w++) {
+    const uint16_t *p = col + w * 64;
+    uint64_t word = 0;
+    for (int j = 0; j < 2; j++) {
+      __m256i a = _mm256_loadu_si256((const __m256i *)(p + j * 32));
+      __m256i b = _mm256_loadu_si256((const __m256i *)(p + j * 32 + 16));
+      __m256i ha = _mm256_setzero_si256();
+      __m256i hb = _mm256_setzero_si256();
+      for (int k = 0; k < num_codes; k++) {
+        ha = _mm256_or_si256(ha, _mm256_cmpeq_epi16(a, vcodes[k]));
+        hb = _mm256_or_si256(hb, _mm256_cmpeq_epi16(b, vcodes[k]));
+      }
+      __m256i packed =
+          _mm256_permute4x64_epi64(_mm256_packs_epi16(ha, hb), 0xD8);
+      unsigned mask = (unsigned)_mm256_movemask_epi8(packed);
+      word |= (uint64_t)mask << (j * 32);
+    }
+    out[w] = word;
+  }
+
+  if (n > full * 64) {
+    scalar_code_in(col + full * 64, n - full * 64, codes, num_codes,
+                   out + full);
+  }
+}
+
+static const FilterKernels avx2_kernels = {"avx2", avx2_int32_cmp, avx2_code_in,
+                                           scalar_code_lut};
+#endif
+
+#ifdef QPE_FILTER_NEON
+/*
+NEON kernels
+*/
+/*
+Name: neon_int32_cmp():
+Parameters: const int32_t *col, size_t n, CompareOp op, int32_t lit,
+            uint64_t *out
+Return: void
+Description:
+
+NEON has no movemask, so each 4-lane compare result is ANDed with the lane
+weights {1, 2, 4, 8} and summed across lanes with vaddvq_u32.
+*/
+static void neon_int32_cmp(const int32_t *col, size_t n, CompareOp op,
+                           int32_t lit, uint64_t *out) {
+  static const uint32_t lane_bits[4] = {1, 2, 4, 8};
+  const uint32x4_t weights = vld1q_u32(lane_bits);
+  const int32x4_t vlit = vdupq_n_s32(lit);
+  const uint64_t flip =
+      (op == OP_NE || op == OP_LE || op == OP_GE) ? ~(uint64_t)0 : 0;
+  size_t full = n / 64;
+
+#define NEON_CMP_LOOP(CMP)                                                     \
+  for (size_t w = 0; w < full; w++) {                                          \
+    const int32_t *p = col + w * 64;                                           \
+    uint64_t word = 0;                                                         \
+    for (int j = 0; j < 16; j++) {                                             \
+      int32x4_t v = vld1q_s32(p + j * 4);                                      \
+      uint32x4_t m = CMP;                                                      \
+      word |= (uint64_t)vaddvq_u32(vandq_u32(m, weights)) << (j * 4);          \
+    }                                                                          \
+    out[w] = word ^ flip;                                                      \
+  }
+
+  if (op == OP_EQ || op == OP_NE) {
+    NEON_CMP_LOOP(vceqq_s32(v, vlit));
+  } else if (op == OP_GT || op == OP_LE) {
+    NEON_CMP_LOOP(vcgtq_s32(v, vlit));
+  } else {
+    NEON_CMP_LOOP(vcltq_s32(v, vlit));
+  }
+
+#undef NEON_CMP_LOOP
+
+  if (n > full * 64) {
+    scalar_int32_cmp(col + full * 64, n - full * 64, op, lit, out + full);
+  }
+}
+
+/*
+Name: neon_code_in():
+Parameters: const uint16_t *col, size_t n, const uint16_t *codes,
+            int num_codes, uint64_t *out
+Return: void
+Description:
+
+Tests eight codes per step, turning the ORed 8-lane equality mask into row
+bits with lane weights {1, 2, ..., 128} and vaddvq_u16.
+*/
+static void neon_code_in(const uint16_t *col, size_t n, const uint16_t *codes,
+                         int num_codes, uint64_t *out) {
+  static const uint16_t lane_bits[8] = {1, 2, 4, 8, 16, 32, 64, 128};
+  const uint16x8_t weights = vld1q_u16(lane_bits);
+  uint16x8_t vcodes[QPE_MAX_IN_CODES];
+  size_t full = n / 64;
+
+  for (int k = 0; k < num_codes; k++) {
+    vcodes[k] = vdupq_n_u16(codes[k]);
+  }
+
+  for (size_t w = 0; w < full; w++) {
+    const uint16_t *p = col + w * 64;
+    uint64_t word = 0;
+    for (int j = 0; j < 8; j++) {
+      uint16x8_t v = vld1q_u16(p + j * 8);
+      uint16x8_t m = vdupq_n_u16(0);
+      for (int k = 0; k < num_codes; k++) {
+        m = vorrq_u16(m, vceqq_u16(v, vcodes[k]));
+      }
+      word |= (uint64_t)vaddvq_u16(vandq_u16(m, weights)) << (j * 8);
+    }
+    out[w] = word;
+  }
+
+  if (n > full * 64) {
+    scalar_code_in(col + full * 64, n - full * 64, codes, num_codes,
+                   out + full);
+  }
+}
+
+static const FilterKernels neon_kernels = {"neon", neon_int32_cmp, neon_code_in,
+                                           scalar_code_lut};
+#endif
+
+/*
+Name: filter_kernels():
+Parameters: FilterIsa isa
+Return: const FilterKernels *
+Description:
+
+Returns the kernel table for the requested instruction set, or NULL when it was
+not compiled in or the running CPU does not support it.
+*/
+const FilterKernels *filter_kernels(FilterIsa isa) {
+  switch (isa) {
+  case ISA_SCALAR:
+    return &scalar_kernels;
+#ifdef QPE_FILTER_X86
+  case ISA_SSE4:
+    return __builtin_cpu_supports("sse4.1") ? &sse4_kernels : NULL;
+  case ISA_AVX2:
+    return __builtin_cpu_supports("avx2") ? &avx2_kernels : NULL;
+#endif
+#ifdef QPE_FILTER_NEON
+  case ISA_NEON:
+    return &neon_kernels;
+#endif
+  default:
+    return NULL;
+  }
+}
+
+/*
+Name: filter_best_isa():
+Parameters: none
+Return: FilterIsa
+Description:
+
+Picks the widest supported kernel set, unless the QPE_SIMD environment variable
+names an available one (scalar, sse4, avx2, neon).
+*/
+FilterIsa filter_best_isa(void) {
+  const char *forced = getenv("QPE_SIMD");
+
+  if (forced != NULL) {
+    for (int isa = 0; isa < NUM_ISAS; isa++) {
+      if (strcasecmp(forced, isa_names[isa]) == 0 &&
+          filter_kernels((FilterIsa)isa) != NULL) {
+        return (FilterIsa)isa;
+      }
+    }
+  }
+
+  for (int isa = NUM_ISAS - 1; isa > ISA_SCALAR; isa--) {
+    if (filter_kernels((FilterIsa)isa) != NULL) {
+      return (FilterIsa)isa;
+    }
+  }
+  return ISA_SCALAR;
+}
+
+/*
+Name: filter_scratch_init():
+Parameters: FilterScratch *scratch, const ColumnFilter *filter
+Return: bool
+Description:
+
+Prepares per-thread state for evaluating filter: one bitmap per tree level plus
+the kernel table chosen by filter_best_isa(). Returns false on allocation
+failure.
+*/
+bool filter_scratch_init(FilterScratch *scratch, const ColumnFilter *filter) {
+  size_t levels = (size_t)filter->depth + 1;
+
+  scratch->filter = filter;
+  scratch->kernels = filter_kernels(filter_best_isa());
+  scratch->bits = malloc(levels * QPE_FILTER_WORDS * sizeof(uint64_t));
+  return scratch->bits != NULL;
+}
+
+/*
+Name: filter_scratch_free():
+Parameters: FilterScratch *scratch
+Return: void
+Description:
+
+Releases the bitmaps owned by the scratch state.
+*/
+void filter_scratch_free(FilterScratch *scratch) {
+  free(scratch->bits);
+  scratch->bits = NULL;
+}
+
+/*
+Name: fill_bits():
+Parameters: uint64_t *out, size_t n, bool value
+Return: void
+Description:
+
+Sets the first n bits of a bitmap to value, keeping bits past n clear.
+*/
+static void fill_bits(uint64_t *out, size_t n, bool value) {
+  size_t words = (n + 63) / 64;
+  memset(out, value ? 0xFF : 0, words * sizeof(uint64_t));
+  if (value && (n % 64) != 0) {
+    out[words - 1] = ((uint64_t)1 << (n % 64)) - 1;
+  }
+}
+
+/*
+Name: all_clear():
+Parameters: const uint64_t *bits, size_t words
+Return: bool
+Description:
+
+Returns true when no bit in the bitmap is set, letting AND skip its right side.
+*/
+static bool all_clear(const uint64_t *bits, size_t words) {
+  uint64_t any = 0;
+  for (size_t w = 0; w < words; w++) {
+    any |= bits[w];
+  }
+  return any == 0;
+}
+
+/*
+Name: eval_bitmap():
+Parameters: FilterScratch *scratch, int idx, size_t start, size_t n, int level
+Return: void
+Description:
+
+Writes the selection bitmap of node idx for rows [start, start + n) into the
+scratch bitmap for level. AND/OR evaluate their right child one level down and
+combine word by word; AND skips the right child when nothing survived the left.
+*/
+static void eval_bitmap(FilterScratch *scratch, int idx, size_t start,
+                        size_t n, int level) {
+  const ColumnFilter *filter = scratch->filter;
+  const PredNode *node = &filter->pred->nodes[idx];
+  const ColumnNode *cn = &filter->nodes[idx];
+  const FilterKernels *k = scratch->kernels;
+  uint64_t *out = scratch->bits + (size_t)level * QPE_FILTER_WORDS;
+  size_t words = (n + 63) / 64;
+
+  if (cn->codes) {
+    if (cn->num_in == 0 || cn->num_in == cn->num_codes) {
+      fill_bits(out, n, cn->num_in != 0);
+    } else if (cn->num_in <= QPE_MAX_IN_CODES) {
+      k->code_in(cn->codes + start, n, cn->in_codes, cn->num_in, out);
+    } else {
+      k->code_lut(cn->codes + start, n, cn->match, out);
+    }
+    return;
+  }
+
+  switch (node->kind) {
+  case PRED_INT_CMP:
+    k->int32_cmp(cn->ints + start, n, (CompareOp)node->op, node->ival, out);
+    break;
+  case PRED_AND: {
+    eval_bitmap(scratch, node->left, start, n, level);
+    if (all_clear(out, words)) {
+      break;
+    }
+    eval_bitmap(scratch, node->right, start, n, level + 1);
+    const uint64_t *rhs = out + QPE_FILTER_WORDS;
+    for (size_t w = 0; w < words; w++) {
+      out[w] &= rhs[w];
+    }
+    break;
+  }
+  case PRED_OR: {
+    eval_bitmap(scratch, node->left, start, n, level);
+    eval_bitmap(scratch, node->right, start, n, level + 1);
+    const uint64_t *rhs = out + QPE_FILTER_WORDS;
+    for (size_t w = 0; w < words; w++) {
+      out[w] |= rhs[w];
+    }
+    break;
+  }
+  default:
+    fill_bits(out, n, node->truth != 0);
+    break;
+  }
+}
+
+/*
+Name: filter_block():
+Parameters: FilterScratch *scratch, size_t start, size_t n
+Return: const uint64_t *
+Description:
+
+Evaluates the bound predicate over rows [start, start + n), n at most
+QPE_FILTER_BLOCK, and returns the selection bitmap (valid until the next call
+with the same scratch). Bit i of word w refers to row start + 64 * w + i.
+*/
+const uint64_t *filter_block(FilterScratch *scratch, size_t start, size_t n) {
+  const Predicate *pred = scratch->filter->pred;
+
+  if (pred->root < 0) {
+    fill_bits(scratch->bits, n, true);
+  } else {
+    eval_bitmap(scratch, pred->root, start, n, 0);
+  }
+  return scratch->bits;
+}
+
+/*
+Name: filter_scan():
+Parameters: FilterScratch *scratch, size_t begin, size_t end,
+            bool (*emit)(size_t row, void *udata), void *udata
+Return: bool
+Description:
+
+Filters rows [begin, end) block by block and calls emit for every matching row
+in ascending order. Like a btree_ascend iterator, emit returns false to stop
+the scan early, in which case filter_scan() also returns false.
+*/
+bool filter_scan(FilterScratch *scratch, size_t begin, size_t end,
+                 bool (*emit)(size_t row, void *udata), void *udata) {
+  for (size_t start = begin; start < end; start += QPE_FILTER_BLOCK) {
+    size_t n =
+        (end - start < QPE_FILTER_BLOCK) ? end - start : QPE_FILTER_BLOCK;
+    const uint64_t *bits = filter_block(scratch, start, n);
+    size_t words = (n + 63) / 64;
+
+    for (size_t w = 0; w < words; w++) {
+      uint64_t word = bits[w];
+      while (word != 0) {
+        size_t row = start + w * 64 + (size_t)__builtin_ctzll(word);
+        word &= word - 1;
+        if (!emit(row, udata)) {
+          return false;
+        }
+      }
+    }
+  }
+  return true;
+}
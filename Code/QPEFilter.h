@@ -0,0 +1,67 @@
+/*
+
+QPEFilter.h
+
+Vectorized filter kernels over the column store (QPEColumn.h). Instead of
+testing a row at a time, a bound ColumnFilter is evaluated one block of rows
+and one column at a time: every leaf produces a selection bitmap (bit i set
+when row i passes) and AND/OR nodes combine bitmaps word by word.
+
+Kernels exist for scalar C, SSE4.1 and AVX2 on x86 and NEON on AArch64. The
+best one the CPU supports is picked at run time; setting QPE_SIMD to scalar,
+sse4, avx2 or neon forces a specific implementation (when available).
+
+*/
+
+#ifndef QPE_FILTER_H
+#define QPE_FILTER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "QPEColumn.h"
+
+/* Rows per evaluation block; a multiple of 64 so bitmaps fill whole words. */
+#define QPE_FILTER_BLOCK 4096
+#define QPE_FILTER_WORDS (QPE_FILTER_BLOCK / 64)
+
+typedef enum { ISA_SCALAR, ISA_SSE4, ISA_AVX2, ISA_NEON, NUM_ISAS } FilterIsa;
+
+/*
+Each kernel tests n rows starting at the given column pointer and writes
+(n + 63) / 64 bitmap words, leaving bits past n clear.
+*/
+typedef void (*Int32CmpKernel)(const int32_t *col, size_t n, CompareOp op,
+                               int32_t lit, uint64_t *out);
+typedef void (*CodeInKernel)(const uint16_t *col, size_t n,
+                             const uint16_t *codes, int num_codes,
+                             uint64_t *out);
+typedef void (*CodeLutKernel)(const uint16_t *col, size_t n,
+                              const unsigned char *match, uint64_t *out);
+
+typedef struct {
+  const char *name;
+  Int32CmpKernel int32_cmp;
+  CodeInKernel code_in;
+  CodeLutKernel code_lut;
+} FilterKernels;
+
+typedef struct {
+  const ColumnFilter *filter;
+  const FilterKernels *kernels;
+  uint64_t *bits; /* (depth + 1) bitmaps of QPE_FILTER_WORDS words */
+} FilterScratch;
+
+/*
+Function Prototypes
+*/
+const FilterKernels *filter_kernels(FilterIsa isa);
+FilterIsa filter_best_isa(void);
+bool filter_scratch_init(FilterScratch *scratch, const ColumnFilter *filter);
+void filter_scratch_free(FilterScratch *scratch);
+const uint64_t *filter_block(FilterScratch *scratch, size_t start, size_t n);
+bool filter_scan(FilterScratch *scratch, size_t begin, size_t end,
+                 bool (*emit)(size_t row, void *udata), void *udata);
+
+#endif
@@ -0,0 +1,539 @@
+/*
+
+QPEIndex.c
+
+Authors:
+    Aidan Levy
+    Maddie Powell
+    Nick Corcoran
+    Austin Phalines
+    Dean Bullock
+
+Creation Date: 10-14-2026
+
+Description:
+
+Builds the (Model, YearMake) and Color secondary indexes described in
+QPEIndex.h and answers WHERE clauses from them.
+
+index_probe_init() walks the top-level AND chain of a compiled Predicate and
+collects the conjuncts index_lookup() can answer from an index:
+
+- Model="x" together with YearMake=n: one (Model, YearMake) posting list
+- Model="x" alone: the union of every (x, YearMake) list, found with
+  btree_ascend() from the pivot (x, INT_MIN)
+- Color="c", or an OR of Color equalities: the union of the Color lists
+
+When both a Model and a Color conjunct are present, the two candidate lists
+are intersected. Any other conjunct is left for match_where() to check on the
+candidate rows.
+
+*/
+
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "QPEIndex.h"
+
+/*
+Struct Definitions
+*/
+typedef struct {
+  const char *model;
+  PostingList *out;
+  bool ok;
+} ModelRangeCtx;
+
+/*
+Function Prototypes
+*/
+static int index_entry_compare(const void *a, const void *b, void *udata);
+static bool posting_list_push(PostingList *list, uint32_t row);
+static bool index_add(struct btree *tree, const char *key, int year,
+                      uint32_t row);
+static bool free_entry_cb(const void *item, void *udata);
+static bool posting_list_union(PostingList *dst, const PostingList *src);
+static bool posting_list_intersect(PostingList *dst, const PostingList *src);
+static bool collect_colors(const Predicate *pred, int idx, const char **colors,
+                           int *num_colors);
+static void collect_conjuncts(const Predicate *pred, int idx,
+                              IndexProbe *probe);
+static bool model_range_cb(const void *item, void *udata);
+static bool lookup_model(const SecondaryIndex *index, const IndexProbe *probe,
+                         PostingList *out);
+static bool lookup_colors(const SecondaryIndex *index, const IndexProbe *probe,
+                          PostingList *out);
+
+/*
+Name: index_entry_compare():
+Parameters: const void *a, const void *b, void *udata
+Return: int
+Description:
+
+B-tree comparator for IndexEntry items: case-insensitive key first, then year.
+*/
+static int index_entry_compare(const void *a, const void *b, void *udata) {
+  const IndexEntry *ea = (const IndexEntry *)a;
+  const IndexEntry *eb = (const IndexEntry *)b;
+  int cmp = strcasecmp(ea->key, eb->key);
+
+  (void)udata;
+
+  if (cmp != 0) {
+    return cmp;
+  }
+  if (ea->year < eb->year) {
+    return -1;
+  }
+  return ea->year > eb->year ? 1 : 0;
+}
+
+/*
+Name: posting_list_push():
+Parameters: PostingList *list, uint32_t row
+Return: bool
+Description:
+
+Appends a row position, growing the list geometrically. Returns false when
+out of memory.
+*/
+static bool posting_list_push(PostingList *list, uint32_t row) {
+  if (list->count == list->cap) {
+    size_t cap = list->cap ? list->cap * 2 : 16;
+    uint32_t *rows = realloc(list->rows, cap * sizeof(uint32_t));
+    if (rows == NULL) {
+      return false;
+    }
+    list->rows = rows;
+    list->cap = cap;
+  }
+  list->rows[list->count++] = row;
+  return true;
+}
+
+/*
+Name: posting_list_free():
+Parameters: PostingList *list
+Return: void
+Description:
+
+Releases the positions held by a posting list and leaves it empty.
+*/
+void posting_list_free(PostingList *list) {
+  free(list->rows);
+  list->rows = NULL;
+  list->count = 0;
+  list->cap = 0;
+}
+
+/*
+Name: index_add():
+Parameters: struct btree *tree, const char *key, int year, uint32_t row
+Return: bool
+Description:
+
+Appends row to the posting list of (key, year), creating the entry the first
+time the key is seen. Rows arrive in ascending order, so lists stay sorted.
+*/
+static bool index_add(struct btree *tree, const char *key, int year,
+                      uint32_t row) {
+  IndexEntry probe = {.year = year, .list = NULL};
+  const IndexEntry *found;
+
+  strncpy(probe.key, key, sizeof(probe.key) - 1);
+  probe.key[sizeof(probe.key) - 1] = '\0';
+
+  found = btree_get(tree, &probe);
+  if (found != NULL) {
+    return posting_list_push(found->list, row);
+  }
+
+  probe.list = calloc(1, sizeof(PostingList));
+  if (probe.list == NULL) {
+    return false;
+  }
+  if (!posting_list_push(probe.list, row) ||
+      (btree_set(tree, &probe) == NULL && btree_oom(tree))) {
+    posting_list_free(probe.list);
+    free(probe.list);
+    return false;
+  }
+  return true;
+}
+
+/*
+Name: index_build():
+Parameters: const CarInventory *rows, size_t count
+Return: SecondaryIndex *
+Description:
+
+Builds both secondary indexes over rows[0 .. count). Row positions refer to
+this array (and to a column store built from the same B-tree walk). Returns
+NULL when out of memory or when count does not fit a 32-bit position.
+*/
+SecondaryIndex *index_build(const CarInventory *rows, size_t count) {
+  SecondaryIndex *index = calloc(1, sizeof(SecondaryIndex));
+
+  if (index == NULL) {
+    return NULL;
+  }
+  index->model_year =
+      btree_new(sizeof(IndexEntry), 0, index_entry_compare, NULL);
+  index->color = btree_new(sizeof(IndexEntry), 0, index_entry_compare, NULL);
+  if (index->model_year == NULL || index->color == NULL ||
+      !index_append(index, rows, count)) {
+    index_free(index);
+    return NULL;
+  }
+  return index;
+}
+
+/*
+Name: index_append():
+Parameters: SecondaryIndex *index, const CarInventory *rows, size_t count
+Return: bool
+Description:
+
+Indexes rows[index->num_rows .. count), the rows appended to the array since
+the index was built or last appended to, so the posting lists stay sorted
+and the work is proportional to the new rows. Returns false when out of
+memory or when count does not fit a 32-bit position; the index is then only
+fit for index_free().
+*/
+bool index_append(SecondaryIndex *index, const CarInventory *rows,
+                  size_t count) {
+  if (count > UINT32_MAX) {
+    return false;
+  }
+  for (size_t i = index->num_rows; i < count; i++) {
+    if (!index_add(index->model_year, rows[i].Model, rows[i].YearMake,
+                   (uint32_t)i) ||
+        !index_add(index->color, rows[i].Color, 0, (uint32_t)i)) {
+      return false;
+    }
+  }
+  index->num_rows = count;
+  return true;
+}
+
+/*
+Name: free_entry_cb():
+Parameters: const void *item, void *udata
+Return: bool
+Description:
+
+btree_ascend callback that releases the posting list owned by an entry.
+*/
+static bool free_entry_cb(const void *item, void *udata) {
+  const IndexEntry *entry = (const IndexEntry *)item;
+
+  (void)udata;
+
+  posting_list_free(entry->list);
+  free(entry->list);
+  return true;
+}
+
+/*
+Name: index_free():
+Parameters: SecondaryIndex *index
+Return: void
+Description:
+
+Frees both index B-trees and every posting list. Accepts NULL.
+*/
+void index_free(SecondaryIndex *index) {
+  if (index == NULL) {
+    return;
+  }
+  if (index->model_year != NULL) {
+    btree_ascend(index->model_year, NULL, free_entry_cb, NULL);
+    btree_free(index->model_year);
+  }
+  if (index->color != NULL) {
+    btree_ascend(index->color, NULL, free_entry_cb, NULL);
+    btree_free(index->color);
+  }
+  free(index);
+}
+
+/*
+Name: posting_list_union():
+Parameters: PostingList *dst, const PostingList *src
+Return: bool
+Description:
+
+Replaces dst with the sorted union of dst and src. Returns false when out of
+memory, leaving dst unchanged.
+*/
+static bool posting_list_union(PostingList *dst, const PostingList *src) {
+  PostingList merged = {NULL, 0, 0};
+  size_t i = 0;
+  size_t j = 0;
+
+  if (src->count == 0) {
+    return true;
+  }
+  merged.cap = dst->count + src->count;
+  merged.rows = malloc(merged.cap * sizeof(uint32_t));
+  if (merged.rows == NULL) {
+    return false;
+  }
+
+  while (i < dst->count && j < src->count) {
+    uint32_t a = dst->rows[i];
+    uint32_t b = src->rows[j];
+    merged.rows[merged.count++] = a < b ? a : b;
+    i += a <= b;
+    j += b <= a;
+  }
+  while (i < dst->count) {
+    merged.rows[merged.count++] = dst->rows[i++];
+  }
+  while (j < src->count) {
+    merged.rows[merged.count++] = src->rows[j++];
+  }
+
+  posting_list_free(dst);
+  *dst = merged;
+  return true;
+}
+
+/*
+Name: posting_list_intersect():
+Parameters: PostingList *dst, const PostingList *src
+Return: bool
+Description:
+
+Keeps only the positions of dst that also appear in src, in place. Always
+succeeds; the bool return matches posting_list_union().
+*/
+static bool posting_list_intersect(PostingList *dst, const PostingList *src) {
+  size_t i = 0;
+  size_t j = 0;
+  size_t kept = 0;
+
+  while (i < dst->count && j < src->count) {
+    if (dst->rows[i] < src->rows[j]) {
+      i++;
+    } else if (dst->rows[i] > src->rows[j]) {
+      j++;
+    } else {
+      dst->rows[kept++] = dst->rows[i];
+      i++;
+      j++;
+    }
+  }
+  dst->count = kept;
+  return true;
+}
+
+/*
+Name: collect_colors():
+Parameters: const Predicate *pred, int idx, const char **colors,
+            int *num_colors
+Return: bool
+Description:
+
+Returns true when the subtree at idx is Color="c" or an OR of such equalities,
+appending each literal to colors. Any other node makes the subtree unusable.
+*/
+static bool collect_colors(const Predicate *pred, int idx, const char **colors,
+                           int *num_colors) {
+  const PredNode *node = &pred->nodes[idx];
+
+  if (node->kind == PRED_OR) {
+    return collect_colors(pred, node->left, colors, num_colors) &&
+           collect_colors(pred, node->right, colors, num_colors);
+  }
+  if (node->kind != PRED_STR_CMP || node->op != OP_EQ ||
+      node->column != COL_COLOR || *num_colors == QPE_MAX_INDEX_COLORS) {
+    return false;
+  }
+  colors[(*num_colors)++] = pred->strpool + node->str;
+  return true;
+}
+
+/*
+Name: collect_conjuncts():
+Parameters: const Predicate *pred, int idx, IndexProbe *probe
+Return: void
+Description:
+
+Walks the AND chain rooted at idx and records the first Model equality, the
+first YearMake equality and the first Color equality (or OR of Color
+equalities) in probe.
+*/
+static void collect_conjuncts(const Predicate *pred, int idx,
+                              IndexProbe *probe) {
+  const PredNode *node = &pred->nodes[idx];
+  const char *colors[QPE_MAX_INDEX_COLORS];
+  int num_colors = 0;
+
+  if (node->kind == PRED_AND) {
+    collect_conjuncts(pred, node->left, probe);
+    collect_conjuncts(pred, node->right, probe);
+    return;
+  }
+
+  if (node->kind == PRED_STR_CMP && node->op == OP_EQ &&
+      node->column == COL_MODEL && probe->model == NULL) {
+    probe->model = pred->strpool + node->str;
+  } else if (node->kind == PRED_INT_CMP && node->op == OP_EQ &&
+             node->column == COL_YEARMAKE && !probe->has_year) {
+    probe->has_year = true;
+    probe->year = node->ival;
+  } else if (probe->num_colors < 0 &&
+             collect_colors(pred, idx, colors, &num_colors)) {
+    memcpy(probe->colors, colors, (size_t)num_colors * sizeof(colors[0]));
+    probe->num_colors = num_colors;
+  }
+}
+
+/*
+Name: model_range_cb():
+Parameters: const void *item, void *udata
+Return: bool
+Description:
+
+btree_ascend callback for a Model-only lookup: unions each (Model, YearMake)
+list into the result and stops at the first entry for a different model.
+*/
+static bool model_range_cb(const void *item, void *udata) {
+  const IndexEntry *entry = (const IndexEntry *)item;
+  ModelRangeCtx *ctx = (ModelRangeCtx *)udata;
+
+  if (strcasecmp(entry->key, ctx->model) != 0) {
+    return false;
+  }
+  if (!posting_list_union(ctx->out, entry->list)) {
+    ctx->ok = false;
+    return false;
+  }
+  return true;
+}
+
+/*
+Name: lookup_model():
+Parameters: const SecondaryIndex *index, const IndexProbe *probe,
+            PostingList *out
+Return: bool
+Description:
+
+Fills out with the rows whose Model (and YearMake, if given) match the probe.
+Returns false when out of memory.
+*/
+static bool lookup_model(const SecondaryIndex *index, const IndexProbe *probe,
+                         PostingList *out) {
+  IndexEntry key = {.year = probe->has_year ? probe->year : INT_MIN};
+
+  /* Stored values are at most 19 characters, so a longer literal matches
+   * nothing (and must not be truncated into a key that does). */
+  if (strlen(probe->model) >= sizeof(key.key)) {
+    return true;
+  }
+  strcpy(key.key, probe->model);
+
+  if (probe->has_year) {
+    const IndexEntry *found = btree_get(index->model_year, &key);
+    return found == NULL || posting_list_union(out, found->list);
+  }
+
+  ModelRangeCtx ctx = {.model = probe->model, .out = out, .ok = true};
+  btree_ascend(index->model_year, &key, model_range_cb, &ctx);
+  return ctx.ok;
+}
+
+/*
+Name: lookup_colors():
+Parameters: const SecondaryIndex *index, const IndexProbe *probe,
+            PostingList *out
+Return: bool
+Description:
+
+Fills out with the rows whose Color equals any of the probe's colors. Returns
+false when out of memory.
+*/
+static bool lookup_colors(const SecondaryIndex *index, const IndexProbe *probe,
+                          PostingList *out) {
+  for (int i = 0; i < probe->num_colors; i++) {
+    IndexEntry key = {.year = 0};
+    const IndexEntry *found;
+
+    if (strlen(probe->colors[i]) >= sizeof(key.key)) {
+      continue;
+    }
+    strcpy(key.key, probe->colors[i]);
+    found = btree_get(index->color, &key);
+    if (found != NULL && !posting_list_union(out, found->list)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/*
+Name: index_probe_init():
+Parameters: IndexProbe *probe, const Predicate *pred
+Return: void
+Description:
+
+Fills probe with the indexable conjuncts of pred. Both sides are left unused
+(model NULL, num_colors -1) when the clause has none.
+*/
+void index_probe_init(IndexProbe *probe, const Predicate *pred) {
+  probe->model = NULL;
+  probe->has_year = false;
+  probe->year = 0;
+  probe->num_colors = -1;
+  if (pred->root >= 0) {
+    collect_conjuncts(pred, pred->root, probe);
+  }
+}
+
+/*
+Name: index_lookup():
+Parameters: const SecondaryIndex *index, const IndexProbe *probe,
+            PostingList *out
+Return: bool
+Description:
+
+Fetches the candidate rows for the sides of probe that are in use,
+intersecting the Model and Color lists when both are. Returns true with out
+holding ascending positions (possibly none) that the caller must still check
+with match_where(). Returns false, with out empty, when the probe uses no
+index or memory runs out; the caller then scans.
+*/
+bool index_lookup(const SecondaryIndex *index, const IndexProbe *probe,
+                  PostingList *out) {
+  PostingList colors = {NULL, 0, 0};
+  bool ok = true;
+
+  out->rows = NULL;
+  out->count = 0;
+  out->cap = 0;
+
+  if (index == NULL || (probe->model == NULL && probe->num_colors < 0)) {
+    return false;
+  }
+
+  if (probe->model != NULL) {
+    ok = lookup_model(index, probe, out);
+  }
+  if (ok && probe->num_colors >= 0) {
+    if (probe->model == NULL) {
+      ok = lookup_colors(index, probe, out);
+    } else if (out->count > 0) {
+      ok = lookup_colors(index, probe, &colors) &&
+           posting_list_intersect(out, &colors);
+    }
+  }
+
+  posting_list_free(&colors);
+  if (!ok) {
+    posting_list_free(out);
+  }
+  return ok;
+}
@@ -0,0 +1,78 @@
+/*
+
+QPEIndex.h
+
+Optional secondary indexes over a snapshot of the CarInventory table (an array
+in ID order, as produced by walking the primary B-tree). Two extra B-trees map
+(Model, YearMake) and Color to sorted posting lists of row positions, so a
+query such as Model="Maxima" AND YearMake=2018 AND (Color="Red") reads only
+the rows in the intersection of those lists instead of scanning every tuple.
+
+Keys compare with strcasecmp(), the same rule match_where() uses, so a lookup
+never misses a row the scan would have returned. Positions are only
+candidates: callers still test each one with match_where() for the remaining
+conjuncts.
+
+index_probe_init() extracts the indexable conjuncts of a WHERE clause into an
+IndexProbe; the planner (QPEPlan.c) may drop either side of it before
+index_lookup() fetches the candidates.
+
+index_append() extends both indexes with rows added at the end of the array,
+which is how --serve follows a database file that grows (QPERefresh.h).
+
+*/
+
+#ifndef QPE_INDEX_H
+#define QPE_INDEX_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "../btree/btree.h"
+#include "QPEQuery.h"
+
+#define QPE_MAX_INDEX_COLORS 16
+
+/*
+Struct Definitions
+*/
+typedef struct {
+  uint32_t *rows; /* ascending row positions */
+  size_t count;
+  size_t cap;
+} PostingList;
+
+typedef struct {
+  char key[20]; /* Model or Color */
+  int year;     /* YearMake for the (Model, YearMake) index, 0 otherwise */
+  PostingList *list;
+} IndexEntry;
+
+typedef struct {
+  const char *model; /* Model= literal, NULL when unused */
+  bool has_year;     /* YearMake= narrows the Model side */
+  int year;
+  const char *colors[QPE_MAX_INDEX_COLORS];
+  int num_colors; /* Color= literals (ORed), -1 when unused */
+} IndexProbe;
+
+typedef struct {
+  size_t num_rows;
+  struct btree *model_year; /* IndexEntry keyed by (Model, YearMake) */
+  struct btree *color;      /* IndexEntry keyed by Color */
+} SecondaryIndex;
+
+/*
+Function Prototypes
+*/
+SecondaryIndex *index_build(const CarInventory *rows, size_t count);
+bool index_append(SecondaryIndex *index, const CarInventory *rows,
+                  size_t count);
+void index_free(SecondaryIndex *index);
+void index_probe_init(IndexProbe *probe, const Predicate *pred);
+bool index_lookup(const SecondaryIndex *index, const IndexProbe *probe,
+                  PostingList *out);
+void posting_list_free(PostingList *list);
+
+#endif
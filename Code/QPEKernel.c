@@ -0,0 +1,260 @@
+/*
+
+QPEKernel.c
+
+Authors:
+    Aidan Levy
+    Maddie Powell
+    Nick Corcoran
+    Austin Phalines
+    Dean Bullock
+
+Creation Date: 10-14-2026
+
+Description:
+
+Specialized scan kernels for the hot WHERE templates (see QPEKernel.h).
+kernel_compile() flattens the predicate's AND chain and keeps the literals,
+lower-cased once, in a ScanKernel; kernel_select() then switches on the
+template once per block and runs a loop in which the columns and operators
+are constants, the cheap YearMake test first. Strings are compared with an
+inlined ASCII case fold that agrees with strcasecmp() == 0 in the C locale
+the engines run in, so the kernels return exactly what match_where() would.
+
+*/
+
+#include <ctype.h>
+#include <string.h>
+
+#include "QPEKernel.h"
+
+/*
+Function Prototypes
+*/
+static bool add_term(ScanKernel *k, const Predicate *pred, int idx);
+static bool add_colors(ScanKernel *k, const Predicate *pred, int idx);
+static bool lower_copy(char *dst, const char *src);
+static inline bool str_ieq(const char *field, const char *lower);
+static inline bool color_in(const ScanKernel *k, const char *color);
+
+/*
+Name: lower_copy():
+Parameters: char *dst, const char *src
+Return: bool
+Description:
+
+Copies src lower-cased into dst, a 20-byte literal slot. Returns false when
+src does not fit, in which case no CarInventory field can equal it and the
+caller leaves the clause to the interpreter.
+*/
+static bool lower_copy(char *dst, const char *src) {
+  size_t len = strlen(src);
+
+  if (len >= 20) {
+    return false;
+  }
+  for (size_t i = 0; i <= len; i++) {
+    dst[i] = (char)tolower((unsigned char)src[i]);
+  }
+  return true;
+}
+
+/*
+Name: add_colors():
+Parameters: ScanKernel *k, const Predicate *pred, int idx
+Return: bool
+Description:
+
+Adds the Color IN set rooted at node idx: a Color = comparison or an OR of
+them. Returns false for anything else or when the set is full.
+*/
+static bool add_colors(ScanKernel *k, const Predicate *pred, int idx) {
+  const PredNode *n = &pred->nodes[idx];
+
+  if (n->kind == PRED_OR) {
+    return add_colors(k, pred, n->left) && add_colors(k, pred, n->right);
+  }
+  if (n->kind != PRED_STR_CMP || n->column != COL_COLOR || n->op != OP_EQ ||
+      k->num_colors == QPE_KERNEL_MAX_COLORS) {
+    return false;
+  }
+  return lower_copy(k->colors[k->num_colors++], pred->strpool + n->str);
+}
+
+/*
+Name: add_term():
+Parameters: ScanKernel *k, const Predicate *pred, int idx
+Return: bool
+Description:
+
+Adds the conjunct rooted at node idx to the kernel, descending through ANDs.
+Each of Model =, YearMake = and the Color set may appear once; returns false
+on a repeat or on any other kind of term.
+*/
+static bool add_term(ScanKernel *k, const Predicate *pred, int idx) {
+  const PredNode *n = &pred->nodes[idx];
+
+  if (n->kind == PRED_AND) {
+    return add_term(k, pred, n->left) && add_term(k, pred, n->right);
+  }
+  if (n->kind == PRED_STR_CMP && n->column == COL_MODEL && n->op == OP_EQ &&
+      !(k->shape & KERNEL_MODEL)) {
+    k->shape |= KERNEL_MODEL;
+    return lower_copy(k->model, pred->strpool + n->str);
+  }
+  if (n->kind == PRED_INT_CMP && n->column == COL_YEARMAKE && n->op == OP_EQ &&
+      !(k->shape & KERNEL_YEAR)) {
+    k->shape |= KERNEL_YEAR;
+    k->year = n->ival;
+    return true;
+  }
+  if ((n->kind == PRED_OR || n->kind == PRED_STR_CMP) &&
+      !(k->shape & KERNEL_COLORS)) {
+    k->shape |= KERNEL_COLORS;
+    return add_colors(k, pred, idx);
+  }
+  return false;
+}
+
+/*
+Name: kernel_compile():
+Parameters: ScanKernel *k, const Predicate *pred
+Return: bool
+Description:
+
+Fills k with the template pred matches and its literals. Returns false, with
+k->shape 0, when pred is empty or is not one of the templates; the caller
+then scans with match_where().
+*/
+bool kernel_compile(ScanKernel *k, const Predicate *pred) {
+  memset(k, 0, sizeof(*k));
+  if (pred->root < 0 || !add_term(k, pred, pred->root)) {
+    k->shape = 0;
+    return false;
+  }
+  return true;
+}
+
+/*
+Name: str_ieq():
+Parameters: const char *field, const char *lower
+Return: bool
+Description:
+
+Whether field equals the lower-cased literal ignoring case.
+*/
+static inline bool str_ieq(const char *field, const char *lower) {
+  for (;; field++, lower++) {
+    if (tolower((unsigned char)*field) != (unsigned char)*lower) {
+      return false;
+    }
+    if (*lower == '\0') {
+      return true;
+    }
+  }
+}
+
+/*
+Name: color_in():
+Parameters: const ScanKernel *k, const char *color
+Return: bool
+Description:
+
+Whether color is one of k's Color set.
+*/
+static inline bool color_in(const ScanKernel *k, const char *color) {
+  for (int c = 0; c < k->num_colors; c++) {
+    if (str_ieq(color, k->colors[c])) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/*
+One selection loop per template. The flags are constants in each expansion,
+so the compiler drops the tests a template does not have.
+*/
+#define QPE_KERNEL(name, MODEL, YEAR, COLORS)                                 \
+  static size_t name(const ScanKernel *k, const CarInventory *rows,          \
+                     size_t begin, size_t end, uint32_t *sel) {              \
+    size_t n = 0;                                                            \
+    for (size_t i = begin; i < end; i++) {                                   \
+      const CarInventory *car = &rows[i];                                    \
+      if ((!(YEAR) || car->YearMake == k->year) &&                           \
+          (!(MODEL) || str_ieq(car->Model, k->model)) &&                     \
+          (!(COLORS) || color_in(k, car->Color))) {                          \
+        sel[n++] = (uint32_t)(i - begin);                                    \
+      }                                                                      \
+    }                                                                        \
+    return n;                                                                \
+  }
+
+QPE_KERNEL(select_m, 1, 0, 0)
+QPE_KERNEL(select_y, 0, 1, 0)
+QPE_KERNEL(select_my, 1, 1, 0)
+QPE_KERNEL(select_c, 0, 0, 1)
+QPE_KERNEL(select_mc, 1, 0, 1)
+QPE_KERNEL(select_yc, 0, 1, 1)
+QPE_KERNEL(select_myc, 1, 1, 1)
+
+/*
+Name: kernel_select():
+Parameters: const ScanKernel *k, const CarInventory *rows, size_t begin,
+            size_t end, uint32_t *sel
+Return: size_t
+Description:
+
+Writes to sel the offsets from begin of the rows in [begin, end) that match
+k, in row order, and returns how many there are. sel must hold end - begin
+entries.
+*/
+size_t kernel_select(const ScanKernel *k, const CarInventory *rows,
+                     size_t begin, size_t end, uint32_t *sel) {
+  switch (k->shape) {
+  case KERNEL_MODEL:
+    return select_m(k, rows, begin, end, sel);
+  case KERNEL_YEAR:
+    return select_y(k, rows, begin, end, sel);
+  case KERNEL_MODEL | KERNEL_YEAR:
+    return select_my(k, rows, begin, end, sel);
+  case KERNEL_COLORS:
+    return select_c(k, rows, begin, end, sel);
+  case KERNEL_MODEL | KERNEL_COLORS:
+    return select_mc(k, rows, begin, end, sel);
+  case KERNEL_YEAR | KERNEL_COLORS:
+    return select_yc(k, rows, begin, end, sel);
+  case KERNEL_MODEL | KERNEL_YEAR | KERNEL_COLORS:
+    return select_myc(k, rows, begin, end, sel);
+  default:
+    return 0;
+  }
+}
+
+/*
+Name: kernel_scan():
+Parameters: const ScanKernel *k, const CarInventory *rows, size_t begin,
+            size_t end, const Query *q, Buffer *out
+Return: bool
+Description:
+
+Appends q's projection of every row in [begin, end) that matches k to out,
+in row order, QPE_KERNEL_BLOCK rows per kernel_select(). Returns false when
+out could not grow.
+*/
+bool kernel_scan(const ScanKernel *k, const CarInventory *rows, size_t begin,
+                 size_t end, const Query *q, Buffer *out) {
+  uint32_t sel[QPE_KERNEL_BLOCK];
+
+  for (size_t lo = begin; lo < end; lo += QPE_KERNEL_BLOCK) {
+    size_t hi = end - lo < QPE_KERNEL_BLOCK ? end : lo + QPE_KERNEL_BLOCK;
+    size_t n = kernel_select(k, rows, lo, hi, sel);
+
+    for (size_t j = 0; j < n; j++) {
+      if (!append_selected(&rows[lo + sel[j]], q, out)) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
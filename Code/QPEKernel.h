@@ -0,0 +1,63 @@
+/*
+
+QPEKernel.h
+
+Specialized row-layout scan kernels for the WHERE clauses the workload is
+made of (see QPEKernel.c). kernel_compile() recognizes a compiled Predicate
+that is a conjunction of at most one of each of
+
+- Model = "literal"
+- YearMake = integer
+- Color = "a" OR Color = "b" OR ...  (a Color IN set of up to
+  QPE_KERNEL_MAX_COLORS values, or a single Color =)
+
+in any order and nesting of the ANDs, such as every query of db/sql.txt.
+Each of the seven combinations has its own loop generated from one macro,
+with the columns, the types and the = operators fixed, so a row is tested
+without walking the predicate tree and without a call per row. Any other
+clause leaves the kernel empty and the scan falls back to match_where().
+
+*/
+
+#ifndef QPE_KERNEL_H
+#define QPE_KERNEL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "QPEBuffer.h"
+#include "QPEQuery.h"
+
+#define QPE_KERNEL_MAX_COLORS 8
+
+/* Rows per kernel_select() call in kernel_scan(). */
+#define QPE_KERNEL_BLOCK 1024
+
+/*
+Struct Definitions
+*/
+typedef enum {
+  KERNEL_MODEL = 1,
+  KERNEL_YEAR = 2,
+  KERNEL_COLORS = 4
+} KernelTerm;
+
+typedef struct {
+  int shape; /* KernelTerm bits present, 0 when no kernel fits */
+  int year;
+  int num_colors;
+  char model[20]; /* literals lower-cased, compared ignoring case */
+  char colors[QPE_KERNEL_MAX_COLORS][20];
+} ScanKernel;
+
+/*
+Function Prototypes
+*/
+bool kernel_compile(ScanKernel *k, const Predicate *pred);
+size_t kernel_select(const ScanKernel *k, const CarInventory *rows,
+                     size_t begin, size_t end, uint32_t *sel);
+bool kernel_scan(const ScanKernel *k, const CarInventory *rows, size_t begin,
+                 size_t end, const Query *q, Buffer *out);
+
+#endif
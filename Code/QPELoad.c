@@ -0,0 +1,1014 @@
+/*
+
+QPELoad.c
+
+Authors:
+    Aidan Levy
+    Maddie Powell
+    Nick Corcoran
+    Austin Phalines
+    Dean Bullock
+
+Creation Date: 10-14-2026
+
+Description:
+
+Memory-mapped, chunk-parallel loader for db.txt (see QPELoad.h). After the
+header line the data is cut at newlines into chunks that are tokenized
+independently; a chunk that ends in the middle of a record (a record split
+over lines) is re-read together with the rest of the file, so the records are
+exactly those the old fscanf() loop returned. The first malformed record
+stops the load with the usual warning and everything before it is kept.
+
+dataGen writes IDs in ascending order, so the parsed array normally is the
+final table. Otherwise it is sorted by ID and duplicates are resolved the way
+btree_set() resolved them.
+
+Files written by save_table_binary() skip all of that: load_table() checks
+the header and hands out pointers into the mapping.
+
+load_table_tail() picks up where a text load stopped. It trusts the file to
+be append-only between calls: only its size, inode and modification time are
+compared, the bytes before the tail are never read again.
+
+*/
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "QPELoad.h"
+
+/* fgets() buffer the old loaders read the header line into. */
+#define QPE_LOAD_HEADER_MAX 256
+/* Smallest chunk worth handing to a separate thread. */
+#define QPE_LOAD_MIN_CHUNK (1u << 20)
+
+/*
+Struct Definitions
+*/
+typedef struct {
+  const char *begin;
+  const char *end;
+  CarInventory *rows;
+  size_t count;
+  size_t cap;
+  ChunkStatus status;
+} LoadChunk;
+
+typedef struct {
+  int id;
+  size_t pos; /* position in file order */
+} IdPos;
+
+/*
+Function Prototypes
+*/
+static double now_seconds(void);
+static int is_space(char c);
+static const char *skip_space(const char *p, const char *end);
+static int parse_int(const char **pp, const char *end, int *out);
+static int parse_token(const char **pp, const char *end, char *out);
+static int parse_record(const char **pp, const char *end, CarInventory *car,
+                        bool *at_end);
+static void parse_chunk(LoadChunk *chunk);
+static int compare_id_pos(const void *a, const void *b);
+static bool dedup_rows(CarInventory *rows, size_t count, TableStats *stats,
+                       LoadedTable *out);
+static bool map_file(const char *filename, char **map, size_t *bytes,
+                     bool *mapped, struct stat *st);
+static void unmap_file(char *map, size_t bytes, bool mapped);
+static bool load_text(const char *filename, const char *map, size_t bytes,
+                      TableStats *stats, LoadedTable *out);
+static void describe_columns(BinaryColumn *columns);
+static size_t align_up(size_t n);
+static void note_file(LoadedTable *table, const struct stat *st);
+static bool same_version(const LoadedTable *table, const struct stat *st);
+static bool grow_rows(LoadedTable *table, size_t extra);
+static bool read_tail(const char *filename, size_t offset, char *data,
+                      size_t len);
+
+/*
+Name: now_seconds():
+Parameters: none
+Return: double
+Description:
+
+Monotonic wall clock in seconds, used to time the load.
+*/
+static double now_seconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+/*
+Name: is_space():
+Parameters: char c
+Return: int
+Description:
+
+isspace() for the "C" locale without the locale table lookup.
+*/
+static int is_space(char c) {
+  return c == ' ' || c == '\n' || c == '\t' || c == '\r' || c == '\v' ||
+         c == '\f';
+}
+
+/*
+Name: skip_space():
+Parameters: const char *p, const char *end
+Return: const char *
+Description:
+
+Returns the first non-whitespace position in [p, end), or end.
+*/
+static const char *skip_space(const char *p, const char *end) {
+  while (p < end && is_space(*p)) {
+    p++;
+  }
+  return p;
+}
+
+/*
+Name: parse_int():
+Parameters: const char **pp, const char *end, int *out
+Return: int
+Description:
+
+Reads one %d field: optional sign, then decimal digits up to the first
+non-digit. Returns 1 on success, 0 on a matching failure and -1 when the input
+ends before the field starts.
+*/
+static int parse_int(const char **pp, const char *end, int *out) {
+  const char *p = skip_space(*pp, end);
+  unsigned int value = 0;
+  int negative = 0;
+  const char *digits;
+
+  if (p == end) {
+    *pp = p;
+    return -1;
+  }
+  if (*p == '-' || *p == '+') {
+    negative = *p == '-';
+    p++;
+  }
+  digits = p;
+  while (p < end && *p >= '0' && *p <= '9') {
+    value = value * 10u + (unsigned int)(*p - '0');
+    p++;
+  }
+  *pp = p;
+  if (p == digits) {
+    return 0;
+  }
+  *out = (int)(negative ? 0u - value : value);
+  return 1;
+}
+
+/*
+Name: parse_token():
+Parameters: const char **pp, const char *end, char *out
+Return: int
+Description:
+
+Reads one %19s field: up to 19 non-whitespace characters, NUL-terminated into
+out. A longer word is left to the next field, as scanf() leaves it. Returns 1
+on success and -1 when the input ends before the field starts.
+*/
+static int parse_token(const char **pp, const char *end, char *out) {
+  const char *p = skip_space(*pp, end);
+  int len = 0;
+
+  if (p == end) {
+    *pp = p;
+    return -1;
+  }
+  while (p < end && len < 19 && !is_space(*p)) {
+    out[len++] = *p++;
+  }
+  out[len] = '\0';
+  *pp = p;
+  return 1;
+}
+
+/*
+Name: parse_record():
+Parameters: const char **pp, const char *end, CarInventory *car,
+            bool *at_end
+Return: int
+Description:
+
+Parses "ID Model YearMake Color Price Dealer" from *pp the way fscanf() with
+"%d %19s %d %19s %d %19s" would: returns EOF when only whitespace remains,
+otherwise the number of fields converted. *at_end is set when a short count
+is due to the input running out rather than a field that does not match.
+*/
+static int parse_record(const char **pp, const char *end, CarInventory *car,
+                        bool *at_end) {
+  int r = 1;
+  int n = 0;
+
+  *at_end = false;
+  if (skip_space(*pp, end) == end) {
+    *pp = end;
+    return EOF;
+  }
+  while (n < 6 && r == 1) {
+    switch (n) {
+    case 0:
+      r = parse_int(pp, end, &car->ID);
+      break;
+    case 1:
+      r = parse_token(pp, end, car->Model);
+      break;
+    case 2:
+      r = parse_int(pp, end, &car->YearMake);
+      break;
+    case 3:
+      r = parse_token(pp, end, car->Color);
+      break;
+    case 4:
+      r = parse_int(pp, end, &car->Price);
+      break;
+    default:
+      r = parse_token(pp, end, car->Dealer);
+      break;
+    }
+    if (r == 1) {
+      n++;
+    }
+  }
+  *at_end = r < 0;
+  return n;
+}
+
+/*
+Name: parse_chunk():
+Parameters: LoadChunk *chunk
+Return: void
+Description:
+
+Parses every record in [chunk->begin, chunk->end) into chunk->rows and sets
+chunk->status to how the chunk ended.
+*/
+static void parse_chunk(LoadChunk *chunk) {
+  const char *p = chunk->begin;
+  CarInventory car;
+
+  chunk->count = 0;
+  chunk->cap = (size_t)(chunk->end - chunk->begin) / 32 + 16;
+  chunk->rows = malloc(chunk->cap * sizeof(CarInventory));
+  if (chunk->rows == NULL) {
+    chunk->status = CHUNK_NOMEM;
+    return;
+  }
+
+  while (1) {
+    bool at_end;
+    int scanned = parse_record(&p, chunk->end, &car, &at_end);
+
+    if (scanned == EOF) {
+      chunk->status = CHUNK_CLEAN;
+      return;
+    }
+    if (scanned != 6) {
+      chunk->status = at_end ? CHUNK_SPLIT : CHUNK_MALFORMED;
+      return;
+    }
+    if (chunk->count == chunk->cap) {
+      CarInventory *grown =
+          realloc(chunk->rows, 2 * chunk->cap * sizeof(CarInventory));
+      if (grown == NULL) {
+        chunk->status = CHUNK_NOMEM;
+        return;
+      }
+      chunk->rows = grown;
+      chunk->cap *= 2;
+    }
+    chunk->rows[chunk->count++] = car;
+  }
+}
+
+/*
+Name: parse_text_slice():
+Parameters: const char *begin, const char *end, CarInventory **rows,
+            size_t *count
+Return: ChunkStatus
+Description:
+
+Parses the records in [begin, end), which must start at a record boundary,
+into a malloc'd array returned through rows and count (the caller frees it,
+also on failure). Lets qpe_mpi parse the slice of the file each rank read.
+*/
+ChunkStatus parse_text_slice(const char *begin, const char *end,
+                             CarInventory **rows, size_t *count) {
+  LoadChunk chunk = {.begin = begin, .end = end};
+
+  parse_chunk(&chunk);
+  *rows = chunk.rows;
+  *count = chunk.count;
+  return chunk.status;
+}
+
+/*
+Name: text_header_length():
+Parameters: const char *data, size_t bytes
+Return: size_t
+Description:
+
+Length of the header line at the start of a text database, by the rule of
+the fgets() into a 256 byte buffer the loaders used to read it with: through
+the first newline, but at most 255 bytes.
+*/
+size_t text_header_length(const char *data, size_t bytes) {
+  size_t n = 0;
+
+  while (n < bytes && n < QPE_LOAD_HEADER_MAX - 1) {
+    if (data[n++] == '\n') {
+      break;
+    }
+  }
+  return n;
+}
+
+/*
+Name: compare_id_pos():
+Parameters: const void *a, const void *b
+Return: int
+Description:
+
+qsort() comparator ordering records by ID, then by position in the file.
+*/
+static int compare_id_pos(const void *a, const void *b) {
+  const IdPos *x = (const IdPos *)a;
+  const IdPos *y = (const IdPos *)b;
+
+  if (x->id != y->id) {
+    return (x->id > y->id) - (x->id < y->id);
+  }
+  return (x->pos > y->pos) - (x->pos < y->pos);
+}
+
+/*
+Name: dedup_rows():
+Parameters: CarInventory *rows, size_t count, TableStats *stats,
+            LoadedTable *out
+Return: bool
+Description:
+
+Builds out->rows from file-ordered rows that are not strictly ascending by
+ID: one record per ID in ID order, the last occurrence winning, while stats
+receives the first occurrence of every ID in file order. Takes ownership of
+rows. Returns false when out of memory.
+*/
+static bool dedup_rows(CarInventory *rows, size_t count, TableStats *stats,
+                       LoadedTable *out) {
+  IdPos *order = malloc((count > 0 ? count : 1) * sizeof(IdPos));
+  unsigned char *first = calloc(count > 0 ? count : 1, 1);
+  CarInventory *sorted = malloc((count > 0 ? count : 1) * sizeof(CarInventory));
+  size_t n = 0;
+
+  if (order == NULL || first == NULL || sorted == NULL) {
+    free(order);
+    free(first);
+    free(sorted);
+    free(rows);
+    return false;
+  }
+  for (size_t i = 0; i < count; i++) {
+    order[i].id = rows[i].ID;
+    order[i].pos = i;
+  }
+  qsort(order, count, sizeof(IdPos), compare_id_pos);
+
+  for (size_t i = 0; i < count; i++) {
+    if (i == 0 || order[i].id != order[i - 1].id) {
+      first[order[i].pos] = 1;
+    }
+    if (i + 1 == count || order[i + 1].id != order[i].id) {
+      sorted[n++] = rows[order[i].pos];
+    }
+  }
+  for (size_t i = 0; i < count; i++) {
+    if (first[i]) {
+      stats_add(stats, &rows[i]);
+    }
+  }
+
+  free(order);
+  free(first);
+  free(rows);
+  out->rows = sorted;
+  out->storage = sorted;
+  out->count = n;
+  return true;
+}
+
+/*
+Name: map_file():
+Parameters: const char *filename, char **map, size_t *bytes, bool *mapped,
+            struct stat *st
+Return: bool
+Description:
+
+Maps the whole file read-only, or reads it into a malloc'd buffer when it
+cannot be mapped (a pipe, say), and fills st from the open file. *map is
+NULL for an empty file. Prints an error and returns false when the file
+cannot be opened or read.
+*/
+static bool map_file(const char *filename, char **map, size_t *bytes,
+                     bool *mapped, struct stat *st) {
+  int fd;
+
+  *map = NULL;
+  *bytes = 0;
+  *mapped = false;
+  fd = open(filename, O_RDONLY);
+  if (fd < 0) {
+    perror("open");
+    return false;
+  }
+  if (fstat(fd, st) != 0) {
+    perror("fstat");
+    close(fd);
+    return false;
+  }
+  *bytes = (size_t)st->st_size;
+
+  if (*bytes > 0) {
+    *map = mmap(NULL, *bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (*map != MAP_FAILED) {
+      *mapped = true;
+      madvise(*map, *bytes, MADV_SEQUENTIAL);
+    } else {
+      size_t got = 0;
+      *map = malloc(*bytes);
+      if (*map == NULL) {
+        fprintf(stderr, "Error: Out of memory loading %s\n", filename);
+        close(fd);
+        return false;
+      }
+      while (got < *bytes) {
+        ssize_t r = read(fd, *map + got, *bytes - got);
+        if (r <= 0) {
+          break;
+        }
+        got += (size_t)r;
+      }
+      *bytes = got;
+    }
+  }
+  close(fd);
+  return true;
+}
+
+/*
+Name: unmap_file():
+Parameters: char *map, size_t bytes, bool mapped
+Return: void
+Description:
+
+Releases what map_file() returned.
+*/
+static void unmap_file(char *map, size_t bytes, bool mapped) {
+  if (mapped) {
+    munmap(map, bytes);
+  } else {
+    free(map);
+  }
+}
+
+/*
+Name: load_text():
+Parameters: const char *filename, const char *map, size_t bytes,
+            TableStats *stats, LoadedTable *out
+Return: bool
+Description:
+
+Parses a text database held in map[0..bytes) into out->rows and fills stats.
+Prints the malformed-line warning if parsing stops early, and an error before
+returning false when there is no header line or memory runs out. out->tail
+is set to bytes when every record parsed and the file ends with a newline,
+so that what is appended later starts on a fresh line.
+*/
+static bool load_text(const char *filename, const char *map, size_t bytes,
+                      TableStats *stats, LoadedTable *out) {
+  const char *data = map;
+  const char *end = map + bytes;
+  const char *p;
+  LoadChunk *chunks;
+  int num_chunks = 1;
+  int last = 0;
+  size_t total = 0;
+  bool ok = true;
+  CarInventory *rows;
+
+  if (bytes == 0) {
+    fprintf(stderr, "Error: Failed to read header from %s\n", filename);
+    return false;
+  }
+  data += text_header_length(map, bytes);
+
+#ifdef _OPENMP
+  num_chunks = omp_get_max_threads() * 4;
+  if ((size_t)(end - data) / QPE_LOAD_MIN_CHUNK < (size_t)num_chunks) {
+    num_chunks = (int)((size_t)(end - data) / QPE_LOAD_MIN_CHUNK) + 1;
+  }
+#endif
+  chunks = calloc((size_t)num_chunks, sizeof(LoadChunk));
+  if (chunks == NULL) {
+    fprintf(stderr, "Error: Out of memory loading %s\n", filename);
+    return false;
+  }
+  p = data;
+  for (int c = 0; c < num_chunks; c++) {
+    const char *cut = data + (size_t)(end - data) / (size_t)num_chunks *
+                                 (size_t)(c + 1);
+    if (c == num_chunks - 1) {
+      cut = end;
+    } else if (cut < p) {
+      cut = p;
+    }
+    while (cut < end && cut[-1] != '\n') {
+      cut++;
+    }
+    chunks[c].begin = p;
+    chunks[c].end = cut;
+    p = cut;
+  }
+
+  /* Parallel Section: chunks are independent, each parses into its own rows.
+   */
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic, 1)
+#endif
+  for (int c = 0; c < num_chunks; c++) {
+    parse_chunk(&chunks[c]);
+  }
+
+  /* Keep chunks up to the first one that did not end cleanly. A record split
+   * across a chunk end is resolved by parsing the rest of the file whole. */
+  for (last = 0; last < num_chunks; last++) {
+    LoadChunk *chunk = &chunks[last];
+    if (chunk->status == CHUNK_SPLIT && chunk->end != end) {
+      free(chunk->rows);
+      chunk->end = end;
+      parse_chunk(chunk);
+    }
+    total += chunk->count;
+    if (chunk->status != CHUNK_CLEAN || chunk->end == end) {
+      break;
+    }
+  }
+  if (chunks[last].status == CHUNK_NOMEM) {
+    ok = false;
+  } else if (chunks[last].status != CHUNK_CLEAN) {
+    fprintf(stderr, "Warning: Malformed line encountered in %s\n", filename);
+  } else if (map[bytes - 1] == '\n') {
+    out->tail = bytes;
+  }
+
+  rows = ok ? malloc((total > 0 ? total : 1) * sizeof(CarInventory)) : NULL;
+  if (rows != NULL) {
+    size_t n = 0;
+    for (int c = 0; c <= last; c++) {
+      memcpy(rows + n, chunks[c].rows, chunks[c].count * sizeof(CarInventory));
+      n += chunks[c].count;
+    }
+  }
+  for (int c = 0; c < num_chunks; c++) {
+    free(chunks[c].rows);
+  }
+  free(chunks);
+  if (rows == NULL) {
+    fprintf(stderr, "Error: Out of memory loading %s\n", filename);
+    return false;
+  }
+
+  for (size_t i = 1; i < total && ok; i++) {
+    ok = rows[i - 1].ID < rows[i].ID;
+  }
+  if (ok) {
+    for (size_t i = 0; i < total; i++) {
+      stats_add(stats, &rows[i]);
+    }
+    out->rows = rows;
+    out->storage = rows;
+    out->count = total;
+  } else if (!dedup_rows(rows, total, stats, out)) {
+    fprintf(stderr, "Error: Out of memory loading %s\n", filename);
+    return false;
+  }
+  out->cap = out->count;
+  stats_finish(stats);
+  return true;
+}
+
+/*
+Name: describe_columns():
+Parameters: BinaryColumn *columns
+Return: void
+Description:
+
+Fills the QPE_BIN_COLUMNS schema entries for this build's CarInventory.
+*/
+static void describe_columns(BinaryColumn *columns) {
+  static const struct {
+    const char *name;
+    BinaryColumnType type;
+    size_t offset;
+  } schema[QPE_BIN_COLUMNS] = {
+      {"ID", BIN_COLUMN_INT32, offsetof(CarInventory, ID)},
+      {"Model", BIN_COLUMN_STR20, offsetof(CarInventory, Model)},
+      {"YearMake", BIN_COLUMN_INT32, offsetof(CarInventory, YearMake)},
+      {"Color", BIN_COLUMN_STR20, offsetof(CarInventory, Color)},
+      {"Price", BIN_COLUMN_INT32, offsetof(CarInventory, Price)},
+      {"Dealer", BIN_COLUMN_STR20, offsetof(CarInventory, Dealer)},
+  };
+
+  memset(columns, 0, QPE_BIN_COLUMNS * sizeof(BinaryColumn));
+  for (int c = 0; c < QPE_BIN_COLUMNS; c++) {
+    strcpy(columns[c].name, schema[c].name);
+    columns[c].type = schema[c].type;
+    columns[c].offset = (uint32_t)schema[c].offset;
+    columns[c].size = schema[c].type == BIN_COLUMN_INT32 ? 4 : 20;
+  }
+}
+
+/*
+Name: align_up():
+Parameters: size_t n
+Return: size_t
+Description:
+
+Rounds n up to the next multiple of QPE_BIN_ALIGN.
+*/
+static size_t align_up(size_t n) {
+  return (n + QPE_BIN_ALIGN - 1) / QPE_BIN_ALIGN * QPE_BIN_ALIGN;
+}
+
+/*
+Name: read_binary_header():
+Parameters: const char *filename, const void *data, size_t bytes,
+            BinaryHeader *header
+Return: bool
+Description:
+
+Copies the header of a db_convert file of the given size out of data and
+checks it against this build: version, byte order, struct sizes, schema, and
+that the sections fit inside the file. Prints an error and returns false if
+the file cannot be used.
+*/
+bool read_binary_header(const char *filename, const void *data, size_t bytes,
+                        BinaryHeader *header) {
+  BinaryColumn columns[QPE_BIN_COLUMNS];
+
+  memcpy(header, data, sizeof(*header));
+  describe_columns(columns);
+  if (header->version != QPE_BIN_VERSION ||
+      header->byte_order != QPE_BIN_BYTE_ORDER ||
+      header->header_size != sizeof(BinaryHeader) ||
+      header->row_size != sizeof(CarInventory) ||
+      header->num_columns != QPE_BIN_COLUMNS ||
+      header->stats_size != sizeof(TableStats) ||
+      memcmp(header->columns, columns, sizeof(columns)) != 0) {
+    fprintf(stderr,
+            "Error: %s is a version %u binary database this build cannot "
+            "read; rerun db_convert\n",
+            filename, header->version);
+    return false;
+  }
+  if (header->stats_offset % QPE_BIN_ALIGN != 0 ||
+      header->rows_offset % QPE_BIN_ALIGN != 0 ||
+      header->stats_offset + sizeof(TableStats) > bytes ||
+      header->rows_offset > bytes ||
+      header->row_count >
+          (bytes - header->rows_offset) / sizeof(CarInventory)) {
+    fprintf(stderr, "Error: %s is truncated or corrupt\n", filename);
+    return false;
+  }
+  return true;
+}
+
+/*
+Name: load_table():
+Parameters: const char *filename, TableStats *stats, LoadedTable *out
+Return: bool
+Description:
+
+Loads the database file into out (rows in ascending ID order) and fills stats
+for the query planner. A file that starts with QPE_BIN_MAGIC is used in place
+from its mapping; anything else is parsed as text. Prints an error before
+returning false when the file cannot be read or memory runs out.
+*/
+bool load_table(const char *filename, TableStats *stats, LoadedTable *out) {
+  double start = now_seconds();
+  BinaryHeader header;
+  struct stat st;
+  char *map;
+  size_t bytes;
+  bool mapped;
+  bool ok;
+
+  memset(out, 0, sizeof(*out));
+  stats_init(stats);
+  if (!map_file(filename, &map, &bytes, &mapped, &st)) {
+    return false;
+  }
+  out->bytes = bytes;
+  note_file(out, &st);
+
+  if (bytes >= sizeof(BinaryHeader) &&
+      memcmp(map, QPE_BIN_MAGIC, sizeof(QPE_BIN_MAGIC)) == 0) {
+    ok = read_binary_header(filename, map, bytes, &header);
+    if (ok) {
+      memcpy(stats, map + header.stats_offset, sizeof(TableStats));
+      out->rows = (const CarInventory *)(map + header.rows_offset);
+      out->count = (size_t)header.row_count;
+      out->binary = true;
+      out->storage = map;
+      out->mapped = mapped ? bytes : 0;
+    } else {
+      unmap_file(map, bytes, mapped);
+    }
+  } else {
+    ok = load_text(filename, map, bytes, stats, out);
+    unmap_file(map, bytes, mapped);
+    if (!S_ISREG(st.st_mode) || bytes != (size_t)st.st_size) {
+      out->tail = 0;
+    }
+  }
+
+  out->seconds = now_seconds() - start;
+  return ok;
+}
+
+/*
+Name: note_file():
+Parameters: LoadedTable *table, const struct stat *st
+Return: void
+Description:
+
+Records which version of the database file table now holds.
+*/
+static void note_file(LoadedTable *table, const struct stat *st) {
+  table->device = (unsigned long long)st->st_dev;
+  table->inode = (unsigned long long)st->st_ino;
+  table->mtime = st->st_mtim;
+}
+
+/*
+Name: same_version():
+Parameters: const LoadedTable *table, const struct stat *st
+Return: bool
+Description:
+
+Whether st describes the file version table was loaded from: the same file,
+size and modification time.
+*/
+static bool same_version(const LoadedTable *table, const struct stat *st) {
+  return table->device == (unsigned long long)st->st_dev &&
+         table->inode == (unsigned long long)st->st_ino &&
+         table->bytes == (size_t)st->st_size &&
+         table->mtime.tv_sec == st->st_mtim.tv_sec &&
+         table->mtime.tv_nsec == st->st_mtim.tv_nsec;
+}
+
+/*
+Name: grow_rows():
+Parameters: LoadedTable *table, size_t extra
+Return: bool
+Description:
+
+Makes room for extra more rows in table's malloc'd storage, doubling it as
+required so a run of small appends copies the table only a few times.
+Returns false when out of memory; the rows are then left as they were.
+*/
+static bool grow_rows(LoadedTable *table, size_t extra) {
+  size_t needed = table->count + extra;
+  size_t cap = table->cap > 0 ? table->cap : 1024;
+  CarInventory *grown;
+
+  if (needed <= table->cap) {
+    return true;
+  }
+  while (cap < needed) {
+    cap *= 2;
+  }
+  grown = realloc(table->storage, cap * sizeof(CarInventory));
+  if (grown == NULL) {
+    return false;
+  }
+  table->storage = grown;
+  table->rows = grown;
+  table->cap = cap;
+  return true;
+}
+
+/*
+Name: read_tail():
+Parameters: const char *filename, size_t offset, char *data, size_t len
+Return: bool
+Description:
+
+Reads len bytes of filename from offset into data with pread(). Returns
+false if the file cannot be read or has fewer bytes than that by now.
+*/
+static bool read_tail(const char *filename, size_t offset, char *data,
+                      size_t len) {
+  size_t got = 0;
+  int fd = open(filename, O_RDONLY);
+
+  if (fd < 0) {
+    return false;
+  }
+  while (got < len) {
+    ssize_t r = pread(fd, data + got, len - got, (off_t)(offset + got));
+    if (r <= 0) {
+      break;
+    }
+    got += (size_t)r;
+  }
+  close(fd);
+  return got == len;
+}
+
+/*
+Name: load_table_tail():
+Parameters: const char *filename, TableStats *stats, LoadedTable *table,
+            size_t *added
+Return: TailStatus
+Description:
+
+Brings table, loaded from filename by load_table(), up to date with what has
+been appended to the file since, reading only the new bytes. When the file
+grew, is the same file, and the new bytes are complete lines of records
+whose IDs ascend past the last loaded one, their rows are appended to table
+(table->rows may move) and to stats, *added is set to their number and
+TAIL_APPENDED returned. TAIL_UNCHANGED means there is nothing to add yet:
+the file is as loaded or its last line is still being written. TAIL_RELOAD
+means anything else (the file was replaced, truncated or rewritten, is
+binary, or its tail does not load cleanly, or memory ran out) and table is
+untouched; only a full load_table() gives the file's contents then.
+*/
+TailStatus load_table_tail(const char *filename, TableStats *stats,
+                           LoadedTable *table, size_t *added) {
+  struct stat st;
+  CarInventory *rows = NULL;
+  size_t count = 0;
+  size_t len;
+  char *data;
+  bool have_last;
+  int last_id;
+  bool ok;
+
+  *added = 0;
+  if (stat(filename, &st) != 0) {
+    return TAIL_RELOAD;
+  }
+  if (same_version(table, &st)) {
+    return TAIL_UNCHANGED;
+  }
+  if (table->tail == 0 || table->tail != table->bytes ||
+      !S_ISREG(st.st_mode) ||
+      table->device != (unsigned long long)st.st_dev ||
+      table->inode != (unsigned long long)st.st_ino ||
+      (size_t)st.st_size <= table->tail) {
+    return TAIL_RELOAD;
+  }
+
+  len = (size_t)st.st_size - table->tail;
+  data = malloc(len);
+  if (data == NULL || !read_tail(filename, table->tail, data, len)) {
+    free(data);
+    return TAIL_RELOAD;
+  }
+  if (data[len - 1] != '\n') {
+    free(data);
+    return TAIL_UNCHANGED;
+  }
+  ok = parse_text_slice(data, data + len, &rows, &count) == CHUNK_CLEAN;
+  free(data);
+  have_last = table->count > 0;
+  last_id = have_last ? table->rows[table->count - 1].ID : 0;
+  for (size_t i = 0; i < count && ok; i++) {
+    ok = !have_last || rows[i].ID > last_id;
+    have_last = true;
+    last_id = rows[i].ID;
+  }
+  if (!ok || !grow_rows(table, count)) {
+    free(rows);
+    return TAIL_RELOAD;
+  }
+
+  memcpy((CarInventory *)table->storage + table->count, rows,
+         count * sizeof(CarInventory));
+  for (size_t i = 0; i < count; i++) {
+    stats_add(stats, &rows[i]);
+  }
+  stats_finish(stats);
+  free(rows);
+  table->count += count;
+  table->bytes = (size_t)st.st_size;
+  table->tail = table->bytes;
+  note_file(table, &st);
+  *added = count;
+  return TAIL_APPENDED;
+}
+
+/*
+Name: save_table_binary():
+Parameters: const char *filename, const LoadedTable *table,
+            const TableStats *stats
+Return: bool
+Description:
+
+Writes table and its finished stats to filename in the binary format
+load_table() maps in place. Prints an error and returns false on failure.
+*/
+bool save_table_binary(const char *filename, const LoadedTable *table,
+                       const TableStats *stats) {
+  static const char zeros[QPE_BIN_ALIGN];
+  BinaryHeader header;
+  size_t stats_end;
+  FILE *fp;
+  bool ok;
+
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, QPE_BIN_MAGIC, sizeof(QPE_BIN_MAGIC));
+  header.version = QPE_BIN_VERSION;
+  header.byte_order = QPE_BIN_BYTE_ORDER;
+  header.header_size = sizeof(BinaryHeader);
+  header.row_size = sizeof(CarInventory);
+  header.num_columns = QPE_BIN_COLUMNS;
+  header.stats_size = sizeof(TableStats);
+  header.row_count = table->count;
+  header.stats_offset = align_up(sizeof(BinaryHeader));
+  stats_end = (size_t)header.stats_offset + sizeof(TableStats);
+  header.rows_offset = align_up(stats_end);
+  describe_columns(header.columns);
+
+  fp = fopen(filename, "wb");
+  if (fp == NULL) {
+    perror("fopen");
+    return false;
+  }
+  ok = fwrite(&header, sizeof(header), 1, fp) == 1 &&
+       fwrite(zeros, 1, header.stats_offset - sizeof(header), fp) ==
+           header.stats_offset - sizeof(header) &&
+       fwrite(stats, sizeof(TableStats), 1, fp) == 1 &&
+       fwrite(zeros, 1, header.rows_offset - stats_end, fp) ==
+           header.rows_offset - stats_end &&
+       fwrite(table->rows, sizeof(CarInventory), table->count, fp) ==
+           table->count;
+  if (fclose(fp) != 0 || !ok) {
+    fprintf(stderr, "Error: Failed to write %s\n", filename);
+    return false;
+  }
+  return true;
+}
+
+/*
+Name: loaded_table_free():
+Parameters: LoadedTable *table
+Return: void
+Description:
+
+Releases the rows returned by load_table(), unmapping a binary file.
+*/
+void loaded_table_free(LoadedTable *table) {
+  if (table->mapped > 0) {
+    munmap(table->storage, table->mapped);
+  } else {
+    free(table->storage);
+  }
+  table->storage = NULL;
+  table->rows = NULL;
+  table->count = 0;
+}
+
+/*
+Name: load_throughput():
+Parameters: const LoadedTable *table
+Return: double
+Description:
+
+Load rate in MB/s (10^6 bytes) of file read and parsed per second.
+*/
+double load_throughput(const LoadedTable *table) {
+  if (table->seconds <= 0.0) {
+    return 0.0;
+  }
+  return (double)table->bytes / 1e6 / table->seconds;
+}
@@ -0,0 +1,125 @@
+/*
+
+QPELoad.h
+
+Fast loader for the flat-file inventory database (db.txt). The file is
+mapped with mmap(), cut into newline-aligned chunks, and each chunk is parsed
+by a hand-written tokenizer that follows the old fscanf("%d %19s %d %19s %d
+%19s") rules without scanf or locale lookups. With OpenMP (qpe_omp) the chunks
+are parsed in parallel; the other programs parse them in turn.
+
+The result is an array in ascending ID order with one record per ID, the last
+occurrence winning as btree_set() did, so callers can bulk-build the B-tree
+or column store from it directly. Statistics are gathered in file order from
+the first occurrence of every ID, exactly as the old insert loop did.
+
+load_table() also accepts the binary format written by db_convert
+(Code/dbConvert.c), recognized by its magic number whatever the file is
+called. A binary file holds a BinaryHeader, the finished TableStats and the
+deduplicated, ID-ordered CarInventory rows, each section aligned to
+QPE_BIN_ALIGN bytes:
+
+    [BinaryHeader][pad][TableStats][pad][CarInventory x row_count]
+
+Such a file is mapped and used in place: the rows point into the mapping and
+the statistics need no pass over the data. The header records the byte order,
+the struct sizes and every column's offset, so a file written by an
+incompatible build is rejected rather than misread; bump QPE_BIN_VERSION
+whenever CarInventory or TableStats change.
+
+A text file that ends with a complete line can be followed as it grows:
+load_table_tail() reads only the bytes appended since the last load and, as
+long as they hold new IDs above every loaded one, appends their rows to the
+table and the statistics (see the --serve refresh in QPERefresh.h). Any other
+change, or a binary file, needs a full load_table().
+
+*/
+
+#ifndef QPE_LOAD_H
+#define QPE_LOAD_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "QPEQuery.h"
+#include "QPEStats.h"
+
+#define QPE_BIN_MAGIC "QPEDBIN" /* 8 bytes with the NUL */
+#define QPE_BIN_VERSION 1
+#define QPE_BIN_BYTE_ORDER 0x01020304u
+#define QPE_BIN_ALIGN 64
+#define QPE_BIN_COLUMNS 6
+
+/*
+Struct Definitions
+*/
+typedef enum {
+  CHUNK_CLEAN,     /* every record in the chunk parsed */
+  CHUNK_MALFORMED, /* a record failed to parse; rows before it are kept */
+  CHUNK_SPLIT,     /* the last record continues past the chunk end */
+  CHUNK_NOMEM
+} ChunkStatus;
+
+typedef enum {
+  TAIL_UNCHANGED, /* nothing to load, or the last appended line is unfinished */
+  TAIL_APPENDED,  /* new rows were added at the end of the table */
+  TAIL_RELOAD     /* the file changed in a way only load_table() can follow */
+} TailStatus;
+
+typedef enum { BIN_COLUMN_INT32, BIN_COLUMN_STR20 } BinaryColumnType;
+
+typedef struct {
+  char name[20];
+  uint32_t type;   /* BinaryColumnType */
+  uint32_t offset; /* byte offset inside a packed row */
+  uint32_t size;
+} BinaryColumn;
+
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t byte_order; /* QPE_BIN_BYTE_ORDER as the writer stored it */
+  uint32_t header_size;
+  uint32_t row_size;
+  uint32_t num_columns;
+  uint32_t stats_size;
+  uint64_t row_count;
+  uint64_t stats_offset;
+  uint64_t rows_offset;
+  BinaryColumn columns[QPE_BIN_COLUMNS];
+} BinaryHeader;
+
+typedef struct {
+  const CarInventory *rows; /* ascending ID, one record per ID */
+  size_t count;
+  size_t bytes;   /* size of the database file */
+  double seconds; /* wall time spent in load_table() */
+  bool binary;    /* rows come from a db_convert file */
+  void *storage;  /* malloc'd rows, or the mapping of a binary file */
+  size_t mapped;  /* length of that mapping, 0 when storage is malloc'd */
+  size_t cap;     /* rows the malloc'd storage has room for */
+  size_t tail;    /* text: offset loaded up to, 0 if appends cannot be read */
+  unsigned long long device; /* the file as loaded, to notice changes */
+  unsigned long long inode;
+  struct timespec mtime;
+} LoadedTable;
+
+/*
+Function Prototypes
+*/
+bool load_table(const char *filename, TableStats *stats, LoadedTable *out);
+TailStatus load_table_tail(const char *filename, TableStats *stats,
+                           LoadedTable *table, size_t *added);
+ChunkStatus parse_text_slice(const char *begin, const char *end,
+                             CarInventory **rows, size_t *count);
+size_t text_header_length(const char *data, size_t bytes);
+bool read_binary_header(const char *filename, const void *data, size_t bytes,
+                        BinaryHeader *header);
+bool save_table_binary(const char *filename, const LoadedTable *table,
+                       const TableStats *stats);
+void loaded_table_free(LoadedTable *table);
+double load_throughput(const LoadedTable *table);
+
+#endif
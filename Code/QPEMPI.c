@@ -4,70 +4,157 @@
  * Parallel MPI implementation of the query processing engine.
  * Root process loads the database and queries, broadcasts the data to all
  * ranks, and every rank evaluates the WHERE clause on a disjoint range of
- * tuples. Query results are printed in rank order for each query to preserve
- * deterministic output.
+ * tuples. Query results are gathered to rank 0 a batch of queries at a time
+ * (one MPI_Gatherv per batch) and printed there in rank order for each query
+ * to preserve deterministic output.
+ *
+ * With --mode=query every rank instead holds the whole table, and rank 0
+ * hands query numbers to idle workers (MPI_Isend/MPI_Irecv) and writes their
+ * results in query order; --mode=auto chooses from the table size, the
+ * number of queries and the number of ranks.
+ *
+ * Built with -fopenmp this file is also qpe_hybrid: one rank per node (or
+ * NUMA domain) and an OpenMP team inside each rank. MPI is initialized with
+ * MPI_THREAD_FUNNELED and only the master thread talks to MPI; the threads
+ * split each full scan of the rank's slice into chunks, each formatted into
+ * the thread's own Buffer as in qpe_omp, and the chunks are joined in order.
+ *
+ * Every rank builds a zone map (QPEZone.h) over its own slice after the
+ * load, so a full scan or full-scan aggregate skips the 64K-row blocks of the
+ * slice that cannot hold a match; batched scans still read every row.
+ *
+ * Aggregate queries never move rows: each rank (and in qpe_hybrid each
+ * thread) folds its matches into its own AggTable, and only the partial
+ * groups travel to rank 0, with MPI_Reduce and a custom reduction op for a
+ * query without GROUP BY or one MPI_Gatherv of the groups for one with it.
+ * ORDER BY ... LIMIT k queries work the same way: every rank (and thread)
+ * keeps its k best matches in a TopK, and the ranks merge them pairwise up a
+ * binomial tree to rank 0, so no rank sends more than k rows.
+ *
+ * With --cache rank 0 looks every query up in the result cache and tells the
+ * other ranks which ones hit, so no rank scans for those; rank 0 writes their
+ * stored lines and records every other query's lines as it writes them.
+ *
+ * With --serve the table stays distributed after the load: rank 0 reads each
+ * request (QPEServe.c), broadcasts the packed query, and every rank answers
+ * it over its slice as in --mode=data, rank 0 replying with the lines. The
+ * slices are not refreshed when the file grows, as qpe_seq and qpe_omp do.
  */
 
-#include <ctype.h>
 #include <limits.h>
 #include <mpi.h>
-#include <stdarg.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <strings.h>
-#include <time.h>
 
-#include "../btree/btree.h"
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "QPEAggregate.h"
+#include "QPEArena.h"
+#include "QPEBatch.h"
+#include "QPEBuffer.h"
+#include "QPECache.h"
+#include "QPEColumn.h"
+#include "QPEFilter.h"
+#include "QPEIndex.h"
+#include "QPEKernel.h"
+#include "QPELoad.h"
+#include "QPEOptions.h"
+#include "QPEOutput.h"
+#include "QPEPlan.h"
+#include "QPEQuery.h"
+#include "QPEServe.h"
+#include "QPEStats.h"
+#include "QPETiming.h"
+#include "QPETopK.h"
+#include "QPEZone.h"
 
 typedef struct {
-  int ID;
-  char Model[20];
-  int YearMake;
-  char Color[20];
-  int Price;
-  char Dealer[20];
-} CarInventory;
+  const ColumnTable *table;
+  const Query *q;
+  Buffer *buf;
+} ColumnarCtx;
 
-typedef struct {
-  char select_attrs[6][20];
-  int num_select_attrs;
-  char where_raw[256];
-} Query;
+enum {
+  TAG_RECORD_COUNT = 1,
+  TAG_RECORD_DATA = 2,
+  TAG_QUERY_ID = 3,      /* --mode=query: rank 0 -> worker, -1 to stop */
+  TAG_RESULT_HEADER = 4, /* worker -> rank 0: query number and bytes */
+  TAG_RESULT_DATA = 5,
+  TAG_TOP_COUNT = 6, /* reduce_top(): rows a rank passes up the tree */
+  TAG_TOP_DATA = 7,
+};
 
+/* --parallel-io: bytes per collective read, slack read past a text cut to
+ * reach the end of its line, and the probe read that detects the format. */
+#define QPE_MPI_IO_BLOCK ((size_t)1 << 30)
+#define QPE_MPI_IO_MARGIN ((size_t)64 * 1024)
+#define QPE_MPI_IO_PROBE 512
+
+/* Queries whose results are gathered to rank 0 together, and the most bytes
+ * rank 0 receives in one MPI_Gatherv round. */
+#define QPE_MPI_OUTPUT_QUERIES 64
+#define QPE_MPI_GATHER_BYTES ((long long)1 << 30)
+
+/* --mode=auto picks query mode only while the table replica is at most this
+ * many bytes and there are at least this many queries per worker. Query IDs
+ * rank 0 keeps in flight to every worker, so none waits for its next query. */
+#define QPE_MPI_REPLICA_BYTES ((size_t)256 << 20)
+#define QPE_MPI_QUERIES_PER_WORKER 4
+#define QPE_MPI_DISPATCH_DEPTH 2
+
+/* The rows a rank answers queries from and what was built over them. */
 typedef struct {
-  char *data;
-  size_t len;
-  size_t cap;
-} Buffer;
-
+  const CarInventory *records; /* ID-ordered slice, or the whole table */
+  size_t count;
+  const ColumnTable *table;    /* --layout=columnar, else NULL */
+  const SecondaryIndex *index; /* --index, else NULL */
+  const ZoneMap *zones;        /* block summaries, NULL if not built */
+  size_t chunk_rows;
+  Buffer *results; /* run_partitioned() lines, emptied after every gather */
+  Buffer *parts;   /* one per scan chunk, kept (emptied) between queries */
+  Arena *scratch;  /* gather_results() arrays, reset by every call */
+} RankData;
+
+/* Where rank 0 records the lines it writes for --cache. */
 typedef struct {
-  CarInventory *arr;
-  size_t index;
-} ToArrayCtx;
-
-typedef enum { VAL_INT, VAL_STR } ValueType;
+  QueryCache *cache; /* NULL on the other ranks and without --cache */
+  const Query *queries;
+  const QueryPlan *plans;
+} ResultStore;
 
+/* Rank 0's bookkeeping while it hands out queries in --mode=query. */
 typedef struct {
-  ValueType type;
-  int i;
-  char s[64];
-} Value;
-
-enum {
-  TAG_RECORD_COUNT = 1,
-  TAG_RECORD_DATA = 2,
-};
+  const QueryPlan *plans; /* PLAN_CACHED queries are never handed out */
+  int num_queries;
+  int next;            /* next query to hand out */
+  int *ids;            /* MPI_Isend buffers (QPE_MPI_DISPATCH_DEPTH each) */
+  MPI_Request *sends;  /* one per ids slot */
+  int *sent;           /* messages sent to each worker so far */
+  bool *stopped;       /* worker has been sent -1 */
+} Dispatcher;
+
+typedef enum {
+  PARTITION_OK,
+  PARTITION_FAILED,
+  PARTITION_FALLBACK /* load on rank 0 and distribute instead */
+} PartitionResult;
+
+/* What each rank reports about the text slice it parsed. */
+typedef struct {
+  int status; /* ChunkStatus */
+  int ordered; /* IDs strictly ascending within the slice */
+  int first_id;
+  int last_id;
+  size_t count;
+} SliceInfo;
 
 /*
 Function prototypes
 */
-static void buffer_init(Buffer *buf);
-static void buffer_free(Buffer *buf);
-static bool buffer_reserve(Buffer *buf, size_t needed);
-static bool buffer_append(Buffer *buf, const char *data, size_t len);
-static bool buffer_appendf(Buffer *buf, const char *fmt, ...);
 static void bcast_bytes(void *data, size_t bytes, int root, MPI_Comm comm);
 static void send_bytes(const void *data, size_t bytes, int dest, int tag,
                        MPI_Comm comm);
@@ -75,26 +162,93 @@ static void recv_bytes(void *data, size_t bytes, int src, int tag,
                        MPI_Comm comm);
 static void compute_bounds(long long total, int size, int rank,
                            long long *start, long long *end);
-static bool to_array_cb(const void *item, void *udata);
-static CarInventory *btree_to_array(struct btree *tree, size_t *out_count);
-int car_compare(const void *a, const void *b, void *udata);
-struct btree *load_database(const char *filename);
-bool print_iter(const void *item, void *udata);
-void print_all_tuples(struct btree *tree);
-static const char *skip_ws(const char *s);
-static void trim_trailing(char *s);
-void load_queries(const char *filename, Query **queries, int *num_queries);
-static bool read_identifier(const char **p, char *out, size_t cap);
-static bool read_value(const char **p, Value *v);
-static int compare_attr_value(const CarInventory *car, const char *attr,
-                              const Value *v);
-static bool eval_comparison(const CarInventory *car, const char **p);
-static bool eval_term(const CarInventory *car, const char **p);
-static bool eval_factor(const CarInventory *car, const char **p);
-static bool eval_expr(const CarInventory *car, const char **p);
-int match_where(const CarInventory *car, const char *where_raw);
-static bool append_selected(const CarInventory *car, const Query *q,
-                            Buffer *buf);
+static size_t read_at_all(MPI_File fh, MPI_Offset offset, void *data,
+                          size_t bytes, MPI_Comm comm);
+static bool find_line_end(MPI_File fh, MPI_Offset file_size, char **buf,
+                          size_t *len, MPI_Offset lo, MPI_Offset from,
+                          MPI_Offset *out);
+static PartitionResult load_binary_partition(MPI_File fh,
+                                             const BinaryHeader *header,
+                                             int rank, int size,
+                                             TableStats *stats,
+                                             LoadedTable *local,
+                                             long long *total);
+static PartitionResult load_text_partition(MPI_File fh, const char *filename,
+                                           MPI_Offset file_size,
+                                           MPI_Offset data_start, int rank,
+                                           int size, TableStats *stats,
+                                           LoadedTable *local,
+                                           long long *total);
+static PartitionResult load_partition(const char *filename, int rank, int size,
+                                      TableStats *stats, LoadedTable *local,
+                                      long long *total);
+static void print_partitioned_tuples(const CarInventory *rows, size_t count,
+                                     long long total, int rank, int size);
+static void gather_results(const Buffer *batch, const long long *lens, int n,
+                           int first, int rank, int size,
+                           const ResultStore *store, Arena *scratch,
+                           OutputSink *sink);
+void print_all_tuples(const CarInventory *records, size_t count);
+static bool columnar_emit_cb(size_t row, void *udata);
+static long long lower_bound_id(const CarInventory *records, long long count,
+                                long long id);
+static int scan_chunk_count(size_t count, size_t chunk_rows);
+static bool scan_range(const CarInventory *records, const ColumnTable *table,
+                       const ColumnFilter *filter, const ZoneFilter *zones,
+                       const ScanKernel *kernel, const Query *q, size_t begin,
+                       size_t end, Buffer *out, size_t *scanned);
+static bool scan_slice(const RankData *data, const Query *q, Buffer *out,
+                       size_t *scanned, bool *kernel);
+static int choose_mode(const QPEOptions *opts, long long records,
+                       int num_queries, int size);
+static void pack_queries(const Query *queries, int num_queries, Buffer *out);
+static void begin_query_bcast(long long *record_count, int *mode,
+                              int *num_queries, Buffer *packed, int rank,
+                              MPI_Request *request);
+static Query *end_query_bcast(Buffer *packed, MPI_Request *request,
+                              int num_queries, int rank, Query *queries);
+static CarInventory *replicate_partition(const CarInventory *rows,
+                                         size_t count, long long total,
+                                         int rank, int size);
+static bool aggregate_slice(const RankData *data, const QueryPlan *plan,
+                            AggTable *agg, size_t *scanned);
+static void combine_groups_op(void *in, void *inout, int *len,
+                              MPI_Datatype *type);
+static void reduce_groups(AggTable *agg, int rank, int size);
+static bool top_slice(const RankData *data, const QueryPlan *plan, TopK *top,
+                      size_t *scanned);
+static void reduce_top(TopK *top, int rank, int size);
+static bool answer_query(const RankData *data, const Query *q,
+                         const QueryPlan *plan, Buffer *out, size_t *scanned,
+                         bool *kernel);
+static void share_cache_hits(QueryCache *cache, const Query *queries,
+                             QueryPlan *plans, int num_queries, int rank);
+static void store_result(const ResultStore *store, int qi, const char *data,
+                         size_t len);
+static void run_partitioned(const RankData *data, const Query *queries,
+                            const QueryPlan *plans, int num_queries,
+                            bool batch, int rank, int size,
+                            RunTiming *timing, const ResultStore *store,
+                            OutputSink *sink);
+static void dispatch_next(Dispatcher *d, int worker);
+static void write_dispatched(const ResultStore *store, int qi, Buffer *result,
+                             OutputSink *sink);
+static void dispatch_queries(int num_queries, int size,
+                             const ResultStore *store, OutputSink *sink);
+static void serve_queries(const RankData *data, const Query *queries,
+                          const QueryPlan *plans, int rank, RunTiming *timing);
+static void serve_requests(const RankData *data, const TableStats *stats,
+                           const QPEOptions *opts, QueryCache *cache,
+                           QueryServer *server, int rank, int size);
+static void reduce_timing(RunTiming *timing, TimingSummary *summary,
+                          int rank, int size);
+static bool batch_range(const QueryBatch *batch, const CarInventory *records,
+                        const ColumnTable *table, size_t begin, size_t end,
+                        Buffer *outs);
+static Buffer *process_batch(const CarInventory *records, size_t count,
+                             const ColumnTable *table, const Query *queries,
+                             const QueryPlan *plans, int num_queries,
+                             size_t chunk_rows);
 
 /*
 Name: main():
@@ -103,110 +257,256 @@ Return: int
 Description:
 
 Initializes MPI, loads the database and queries on rank 0, distributes records
-to every rank, runs WHERE clause evaluation locally, and prints results in rank
-order before reporting aggregate timing.
+to every rank, runs WHERE clause evaluation locally, and has rank 0 print the
+gathered results in rank order before reporting aggregate timing. With
+--layout=columnar every rank encodes its slice into a local column store and
+scans that instead. Rank 0's load-time statistics are broadcast so every rank
+plans each query the same way. In qpe_hybrid the optional third argument sets
+the threads per rank, and full scans and --batch run on the rank's OpenMP team
+in --chunk row chunks. Rank 0 picks the --mode once the table and queries are
+loaded: in query mode the whole table is replicated on every rank and the
+queries are dispatched one by one instead of being run everywhere over slices.
+Every rank times its own phases (QPETiming.c) and rank 0 reports them reduced
+over the ranks. With --serve there is no query file: once the slices are built,
+serve_requests() answers queries as rank 0 receives them.
 */
 int main(int argc, char **argv) {
+#ifdef _OPENMP
+  int thread_level = MPI_THREAD_SINGLE;
+  MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &thread_level);
+#else
   MPI_Init(&argc, &argv);
-  clock_t startTime = clock();
+#endif
+  RunTiming timing;
+  TimingSummary summary;
+  timing_init(&timing);
+  double mark = timing.start;
   int world_rank = 0;
   int world_size = 1;
   MPI_Comm_rank(MPI_COMM_WORLD, &world_rank);
   MPI_Comm_size(MPI_COMM_WORLD, &world_size);
 
-  const char *filename = "db/db.txt";
-  const char *queryfile = "db/sql.txt";
-  if (argc >= 2) {
-    filename = argv[1];
+  QPEOptions opts;
+  const char *bad_arg = parse_options(argc, argv, &opts);
+  if (bad_arg) {
+    if (world_rank == 0) {
+      fprintf(stderr, "Error: unrecognized argument %s\n", bad_arg);
+    }
+    MPI_Finalize();
+    return 1;
+  }
+  const char *filename = opts.db_file;
+  const char *queryfile = opts.query_file;
+  if (opts.mem_limit > 0 && world_rank == 0) {
+    fprintf(stderr, "Warning: --mem-limit is not supported by qpe_mpi; "
+                    "loading the whole table\n");
+  }
+  QueryServer server;
+  QueryServer *qserver = NULL;
+  if (opts.serve) {
+    if (world_rank == 0) {
+      serve_options(&opts);
+      if (opts.mode != MODE_DATA) {
+        fprintf(stderr, "Warning: --mode is ignored with --serve\n");
+      }
+      if (!serve_open(&server, opts.serve_path)) {
+        MPI_Abort(MPI_COMM_WORLD, 1);
+      }
+      qserver = &server;
+    }
+    opts.batch = false;
+    opts.mode = MODE_DATA;
+  }
+  OutputSink sink = {0};
+  if (world_rank == 0 && !output_open(&sink, opts.output_file)) {
+    MPI_Abort(MPI_COMM_WORLD, 1);
+  }
+  QueryCache cache;
+  QueryCache *qcache = NULL;
+  if (world_rank == 0 && opts.cache &&
+      cache_open(&cache, filename, opts.cache_dir)) {
+    qcache = &cache;
+  }
+
+#ifdef _OPENMP
+  if (thread_level < MPI_THREAD_FUNNELED) {
+    if (world_rank == 0) {
+      fprintf(stderr, "Warning: MPI lacks MPI_THREAD_FUNNELED support; "
+                      "using one thread per rank\n");
+    }
+    opts.num_threads = 1;
   }
-  if (argc >= 3) {
-    queryfile = argv[2];
+  if (opts.num_threads > 0) {
+    omp_set_num_threads(opts.num_threads);
   }
+  int num_threads = omp_get_max_threads();
+#endif
 
-  struct btree *tree = NULL;
   Query *queries = NULL;
   int num_queries = 0;
-  CarInventory *records = NULL;
+  const CarInventory *records = NULL;
   size_t record_count = 0;
   long long record_count_ll = 0;
-
-  if (world_rank == 0) {
-    tree = load_database(filename);
-    if (!tree) {
-      fprintf(stderr, "Error: Failed to load database from %s\n", filename);
-      record_count_ll = -1;
-    } else {
-      record_count = btree_count(tree);
-      record_count_ll = (long long)record_count;
-      printf("Loaded %zu tuples from %s\n", record_count, filename);
-      if (record_count <= 10) {
-        printf("Printing all tuples for debugging:\n");
-        print_all_tuples(tree);
-      }
-
-      load_queries(queryfile, &queries, &num_queries);
-      printf("Processing %d queries from %s\n", num_queries, queryfile);
-      records = btree_to_array(tree, &record_count);
-      record_count_ll = (long long)record_count;
-      if (record_count_ll > 0 && !records) {
-        fprintf(stderr, "Error: Failed to materialize B-tree into array\n");
-        record_count_ll = -1;
+  TableStats stats;
+  LoadedTable loaded = {0};
+
+  long long local_count_ll = 0;
+  const CarInventory *local_records = NULL;
+  CarInventory *owned_records = NULL; /* slice received from rank 0 */
+  PartitionResult partition = PARTITION_FALLBACK;
+
+  if (opts.parallel_io) {
+    partition = load_partition(filename, world_rank, world_size, &stats,
+                               &loaded, &record_count_ll);
+    if (partition == PARTITION_FAILED) {
+      if (world_rank == 0) {
+        fprintf(stderr, "Error: Failed to load database from %s\n", filename);
       }
+      serve_close(qserver);
+      cache_close(qcache);
+      MPI_Finalize();
+      return 1;
     }
-  }
-
-  MPI_Bcast(&record_count_ll, 1, MPI_LONG_LONG, 0, MPI_COMM_WORLD);
-  if (record_count_ll < 0) {
-    if (tree) {
-      btree_free(tree);
+    if (partition == PARTITION_FALLBACK && world_rank == 0) {
+      fprintf(stderr, "Warning: %s needs a full load; reading it on rank 0\n",
+              filename);
     }
-    MPI_Finalize();
-    return 1;
+    mark = timing_lap(&timing, TIME_LOAD, mark);
   }
 
-  long long local_start = 0;
-  long long local_end = 0;
-  compute_bounds(record_count_ll, world_size, world_rank, &local_start,
-                 &local_end);
-  long long local_count_ll = local_end - local_start;
+  int mode = MODE_DATA; /* Mode, chosen on rank 0 */
+  Buffer packed_queries; /* query_pack() form, broadcast from rank 0 */
+  MPI_Request queries_request = MPI_REQUEST_NULL;
+  buffer_init(&packed_queries);
 
-  CarInventory *local_records = NULL;
-  bool owns_local_records = false;
-
-  if (record_count_ll > 0) {
+  if (partition == PARTITION_OK) {
+    local_records = loaded.rows;
+    local_count_ll = (long long)loaded.count;
+    if (world_rank == 0) {
+      printf("Loaded %lld tuples from %s\n", record_count_ll, filename);
+    }
+    if (record_count_ll <= 10) {
+      print_partitioned_tuples(local_records, loaded.count, record_count_ll,
+                               world_rank, world_size);
+    }
     if (world_rank == 0) {
-      if (local_count_ll > 0) {
-        local_records = records + local_start;
+      if (!opts.serve) {
+        load_queries(queryfile, &queries, &num_queries);
+        printf("Processing %d queries from %s\n", num_queries, queryfile);
       }
-      for (int dest = 1; dest < world_size; ++dest) {
-        long long dest_start = 0;
-        long long dest_end = 0;
-        compute_bounds(record_count_ll, world_size, dest, &dest_start,
-                       &dest_end);
-        long long dest_count = dest_end - dest_start;
-        MPI_Send(&dest_count, 1, MPI_LONG_LONG, dest, TAG_RECORD_COUNT,
-                 MPI_COMM_WORLD);
-        if (dest_count > 0) {
-          size_t bytes = (size_t)dest_count * sizeof(CarInventory);
-          send_bytes(records + dest_start, bytes, dest, TAG_RECORD_DATA,
-                     MPI_COMM_WORLD);
+      mode = choose_mode(&opts, record_count_ll, num_queries, world_size);
+      pack_queries(queries, num_queries, &packed_queries);
+    }
+    mark = timing_lap(&timing, TIME_MATERIALIZE, mark);
+
+    begin_query_bcast(&record_count_ll, &mode, &num_queries, &packed_queries,
+                      world_rank, &queries_request);
+    if (mode == MODE_QUERY) {
+      owned_records = replicate_partition(local_records, loaded.count,
+                                          record_count_ll, world_rank,
+                                          world_size);
+      local_records = owned_records;
+      local_count_ll = record_count_ll;
+    }
+  } else {
+    if (world_rank == 0) {
+      if (!load_table(filename, &stats, &loaded)) {
+        fprintf(stderr, "Error: Failed to load database from %s\n", filename);
+        record_count_ll = -1;
+      } else {
+        records = loaded.rows;
+        record_count = loaded.count;
+        record_count_ll = (long long)record_count;
+        printf("Loaded %zu tuples from %s\n", record_count, filename);
+        if (record_count <= 10) {
+          printf("Printing all tuples for debugging:\n");
+          print_all_tuples(records, record_count);
         }
+        mark = timing_lap(&timing, TIME_LOAD, mark);
+
+        if (!opts.serve) {
+          load_queries(queryfile, &queries, &num_queries);
+          printf("Processing %d queries from %s\n", num_queries, queryfile);
+        }
+        mode = choose_mode(&opts, record_count_ll, num_queries, world_size);
+        pack_queries(queries, num_queries, &packed_queries);
+        mark = timing_lap(&timing, TIME_MATERIALIZE, mark);
       }
-    } else {
-      MPI_Recv(&local_count_ll, 1, MPI_LONG_LONG, 0, TAG_RECORD_COUNT,
-               MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-      if (local_count_ll > 0) {
-        size_t alloc_bytes = (size_t)local_count_ll * sizeof(CarInventory);
-        local_records = (CarInventory *)malloc(alloc_bytes);
-        if (!local_records) {
+    }
+
+    begin_query_bcast(&record_count_ll, &mode, &num_queries, &packed_queries,
+                      world_rank, &queries_request);
+    if (record_count_ll < 0) {
+      serve_close(qserver);
+      cache_close(qcache);
+      MPI_Finalize();
+      return 1;
+    }
+
+    if (mode == MODE_QUERY) {
+      /* Every rank gets a replica of the whole table. */
+      local_count_ll = record_count_ll;
+      CarInventory *replica = (CarInventory *)records;
+      if (world_rank != 0 && record_count_ll > 0) {
+        owned_records =
+            (CarInventory *)malloc((size_t)record_count_ll *
+                                   sizeof(CarInventory));
+        if (!owned_records) {
           fprintf(stderr,
-                  "Rank %d: out of memory allocating %lld local records\n",
-                  world_rank, local_count_ll);
+                  "Rank %d: out of memory allocating %lld replica records\n",
+                  world_rank, record_count_ll);
           MPI_Abort(MPI_COMM_WORLD, 1);
         }
-        recv_bytes(local_records, alloc_bytes, 0, TAG_RECORD_DATA,
-                   MPI_COMM_WORLD);
-        owns_local_records = true;
+        replica = owned_records;
+      }
+      if (record_count_ll > 0) {
+        bcast_bytes(replica, (size_t)record_count_ll * sizeof(CarInventory), 0,
+                    MPI_COMM_WORLD);
+      }
+      local_records = replica;
+    } else {
+      long long local_start = 0;
+      long long local_end = 0;
+      compute_bounds(record_count_ll, world_size, world_rank, &local_start,
+                     &local_end);
+      local_count_ll = local_end - local_start;
+
+      if (record_count_ll > 0) {
+        if (world_rank == 0) {
+          if (local_count_ll > 0) {
+            local_records = records + local_start;
+          }
+          for (int dest = 1; dest < world_size; ++dest) {
+            long long dest_start = 0;
+            long long dest_end = 0;
+            compute_bounds(record_count_ll, world_size, dest, &dest_start,
+                           &dest_end);
+            long long dest_count = dest_end - dest_start;
+            MPI_Send(&dest_count, 1, MPI_LONG_LONG, dest, TAG_RECORD_COUNT,
+                     MPI_COMM_WORLD);
+            if (dest_count > 0) {
+              size_t bytes = (size_t)dest_count * sizeof(CarInventory);
+              send_bytes(records + dest_start, bytes, dest, TAG_RECORD_DATA,
+                         MPI_COMM_WORLD);
+            }
+          }
+        } else {
+          MPI_Recv(&local_count_ll, 1, MPI_LONG_LONG, 0, TAG_RECORD_COUNT,
+                   MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+          if (local_count_ll > 0) {
+            size_t alloc_bytes = (size_t)local_count_ll * sizeof(CarInventory);
+            owned_records = (CarInventory *)malloc(alloc_bytes);
+            if (!owned_records) {
+              fprintf(stderr,
+                      "Rank %d: out of memory allocating %lld local records\n",
+                      world_rank, local_count_ll);
+              MPI_Abort(MPI_COMM_WORLD, 1);
+            }
+            recv_bytes(owned_records, alloc_bytes, 0, TAG_RECORD_DATA,
+                       MPI_COMM_WORLD);
+            local_records = owned_records;
+          }
+        }
       }
     }
   }
@@ -216,179 +516,162 @@ int main(int argc, char **argv) {
             world_rank, local_count_ll);
     MPI_Abort(MPI_COMM_WORLD, 1);
   }
-
-  MPI_Bcast(&num_queries, 1, MPI_INT, 0, MPI_COMM_WORLD);
-  if (world_rank != 0 && num_queries > 0) {
-    queries = malloc((size_t)num_queries * sizeof(Query));
-    if (!queries) {
-      fprintf(stderr, "Rank %d: out of memory allocating queries buffer\n",
+  if (!timing_queries(&timing, num_queries)) {
+    fprintf(stderr, "Rank %d: out of memory timing queries\n", world_rank);
+    MPI_Abort(MPI_COMM_WORLD, 1);
+  }
+  mark = timing_lap(&timing, TIME_DISTRIBUTE, mark);
+
+  ColumnTable *local_table = NULL;
+  if (opts.layout == LAYOUT_COLUMNAR) {
+    local_table =
+        column_table_from_array(local_records, (size_t)local_count_ll);
+    if (!local_table) {
+      fprintf(stderr, "Rank %d: failed to build local column store\n",
               world_rank);
       MPI_Abort(MPI_COMM_WORLD, 1);
     }
   }
 
-  if (num_queries > 0) {
-    bcast_bytes(queries, (size_t)num_queries * sizeof(Query), 0,
-                MPI_COMM_WORLD);
-  }
-
-  for (int qi = 0; qi < num_queries; ++qi) {
-    Buffer local_buf;
-    buffer_init(&local_buf);
-    const Query *q = &queries[qi];
-
-    for (long long idx = 0; idx < local_count_ll; ++idx) {
-      if (local_records && match_where(&local_records[idx], q->where_raw)) {
-        if (!append_selected(&local_records[idx], q, &local_buf)) {
-          fprintf(stderr, "Rank %d: Failed to append query result\n",
-                  world_rank);
-          MPI_Abort(MPI_COMM_WORLD, 1);
-        }
-      }
-    }
-
-    for (int src = 0; src < world_size; ++src) {
-      MPI_Barrier(MPI_COMM_WORLD);
-      if (src == world_rank && local_buf.len > 0) {
-        fwrite(local_buf.data, 1, local_buf.len, stdout);
-        fflush(stdout);
-      }
+  SecondaryIndex *local_index = NULL;
+  if (opts.use_index) {
+    local_index = index_build(local_records, (size_t)local_count_ll);
+    if (!local_index) {
+      fprintf(stderr, "Rank %d: failed to build secondary indexes\n",
+              world_rank);
+      MPI_Abort(MPI_COMM_WORLD, 1);
     }
-    MPI_Barrier(MPI_COMM_WORLD);
+  }
 
-    buffer_free(&local_buf);
+  ZoneMap *local_zones = zone_map_build(local_records, (size_t)local_count_ll);
+  if (!local_zones) {
+    fprintf(stderr, "Rank %d: out of memory building zone maps, full scans "
+                    "read every block\n",
+            world_rank);
   }
+  mark = timing_lap(&timing, TIME_MATERIALIZE, mark);
 
-  if (world_rank == 0) {
-    clock_t end = clock();
-    double time = (double)(end - startTime) / CLOCKS_PER_SEC;
+  bcast_bytes(&stats, sizeof(stats), 0, MPI_COMM_WORLD);
 
-    printf("\nTiming summary (MPI_Wtime, max across ranks):\n");
-    printf("  Total time: %.6f seconds\n", time);
-    printf("  Number of processors: %d\n", world_size);
-  }
+  queries = end_query_bcast(&packed_queries, &queries_request, num_queries,
+                            world_rank, queries);
+  buffer_free(&packed_queries);
+  mark = timing_lap(&timing, TIME_DISTRIBUTE, mark);
 
-  if (world_rank == 0) {
-    free(queries);
-    btree_free(tree);
-  } else if (queries) {
-    free(queries);
+  QueryPlan *plans = malloc(((size_t)num_queries + 1) * sizeof(QueryPlan));
+  if (!plans) {
+    fprintf(stderr, "Rank %d: out of memory planning queries\n", world_rank);
+    MPI_Abort(MPI_COMM_WORLD, 1);
   }
-  if (owns_local_records && local_records) {
-    free(local_records);
+  for (int qi = 0; qi < num_queries; ++qi) {
+    plan_query(&stats, local_index,
+               local_table ? QPE_COST_COLUMNAR_SCAN : QPE_COST_ROW_SCAN,
+               &queries[qi].where, &plans[qi]);
   }
-  if (world_rank == 0) {
-    free(records);
+  if (opts.cache) {
+    share_cache_hits(qcache, queries, plans, num_queries, world_rank);
   }
-  MPI_Finalize();
-  return 0;
-}
-
-/*
-Buffer helpers
-*/
-/*
-Name: buffer_init():
-Parameters: Buffer *buf
-Return: void
-Description:
-
-Initializes a Buffer by zeroing its metadata so subsequent append operations
-can grow it dynamically.
-*/
-static void buffer_init(Buffer *buf) {
-  buf->data = NULL;
-  buf->len = 0;
-  buf->cap = 0;
-}
-
-/*
-Name: buffer_free():
-Parameters: Buffer *buf
-Return: void
-Description:
-
-Releases any allocated storage backing the buffer and resets the bookkeeping
-fields.
-*/
-static void buffer_free(Buffer *buf) {
-  free(buf->data);
-  buf->data = NULL;
-  buf->len = 0;
-  buf->cap = 0;
-}
-
-/*
-Name: buffer_reserve():
-Parameters: Buffer *buf, size_t needed
-Return: bool
-Description:
-
-Ensures the buffer has at least the requested capacity by reallocating in
-doubling chunks; returns false on allocation failure.
-*/
-static bool buffer_reserve(Buffer *buf, size_t needed) {
-  if (needed <= buf->cap) {
-    return true;
+  if (opts.explain && world_rank == 0) {
+    for (int qi = 0; qi < num_queries; ++qi) {
+      plan_explain(stderr, qi + 1, &queries[qi].where, &plans[qi]);
+    }
   }
-  size_t new_cap = buf->cap ? buf->cap : 256;
-  while (new_cap < needed) {
-    new_cap *= 2;
+  ResultStore store = {.cache = qcache, .queries = queries, .plans = plans};
+
+  /* Scratch kept for the whole run, so the query loop reuses its memory. */
+  int num_parts = scan_chunk_count((size_t)local_count_ll, opts.chunk_rows);
+  Buffer results;
+  Buffer *parts = calloc((size_t)num_parts + 1, sizeof(Buffer));
+  Arena scratch;
+  buffer_init(&results);
+  arena_init(&scratch);
+  if (!parts) {
+    fprintf(stderr, "Rank %d: out of memory allocating result buffers\n",
+            world_rank);
+    MPI_Abort(MPI_COMM_WORLD, 1);
   }
-  char *tmp = realloc(buf->data, new_cap);
-  if (!tmp) {
-    return false;
+  RankData data = {.records = local_records,
+                   .count = (size_t)local_count_ll,
+                   .table = local_table,
+                   .index = local_index,
+                   .zones = local_zones,
+                   .chunk_rows = opts.chunk_rows,
+                   .results = &results,
+                   .parts = parts,
+                   .scratch = &scratch};
+  mark = timing_lap(&timing, TIME_MATERIALIZE, mark);
+
+  if (opts.serve) {
+    serve_requests(&data, &stats, &opts, qcache, qserver, world_rank,
+                   world_size);
+  } else if (mode == MODE_QUERY && world_rank == 0) {
+    /* Rank 0 only receives and writes results in query mode. */
+    dispatch_queries(num_queries, world_size, &store, &sink);
+    timing_lap(&timing, TIME_OUTPUT, mark);
+  } else if (mode == MODE_QUERY) {
+    serve_queries(&data, queries, plans, world_rank, &timing);
+  } else {
+    run_partitioned(&data, queries, plans, num_queries, opts.batch,
+                    world_rank, world_size, &timing, &store, &sink);
   }
-  buf->data = tmp;
-  buf->cap = new_cap;
-  return true;
-}
-
-/*
-Name: buffer_append():
-Parameters: Buffer *buf, const char *data, size_t len
-Return: bool
-Description:
-
-Appends raw bytes to the buffer, automatically reserving extra capacity and
-maintaining a trailing null terminator.
-*/
-static bool buffer_append(Buffer *buf, const char *data, size_t len) {
-  if (!buffer_reserve(buf, buf->len + len + 1)) {
-    return false;
+  bool ok = world_rank != 0 || output_close(&sink);
+  if (qcache) {
+    timing.value[COUNT_CACHE_HITS] = (double)qcache->hits;
+    timing.value[COUNT_CACHE_MISSES] = (double)qcache->misses;
   }
-  memcpy(buf->data + buf->len, data, len);
-  buf->len += len;
-  buf->data[buf->len] = '\0';
-  return true;
-}
+  reduce_timing(&timing, &summary, world_rank, world_size);
 
-/*
-Name: buffer_appendf():
-Parameters: Buffer *buf, const char *fmt, ...
-Return: bool
-Description:
+  if (world_rank == 0 && !opts.serve) {
+    printf("\nTiming summary (wall clock, max across ranks):\n");
+    printf("  Total time: %.6f seconds\n", summary.max[TIME_TOTAL]);
+    printf("  Number of processors: %d\n", world_size);
+    printf("  Mode: %s\n", mode == MODE_QUERY ? "query" : "data");
+#ifdef _OPENMP
+    printf("  Threads per rank: %d\n", num_threads);
+    printf("  Chunk size: %zu rows\n", opts.chunk_rows);
+#endif
+    printf("  Load time: %.6f seconds (%.1f MB/s)\n", loaded.seconds,
+           load_throughput(&loaded));
+    timing_print(stdout, &summary);
+  }
 
-Formats text using printf semantics directly into the buffer's append position,
-growing the storage when required.
-*/
-static bool buffer_appendf(Buffer *buf, const char *fmt, ...) {
-  va_list ap;
-  va_start(ap, fmt);
-  int needed = vsnprintf(NULL, 0, fmt, ap);
-  va_end(ap);
-  if (needed < 0) {
-    return false;
+  if (world_rank == 0 && opts.timing_file) {
+    TimingInfo info = {
+#ifdef _OPENMP
+        .engine = "qpe_hybrid",
+        .threads = num_threads,
+#else
+        .engine = "qpe_mpi",
+        .threads = 1,
+#endif
+        .db_file = filename,
+        .query_file = queryfile,
+        .layout = opts.layout == LAYOUT_COLUMNAR ? "columnar" : "row",
+        .mode = mode == MODE_QUERY ? "query" : "data",
+        .processes = world_size,
+        .tuples = record_count_ll};
+    timing_write(opts.timing_file, &info, &summary, timing.queries,
+                 timing.num_queries);
   }
-  size_t total = buf->len + (size_t)needed + 1;
-  if (!buffer_reserve(buf, total)) {
-    return false;
+  timing_free(&timing);
+
+  serve_close(qserver);
+  cache_close(qcache);
+  for (int c = 0; c < num_parts; ++c) {
+    buffer_free(&parts[c]);
   }
-  va_start(ap, fmt);
-  vsnprintf(buf->data + buf->len, buf->cap - buf->len, fmt, ap);
-  va_end(ap);
-  buf->len += (size_t)needed;
-  return true;
+  free(parts);
+  buffer_free(&results);
+  arena_free(&scratch);
+  free(plans);
+  free(queries);
+  index_free(local_index);
+  zone_map_free(local_zones);
+  column_table_free(local_table);
+  free(owned_records);
+  loaded_table_free(&loaded);
+  MPI_Finalize();
+  return ok ? 0 : 1;
 }
 
 /*
@@ -481,606 +764,1918 @@ static void compute_bounds(long long total, int size, int rank,
 }
 
 /*
-Name: to_array_cb():
-Parameters: const void *item, void *udata
-Return: bool
+Name: read_at_all():
+Parameters: MPI_File fh, MPI_Offset offset, void *data, size_t bytes,
+            MPI_Comm comm
+Return: size_t
 Description:
 
-btree_ascend callback that copies each record into a linear array while
-tracking the current insertion slot.
+Collective MPI_File_read_at_all() of bytes at offset into data. Every rank
+may ask for a different amount; the read is split into pieces below INT_MAX
+and all ranks take part in as many rounds as the largest request needs.
+Returns the number of bytes read, short only at end of file.
 */
-static bool to_array_cb(const void *item, void *udata) {
-  ToArrayCtx *ctx = (ToArrayCtx *)udata;
-  ctx->arr[ctx->index++] = *(const CarInventory *)item;
-  return true;
+static size_t read_at_all(MPI_File fh, MPI_Offset offset, void *data,
+                          size_t bytes, MPI_Comm comm) {
+  long long rounds = (long long)((bytes + QPE_MPI_IO_BLOCK - 1) /
+                                 QPE_MPI_IO_BLOCK);
+  size_t done = 0;
+  char *ptr = (char *)data;
+
+  MPI_Allreduce(MPI_IN_PLACE, &rounds, 1, MPI_LONG_LONG, MPI_MAX, comm);
+  for (long long r = 0; r < rounds; r++) {
+    size_t want = bytes - done < QPE_MPI_IO_BLOCK ? bytes - done
+                                                  : QPE_MPI_IO_BLOCK;
+    MPI_Status status;
+    int got = 0;
+    MPI_File_read_at_all(fh, offset + (MPI_Offset)done, ptr + done, (int)want,
+                         MPI_BYTE, &status);
+    MPI_Get_count(&status, MPI_BYTE, &got);
+    done += got > 0 ? (size_t)got : 0;
+  }
+  return done;
 }
 
 /*
-Name: btree_to_array():
-Parameters: struct btree *tree, size_t *out_count
-Return: CarInventory *
+Name: find_line_end():
+Parameters: MPI_File fh, MPI_Offset file_size, char **buf, size_t *len,
+            MPI_Offset lo, MPI_Offset from, MPI_Offset *out
+Return: bool
 Description:
 
-Materializes the B-tree contents into a malloc'd array and returns both the
-pointer and tuple count so MPI can scatter contiguous chunks to ranks.
+Sets *out to the file offset just past the first newline at or after from
+(the file size if there is none). (*buf)[0..*len) holds the file from offset
+lo; when the newline lies beyond it the buffer is extended with independent
+reads. Returns false when out of memory.
 */
-static CarInventory *btree_to_array(struct btree *tree, size_t *out_count) {
-  size_t count = btree_count(tree);
-  CarInventory *arr = NULL;
-  if (count > 0) {
-    arr = malloc(count * sizeof(CarInventory));
-    if (!arr) {
-      *out_count = 0;
-      return NULL;
-    }
-    ToArrayCtx ctx = {.arr = arr, .index = 0};
-    btree_ascend(tree, NULL, to_array_cb, &ctx);
-  }
-  *out_count = count;
-  return arr;
+static bool find_line_end(MPI_File fh, MPI_Offset file_size, char **buf,
+                          size_t *len, MPI_Offset lo, MPI_Offset from,
+                          MPI_Offset *out) {
+  MPI_Offset pos = from;
+
+  while (1) {
+    for (; pos < lo + (MPI_Offset)*len; pos++) {
+      if ((*buf)[pos - lo] == '\n') {
+        *out = pos + 1;
+        return true;
+      }
+    }
+    if (lo + (MPI_Offset)*len >= file_size) {
+      *out = file_size;
+      return true;
+    }
+
+    size_t extra = (size_t)(file_size - (lo + (MPI_Offset)*len));
+    if (extra > QPE_MPI_IO_MARGIN) {
+      extra = QPE_MPI_IO_MARGIN;
+    }
+    char *grown = realloc(*buf, *len + extra);
+    if (!grown) {
+      return false;
+    }
+    *buf = grown;
+
+    MPI_Status status;
+    int got = 0;
+    MPI_File_read_at(fh, lo + (MPI_Offset)*len, *buf + *len, (int)extra,
+                     MPI_BYTE, &status);
+    MPI_Get_count(&status, MPI_BYTE, &got);
+    if (got <= 0) {
+      *out = lo + (MPI_Offset)*len;
+      return true;
+    }
+    *len += (size_t)got;
+  }
 }
 
 /*
-Name: car_compare():
-Parameters: const void *a, const void *b, void *udata
-Return: int
+Name: load_binary_partition():
+Parameters: MPI_File fh, const BinaryHeader *header, int rank, int size,
+            TableStats *stats, LoadedTable *local, long long *total
+Return: PartitionResult
 Description:
 
-Comparison callback for the B-tree that orders CarInventory structures by ID,
-ignoring the user data pointer.
+Reads this rank's compute_bounds() share of the rows of a db_convert file
+and the stored statistics, both with collective reads.
 */
-int car_compare(const void *a, const void *b, void *udata) {
-  (void)udata;
-  const CarInventory *ca = (const CarInventory *)a;
-  const CarInventory *cb = (const CarInventory *)b;
-
-  if (ca->ID < cb->ID) {
-    return -1;
-  } else if (ca->ID > cb->ID) {
-    return 1;
-  } else {
-    return 0;
+static PartitionResult load_binary_partition(MPI_File fh,
+                                             const BinaryHeader *header,
+                                             int rank, int size,
+                                             TableStats *stats,
+                                             LoadedTable *local,
+                                             long long *total) {
+  long long start = 0;
+  long long end = 0;
+  int ok;
+
+  compute_bounds((long long)header->row_count, size, rank, &start, &end);
+  size_t bytes = (size_t)(end - start) * sizeof(CarInventory);
+  CarInventory *rows = malloc(bytes > 0 ? bytes : 1);
+
+  ok = rows != NULL;
+  MPI_Allreduce(MPI_IN_PLACE, &ok, 1, MPI_INT, MPI_LAND, MPI_COMM_WORLD);
+  if (!ok) {
+    if (!rows) {
+      fprintf(stderr, "Rank %d: out of memory allocating %lld local records\n",
+              rank, end - start);
+    }
+    free(rows);
+    return PARTITION_FAILED;
+  }
+
+  read_at_all(fh, (MPI_Offset)header->stats_offset, stats, sizeof(*stats),
+              MPI_COMM_WORLD);
+  ok = read_at_all(fh,
+                   (MPI_Offset)(header->rows_offset +
+                                (uint64_t)start * sizeof(CarInventory)),
+                   rows, bytes, MPI_COMM_WORLD) == bytes;
+  MPI_Allreduce(MPI_IN_PLACE, &ok, 1, MPI_INT, MPI_LAND, MPI_COMM_WORLD);
+  if (!ok) {
+    free(rows);
+    return PARTITION_FAILED;
   }
+
+  local->rows = rows;
+  local->storage = rows;
+  local->count = (size_t)(end - start);
+  local->binary = true;
+  *total = (long long)header->row_count;
+  return PARTITION_OK;
 }
 
 /*
-Name: load_database():
-Parameters: const char *filename
-Return: struct btree *
+Name: load_text_partition():
+Parameters: MPI_File fh, const char *filename, MPI_Offset file_size,
+            MPI_Offset data_start, int rank, int size, TableStats *stats,
+            LoadedTable *local, long long *total
+Return: PartitionResult
 Description:
 
-Opens the inventory file, loads each tuple into a B-tree keyed by ID, and
-returns the populated structure or NULL if any error occurs.
+Splits the text after the header into equal byte ranges, moves every cut
+forward past the next newline, and parses this rank's lines with
+parse_text_slice(). Rows are kept only up to the first malformed record in
+file order, as load_table() keeps them; the planner statistics of the ranks
+are merged on rank 0. Returns PARTITION_FALLBACK when the slices cannot be
+used as they are: a record spans lines across a cut, or the IDs are not
+strictly ascending over the file (these need load_table() on one rank to
+match its results).
 */
-struct btree *load_database(const char *filename) {
-  FILE *fp = fopen(filename, "r");
-  if (!fp) {
-    perror("fopen");
-    return NULL;
+static PartitionResult load_text_partition(MPI_File fh, const char *filename,
+                                           MPI_Offset file_size,
+                                           MPI_Offset data_start, int rank,
+                                           int size, TableStats *stats,
+                                           LoadedTable *local,
+                                           long long *total) {
+  MPI_Offset span = file_size - data_start;
+  MPI_Offset cut_lo = data_start + span * rank / size;
+  MPI_Offset cut_hi = data_start + span * (rank + 1) / size;
+  MPI_Offset lo = rank == 0 ? data_start : cut_lo - 1;
+  MPI_Offset hi = cut_hi + QPE_MPI_IO_MARGIN;
+  MPI_Offset start = data_start;
+  MPI_Offset end = file_size;
+  CarInventory *rows = NULL;
+  SliceInfo info = {.status = CHUNK_CLEAN};
+  SliceInfo *all = malloc((size_t)size * sizeof(SliceInfo));
+  TableStats *parts = NULL;
+  int first_bad;
+  int ok;
+
+  if (hi > file_size) {
+    hi = file_size;
   }
-
-  struct btree *tree = btree_new(sizeof(CarInventory), 0, car_compare, NULL);
-  if (!tree) {
-    fclose(fp);
-    return NULL;
+  size_t len = (size_t)(hi - lo);
+  char *buf = malloc(len > 0 ? len : 1);
+
+  ok = buf != NULL && all != NULL;
+  MPI_Allreduce(MPI_IN_PLACE, &ok, 1, MPI_INT, MPI_LAND, MPI_COMM_WORLD);
+  if (!ok) {
+    free(buf);
+    free(all);
+    return PARTITION_FAILED;
   }
-
-  char header_line[256];
-  if (!fgets(header_line, sizeof(header_line), fp)) {
-    fprintf(stderr, "Error: Failed to read header from %s\n", filename);
-    btree_free(tree);
-    fclose(fp);
-    return NULL;
+  len = read_at_all(fh, lo, buf, len, MPI_COMM_WORLD);
+
+  /* Both cuts of a slice follow the same rule, so neighbours agree. */
+  ok = (rank == 0 ||
+        find_line_end(fh, file_size, &buf, &len, lo, cut_lo - 1, &start)) &&
+       (rank == size - 1 ||
+        find_line_end(fh, file_size, &buf, &len, lo, cut_hi - 1, &end));
+  if (ok) {
+    info.status = parse_text_slice(buf + (start - lo), buf + (end - lo), &rows,
+                                   &info.count);
+    ok = info.status != CHUNK_NOMEM;
   }
-
-  CarInventory car;
-  while (1) {
-    int scanned = fscanf(fp, "%d %19s %d %19s %d %19s", &car.ID, car.Model,
-                         &car.YearMake, car.Color, &car.Price, car.Dealer);
-    if (scanned == EOF) {
+  free(buf);
+  info.ordered = 1;
+  for (size_t i = 1; i < info.count; i++) {
+    if (rows[i - 1].ID >= rows[i].ID) {
+      info.ordered = 0;
       break;
     }
-    if (scanned != 6) {
-      fprintf(stderr, "Warning: malformed line encountered in %s\n", filename);
+  }
+  if (info.count > 0) {
+    info.first_id = rows[0].ID;
+    info.last_id = rows[info.count - 1].ID;
+  }
+  if (!ok) {
+    fprintf(stderr, "Rank %d: out of memory loading %s\n", rank, filename);
+    info.status = CHUNK_NOMEM;
+  }
+  MPI_Allgather(&info, (int)sizeof(info), MPI_BYTE, all, (int)sizeof(info),
+                MPI_BYTE, MPI_COMM_WORLD);
+
+  /* Every rank reaches the same verdict from the gathered slice summaries. */
+  for (first_bad = 0; first_bad < size; first_bad++) {
+    if (all[first_bad].status != CHUNK_CLEAN) {
       break;
     }
-    if (btree_set(tree, &car) == NULL && btree_oom(tree)) {
-      fprintf(stderr, "Error: out of memory inserting ID=%d\n", car.ID);
-      btree_free(tree);
-      fclose(fp);
-      return NULL;
+  }
+  for (int r = 0; r < size; r++) {
+    if (all[r].status == CHUNK_NOMEM) {
+      free(rows);
+      free(all);
+      return PARTITION_FAILED;
     }
   }
+  PartitionResult result = PARTITION_OK;
+  if (first_bad < size - 1 && all[first_bad].status == CHUNK_SPLIT) {
+    result = PARTITION_FALLBACK;
+  }
+  int prev_last = 0;
+  bool any = false;
+  *total = 0;
+  for (int r = 0; r < size && r <= first_bad && result == PARTITION_OK; r++) {
+    if (all[r].count == 0) {
+      continue;
+    }
+    if (!all[r].ordered || (any && prev_last >= all[r].first_id)) {
+      result = PARTITION_FALLBACK;
+    }
+    prev_last = all[r].last_id;
+    any = true;
+    *total += (long long)all[r].count;
+  }
+  free(all);
+  if (result != PARTITION_OK) {
+    free(rows);
+    return result;
+  }
+  if (rank > first_bad) {
+    info.count = 0;
+  }
+  if (rank == 0 && first_bad < size) {
+    fprintf(stderr, "Warning: Malformed line encountered in %s\n", filename);
+  }
 
-  fclose(fp);
-  return tree;
-}
-
-/*
-Name: print_iter():
-Parameters: const void *item, void *udata
-Return: bool
-Description:
-
-btree iteration callback that prints a formatted CarInventory record and
-continues traversal by returning true.
-*/
-bool print_iter(const void *item, void *udata) {
-  (void)udata;
-  const CarInventory *car = (const CarInventory *)item;
-  printf("%d %s %d %s %d %s\n", car->ID, car->Model, car->YearMake, car->Color,
-         car->Price, car->Dealer);
-  return true;
-}
-
-/*
-Name: print_all_tuples():
-Parameters: struct btree *tree
-Return: void
-Description:
-
-Walks the B-tree from smallest to largest ID and prints every tuple, useful on
-small datasets to verify correctness before MPI distribution.
-*/
-void print_all_tuples(struct btree *tree) {
-  btree_ascend(tree, NULL, print_iter, NULL);
-}
-
-/*
-Name: skip_ws():
-Parameters: const char *s
-Return: const char *
-Description:
-
-Moves a pointer past leading whitespace characters and returns the first
-non-space location within a SQL-like clause.
-*/
-static const char *skip_ws(const char *s) {
-  while (*s && isspace((unsigned char)*s)) {
-    s++;
+  stats_init(stats);
+  for (size_t i = 0; i < info.count; i++) {
+    stats_add(stats, &rows[i]);
+  }
+  if (rank == 0) {
+    parts = malloc((size_t)size * sizeof(TableStats));
+    if (!parts) {
+      fprintf(stderr, "Rank 0: out of memory merging statistics\n");
+      MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+  }
+  MPI_Gather(stats, (int)sizeof(TableStats), MPI_BYTE, parts,
+             (int)sizeof(TableStats), MPI_BYTE, 0, MPI_COMM_WORLD);
+  if (rank == 0) {
+    for (int r = 1; r < size; r++) {
+      stats_merge(stats, &parts[r]);
+    }
+    stats_finish(stats);
+    free(parts);
   }
-  return s;
+
+  local->rows = rows;
+  local->storage = rows;
+  local->count = info.count;
+  return PARTITION_OK;
 }
 
 /*
-Name: trim_trailing():
-Parameters: char *s
-Return: void
+Name: load_partition():
+Parameters: const char *filename, int rank, int size, TableStats *stats,
+            LoadedTable *local, long long *total
+Return: PartitionResult
 Description:
 
-Removes trailing whitespace and semicolons from a mutable string so later
-comparisons operate on clean tokens.
+--parallel-io loader: every rank opens the database with MPI-IO and reads
+only its own slice (a row range of a binary file, a newline-aligned byte
+range of a text file) into local. On PARTITION_OK *total is the table size
+and rank 0's stats describe the whole table; PARTITION_FALLBACK asks the
+caller to load on rank 0 and distribute as usual. Collective over
+MPI_COMM_WORLD.
 */
-static void trim_trailing(char *s) {
-  size_t len = strlen(s);
-  while (len > 0 && isspace((unsigned char)s[len - 1])) {
-    s[--len] = '\0';
+static PartitionResult load_partition(const char *filename, int rank, int size,
+                                      TableStats *stats, LoadedTable *local,
+                                      long long *total) {
+  double start = MPI_Wtime();
+  MPI_File fh;
+  MPI_Offset file_size = 0;
+  char probe[QPE_MPI_IO_PROBE];
+  BinaryHeader header;
+  PartitionResult result;
+
+  memset(local, 0, sizeof(*local));
+  if (MPI_File_open(MPI_COMM_WORLD, filename, MPI_MODE_RDONLY, MPI_INFO_NULL,
+                    &fh) != MPI_SUCCESS) {
+    if (rank == 0) {
+      fprintf(stderr, "Error: MPI_File_open failed for %s\n", filename);
+    }
+    return PARTITION_FAILED;
   }
-  if (len > 0 && s[len - 1] == ';') {
-    s[--len] = '\0';
-    trim_trailing(s);
+  MPI_File_get_size(fh, &file_size);
+  size_t probed = read_at_all(fh, 0, probe,
+                              file_size < QPE_MPI_IO_PROBE ? (size_t)file_size
+                                                           : QPE_MPI_IO_PROBE,
+                              MPI_COMM_WORLD);
+
+  if (probed >= sizeof(BinaryHeader) &&
+      memcmp(probe, QPE_BIN_MAGIC, sizeof(QPE_BIN_MAGIC)) == 0) {
+    int ok = rank != 0 || read_binary_header(filename, probe,
+                                             (size_t)file_size, &header);
+    MPI_Bcast(&ok, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    memcpy(&header, probe, sizeof(header));
+    result = ok ? load_binary_partition(fh, &header, rank, size, stats, local,
+                                        total)
+                : PARTITION_FAILED;
+  } else if (probed == 0) {
+    if (rank == 0) {
+      fprintf(stderr, "Error: Failed to read header from %s\n", filename);
+    }
+    result = PARTITION_FAILED;
+  } else {
+    result = load_text_partition(fh, filename, file_size,
+                                 (MPI_Offset)text_header_length(probe, probed),
+                                 rank, size, stats, local, total);
   }
+  MPI_File_close(&fh);
+
+  local->bytes = (size_t)file_size;
+  local->seconds = MPI_Wtime() - start;
+  MPI_Allreduce(MPI_IN_PLACE, &local->seconds, 1, MPI_DOUBLE, MPI_MAX,
+                MPI_COMM_WORLD);
+  return result;
 }
 
 /*
-Name: load_queries():
-Parameters: const char *filename, Query **queries, int *num_queries
+Name: gather_results():
+Parameters: const Buffer *batch, const long long *lens, int n, int first,
+            int rank, int size, const ResultStore *store, Arena *scratch,
+            OutputSink *sink
 Return: void
 Description:
 
-Reads each query line from disk, extracts the SELECT attribute list and raw
-WHERE clause, and stores them in a reallocating array of Query structures.
+Writes the results of n consecutive queries, numbered from first + 1, to sink
+from rank 0. batch holds this rank's results for all n queries back to back,
+lens[q] bytes for query q. The lengths are exchanged with one MPI_Allgather and
+the data collected with MPI_Gatherv (one round unless rank 0 would receive more
+than QPE_MPI_GATHER_BYTES), after which rank 0 writes query by query and rank by
+rank, the order the old barrier round-robin produced, and hands each query's
+lines to store. The lengths, the Gatherv arrays and the received bytes are all
+carved from scratch, which is reset on entry, so once it has grown to the
+largest round no gather calls malloc. Collective.
 */
-void load_queries(const char *filename, Query **queries, int *num_queries) {
-  FILE *fp = fopen(filename, "r");
-  if (!fp) {
-    perror("fopen queries");
-    *queries = NULL;
-    *num_queries = 0;
-    return;
+static void gather_results(const Buffer *batch, const long long *lens, int n,
+                           int first, int rank, int size,
+                           const ResultStore *store, Arena *scratch,
+                           OutputSink *sink) {
+  long long piece = QPE_MPI_GATHER_BYTES / size;
+  if (piece < 1) {
+    piece = 1;
   }
-
-  int capacity = 4;
-  Query *arr = malloc(sizeof(Query) * capacity);
-  if (!arr) {
-    fprintf(stderr, "Error: out of memory allocating queries\n");
-    fclose(fp);
-    *queries = NULL;
-    *num_queries = 0;
-    return;
+  arena_reset(scratch);
+  long long *all =
+      arena_alloc(scratch, (size_t)size * (size_t)n * sizeof(long long) + 1);
+  long long *start = arena_alloc(scratch, ((size_t)size + 1) *
+                                              sizeof(long long));
+  long long rounds = 0;
+  int *counts = NULL;
+  int *displs = NULL;
+  char *data = NULL;
+  char *round_buf = NULL;
+
+  if (!all || !start) {
+    fprintf(stderr, "Rank %d: out of memory gathering results\n", rank);
+    MPI_Abort(MPI_COMM_WORLD, 1);
   }
-
-  char line[512];
-  *num_queries = 0;
-
-  while (fgets(line, sizeof(line), fp)) {
-    if (line[0] == '\n' || line[0] == '\0') {
-      continue;
+  memset(start, 0, ((size_t)size + 1) * sizeof(long long));
+  MPI_Allgather(lens, n, MPI_LONG_LONG, all, n, MPI_LONG_LONG, MPI_COMM_WORLD);
+  for (int r = 0; r < size; r++) {
+    long long total = 0;
+    for (int q = 0; q < n; q++) {
+      total += all[(size_t)r * (size_t)n + (size_t)q];
     }
-
-    Query q;
-    memset(&q, 0, sizeof(q));
-
-    char *select_pos = strstr(line, "SELECT");
-    char *from_pos = strstr(line, "FROM");
-    char *where_pos = strstr(line, "WHERE");
-
-    if (!select_pos || !from_pos || !where_pos) {
-      fprintf(stderr, "Warning: skipping malformed query: %s", line);
-      continue;
-    }
-
-    select_pos += strlen("SELECT");
-    while (*select_pos && isspace((unsigned char)*select_pos)) {
-      select_pos++;
+    start[r + 1] = start[r] + total;
+    if ((total + piece - 1) / piece > rounds) {
+      rounds = (total + piece - 1) / piece;
     }
+  }
 
-    if (from_pos <= select_pos) {
-      fprintf(stderr, "Warning: malformed SELECT clause: %s", line);
-      continue;
+  if (rank == 0) {
+    counts = arena_alloc(scratch, (size_t)size * sizeof(int));
+    displs = arena_alloc(scratch, (size_t)size * sizeof(int));
+    data = arena_alloc(scratch, (size_t)start[size] + 1);
+    round_buf =
+        rounds > 1 ? arena_alloc(scratch, (size_t)(piece * size)) : data;
+    if (!counts || !displs || !data || !round_buf) {
+      fprintf(stderr, "Rank 0: out of memory gathering results\n");
+      MPI_Abort(MPI_COMM_WORLD, 1);
     }
+  }
 
-    char select_part[256];
-    memset(select_part, 0, sizeof(select_part));
-    strncpy(select_part, select_pos, (size_t)(from_pos - select_pos));
-    trim_trailing(select_part);
-
-    char *token = strtok(select_part, ",");
-    int idx = 0;
-    while (token && idx < 6) {
-      token = (char *)skip_ws(token);
-      trim_trailing(token);
-      strncpy(q.select_attrs[idx], token, sizeof(q.select_attrs[idx]) - 1);
-      idx++;
-      token = strtok(NULL, ",");
+  long long mine = start[rank + 1] - start[rank];
+  for (long long k = 0; k < rounds; k++) {
+    long long offset = k * piece;
+    long long send = mine - offset;
+    send = send < 0 ? 0 : send > piece ? piece : send;
+    if (rank == 0) {
+      int at = 0;
+      for (int r = 0; r < size; r++) {
+        long long left = start[r + 1] - start[r] - offset;
+        counts[r] = (int)(left < 0 ? 0 : left > piece ? piece : left);
+        displs[r] = rounds > 1 ? at : (int)start[r];
+        at += counts[r];
+      }
     }
-    q.num_select_attrs = idx;
-
-    where_pos += strlen("WHERE");
-    while (*where_pos && isspace((unsigned char)*where_pos)) {
-      where_pos++;
+    MPI_Gatherv(batch->data + offset, (int)send, MPI_BYTE, round_buf, counts,
+                displs, MPI_BYTE, 0, MPI_COMM_WORLD);
+    if (rank == 0 && rounds > 1) {
+      for (int r = 0; r < size; r++) {
+        memcpy(data + start[r] + offset, round_buf + displs[r],
+               (size_t)counts[r]);
+      }
     }
-    strncpy(q.where_raw, where_pos, sizeof(q.where_raw) - 1);
-    q.where_raw[sizeof(q.where_raw) - 1] = '\0';
-    trim_trailing(q.where_raw);
+  }
 
-    if (*num_queries >= capacity) {
-      capacity *= 2;
-      Query *tmp = realloc(arr, sizeof(Query) * capacity);
-      if (!tmp) {
-        fprintf(stderr, "Error: out of memory reallocating queries\n");
-        break;
+  if (rank == 0) {
+    Buffer lines;
+    buffer_init(&lines);
+    for (int q = 0; q < n; q++) {
+      bool keep = store->cache != NULL &&
+                  store->plans[first + q].path != PLAN_CACHED;
+      lines.len = 0;
+      for (int r = 0; r < size; r++) {
+        long long len = all[(size_t)r * (size_t)n + (size_t)q];
+        output_write(sink, first + q + 1, data + start[r], (size_t)len);
+        keep = keep && buffer_append(&lines, data + start[r], (size_t)len);
+        start[r] += len;
+      }
+      if (keep) {
+        store_result(store, first + q, lines.data, lines.len);
       }
-      arr = tmp;
     }
-
-    arr[*num_queries] = q;
-    (*num_queries)++;
+    buffer_free(&lines);
   }
-
-  fclose(fp);
-  *queries = arr;
 }
+
 /*
-Name: read_identifier():
-Parameters: const char **p, char *out, size_t cap
-Return: bool
+Name: print_partitioned_tuples():
+Parameters: const CarInventory *rows, size_t count, long long total, int rank,
+            int size
+Return: void
 Description:
 
-Parses an identifier token from the WHERE clause string, writing it into the
-provided buffer and advancing the caller pointer when successful.
+Debug listing of a small table loaded with --parallel-io: the slices are
+gathered to rank 0, which prints them in rank (and so ID) order. Collective.
 */
-static bool read_identifier(const char **p, char *out, size_t cap) {
-  const char *s = *p;
-  size_t i = 0;
-  s = skip_ws(s);
-  if (!*s) {
-    return false;
+static void print_partitioned_tuples(const CarInventory *rows, size_t count,
+                                     long long total, int rank, int size) {
+  int bytes = (int)(count * sizeof(CarInventory));
+  int *sizes = NULL;
+  int *displs = NULL;
+  CarInventory *all = NULL;
+
+  if (rank == 0) {
+    sizes = malloc((size_t)size * sizeof(int));
+    displs = malloc((size_t)size * sizeof(int));
+    all = malloc((size_t)(total > 0 ? total : 1) * sizeof(CarInventory));
+    if (!sizes || !displs || !all) {
+      fprintf(stderr, "Rank 0: out of memory gathering tuples\n");
+      MPI_Abort(MPI_COMM_WORLD, 1);
+    }
   }
-  while (*s && (isalnum((unsigned char)*s) || *s == '_')) {
-    if (i + 1 < cap) {
-      out[i++] = *s;
+  MPI_Gather(&bytes, 1, MPI_INT, sizes, 1, MPI_INT, 0, MPI_COMM_WORLD);
+  if (rank == 0) {
+    for (int r = 0, offset = 0; r < size; r++) {
+      displs[r] = offset;
+      offset += sizes[r];
     }
-    s++;
   }
-  out[i] = '\0';
-  *p = s;
-  return i > 0;
+  MPI_Gatherv(rows, bytes, MPI_BYTE, all, sizes, displs, MPI_BYTE, 0,
+              MPI_COMM_WORLD);
+  if (rank == 0) {
+    printf("Printing all tuples for debugging:\n");
+    print_all_tuples(all, (size_t)total);
+  }
+  free(sizes);
+  free(displs);
+  free(all);
 }
 
 /*
-Name: read_value():
-Parameters: const char **p, Value *v
-Return: bool
+Name: print_all_tuples():
+Parameters: const CarInventory *records, size_t count
+Return: void
 Description:
 
-Parses either a quoted string or an integer literal into a Value struct so
-comparison logic can operate uniformly regardless of type.
+Prints every loaded tuple in ascending ID order, useful on small datasets to
+verify correctness before MPI distribution.
 */
-static bool read_value(const char **p, Value *v) {
-  const char *s = skip_ws(*p);
-  if (*s == '"') {
-    size_t i = 0;
-    s++;
-    while (*s && *s != '"' && i + 1 < sizeof(v->s)) {
-      v->s[i++] = *s++;
-    }
-    v->s[i] = '\0';
-    if (*s == '"') {
-      s++;
-    }
-    v->type = VAL_STR;
-  } else {
-    char *endptr;
-    v->i = (int)strtol(s, &endptr, 10);
-    if (endptr == s) {
-      return false;
-    }
-    s = endptr;
-    v->type = VAL_INT;
+void print_all_tuples(const CarInventory *records, size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    const CarInventory *car = &records[i];
+    printf("%d %s %d %s %d %s\n", car->ID, car->Model, car->YearMake,
+           car->Color, car->Price, car->Dealer);
   }
-  *p = s;
-  return true;
 }
 
 /*
-Name: compare_attr_value():
-Parameters: const CarInventory *car, const char *attr, const Value *v
+Name: columnar_emit_cb():
+Parameters: size_t row, void *udata
+Return: bool
+Description:
+
+filter_scan() callback that decodes a matching row of the rank's column store
+and appends it to the rank's output buffer; returns false (ending the scan) if
+the append fails.
+*/
+static bool columnar_emit_cb(size_t row, void *udata) {
+  ColumnarCtx *ctx = (ColumnarCtx *)udata;
+  CarInventory car;
+  column_table_get(ctx->table, row, &car);
+  return append_selected(&car, ctx->q, ctx->buf);
+}
+
+/*
+Name: lower_bound_id():
+Parameters: const CarInventory *records, long long count, long long id
+Return: long long
+Description:
+
+Binary search over a rank's ID-ordered slice for the first record whose ID is
+>= id, which is where a PLAN_ID_RANGE scan starts.
+*/
+static long long lower_bound_id(const CarInventory *records, long long count,
+                                long long id) {
+  long long lo = 0;
+  long long hi = count;
+  while (lo < hi) {
+    long long mid = lo + (hi - lo) / 2;
+    if (records[mid].ID < id) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+/*
+Name: scan_chunk_count():
+Parameters: size_t count, size_t chunk_rows
 Return: int
 Description:
 
-Extracts the named attribute from a car record, converts it if necessary, and
-compares it to the provided literal returning -1, 0, or 1.
+Number of chunks a full scan of count rows is split into. qpe_hybrid hands
+the rank's OpenMP team one chunk of chunk_rows rows at a time; qpe_mpi scans
+its slice as a single chunk.
 */
-static int compare_attr_value(const CarInventory *car, const char *attr,
-                              const Value *v) {
-  if (strcasecmp(attr, "ID") == 0 || strcasecmp(attr, "YearMake") == 0 ||
-      strcasecmp(attr, "Price") == 0) {
-    int lhs = 0;
-    if (strcasecmp(attr, "ID") == 0) {
-      lhs = car->ID;
-    } else if (strcasecmp(attr, "YearMake") == 0) {
-      lhs = car->YearMake;
-    } else if (strcasecmp(attr, "Price") == 0) {
-      lhs = car->Price;
-    }
-    int rhs = (v->type == VAL_INT) ? v->i : atoi(v->s);
-    if (lhs < rhs) {
-      return -1;
-    }
-    if (lhs > rhs) {
-      return 1;
+static int scan_chunk_count(size_t count, size_t chunk_rows) {
+#ifdef _OPENMP
+  if (count > chunk_rows && omp_get_max_threads() > 1) {
+    return (int)((count + chunk_rows - 1) / chunk_rows);
+  }
+#else
+  (void)count;
+  (void)chunk_rows;
+#endif
+  return 1;
+}
+
+/*
+Name: scan_range():
+Parameters: const CarInventory *records, const ColumnTable *table,
+            const ColumnFilter *filter, const ZoneFilter *zones,
+            const ScanKernel *kernel, const Query *q, size_t begin,
+            size_t end, Buffer *out, size_t *scanned
+Return: bool
+Description:
+
+Full scan of rows [begin, end) of the rank's slice on the calling thread,
+through the column store (with q's WHERE clause already bound in filter) when
+table is not NULL, else with the specialized kernel compiled from it when
+kernel->shape is not 0, else with match_where(). Only the runs of blocks zones
+cannot rule out are read, and their rows are added to *scanned. begin is a
+multiple of QPE_FILTER_BLOCK, and so is the start of every run. Returns false if
+scratch bitmaps or a result could not be allocated.
+*/
+static bool scan_range(const CarInventory *records, const ColumnTable *table,
+                       const ColumnFilter *filter, const ZoneFilter *zones,
+                       const ScanKernel *kernel, const Query *q, size_t begin,
+                       size_t end, Buffer *out, size_t *scanned) {
+  FilterScratch scratch;
+  ColumnarCtx ctx = {.table = table, .q = q, .buf = out};
+  size_t stop;
+  bool ok = !table || filter_scratch_init(&scratch, filter);
+
+  for (size_t i = zone_next(zones, begin, end, &stop); ok && i < end;
+       i = zone_next(zones, stop, end, &stop)) {
+    *scanned += stop - i;
+    if (table) {
+      ok = filter_scan(&scratch, i, stop, columnar_emit_cb, &ctx);
+    } else if (kernel->shape) {
+      ok = kernel_scan(kernel, records, i, stop, q, out);
+    } else {
+      for (size_t r = i; ok && r < stop; ++r) {
+        ok = !match_where(&records[r], &q->where) ||
+             append_selected(&records[r], q, out);
+      }
     }
-    return 0;
   }
+  if (table) {
+    filter_scratch_free(&scratch);
+  }
+  return ok;
+}
 
-  const char *lhs = NULL;
-  if (strcasecmp(attr, "Model") == 0) {
-    lhs = car->Model;
-  } else if (strcasecmp(attr, "Color") == 0) {
-    lhs = car->Color;
-  } else if (strcasecmp(attr, "Dealer") == 0) {
-    lhs = car->Dealer;
+/*
+Name: scan_slice():
+Parameters: const RankData *data, const Query *q, Buffer *out,
+            size_t *scanned, bool *kernel
+Return: bool
+Description:
+
+Answers a PLAN_FULL_SCAN query over the rank's slice, skipping the zone map
+blocks q's WHERE clause rules out and adding the rows read to *scanned. A
+row slice is scanned with a QPEKernel.c kernel when the clause fits one, and
+*kernel is then set.
+In qpe_hybrid the slice
+is cut into chunks of chunk_rows rows that the rank's threads scan into the
+chunks' own Buffers (data->parts), with no locking; the master thread then
+appends them to out in chunk order, so the rank's output is the same as a
+single-threaded scan. The chunk Buffers are emptied but keep their memory
+for the next query.
+Only the master thread runs MPI calls, which is all MPI_THREAD_FUNNELED
+allows. Returns false on allocation failure.
+*/
+static bool scan_slice(const RankData *data, const Query *q, Buffer *out,
+                       size_t *scanned, bool *kernel) {
+  const CarInventory *records = data->records;
+  const ColumnTable *table = data->table;
+  size_t count = data->count;
+  size_t chunk_rows = data->chunk_rows;
+  int num_chunks = scan_chunk_count(count, chunk_rows);
+  Buffer *parts = data->parts;
+  ColumnFilter filter;
+  ZoneFilter zones;
+  ScanKernel compiled;
+  size_t rows = 0;
+  bool ok = true;
+
+  memset(&compiled, 0, sizeof(compiled));
+  if (!table && kernel_compile(&compiled, &q->where)) {
+    *kernel = true;
+  }
+  if (!zone_filter_init(&zones, data->zones, &q->where)) {
+    return false;
+  }
+  if (table && !column_filter_init(&filter, table, &q->where)) {
+    zone_filter_free(&zones);
+    return false;
+  }
+
+  if (num_chunks == 1) {
+    ok = scan_range(records, table, &filter, &zones, &compiled, q, 0, count,
+                    out, &rows);
   } else {
-    return 0;
+    /* Parallel Section: chunks are independent, each formats into its own
+     * Buffer. */
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic, 1) reduction(&& : ok)              \
+    reduction(+ : rows)
+#endif
+    for (int c = 0; c < num_chunks; ++c) {
+      size_t begin = (size_t)c * chunk_rows;
+      size_t end = begin + chunk_rows < count ? begin + chunk_rows : count;
+      ok = scan_range(records, table, &filter, &zones, &compiled, q, begin,
+                      end, &parts[c], &rows) &&
+           ok;
+    }
+
+    for (int c = 0; c < num_chunks; ++c) {
+      ok = ok && buffer_append(out, parts[c].data, parts[c].len);
+      parts[c].len = 0;
+    }
   }
 
-  const char *rhs = (v->type == VAL_STR) ? v->s : "";
-  return strcasecmp(lhs, rhs);
+  if (table) {
+    column_filter_free(&filter);
+  }
+  zone_filter_free(&zones);
+  *scanned += rows;
+  return ok;
 }
 
 /*
-Name: eval_comparison():
-Parameters: const CarInventory *car, const char **p
+Name: batch_range():
+Parameters: const QueryBatch *batch, const CarInventory *records,
+            const ColumnTable *table, size_t begin, size_t end, Buffer *outs
 Return: bool
 Description:
 
-Parses a single comparison (attribute operator literal) from the WHERE clause
-and evaluates it immediately against the provided record.
+Runs the shared batch scan over rows [begin, end) of the rank's slice on the
+calling thread, formatting every member query's matches into outs (indexed
+like the queries array). Returns false on allocation failure.
 */
-static bool eval_comparison(const CarInventory *car, const char **p) {
-  char attr[32];
-  char op[3] = {0};
-  Value v;
-  const char *s = skip_ws(*p);
+static bool batch_range(const QueryBatch *batch, const CarInventory *records,
+                        const ColumnTable *table, size_t begin, size_t end,
+                        Buffer *outs) {
+  bool ok = true;
+  if (table) {
+    BatchScratch scratch;
+    ok = batch_scratch_init(&scratch, batch) &&
+         batch_scan_columnar(batch, &scratch, begin, end, outs);
+    batch_scratch_free(&scratch, batch);
+    return ok;
+  }
+  for (size_t i = begin; ok && i < end; ++i) {
+    ok = batch_row(batch, &records[i], outs);
+  }
+  return ok;
+}
 
-  if (!read_identifier(&s, attr, sizeof(attr))) {
-    return false;
+/*
+Name: process_batch():
+Parameters: const CarInventory *records, size_t count,
+            const ColumnTable *table, const Query *queries,
+            const QueryPlan *plans, int num_queries, size_t chunk_rows
+Return: Buffer *
+Description:
+
+Answers every non-aggregate, unordered query planned as PLAN_FULL_SCAN over the
+rank's slice with one shared pass (QPEBatch.c), over the column store when table
+is not NULL. In qpe_hybrid the pass is split into chunks of chunk_rows rows
+across the rank's threads, each chunk with its own set of Buffers, joined in
+chunk order. Returns num_queries Buffers indexed like queries, the non-batched
+ones left empty, or NULL on allocation failure.
+*/
+static Buffer *process_batch(const CarInventory *records, size_t count,
+                             const ColumnTable *table, const Query *queries,
+                             const QueryPlan *plans, int num_queries,
+                             size_t chunk_rows) {
+  Buffer *outs = calloc((size_t)num_queries + 1, sizeof(Buffer));
+  int *members = malloc(((size_t)num_queries + 1) * sizeof(int));
+  int num_members = 0;
+  int num_chunks = scan_chunk_count(count, chunk_rows);
+  QueryBatch batch;
+  bool ok;
+
+  if (!outs || !members) {
+    free(outs);
+    free(members);
+    return NULL;
   }
+  for (int qi = 0; qi < num_queries; ++qi) {
+    if (plans[qi].path == PLAN_FULL_SCAN && !queries[qi].aggregate &&
+        !queries[qi].ordered) {
+      members[num_members++] = qi;
+    }
+  }
+  ok = batch_init(&batch, queries, members, num_members, table);
+  free(members);
+
+  if (ok && num_chunks == 1) {
+    ok = batch_range(&batch, records, table, 0, count, outs);
+  } else if (ok) {
+    size_t width = (size_t)num_queries + 1;
+    Buffer *parts = calloc((size_t)num_chunks * width, sizeof(Buffer));
+    ok = parts != NULL;
+
+    /* Parallel Section: chunk c formats into parts[c * width ...]. */
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic, 1) reduction(&& : ok) if (parts)
+#endif
+    for (int c = 0; c < num_chunks; ++c) {
+      size_t begin = (size_t)c * chunk_rows;
+      size_t end = begin + chunk_rows < count ? begin + chunk_rows : count;
+      ok = batch_range(&batch, records, table, begin, end,
+                       &parts[(size_t)c * width]) &&
+           ok;
+    }
 
-  s = skip_ws(s);
-  if (*s == '!' && *(s + 1) == '=') {
-    strcpy(op, "!=");
-    s += 2;
-  } else if (*s == '>' && *(s + 1) == '=') {
-    strcpy(op, ">=");
-    s += 2;
-  } else if (*s == '<' && *(s + 1) == '=') {
-    strcpy(op, "<=");
-    s += 2;
-  } else if (*s == '>') {
-    strcpy(op, ">");
-    s++;
-  } else if (*s == '<') {
-    strcpy(op, "<");
-    s++;
-  } else if (*s == '=') {
-    strcpy(op, "=");
-    s++;
-  } else {
-    return false;
+    for (int qi = 0; parts && qi < num_queries; ++qi) {
+      for (int c = 0; c < num_chunks; ++c) {
+        Buffer *part = &parts[(size_t)c * width + qi];
+        ok = ok && buffer_append(&outs[qi], part->data, part->len);
+        buffer_free(part);
+      }
+    }
+    free(parts);
   }
+  batch_free(&batch);
 
-  if (!read_value(&s, &v)) {
-    return false;
+  if (!ok) {
+    for (int qi = 0; qi < num_queries; ++qi) {
+      buffer_free(&outs[qi]);
+    }
+    free(outs);
+    return NULL;
+  }
+  return outs;
+}
+
+/*
+Name: choose_mode():
+Parameters: const QPEOptions *opts, long long records, int num_queries,
+            int size
+Return: int
+Description:
+
+Rank 0's choice between data partitioning and query dispatch (a Mode), made
+once the table and queries are loaded. Query mode needs a worker besides
+rank 0, so a single rank always runs in data mode. --mode=auto weighs what
+query mode costs, one broadcast of the whole table and a replica of it per
+rank, against what it buys: no collective per batch of queries, and uneven
+queries balanced by handing them out one at a time. It picks query mode when
+the table is at most QPE_MPI_REPLICA_BYTES and there are at least
+QPE_MPI_QUERIES_PER_WORKER queries for every worker, unless --batch asks for
+the shared scans only data mode runs.
+*/
+static int choose_mode(const QPEOptions *opts, long long records,
+                       int num_queries, int size) {
+  int mode = MODE_DATA;
+  size_t bytes = (size_t)records * sizeof(CarInventory);
+
+  if (size < 2) {
+    mode = MODE_DATA;
+  } else if (opts->mode == MODE_QUERY) {
+    if (opts->batch) {
+      fprintf(stderr, "Warning: --batch is ignored with --mode=query\n");
+    }
+    mode = MODE_QUERY;
+  } else if (opts->mode == MODE_AUTO && !opts->batch &&
+             bytes <= QPE_MPI_REPLICA_BYTES &&
+             (long long)num_queries >=
+                 (long long)QPE_MPI_QUERIES_PER_WORKER * (size - 1)) {
+    mode = MODE_QUERY;
   }
 
-  *p = s;
+  if (opts->explain) {
+    fprintf(stderr, "EXPLAIN mode: %s (%lld tuples, %d queries, %d ranks)\n",
+            mode == MODE_QUERY ? "query" : "data", records, num_queries,
+            size);
+  }
+  return mode;
+}
+
+/*
+Name: pack_queries():
+Parameters: const Query *queries, int num_queries, Buffer *out
+Return: void
+Description:
+
+Rank 0: appends every query in its compact query_pack() form to out, which
+is what the other ranks receive instead of the raw Query structs.
+*/
+static void pack_queries(const Query *queries, int num_queries, Buffer *out) {
+  size_t bytes = 0;
+  for (int qi = 0; qi < num_queries; ++qi) {
+    bytes += query_pack(&queries[qi], NULL);
+  }
+  if (!buffer_reserve(out, bytes + 1)) {
+    fprintf(stderr, "Rank 0: out of memory packing queries\n");
+    MPI_Abort(MPI_COMM_WORLD, 1);
+  }
+  for (int qi = 0; qi < num_queries; ++qi) {
+    out->len +=
+        query_pack(&queries[qi], (unsigned char *)out->data + out->len);
+  }
+}
 
-  int cmp = compare_attr_value(car, attr, &v);
+/*
+Name: begin_query_bcast():
+Parameters: long long *record_count, int *mode, int *num_queries,
+            Buffer *packed, int rank, MPI_Request *request
+Return: void
+Description:
 
-  if (strcmp(op, "=") == 0) {
-    return cmp == 0;
-  } else if (strcmp(op, "!=") == 0) {
-    return cmp != 0;
-  } else if (strcmp(op, ">") == 0) {
-    return cmp > 0;
-  } else if (strcmp(op, "<") == 0) {
-    return cmp < 0;
-  } else if (strcmp(op, ">=") == 0) {
-    return cmp >= 0;
-  } else if (strcmp(op, "<=") == 0) {
-    return cmp <= 0;
+Broadcasts what rank 0 decided before the table is distributed (the table
+size, -1 if loading failed, the Mode and the number of queries), then starts
+an MPI_Ibcast of the packed queries into packed. The queries travel while
+rank 0 sends the records; end_query_bcast() waits for them. Packets over
+INT_MAX bytes are broadcast at once in pieces instead. Collective.
+*/
+static void begin_query_bcast(long long *record_count, int *mode,
+                              int *num_queries, Buffer *packed, int rank,
+                              MPI_Request *request) {
+  long long setup[4] = {*record_count, *mode, *num_queries,
+                        (long long)packed->len};
+
+  MPI_Bcast(setup, 4, MPI_LONG_LONG, 0, MPI_COMM_WORLD);
+  *record_count = setup[0];
+  *mode = (int)setup[1];
+  *num_queries = (int)setup[2];
+  *request = MPI_REQUEST_NULL;
+  if (setup[0] < 0 || setup[3] == 0) {
+    return;
   }
 
-  return false;
+  if (rank != 0 && !buffer_reserve(packed, (size_t)setup[3])) {
+    fprintf(stderr, "Rank %d: out of memory receiving queries\n", rank);
+    MPI_Abort(MPI_COMM_WORLD, 1);
+  }
+  packed->len = (size_t)setup[3];
+  if (setup[3] <= INT_MAX) {
+    MPI_Ibcast(packed->data, (int)setup[3], MPI_BYTE, 0, MPI_COMM_WORLD,
+               request);
+  } else {
+    bcast_bytes(packed->data, packed->len, 0, MPI_COMM_WORLD);
+  }
 }
 
-static bool eval_expr(const CarInventory *car, const char **p);
-static bool eval_factor(const CarInventory *car, const char **p);
+/*
+Name: end_query_bcast():
+Parameters: Buffer *packed, MPI_Request *request, int num_queries, int rank,
+            Query *queries
+Return: Query *
+Description:
+
+Waits for the packed queries started by begin_query_bcast(). Rank 0 keeps the
+queries it loaded and returns them unchanged; every other rank unpacks the
+num_queries compiled queries into a new array and returns that.
+*/
+static Query *end_query_bcast(Buffer *packed, MPI_Request *request,
+                              int num_queries, int rank, Query *queries) {
+  MPI_Wait(request, MPI_STATUS_IGNORE);
+  if (rank == 0 || num_queries == 0) {
+    return queries;
+  }
+
+  queries = malloc((size_t)num_queries * sizeof(Query));
+  if (!queries) {
+    fprintf(stderr, "Rank %d: out of memory allocating queries buffer\n",
+            rank);
+    MPI_Abort(MPI_COMM_WORLD, 1);
+  }
+  size_t at = 0;
+  for (int qi = 0; qi < num_queries; ++qi) {
+    size_t used = query_unpack((const unsigned char *)packed->data + at,
+                               packed->len - at, &queries[qi]);
+    if (used == 0) {
+      fprintf(stderr, "Rank %d: received a corrupt query %d\n", rank,
+              qi + 1);
+      MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    at += used;
+  }
+  return queries;
+}
 
 /*
-Name: eval_term():
-Parameters: const CarInventory *car, const char **p
-Return: bool
+Name: replicate_partition():
+Parameters: const CarInventory *rows, size_t count, long long total,
+            int rank, int size
+Return: CarInventory *
 Description:
 
-Evaluates AND-separated factors while advancing the parse pointer, combining the
-results of eval_factor() calls.
+Turns the slices the ranks loaded with --parallel-io into a copy of the
+whole table on every rank for --mode=query, with one MPI_Allgatherv of the
+slices in rank (and so ID) order. Returns the malloc'd replica of total rows.
+Collective.
 */
-static bool eval_term(const CarInventory *car, const char **p) {
-  bool result = eval_factor(car, p);
-  const char *s = skip_ws(*p);
+static CarInventory *replicate_partition(const CarInventory *rows,
+                                         size_t count, long long total,
+                                         int rank, int size) {
+  long long mine = (long long)count;
+  long long *all = malloc((size_t)size * sizeof(long long));
+  int *counts = malloc((size_t)size * sizeof(int));
+  int *displs = malloc((size_t)size * sizeof(int));
+  CarInventory *replica = malloc((size_t)total * sizeof(CarInventory) + 1);
+  MPI_Datatype row_type;
+
+  if (!all || !counts || !displs || !replica) {
+    fprintf(stderr, "Rank %d: out of memory replicating the table\n", rank);
+    MPI_Abort(MPI_COMM_WORLD, 1);
+  }
+  if (total > INT_MAX) {
+    fprintf(stderr, "Rank %d: %lld tuples are too many to replicate\n", rank,
+            total);
+    MPI_Abort(MPI_COMM_WORLD, 1);
+  }
 
-  while (strncasecmp(s, "AND", 3) == 0) {
-    s += 3;
-    *p = s;
-    bool rhs = eval_factor(car, p);
-    result = result && rhs;
-    s = skip_ws(*p);
+  MPI_Allgather(&mine, 1, MPI_LONG_LONG, all, 1, MPI_LONG_LONG,
+                MPI_COMM_WORLD);
+  long long at = 0;
+  for (int r = 0; r < size; r++) {
+    counts[r] = (int)all[r];
+    displs[r] = (int)at;
+    at += all[r];
   }
 
-  *p = s;
-  return result;
+  MPI_Type_contiguous((int)sizeof(CarInventory), MPI_BYTE, &row_type);
+  MPI_Type_commit(&row_type);
+  MPI_Allgatherv(rows, (int)count, row_type, replica, counts, displs,
+                 row_type, MPI_COMM_WORLD);
+  MPI_Type_free(&row_type);
+
+  free(all);
+  free(counts);
+  free(displs);
+  return replica;
 }
 
 /*
-Name: eval_factor():
-Parameters: const CarInventory *car, const char **p
+Name: aggregate_slice():
+Parameters: const RankData *data, const QueryPlan *plan, AggTable *agg,
+            size_t *scanned
 Return: bool
 Description:
 
-Handles parentheses or single comparisons when evaluating WHERE clauses, making
-recursive calls to eval_expr() as needed.
+Folds the rows of the rank's slice that match agg's query into it, along
+its plan (agg_query()). A full scan reads only the runs of zone map blocks
+the query cannot rule out; in qpe_hybrid it is cut into chunks as in
+scan_slice(), and every thread aggregates its chunks into its own AggTable,
+merged into agg once the team is done. Adds the rows tested to
+*scanned and returns false on allocation failure.
 */
-static bool eval_factor(const CarInventory *car, const char **p) {
-  const char *s = skip_ws(*p);
-  bool result;
-
-  if (*s == '(') {
-    s++;
-    *p = s;
-    result = eval_expr(car, p);
-    s = skip_ws(*p);
-    if (*s == ')') {
-      s++;
-    }
-    *p = s;
-  } else {
-    result = eval_comparison(car, &s);
-    *p = s;
+static bool aggregate_slice(const RankData *data, const QueryPlan *plan,
+                            AggTable *agg, size_t *scanned) {
+  ZoneFilter zones;
+  size_t rows = 0;
+  size_t stop;
+  bool ok = true;
+
+  if (plan->path != PLAN_FULL_SCAN) {
+    return agg_query(agg, data->records, data->count, data->index, plan,
+                     scanned);
   }
+  if (!zone_filter_init(&zones, data->zones, &agg->q->where)) {
+    return false;
+  }
+#ifdef _OPENMP
+  int num_chunks = scan_chunk_count(data->count, data->chunk_rows);
 
-  return result;
+  if (num_chunks > 1) {
+    int threads = omp_get_max_threads();
+    AggTable *mine = calloc((size_t)threads, sizeof(AggTable));
+    ok = mine != NULL;
+
+    for (int t = 0; ok && t < threads; ++t) {
+      ok = agg_init(&mine[t], agg->q);
+    }
+
+    /* Parallel Section: thread t only touches mine[t]. */
+#pragma omp parallel for schedule(dynamic, 1) reduction(&& : ok)              \
+    reduction(+ : rows) private(stop) if (ok)
+    for (int c = 0; c < num_chunks; ++c) {
+      size_t begin = (size_t)c * data->chunk_rows;
+      size_t end = begin + data->chunk_rows < data->count
+                       ? begin + data->chunk_rows
+                       : data->count;
+      for (size_t i = zone_next(&zones, begin, end, &stop); ok && i < end;
+           i = zone_next(&zones, stop, end, &stop)) {
+        ok = agg_scan(&mine[omp_get_thread_num()], data->records, i, stop);
+        rows += stop - i;
+      }
+    }
+
+    for (int t = 0; mine && t < threads; ++t) {
+      ok = ok && agg_merge(agg, &mine[t]);
+      agg_free(&mine[t]);
+    }
+    free(mine);
+  } else
+#endif
+  {
+    for (size_t i = zone_next(&zones, 0, data->count, &stop);
+         ok && i < data->count;
+         i = zone_next(&zones, stop, data->count, &stop)) {
+      ok = agg_scan(agg, data->records, i, stop);
+      rows += stop - i;
+    }
+  }
+  zone_filter_free(&zones);
+  *scanned += rows;
+  return ok;
 }
 
 /*
-Name: eval_expr():
-Parameters: const CarInventory *car, const char **p
-Return: bool
+Name: combine_groups_op():
+Parameters: void *in, void *inout, int *len, MPI_Datatype *type
+Return: void
 Description:
 
-Evaluates OR-separated terms to compute the final truth value of the WHERE
-clause for a record.
+User-defined MPI reduction over AggGroups: agg_combine() of every element of
+in into the matching element of inout. Counts and sums add and minimums and
+maximums are order-free, so the op is commutative.
 */
-static bool eval_expr(const CarInventory *car, const char **p) {
-  bool result = eval_term(car, p);
-  const char *s = skip_ws(*p);
-  while (strncasecmp(s, "OR", 2) == 0) {
-    s += 2;
-    *p = s;
-    bool rhs = eval_term(car, p);
-    result = result || rhs;
-    s = skip_ws(*p);
-  }
-  *p = s;
-  return result;
+static void combine_groups_op(void *in, void *inout, int *len,
+                              MPI_Datatype *type) {
+  const AggGroup *from = (const AggGroup *)in;
+  AggGroup *into = (AggGroup *)inout;
+  (void)type;
+  for (int i = 0; i < *len; ++i) {
+    agg_combine(&into[i], &from[i]);
+  }
 }
 
 /*
-Name: match_where():
-Parameters: const CarInventory *car, const char *where_raw
-Return: int
+Name: reduce_groups():
+Parameters: AggTable *agg, int rank, int size
+Return: void
 Description:
 
-Skips leading whitespace then invokes the recursive expression parser,
-returning 1 if the record satisfies the WHERE predicate or 0 otherwise.
+Combines every rank's partial groups of one aggregate query into agg on rank
+0. A query without GROUP BY has one group on each rank, reduced with
+MPI_Reduce and combine_groups_op(). With GROUP BY the ranks may hold
+different keys, so their groups are gathered with one MPI_Gatherv and rank 0
+merges them by key. Only groups are sent, never rows. Collective.
 */
-int match_where(const CarInventory *car, const char *where_raw) {
-  const char *p = skip_ws(where_raw);
-  if (*p == '\0') {
-    return 1;
+static void reduce_groups(AggTable *agg, int rank, int size) {
+  MPI_Datatype group_type;
+  int mine = (int)agg->num_groups;
+  int *counts = NULL;
+  int *displs = NULL;
+  AggGroup *all = NULL;
+  long long total = 0;
+
+  MPI_Type_contiguous((int)sizeof(AggGroup), MPI_BYTE, &group_type);
+  MPI_Type_commit(&group_type);
+
+  if (agg->q->group_col == COL_UNKNOWN) {
+    AggGroup sum = agg->groups[0];
+    MPI_Op op;
+    MPI_Op_create(combine_groups_op, 1, &op);
+    MPI_Reduce(agg->groups, &sum, 1, group_type, op, 0, MPI_COMM_WORLD);
+    MPI_Op_free(&op);
+    agg->groups[0] = sum;
+    MPI_Type_free(&group_type);
+    return;
+  }
+
+  if (rank == 0) {
+    counts = malloc((size_t)size * sizeof(int));
+    displs = malloc((size_t)size * sizeof(int));
+    if (!counts || !displs) {
+      fprintf(stderr, "Rank 0: out of memory gathering groups\n");
+      MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+  }
+  MPI_Gather(&mine, 1, MPI_INT, counts, 1, MPI_INT, 0, MPI_COMM_WORLD);
+  if (rank == 0) {
+    for (int r = 0; r < size; ++r) {
+      displs[r] = (int)total;
+      total += counts[r];
+    }
+    all = malloc((size_t)total * sizeof(AggGroup) + 1);
+    if (!all || total > INT_MAX) {
+      fprintf(stderr, "Rank 0: %lld groups are too many to gather\n",
+              total);
+      MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+  }
+  MPI_Gatherv(agg->groups, mine, group_type, all, counts, displs, group_type,
+              0, MPI_COMM_WORLD);
+  if (rank == 0 &&
+      !agg_merge_groups(agg, all + counts[0], (size_t)(total - counts[0]))) {
+    fprintf(stderr, "Rank 0: out of memory merging groups\n");
+    MPI_Abort(MPI_COMM_WORLD, 1);
   }
-  return eval_expr(car, &p) ? 1 : 0;
+  MPI_Type_free(&group_type);
+  free(all);
+  free(counts);
+  free(displs);
 }
 
 /*
-Name: append_selected():
-Parameters: const CarInventory *car, const Query *q, Buffer *buf
+Name: top_slice():
+Parameters: const RankData *data, const QueryPlan *plan, TopK *top,
+            size_t *scanned
 Return: bool
 Description:
 
-Formats either all attributes or the requested subset into the provided Buffer,
-appending a newline so rank-ordered output can be printed later.
+Keeps the k best rows of the rank's slice that match top's query, along its
+plan (topk_query(), which stops early when ordered by ID). A full scan
+ordered by Price reads only the runs of zone map blocks the query cannot
+rule out; in qpe_hybrid it is cut into chunks as in scan_slice(), and every
+thread keeps its own TopK, merged into top once the team is done. Adds the
+rows tested to *scanned and returns false on allocation failure.
 */
-static bool append_selected(const CarInventory *car, const Query *q,
-                            Buffer *buf) {
-  if (q->num_select_attrs == 0 ||
-      (q->num_select_attrs == 1 && strcmp(q->select_attrs[0], "*") == 0)) {
-    return buffer_appendf(buf, "%d %s %d %s %d %s\n", car->ID, car->Model,
-                          car->YearMake, car->Color, car->Price, car->Dealer);
+static bool top_slice(const RankData *data, const QueryPlan *plan, TopK *top,
+                      size_t *scanned) {
+  ZoneFilter zones;
+  size_t rows = 0;
+  size_t stop;
+  bool ok = true;
+
+  if (plan->path != PLAN_FULL_SCAN || top->q->order_col == COL_ID) {
+    return topk_query(top, NULL, data->records, data->count, data->index,
+                      plan, scanned);
+  }
+  if (!zone_filter_init(&zones, data->zones, &top->q->where)) {
+    return false;
   }
+#ifdef _OPENMP
+  int num_chunks = scan_chunk_count(data->count, data->chunk_rows);
+
+  if (num_chunks > 1) {
+    int threads = omp_get_max_threads();
+    TopK *mine = calloc((size_t)threads, sizeof(TopK));
+    ok = mine != NULL;
+
+    for (int t = 0; ok && t < threads; ++t) {
+      topk_init(&mine[t], top->q);
+    }
+
+    /* Parallel Section: thread t only touches mine[t]. */
+#pragma omp parallel for schedule(dynamic, 1) reduction(&& : ok)              \
+    reduction(+ : rows) private(stop) if (ok)
+    for (int c = 0; c < num_chunks; ++c) {
+      size_t begin = (size_t)c * data->chunk_rows;
+      size_t end = begin + data->chunk_rows < data->count
+                       ? begin + data->chunk_rows
+                       : data->count;
+      for (size_t i = zone_next(&zones, begin, end, &stop); ok && i < end;
+           i = zone_next(&zones, stop, end, &stop)) {
+        ok = topk_scan(&mine[omp_get_thread_num()], data->records, i, stop,
+                       &rows);
+      }
+    }
+
+    for (int t = 0; mine && t < threads; ++t) {
+      ok = ok && topk_merge(top, &mine[t]);
+      topk_free(&mine[t]);
+    }
+    free(mine);
+  } else
+#endif
+  {
+    for (size_t i = zone_next(&zones, 0, data->count, &stop);
+         ok && i < data->count;
+         i = zone_next(&zones, stop, data->count, &stop)) {
+      ok = topk_scan(top, data->records, i, stop, &rows);
+    }
+  }
+  zone_filter_free(&zones);
+  *scanned += rows;
+  return ok;
+}
+
+/*
+Name: reduce_top():
+Parameters: TopK *top, int rank, int size
+Return: void
+Description:
 
-  for (int i = 0; i < q->num_select_attrs; ++i) {
-    if (i > 0 && !buffer_append(buf, " ", 1)) {
+Merges every rank's kept rows of one ordered query into top on rank 0 along
+a binomial tree: in round s (1, 2, 4, ...) a rank with bit s set sends its
+rows to rank - s and is done, and the rank it sends to merges them into its
+own. Every message holds at most k rows and rank 0 merges log2(size) of
+them, instead of receiving size - 1. Collective.
+*/
+static void reduce_top(TopK *top, int rank, int size) {
+  for (int step = 1; step < size; step <<= 1) {
+    if (rank & step) {
+      long long count = (long long)top->count;
+      MPI_Send(&count, 1, MPI_LONG_LONG, rank - step, TAG_TOP_COUNT,
+               MPI_COMM_WORLD);
+      send_bytes(top->rows, top->count * sizeof(CarInventory), rank - step,
+                 TAG_TOP_DATA, MPI_COMM_WORLD);
+      return;
+    }
+    if (rank + step < size) {
+      long long count = 0;
+      CarInventory *rows;
+      MPI_Recv(&count, 1, MPI_LONG_LONG, rank + step, TAG_TOP_COUNT,
+               MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+      rows = malloc((size_t)count * sizeof(CarInventory) + 1);
+      if (!rows) {
+        fprintf(stderr, "Rank %d: out of memory merging ordered rows\n",
+                rank);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+      }
+      recv_bytes(rows, (size_t)count * sizeof(CarInventory), rank + step,
+                 TAG_TOP_DATA, MPI_COMM_WORLD);
+      if (!topk_merge_rows(top, rows, (size_t)count)) {
+        fprintf(stderr, "Rank %d: out of memory merging ordered rows\n",
+                rank);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+      }
+      free(rows);
+    }
+  }
+}
+
+/*
+Name: answer_query():
+Parameters: const RankData *data, const Query *q, const QueryPlan *plan,
+            Buffer *out, size_t *scanned, bool *kernel
+Return: bool
+Description:
+
+Runs one query's plan over the rank's rows and formats the matches into out:
+an ID range starts at the binary-searched lower bound, an index plan tests
+only the posting-list candidates, and everything else (including an index
+lookup that failed) is a full scan. An aggregate query formats its groups
+instead (aggregate_slice()), and an ordered query its k best matches
+(top_slice()), which is the whole answer when the rank holds the whole
+table. Adds the rows tested to *scanned and sets *kernel when the
+full scan ran a specialized kernel (scan_slice()). Returns false if a result
+could not be buffered.
+*/
+static bool answer_query(const RankData *data, const Query *q,
+                         const QueryPlan *plan, Buffer *out, size_t *scanned,
+                         bool *kernel) {
+  PostingList hits;
+
+  if (q->aggregate) {
+    AggTable agg;
+    bool ok = agg_init(&agg, q) &&
+              aggregate_slice(data, plan, &agg, scanned) &&
+              agg_format(&agg, out);
+    agg_free(&agg);
+    return ok;
+  }
+  if (q->ordered) {
+    TopK top;
+    topk_init(&top, q);
+    if (!top_slice(data, plan, &top, scanned)) {
+      topk_free(&top);
       return false;
     }
-    const char *attr = q->select_attrs[i];
-    if (strcasecmp(attr, "ID") == 0) {
-      if (!buffer_appendf(buf, "%d", car->ID)) {
+    return topk_format(&top, out);
+  }
+
+  if (plan->path == PLAN_ID_RANGE) {
+    long long count = (long long)data->count;
+    long long idx = lower_bound_id(data->records, count, plan->id_lo);
+    for (; idx < count && data->records[idx].ID <= plan->id_hi; ++idx) {
+      ++*scanned;
+      if (match_where(&data->records[idx], &q->where) &&
+          !append_selected(&data->records[idx], q, out)) {
         return false;
       }
-    } else if (strcasecmp(attr, "Model") == 0) {
-      if (!buffer_appendf(buf, "%s", car->Model)) {
-        return false;
+    }
+    return true;
+  }
+
+  if (plan->path != PLAN_FULL_SCAN &&
+      index_lookup(data->index, &plan->probe, &hits)) {
+    bool ok = true;
+    *scanned += hits.count;
+    for (size_t i = 0; ok && i < hits.count; ++i) {
+      const CarInventory *car = &data->records[hits.rows[i]];
+      if (match_where(car, &q->where)) {
+        ok = append_selected(car, q, out);
       }
-    } else if (strcasecmp(attr, "YearMake") == 0) {
-      if (!buffer_appendf(buf, "%d", car->YearMake)) {
-        return false;
+    }
+    posting_list_free(&hits);
+    return ok;
+  }
+
+  return scan_slice(data, q, out, scanned, kernel);
+}
+
+/*
+Name: share_cache_hits():
+Parameters: QueryCache *cache, const Query *queries, QueryPlan *plans,
+            int num_queries, int rank
+Return: void
+Description:
+
+--cache: rank 0 looks every query up in cache (NULL if it could not be
+opened) and broadcasts which ones hit, and every rank plans those as
+PLAN_CACHED so none of them is answered again. Only rank 0 holds the stored
+lines. Collective.
+*/
+static void share_cache_hits(QueryCache *cache, const Query *queries,
+                             QueryPlan *plans, int num_queries, int rank) {
+  unsigned char *hits = calloc((size_t)num_queries + 1, 1);
+  if (!hits) {
+    fprintf(stderr, "Rank %d: out of memory sharing cache hits\n", rank);
+    MPI_Abort(MPI_COMM_WORLD, 1);
+  }
+  for (int qi = 0; rank == 0 && cache && qi < num_queries; ++qi) {
+    hits[qi] = cache_plan(cache, &queries[qi], &plans[qi]);
+  }
+  MPI_Bcast(hits, num_queries, MPI_UNSIGNED_CHAR, 0, MPI_COMM_WORLD);
+  for (int qi = 0; rank != 0 && qi < num_queries; ++qi) {
+    if (hits[qi]) {
+      plans[qi].path = PLAN_CACHED;
+    }
+  }
+  free(hits);
+}
+
+/*
+Name: store_result():
+Parameters: const ResultStore *store, int qi, const char *data, size_t len
+Return: void
+Description:
+
+Records the len bytes at data, all of query qi's lines, in the result cache
+unless there is none on this rank or the lines came from it.
+*/
+static void store_result(const ResultStore *store, int qi, const char *data,
+                         size_t len) {
+  if (store->cache && store->plans[qi].path != PLAN_CACHED) {
+    cache_store(store->cache, &store->queries[qi], data, len);
+  }
+}
+
+/*
+Name: run_partitioned():
+Parameters: const RankData *data, const Query *queries,
+            const QueryPlan *plans, int num_queries, bool batch, int rank,
+            int size, RunTiming *timing, OutputSink *sink
+Return: void
+Description:
+
+--mode=data: every rank runs every query over its own slice (the full-scan ones
+in one shared pass with --batch), and the results are gathered to rank 0
+QPE_MPI_OUTPUT_QUERIES queries at a time. An aggregate query's partial groups
+are combined on rank 0 right away (reduce_groups()), as are an ordered query's
+kept rows (reduce_top()), and only rank 0 has lines to gather for it, as for a
+PLAN_CACHED query, whose stored lines rank 0 copies. Every query formats
+straight into the rank's data->results, which keeps its memory from one gather
+(and one call) to the next. Query time goes to the rank's filter phase and the
+gathers to its output phase; the members of the batch share its pass, so each is
+charged an equal part of its time. Collective.
+*/
+static void run_partitioned(const RankData *data, const Query *queries,
+                            const QueryPlan *plans, int num_queries,
+                            bool batch, int rank, int size,
+                            RunTiming *timing, const ResultStore *store,
+                            OutputSink *sink) {
+  Buffer *batch_outs = NULL;
+  Buffer *out_batch = data->results;
+  long long out_lens[QPE_MPI_OUTPUT_QUERIES];
+  int out_count = 0;
+  double batch_seconds = 0;
+  double mark = timing_now();
+
+  if (batch) {
+    int num_members = 0;
+    batch_outs = process_batch(data->records, data->count, data->table,
+                               queries, plans, num_queries, data->chunk_rows);
+    if (!batch_outs) {
+      fprintf(stderr, "Rank %d: out of memory running query batch\n", rank);
+      MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    for (int qi = 0; qi < num_queries; ++qi) {
+      num_members += plans[qi].path == PLAN_FULL_SCAN &&
+                     !queries[qi].aggregate && !queries[qi].ordered;
+    }
+    batch_seconds = timing_now() - mark;
+    if (num_members > 0) {
+      batch_seconds /= num_members;
+    }
+  }
+
+  if (!buffer_reserve(out_batch, QPE_ROW_MAX)) {
+    fprintf(stderr, "Rank %d: Failed to buffer query results\n", rank);
+    MPI_Abort(MPI_COMM_WORLD, 1);
+  }
+  for (int qi = 0; qi < num_queries; ++qi) {
+    QueryTiming *qt = &timing->queries[qi];
+    size_t at = out_batch->len; /* this query's lines start here */
+    size_t scanned = 0;
+    bool kernel = false;
+
+    qt->seconds = timing_now();
+    if (plans[qi].path == PLAN_CACHED) {
+      if (rank == 0 && !buffer_append(out_batch, plans[qi].cached,
+                                      plans[qi].cached_len)) {
+        fprintf(stderr, "Rank 0: out of memory answering query %d\n",
+                qi + 1);
+        MPI_Abort(MPI_COMM_WORLD, 1);
       }
-    } else if (strcasecmp(attr, "Color") == 0) {
-      if (!buffer_appendf(buf, "%s", car->Color)) {
-        return false;
+    } else if (batch_outs && plans[qi].path == PLAN_FULL_SCAN &&
+               !queries[qi].aggregate && !queries[qi].ordered) {
+      if (!buffer_append(out_batch, batch_outs[qi].data,
+                         batch_outs[qi].len)) {
+        fprintf(stderr, "Rank %d: Failed to buffer query results\n", rank);
+        MPI_Abort(MPI_COMM_WORLD, 1);
       }
-    } else if (strcasecmp(attr, "Price") == 0) {
-      if (!buffer_appendf(buf, "%d", car->Price)) {
-        return false;
+      buffer_free(&batch_outs[qi]);
+      scanned = data->count;
+      qt->seconds -= batch_seconds;
+    } else if (queries[qi].aggregate) {
+      AggTable agg;
+      if (!agg_init(&agg, &queries[qi]) ||
+          !aggregate_slice(data, &plans[qi], &agg, &scanned)) {
+        fprintf(stderr, "Rank %d: out of memory answering query %d\n", rank,
+                qi + 1);
+        MPI_Abort(MPI_COMM_WORLD, 1);
       }
-    } else if (strcasecmp(attr, "Dealer") == 0) {
-      if (!buffer_appendf(buf, "%s", car->Dealer)) {
-        return false;
+      reduce_groups(&agg, rank, size);
+      if (rank == 0 && !agg_format(&agg, out_batch)) {
+        fprintf(stderr, "Rank 0: out of memory answering query %d\n",
+                qi + 1);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+      }
+      agg_free(&agg);
+    } else if (queries[qi].ordered) {
+      TopK top;
+      topk_init(&top, &queries[qi]);
+      if (!top_slice(data, &plans[qi], &top, &scanned)) {
+        fprintf(stderr, "Rank %d: out of memory answering query %d\n", rank,
+                qi + 1);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+      }
+      reduce_top(&top, rank, size);
+      if (rank == 0 && !topk_format(&top, out_batch)) {
+        fprintf(stderr, "Rank 0: out of memory answering query %d\n",
+                qi + 1);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+      }
+      topk_free(&top);
+    } else if (!answer_query(data, &queries[qi], &plans[qi], out_batch,
+                             &scanned, &kernel)) {
+      fprintf(stderr, "Rank %d: out of memory answering query %d\n", rank,
+              qi + 1);
+      MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    qt->seconds = timing_now() - qt->seconds;
+    qt->rows_scanned = (double)scanned;
+    /* Every rank ran the same kernel; count the query once. */
+    qt->kernel = kernel && rank == 0;
+    timing_output(qt, out_batch->data + at, out_batch->len - at);
+    out_lens[out_count++] = (long long)(out_batch->len - at);
+
+    if (out_count == QPE_MPI_OUTPUT_QUERIES || qi == num_queries - 1) {
+      mark = timing_lap(timing, TIME_FILTER, mark);
+      gather_results(out_batch, out_lens, out_count, qi + 1 - out_count,
+                     rank, size, store, data->scratch, sink);
+      mark = timing_lap(timing, TIME_OUTPUT, mark);
+      out_batch->len = 0;
+      out_count = 0;
+    }
+  }
+  timing_lap(timing, TIME_FILTER, mark);
+  free(batch_outs);
+}
+
+/*
+Name: serve_requests():
+Parameters: const RankData *data, const TableStats *stats,
+            const QPEOptions *opts, QueryCache *cache, QueryServer *server,
+            int rank, int size
+Return: void
+Description:
+
+The --serve loop. For every query serve_next() returns on rank 0, the length
+of its query_pack() form (-1 once the server stops) and then the form itself
+are broadcast; every rank plans it, --cache hits are shared as for a query
+file, and run_partitioned() answers it over the slices into an in-memory
+sink on rank 0, which sends the lines back with serve_reply(). Prints how
+many queries were served on rank 0 at the end. Collective.
+*/
+static void serve_requests(const RankData *data, const TableStats *stats,
+                           const QPEOptions *opts, QueryCache *cache,
+                           QueryServer *server, int rank, int size) {
+  RunTiming timing;
+  Buffer packed;
+  Query q;
+  QueryPlan plan;
+  ResultStore store = {.cache = cache, .queries = &q, .plans = &plan};
+
+  timing_init(&timing);
+  if (!timing_queries(&timing, 1)) {
+    fprintf(stderr, "Rank %d: out of memory timing queries\n", rank);
+    MPI_Abort(MPI_COMM_WORLD, 1);
+  }
+  buffer_init(&packed);
+  if (rank == 0) {
+    printf("Serving queries from %s on %d ranks\n",
+           server->path ? server->path : "stdin", size);
+    fflush(stdout);
+  }
+
+  for (;;) {
+    OutputSink reply = {0};
+    char *reply_data = NULL;
+    size_t reply_len = 0;
+    long long len = -1;
+    double start = timing_now();
+
+    while (rank == 0 && serve_next(server, &q)) {
+      if (output_open_memory(&reply, &reply_data, &reply_len)) {
+        packed.len = 0;
+        pack_queries(&q, 1, &packed);
+        len = (long long)packed.len;
+        break;
       }
+      serve_error(server, "out of memory");
+    }
+    MPI_Bcast(&len, 1, MPI_LONG_LONG, 0, MPI_COMM_WORLD);
+    if (len < 0) {
+      break;
+    }
+    if (rank != 0 && !buffer_reserve(&packed, (size_t)len)) {
+      fprintf(stderr, "Rank %d: out of memory receiving queries\n", rank);
+      MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    bcast_bytes(packed.data, (size_t)len, 0, MPI_COMM_WORLD);
+    if (rank != 0 &&
+        query_unpack((const unsigned char *)packed.data, (size_t)len, &q) ==
+            0) {
+      fprintf(stderr, "Rank %d: received a corrupt query\n", rank);
+      MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+
+    plan_query(stats, data->index,
+               data->table ? QPE_COST_COLUMNAR_SCAN : QPE_COST_ROW_SCAN,
+               &q.where, &plan);
+    if (opts->cache) {
+      share_cache_hits(cache, &q, &plan, 1, rank);
+    }
+    if (opts->explain && rank == 0) {
+      plan_explain(stderr, (int)server->served + 1, &q.where, &plan);
+    }
+    run_partitioned(data, &q, &plan, 1, false, rank, size, &timing, &store,
+                    &reply);
+    if (rank == 0) {
+      if (output_close(&reply)) {
+        serve_reply(server, reply_data, reply_len, timing_now() - start);
+      } else {
+        serve_error(server, "out of memory");
+      }
+      free(reply_data);
+    }
+  }
+
+  if (rank == 0) {
+    printf("\nServed %lld queries in %.6f seconds (%.6f s mean)\n",
+           server->served, server->seconds,
+           server->served > 0 ? server->seconds / server->served : 0.0);
+    if (cache) {
+      printf("  Result cache: %lld hits, %lld misses\n", cache->hits,
+             cache->misses);
+    }
+  }
+  buffer_free(&packed);
+  timing_free(&timing);
+}
+
+/*
+Name: dispatch_next():
+Parameters: Dispatcher *d, int worker
+Return: void
+Description:
+
+Hands worker (numbered from 0, MPI rank worker + 1) the next query with
+MPI_Isend, or -1 once every query is handed out. PLAN_CACHED queries are
+skipped. After the -1 the worker gets nothing more. The Isend slot is reused
+in turn, waiting first for the send QPE_MPI_DISPATCH_DEPTH messages back to
+finish.
+*/
+static void dispatch_next(Dispatcher *d, int worker) {
+  if (d->stopped[worker]) {
+    return;
+  }
+  int slot = worker * QPE_MPI_DISPATCH_DEPTH +
+             d->sent[worker]++ % QPE_MPI_DISPATCH_DEPTH;
+  MPI_Wait(&d->sends[slot], MPI_STATUS_IGNORE);
+  while (d->next < d->num_queries && d->plans[d->next].path == PLAN_CACHED) {
+    ++d->next;
+  }
+  if (d->next < d->num_queries) {
+    d->ids[slot] = d->next++;
+  } else {
+    d->ids[slot] = -1;
+    d->stopped[worker] = true;
+  }
+  MPI_Isend(&d->ids[slot], 1, MPI_INT, worker + 1, TAG_QUERY_ID,
+            MPI_COMM_WORLD, &d->sends[slot]);
+}
+
+/*
+Name: write_dispatched():
+Parameters: const ResultStore *store, int qi, Buffer *result,
+            OutputSink *sink
+Return: void
+Description:
+
+Writes query qi's lines in --mode=query, the stored ones of a PLAN_CACHED
+query or else the worker's result, which is handed to store and released.
+*/
+static void write_dispatched(const ResultStore *store, int qi, Buffer *result,
+                             OutputSink *sink) {
+  const QueryPlan *plan = &store->plans[qi];
+  if (plan->path == PLAN_CACHED) {
+    output_write(sink, qi + 1, plan->cached, plan->cached_len);
+    return;
+  }
+  output_write(sink, qi + 1, result->data, result->len);
+  store_result(store, qi, result->data, result->len);
+  buffer_free(result);
+}
+
+/*
+Name: dispatch_queries():
+Parameters: int num_queries, int size, const ResultStore *store,
+            OutputSink *sink
+Return: void
+Description:
+
+Rank 0's side of --mode=query. Every worker starts with
+QPE_MPI_DISPATCH_DEPTH queries and gets one more each time it returns a
+result, so fast workers take more queries. Results arrive in any order. Each
+one is kept until all earlier queries are in, then written to out, so the
+output is the same as qpe_seq. The next result header is received with
+MPI_Irecv while finished results are being written. PLAN_CACHED queries
+count as arrived from the start.
+*/
+static void dispatch_queries(int num_queries, int size,
+                             const ResultStore *store, OutputSink *sink) {
+  int workers = size - 1;
+  size_t slots = (size_t)workers * QPE_MPI_DISPATCH_DEPTH;
+  Buffer *results = calloc((size_t)num_queries + 1, sizeof(Buffer));
+  bool *arrived = calloc((size_t)num_queries + 1, sizeof(bool));
+  Dispatcher d = {.plans = store->plans,
+                  .num_queries = num_queries,
+                  .next = 0,
+                  .ids = malloc(slots * sizeof(int)),
+                  .sends = malloc(slots * sizeof(MPI_Request)),
+                  .sent = calloc((size_t)workers, sizeof(int)),
+                  .stopped = calloc((size_t)workers, sizeof(bool))};
+  int received = 0;
+  int written = 0;
+
+  if (!results || !arrived || !d.ids || !d.sends || !d.sent || !d.stopped) {
+    fprintf(stderr, "Rank 0: out of memory dispatching queries\n");
+    MPI_Abort(MPI_COMM_WORLD, 1);
+  }
+  for (size_t i = 0; i < slots; i++) {
+    d.sends[i] = MPI_REQUEST_NULL;
+  }
+  for (int qi = 0; qi < num_queries; ++qi) {
+    if (store->plans[qi].path == PLAN_CACHED) {
+      arrived[qi] = true;
+      received++;
+    }
+  }
+  for (int k = 0; k < QPE_MPI_DISPATCH_DEPTH; k++) {
+    for (int w = 0; w < workers; w++) {
+      dispatch_next(&d, w);
+    }
+  }
+
+  while (received < num_queries) {
+    long long header[2]; /* query number, result bytes */
+    MPI_Request request;
+    MPI_Status status;
+
+    MPI_Irecv(header, 2, MPI_LONG_LONG, MPI_ANY_SOURCE, TAG_RESULT_HEADER,
+              MPI_COMM_WORLD, &request);
+    while (written < num_queries && arrived[written]) {
+      write_dispatched(store, written, &results[written], sink);
+      written++;
+    }
+    MPI_Wait(&request, &status);
+
+    int qi = (int)header[0];
+    size_t bytes = (size_t)header[1];
+    if (!buffer_reserve(&results[qi], bytes + 1)) {
+      fprintf(stderr, "Rank 0: out of memory receiving query %d results\n",
+              qi + 1);
+      MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    recv_bytes(results[qi].data, bytes, status.MPI_SOURCE, TAG_RESULT_DATA,
+               MPI_COMM_WORLD);
+    results[qi].len = bytes;
+    arrived[qi] = true;
+    received++;
+    dispatch_next(&d, status.MPI_SOURCE - 1);
+  }
+
+  for (; written < num_queries; written++) {
+    write_dispatched(store, written, &results[written], sink);
+  }
+  MPI_Waitall((int)slots, d.sends, MPI_STATUSES_IGNORE);
+
+  free(results);
+  free(arrived);
+  free(d.ids);
+  free(d.sends);
+  free(d.sent);
+  free(d.stopped);
+}
+
+/*
+Name: serve_queries():
+Parameters: const RankData *data, const Query *queries,
+            const QueryPlan *plans, int rank, RunTiming *timing
+Return: void
+Description:
+
+A worker's side of --mode=query: answers the queries rank 0 hands out over
+the rank's replica of the table until it receives -1, sending each result
+back as a (query, bytes) header followed by the bytes. The next query number
+is received with MPI_Irecv while the current query runs. Each query answered
+is timed here, so reduce_timing() finds its figures on this rank alone;
+waiting for queries counts as distribute and sending results as output.
+*/
+static void serve_queries(const RankData *data, const Query *queries,
+                          const QueryPlan *plans, int rank, RunTiming *timing) {
+  int ids[2];
+  int cur = 0;
+  MPI_Request request;
+  Buffer out;
+  double mark = timing_now();
+
+  buffer_init(&out);
+  MPI_Irecv(&ids[cur], 1, MPI_INT, 0, TAG_QUERY_ID, MPI_COMM_WORLD, &request);
+  for (;;) {
+    MPI_Wait(&request, MPI_STATUS_IGNORE);
+    int qi = ids[cur];
+    if (qi < 0) {
+      break;
+    }
+    cur ^= 1;
+    MPI_Irecv(&ids[cur], 1, MPI_INT, 0, TAG_QUERY_ID, MPI_COMM_WORLD,
+              &request);
+    mark = timing_lap(timing, TIME_DISTRIBUTE, mark);
+
+    QueryTiming *qt = &timing->queries[qi];
+    size_t scanned = 0;
+    bool kernel = false;
+    if (!answer_query(data, &queries[qi], &plans[qi], &out, &scanned,
+                      &kernel)) {
+      fprintf(stderr, "Rank %d: out of memory answering query %d\n", rank,
+              qi + 1);
+      MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    qt->seconds = timing_now() - mark;
+    qt->rows_scanned = (double)scanned;
+    qt->kernel = kernel;
+    timing_output(qt, out.data, out.len);
+    mark = timing_lap(timing, TIME_FILTER, mark);
+
+    long long header[2] = {qi, (long long)out.len};
+    MPI_Send(header, 2, MPI_LONG_LONG, 0, TAG_RESULT_HEADER, MPI_COMM_WORLD);
+    send_bytes(out.data, out.len, 0, TAG_RESULT_DATA, MPI_COMM_WORLD);
+    out.len = 0;
+    mark = timing_lap(timing, TIME_OUTPUT, mark);
+  }
+  timing_lap(timing, TIME_DISTRIBUTE, mark);
+  buffer_free(&out);
+}
+
+/*
+Name: reduce_timing():
+Parameters: RunTiming *timing, TimingSummary *summary, int rank, int size
+Return: void
+Description:
+
+Stops every rank's clock and reduces the ranks' figures to rank 0: each
+phase's min, max and sum over the ranks into summary, and into timing's
+per-query records the slowest rank's time and the rows and bytes summed
+over the ranks. summary and the per-query records are only meaningful on
+rank 0 afterwards. Collective.
+*/
+static void reduce_timing(RunTiming *timing, TimingSummary *summary,
+                          int rank, int size) {
+  int n = timing->num_queries;
+  double *seconds = malloc(((size_t)n + 1) * sizeof(double));
+  double *counts = malloc(((size_t)n * 3 + 1) * sizeof(double));
+  double *reduced = malloc(((size_t)n * 3 + 1) * sizeof(double));
+
+  if (!seconds || !counts || !reduced) {
+    fprintf(stderr, "Rank %d: out of memory reducing timing\n", rank);
+    MPI_Abort(MPI_COMM_WORLD, 1);
+  }
+  timing_finish(timing);
+  MPI_Reduce(timing->value, summary->min, QPE_TIMING_VALUES, MPI_DOUBLE,
+             MPI_MIN, 0, MPI_COMM_WORLD);
+  MPI_Reduce(timing->value, summary->max, QPE_TIMING_VALUES, MPI_DOUBLE,
+             MPI_MAX, 0, MPI_COMM_WORLD);
+  MPI_Reduce(timing->value, summary->sum, QPE_TIMING_VALUES, MPI_DOUBLE,
+             MPI_SUM, 0, MPI_COMM_WORLD);
+  summary->processes = size;
+
+  for (int i = 0; i < n; i++) {
+    seconds[i] = timing->queries[i].seconds;
+    counts[3 * i] = timing->queries[i].rows_scanned;
+    counts[3 * i + 1] = timing->queries[i].rows_matched;
+    counts[3 * i + 2] = timing->queries[i].bytes;
+  }
+  MPI_Reduce(rank == 0 ? MPI_IN_PLACE : seconds, seconds, n, MPI_DOUBLE,
+             MPI_MAX, 0, MPI_COMM_WORLD);
+  MPI_Reduce(counts, reduced, 3 * n, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+  if (rank == 0) {
+    for (int i = 0; i < n; i++) {
+      timing->queries[i].seconds = seconds[i];
+      timing->queries[i].rows_scanned = reduced[3 * i];
+      timing->queries[i].rows_matched = reduced[3 * i + 1];
+      timing->queries[i].bytes = reduced[3 * i + 2];
     }
   }
-  return buffer_append(buf, "\n", 1);
+  free(seconds);
+  free(counts);
+  free(reduced);
 }
@@ -0,0 +1,324 @@
+/*
+
+QPENuma.c
+
+Authors:
+    Aidan Levy
+    Maddie Powell
+    Nick Corcoran
+    Austin Phalines
+    Dean Bullock
+
+Creation Date: 10-14-2026
+
+Description:
+
+First-touch placement of the rows and column store for qpe_omp --numa (see
+QPENuma.h). The copies are allocated with malloc(), which hands out large
+blocks as fresh mmap() pages, and the pages get their node when the team
+writes them. Threads are pinned first, one CPU each spread evenly over the
+CPUs the process may run on, so a thread stays on the node its partition was
+placed on; when the OpenMP runtime already binds them (OMP_PROC_BIND or
+OMP_PLACES) its binding is kept instead. Nodes are read with getcpu(), so no
+libnuma is needed. Without OpenMP the placement is a plain copy.
+
+*/
+
+#define _GNU_SOURCE
+
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "QPENuma.h"
+
+/*
+Function Prototypes
+*/
+static bool pin_thread(const cpu_set_t *allowed, int t, int threads);
+static void copy_partition(const Placement *p, int t, CarInventory *rows,
+                           const LoadedTable *loaded, ColumnTable *placed,
+                           const ColumnTable *table);
+
+/*
+Name: numa_node():
+Parameters: void
+Return: int
+Description:
+
+The NUMA node the calling thread is running on, or -1 if it cannot be told.
+*/
+int numa_node(void) {
+#ifdef SYS_getcpu
+  unsigned cpu;
+  unsigned node;
+
+  if (syscall(SYS_getcpu, &cpu, &node, NULL) == 0) {
+    return (int)node;
+  }
+#endif
+  return -1;
+}
+
+/*
+Name: numa_first_row():
+Parameters: const Placement *p, int t
+Return: size_t
+Description:
+
+The first row of thread t's partition; numa_first_row(p, p->threads) is the
+row count, so partition t is [numa_first_row(p, t), numa_first_row(p, t + 1)).
+*/
+size_t numa_first_row(const Placement *p, int t) {
+  return ((size_t)t * p->count + (size_t)p->threads - 1) / (size_t)p->threads;
+}
+
+/*
+Name: numa_owner():
+Parameters: const Placement *p, size_t row
+Return: int
+Description:
+
+The thread whose partition holds row. Rows past the placed ones belong to the
+last thread.
+*/
+int numa_owner(const Placement *p, size_t row) {
+  if (row >= p->count) {
+    return p->threads - 1;
+  }
+  return (int)(row * (size_t)p->threads / p->count);
+}
+
+/*
+Name: numa_local():
+Parameters: const Placement *p, size_t row
+Return: bool
+Description:
+
+Whether row is in memory local to the calling OpenMP thread: the thread runs
+on the node its owner touched the row from, or, when nodes cannot be told,
+the thread is the owner.
+*/
+bool numa_local(const Placement *p, size_t row) {
+  int owner = numa_owner(p, row);
+  int node = p->node[owner] >= 0 ? numa_node() : -1;
+
+  if (node >= 0) {
+    return node == p->node[owner];
+  }
+#ifdef _OPENMP
+  return owner == omp_get_thread_num();
+#else
+  return owner == 0;
+#endif
+}
+
+/*
+Name: pin_thread():
+Parameters: const cpu_set_t *allowed, int t, int threads
+Return: bool
+Description:
+
+Pins the calling thread, thread t of threads, to one CPU of allowed, the
+threads spread evenly over them in CPU order. Returns false if the pin was
+refused.
+*/
+static bool pin_thread(const cpu_set_t *allowed, int t, int threads) {
+  int cpus = CPU_COUNT(allowed);
+  int target = (int)((long long)t * cpus / threads);
+  cpu_set_t mine;
+
+  for (int cpu = 0; cpus > 0 && cpu < CPU_SETSIZE; cpu++) {
+    if (CPU_ISSET(cpu, allowed) && target-- == 0) {
+      CPU_ZERO(&mine);
+      CPU_SET(cpu, &mine);
+      return sched_setaffinity(0, sizeof(mine), &mine) == 0;
+    }
+  }
+  return false;
+}
+
+/*
+Name: copy_partition():
+Parameters: const Placement *p, int t, CarInventory *rows,
+            const LoadedTable *loaded, ColumnTable *placed,
+            const ColumnTable *table
+Return: void
+Description:
+
+Copies partition t of loaded's rows into rows and, when table is not NULL, of
+its columns into placed's, so the calling thread is the first to touch those
+pages.
+*/
+static void copy_partition(const Placement *p, int t, CarInventory *rows,
+                           const LoadedTable *loaded, ColumnTable *placed,
+                           const ColumnTable *table) {
+  size_t lo = numa_first_row(p, t);
+  size_t n = numa_first_row(p, t + 1) - lo;
+
+  memcpy(rows + lo, loaded->rows + lo, n * sizeof(CarInventory));
+  if (table == NULL) {
+    return;
+  }
+  memcpy(placed->id + lo, table->id + lo, n * sizeof(int32_t));
+  memcpy(placed->year_make + lo, table->year_make + lo, n * sizeof(int32_t));
+  memcpy(placed->price + lo, table->price + lo, n * sizeof(int32_t));
+  memcpy(placed->model + lo, table->model + lo, n * sizeof(uint16_t));
+  memcpy(placed->color + lo, table->color + lo, n * sizeof(uint16_t));
+  memcpy(placed->dealer + lo, table->dealer + lo, n * sizeof(uint16_t));
+}
+
+/*
+Name: numa_place():
+Parameters: Placement *p, LoadedTable *loaded, ColumnTable *table,
+            int threads
+Return: bool
+Description:
+
+Pins the OpenMP threads and replaces loaded's rows and, when table is not
+NULL, its columns with copies whose partition t was first touched by thread
+t, recording in p where each partition went. table must have been built from
+loaded. If the team comes up smaller than threads, each thread places every
+partition of its stride. Returns false when out of memory, leaving loaded
+and table as they were.
+*/
+bool numa_place(Placement *p, LoadedTable *loaded, ColumnTable *table,
+                int threads) {
+  size_t count = loaded->count > 0 ? loaded->count : 1;
+  ColumnTable placed;
+  CarInventory *rows;
+  cpu_set_t allowed;
+  bool have_mask = sched_getaffinity(0, sizeof(allowed), &allowed) == 0;
+  int pinned = 0;
+
+  memset(p, 0, sizeof(*p));
+  memset(&placed, 0, sizeof(placed));
+  p->threads = threads > 0 ? threads : 1;
+  p->count = loaded->count;
+  p->node = malloc((size_t)p->threads * sizeof(int));
+  rows = malloc(count * sizeof(CarInventory));
+  if (table != NULL) {
+    placed.id = malloc(count * sizeof(int32_t));
+    placed.year_make = malloc(count * sizeof(int32_t));
+    placed.price = malloc(count * sizeof(int32_t));
+    placed.model = malloc(count * sizeof(uint16_t));
+    placed.color = malloc(count * sizeof(uint16_t));
+    placed.dealer = malloc(count * sizeof(uint16_t));
+  }
+  if (p->node == NULL || rows == NULL ||
+      (table != NULL &&
+       (placed.id == NULL || placed.year_make == NULL ||
+        placed.price == NULL || placed.model == NULL ||
+        placed.color == NULL || placed.dealer == NULL))) {
+    free(placed.id);
+    free(placed.year_make);
+    free(placed.price);
+    free(placed.model);
+    free(placed.color);
+    free(placed.dealer);
+    free(rows);
+    placement_free(p);
+    return false;
+  }
+
+  p->binding = BIND_PINNED;
+#ifdef _OPENMP
+  if (omp_get_proc_bind() != omp_proc_bind_false) {
+    p->binding = BIND_RUNTIME;
+  }
+#endif
+
+  /* Parallel Section: thread t pins itself, then writes only partition t. */
+#ifdef _OPENMP
+#pragma omp parallel num_threads(p->threads) reduction(+ : pinned)
+#endif
+  {
+    int me = 0;
+    int team = 1;
+#ifdef _OPENMP
+    me = omp_get_thread_num();
+    team = omp_get_num_threads();
+#endif
+    if (p->binding == BIND_PINNED && have_mask &&
+        pin_thread(&allowed, me, p->threads)) {
+      pinned++;
+    }
+    for (int t = me; t < p->threads; t += team) {
+      p->node[t] = numa_node();
+      copy_partition(p, t, rows, loaded, &placed, table);
+    }
+  }
+  if (p->binding == BIND_PINNED && pinned < p->threads) {
+    p->binding = BIND_NONE;
+  }
+
+  for (int t = 0; t < p->threads; t++) {
+    bool seen = false;
+    for (int u = 0; u < t && !seen; u++) {
+      seen = p->node[u] == p->node[t];
+    }
+    p->num_nodes += !seen && p->node[t] >= 0;
+  }
+
+  loaded_table_free(loaded);
+  loaded->rows = rows;
+  loaded->storage = rows;
+  loaded->count = p->count;
+  loaded->cap = p->count;
+  loaded->mapped = 0;
+  if (table != NULL) {
+    free(table->id);
+    free(table->year_make);
+    free(table->price);
+    free(table->model);
+    free(table->color);
+    free(table->dealer);
+    table->id = placed.id;
+    table->year_make = placed.year_make;
+    table->price = placed.price;
+    table->model = placed.model;
+    table->color = placed.color;
+    table->dealer = placed.dealer;
+    table->cap = table->count;
+  }
+  return true;
+}
+
+/*
+Name: placement_free():
+Parameters: Placement *p
+Return: void
+Description:
+
+Releases the per-partition nodes. The placed rows and columns belong to
+the LoadedTable and ColumnTable.
+*/
+void placement_free(Placement *p) {
+  free(p->node);
+  p->node = NULL;
+}
+
+/*
+Name: numa_binding_name():
+Parameters: PlaceBinding binding
+Return: const char *
+Description:
+
+How the threads were bound, for the timing summary.
+*/
+const char *numa_binding_name(PlaceBinding binding) {
+  switch (binding) {
+  case BIND_RUNTIME:
+    return "bound by OMP_PROC_BIND";
+  case BIND_PINNED:
+    return "pinned";
+  default:
+    return "not pinned";
+  }
+}
@@ -0,0 +1,54 @@
+/*
+
+QPENuma.h
+
+First-touch placement of the shared table for qpe_omp --numa (see
+QPENuma.c). Linux puts a page on the NUMA node of the thread that first
+writes it, so a table filled by one thread lives on one socket and every
+other socket's threads scan it over the interconnect. numa_place() pins the
+threads (unless OMP_PROC_BIND already does) and copies the rows and the
+column store into fresh memory, each thread writing its own static partition:
+thread t gets rows [numa_first_row(t), numa_first_row(t + 1)). A scan that
+hands each thread the chunks of its own partition then reads local memory.
+
+*/
+
+#ifndef QPE_NUMA_H
+#define QPE_NUMA_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "QPEColumn.h"
+#include "QPELoad.h"
+
+/*
+Struct Definitions
+*/
+typedef enum {
+  BIND_NONE,    /* threads may migrate, placement is a hint */
+  BIND_RUNTIME, /* OMP_PROC_BIND / OMP_PLACES bound them */
+  BIND_PINNED   /* numa_place() pinned one CPU per thread */
+} PlaceBinding;
+
+typedef struct {
+  int threads;   /* partitions, one per thread */
+  size_t count;  /* rows placed */
+  int *node;     /* per partition: node of the thread that touched it, or -1 */
+  int num_nodes; /* distinct nodes among those */
+  PlaceBinding binding;
+} Placement;
+
+/*
+Function Prototypes
+*/
+bool numa_place(Placement *p, LoadedTable *loaded, ColumnTable *table,
+                int threads);
+void placement_free(Placement *p);
+size_t numa_first_row(const Placement *p, int t);
+int numa_owner(const Placement *p, size_t row);
+bool numa_local(const Placement *p, size_t row);
+int numa_node(void);
+const char *numa_binding_name(PlaceBinding binding);
+
+#endif
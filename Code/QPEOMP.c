@@ -1,61 +1,188 @@
-#include <ctype.h>
 #include <omp.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <strings.h>
 
 #include "../btree/btree.h"
+#include "QPEAggregate.h"
+#include "QPEBatch.h"
+#include "QPEBuffer.h"
+#include "QPECache.h"
+#include "QPEColumn.h"
+#include "QPEFilter.h"
+#include "QPEIndex.h"
+#include "QPEKernel.h"
+#include "QPELoad.h"
+#include "QPENuma.h"
+#include "QPEOptions.h"
+#include "QPEOutput.h"
+#include "QPEPlan.h"
+#include "QPEQuery.h"
+#include "QPERefresh.h"
+#include "QPEServe.h"
+#include "QPEStats.h"
+#include "QPEStream.h"
+#include "QPETiming.h"
+#include "QPETopK.h"
+#include "QPEZone.h"
 
 typedef struct {
-  int ID;
-  char Model[20];
-  int YearMake;
-  char Color[20];
-  int Price;
-  char Dealer[20];
-} CarInventory;
+  const ColumnTable *table;
+  Query *q;
+  Buffer *buf;
+} ColumnarCtx;
 
 typedef struct {
-  char select_attrs[6][20];
-  int num_select_attrs;
-  char where_raw[256];
-} Query;
+  Query *q;
+  long long id_hi;
+  Buffer *buf;
+  size_t scanned;
+  bool ok;
+} RangeCtx;
 
+/*
+Everything the queries read, built once after load_database() and never
+modified while queries run, so every thread shares it without locks. With
+--serve it is refreshed between requests, when no task is running.
+*/
+typedef struct {
+  const CarInventory *rows; /* ID-ordered rows from load_table() */
+  size_t count;
+  const ColumnTable *table;    /* --layout=columnar, else NULL */
+  const SecondaryIndex *index; /* --index, else NULL */
+  const ZoneMap *zones;        /* block summaries, NULL if not built */
+  const TableStats *stats;
+} Snapshot;
+
+/*
+A job is one query, or the whole --batch shared scan, split into chunk tasks.
+Full scans get one chunk per chunk_rows rows of the snapshot; ID range and
+index plans run as a single task. Chunk c formats the matches of the job's
+j-th query into parts[c * width + j] (width is 1 for a single query and
+num_queries for the batch), so writing the parts in chunk order keeps the
+sequential row order. An aggregate query's chunks each fill their own
+AggTable instead; the last chunk to finish merges them and formats the
+groups into parts[0]. A full scan ORDER BY Price ... LIMIT query keeps one
+TopK per thread, which every chunk that thread runs adds to, and is merged
+and formatted the same way. Ordered by ID it runs as a single task walking
+the B-tree instead.
+*/
+typedef struct {
+  Query *q; /* NULL for the batch job */
+  const QueryPlan *plan;
+  int query_no;
+  Buffer *parts;
+  int num_chunks;
+  int width;
+  int remaining;        /* chunk tasks not finished yet */
+  bool failed;          /* a result could not be buffered */
+  ColumnFilter *filter; /* columnar full scan: WHERE bound for all chunks */
+  ZoneFilter *zones;    /* full scan of one query: blocks it can skip */
+  ScanKernel kernel;    /* row full scan: specialized WHERE, shape 0 if none */
+  AggTable *aggs;       /* aggregate query: one table per chunk, else NULL */
+  TopK *tops;           /* ORDER BY Price scan: one heap per thread, or NULL */
+  int num_tops;
+  double seconds;       /* task time summed over the chunks */
+  size_t scanned;       /* rows the chunks tested */
+} Job;
+
+/*
+The result Buffers of every Job of a run, kept for the whole run (or the
+whole --serve session) so a query takes its parts from Buffers that already
+hold memory instead of allocating them. parts_reserve() is only called while
+no task runs, as growing the array moves it; parts_reset() hands the same
+Buffers out again to the next request.
+*/
 typedef struct {
-  CarInventory *arr;
-  size_t index;
-} ToArrayCtx;
+  Buffer *bufs;
+  size_t cap;  /* Buffers allocated */
+  size_t used; /* handed out since the last parts_reset() */
+} PartPool;
 
-typedef enum { VAL_INT, VAL_STR } ValueType;
+/* Per-thread scheduler counters, padded so threads never share a line. */
+typedef struct {
+  double busy; /* seconds spent inside tasks */
+  long tasks;
+  size_t rows;       /* rows scanned by full-scan chunks */
+  size_t local_rows; /* those in memory local to the thread (--numa) */
+  char pad[32];
+} ThreadStats;
 
+/*
+With --numa, every chunk task of the run grouped by the thread whose
+partition holds the chunk's first row (numa_owner()); single-task plans are
+dealt out in turn. Each task claims the next chunk of its own thread's group
+and only takes one from another group when its own is empty, so threads scan
+their own partitions while they have any left and still share the tail.
+*/
 typedef struct {
-  ValueType type;
-  int i;
-  char s[64];
-} Value;
+  Job *job;
+  int chunk;
+} ChunkRef;
+
+typedef struct {
+  ChunkRef *chunks; /* grouped by owner thread */
+  int *next;        /* per thread: next unclaimed entry of its group */
+  int *end;         /* per thread: end of its group */
+  int threads;
+} LocalQueues;
+
+typedef struct {
+  const Snapshot *snap;
+  struct btree *tree;
+  const QueryBatch *batch; /* --batch, else NULL */
+  size_t chunk_rows;
+  bool ordered;
+  ThreadStats *stats;
+  QueryTiming *timing; /* one per query, filled in by finish_job() */
+  OutputSink *sink;
+  const Placement *placement; /* --numa, else NULL */
+  LocalQueues *queues;        /* --numa, else NULL */
+  PartPool *parts;            /* every Job's result Buffers */
+} Scheduler;
 
-static bool to_array_cb(const void *item, void *udata);
-CarInventory *btree_to_array(struct btree *tree, size_t *out_count);
 int car_compare(const void *a, const void *b, void *udata);
-struct btree *load_database(const char *filename);
+struct btree *load_database(const char *filename, TableStats *stats,
+                            LoadedTable *loaded);
 bool print_iter(const void *item, void *udata);
 void print_all_tuples(struct btree *tree);
-static const char *skip_ws(const char *s);
-static void trim_trailing(char *s);
-void load_queries(const char *filename, Query **queries, int *num_queries);
-static bool read_identifier(const char **p, char *out, size_t cap);
-static bool read_value(const char **p, Value *v);
-static int compare_attr_value(const CarInventory *car, const char *attr,
-                              const Value *v);
-static bool eval_comparison(const CarInventory *car, const char **p);
-static bool eval_term(const CarInventory *car, const char **p);
-static bool eval_factor(const CarInventory *car, const char **p);
-static bool eval_expr(const CarInventory *car, const char **p);
-int match_where(const CarInventory *car, const char *where_raw);
-void print_selected(const CarInventory *car, Query *q);
-void process_query(struct btree *tree, Query *q);
+bool scan_rows(const CarInventory *rows, size_t begin, size_t end, Query *q,
+               Buffer *out);
+static bool columnar_emit_cb(size_t row, void *udata);
+bool scan_columnar(const ColumnTable *table, const ColumnFilter *filter,
+                   size_t begin, size_t end, Query *q, Buffer *out);
+static bool range_iter_cb(const void *item, void *udata);
+bool process_query_range(struct btree *tree, const QueryPlan *plan, Query *q,
+                         Buffer *out, size_t *scanned);
+bool process_query_indexed(const SecondaryIndex *index,
+                           const CarInventory *rows, const IndexProbe *probe,
+                           Query *q, Buffer *out, bool *done, size_t *scanned);
+bool run_query(const Snapshot *snap, struct btree *tree,
+               const QueryPlan *plan, Query *q, Buffer *out, size_t *scanned);
+bool parts_reserve(PartPool *pool, size_t needed);
+Buffer *parts_take(PartPool *pool, size_t n);
+void parts_reset(PartPool *pool);
+void parts_free(PartPool *pool);
+int job_chunks(const Snapshot *snap, size_t chunk_rows, const Query *q,
+               const QueryPlan *plan);
+bool job_init(Job *job, const Snapshot *snap, size_t chunk_rows, Query *q,
+              const QueryPlan *plan, int query_no, int width, PartPool *pool);
+void job_free(Job *job);
+void job_write(const Job *job, int j, OutputSink *sink);
+void job_store(const Job *job, int j, const Query *q, QueryCache *cache);
+static void run_chunk(const Scheduler *sched, Job *job, int c);
+static int chunk_owner(const Job *job, int c, const Placement *p,
+                       size_t chunk_rows, int *turn);
+bool local_queues_init(LocalQueues *lq, Job *jobs, int num_jobs,
+                       const Placement *p, size_t chunk_rows);
+void local_queues_free(LocalQueues *lq);
+static void run_local(const Scheduler *sched);
+static void finish_job(const Scheduler *sched, Job *job);
+bool serve_queries(QueryServer *server, Snapshot *snap, ResidentTables *live,
+                   size_t chunk_rows, int thread_num, bool explain);
+int run_stream(const QPEOptions *opts, RunTiming *timing, int thread_num,
+               OutputSink *sink);
 
 /*
 Name: main():
@@ -63,33 +190,89 @@ Parameters: int argc, char **argv
 Return: int
 Description:
 
-Initializes the OpenMP runtime, loads the database and queries, and uses a
-parallel for loop to distribute query execution across threads while timing the
-overall runtime.
+Initializes the OpenMP runtime, loads the database and queries, and runs them as
+OpenMP tasks while timing every phase and query (QPETiming.c). The loaded rows
+form a read-only Snapshot array that all queries and threads share. With
+--layout=columnar the queries scan a column store built from that array instead;
+with --index, queries the secondary indexes can answer only visit their
+candidate rows. Every query is planned from the load-time statistics first, then
+becomes a Job: full scans are split into (query, row range) chunk tasks of
+--chunk rows, so a few heavy queries spread over all threads while light ones
+fill the gaps. With --batch the full-scan queries share one Job whose chunks run
+the QPEBatch.c scan. With --numa the rows and column store are first copied into
+memory each thread first-touches a static partition of (QPENuma.c), and every
+chunk is claimed first by the thread whose partition holds it.
+
+Each chunk formats its results into its own Buffer; the chunk that finishes a
+Job last writes all of them under a single output lock, so no lock is taken
+per row. With --ordered the Jobs are instead written in query order after all
+tasks finish, matching qpe_seq byte for byte. With --cache, queries the
+result cache (QPECache.c) answers become single-chunk Jobs that copy the
+stored lines, and every other query's lines are stored once all tasks are
+done. With --serve the queries come from serve_queries() instead of the
+query file.
 */
 int main(int argc, char **argv) {
-  double par_start = omp_get_wtime();
+  RunTiming timing;
+  TimingSummary summary;
+  timing_init(&timing);
+  double mark = timing.start;
 
-  const char *filename = "db/db.txt";
-  const char *queryfile = "db/sql.txt";
   struct btree *tree;
+  ColumnTable *table = NULL;
+  const CarInventory *rows;
+  SecondaryIndex *index = NULL;
+  ZoneMap *zones;
+  Placement placement;
+  const Placement *placed = NULL;
+  TableStats stats;
+  LoadedTable loaded;
+  Snapshot snap;
   size_t count;
+  QPEOptions opts;
+  OutputSink sink;
+  QueryCache cache;
+  QueryCache *qcache = NULL;
+  QueryServer server;
+  QueryServer *qserver = NULL;
+
+  const char *bad_arg = parse_options(argc, argv, &opts);
+  if (bad_arg) {
+    fprintf(stderr, "Error: unrecognized argument %s\n", bad_arg);
+    return 1;
+  }
+  const char *filename = opts.db_file;
+  const char *queryfile = opts.query_file;
 
-  int thread_num = atoi(argv[3]);
-  omp_set_num_threads(thread_num);
-
-  if (argc >= 2)
-    filename = argv[1];
-  if (argc >= 3)
-    queryfile = argv[2];
+  int thread_num = opts.num_threads;
+  if (thread_num > 0)
+    omp_set_num_threads(thread_num);
+  else
+    thread_num = omp_get_max_threads();
+  if (opts.serve) {
+    serve_options(&opts);
+    if (!serve_open(&server, opts.serve_path))
+      return 1;
+    qserver = &server;
+  }
+  if (!output_open(&sink, opts.output_file))
+    return 1;
+  if (opts.mem_limit > 0)
+    return run_stream(&opts, &timing, thread_num, &sink);
+  if (opts.cache && cache_open(&cache, filename, opts.cache_dir))
+    qcache = &cache;
 
-  tree = load_database(filename);
+  tree = load_database(filename, &stats, &loaded);
   if (!tree) {
     fprintf(stderr, "Error: Failed to load database from %s\n", filename);
+    serve_close(qserver);
+    cache_close(qcache);
     return 1;
   }
+  mark = timing_lap(&timing, TIME_LOAD, mark);
 
-  count = btree_count(tree);
+  rows = loaded.rows;
+  count = loaded.count;
   printf("Loaded %zu tuples from %s\n", count, filename);
 
   if (count <= 10) {
@@ -97,72 +280,307 @@ int main(int argc, char **argv) {
     print_all_tuples(tree);
   }
 
+  if (opts.layout == LAYOUT_COLUMNAR) {
+    table = column_table_from_array(rows, count);
+    if (!table) {
+      serve_close(qserver);
+      cache_close(qcache);
+      loaded_table_free(&loaded);
+      btree_free(tree);
+      return 1;
+    }
+  }
+
+  if (opts.numa) {
+    if (numa_place(&placement, &loaded, table, thread_num))
+      placed = &placement;
+    else
+      fprintf(stderr, "Warning: out of memory placing the table, --numa "
+                      "ignored\n");
+    rows = loaded.rows;
+  }
+
+  if (opts.use_index) {
+    index = index_build(rows, count);
+    if (!index) {
+      fprintf(stderr, "Error: Failed to build secondary indexes\n");
+      serve_close(qserver);
+      cache_close(qcache);
+      loaded_table_free(&loaded);
+      column_table_free(table);
+      btree_free(tree);
+      return 1;
+    }
+  }
+
+  zones = zone_map_build(rows, count);
+  if (!zones)
+    fprintf(stderr, "Warning: out of memory building zone maps, full scans "
+                    "read every block\n");
+
+  snap.rows = rows;
+  snap.count = count;
+  snap.table = table;
+  snap.index = index;
+  snap.zones = zones;
+  snap.stats = &stats;
+
+  if (qserver) {
+    ResidentTables live = {.filename = filename,
+                           .loaded = &loaded,
+                           .stats = &stats,
+                           .tree = tree,
+                           .table = table,
+                           .index = index,
+                           .zones = zones,
+                           .cache = qcache};
+    bool served = serve_queries(qserver, &snap, &live, opts.chunk_rows,
+                                thread_num, opts.explain);
+    serve_close(qserver);
+    cache_close(qcache);
+    index_free(live.index);
+    zone_map_free(live.zones);
+    loaded_table_free(&loaded);
+    column_table_free(live.table);
+    btree_free(tree);
+    timing_free(&timing);
+    return served ? 0 : 1;
+  }
+
   Query *queries = NULL;
   int num_queries = 0;
+  QueryPlan *plans = NULL;
+  Job *jobs = NULL;
+  QueryBatch batch;
+  bool batched = false;
+  ThreadStats *tstats = NULL;
+  PartPool pool = {0};
+  size_t num_parts = 0;
   load_queries(queryfile, &queries, &num_queries);
   printf("Processing %d queries from %s\n", num_queries, queryfile);
 
+  plans = malloc(((size_t)num_queries + 1) * sizeof(QueryPlan));
+  jobs = calloc((size_t)num_queries + 1, sizeof(Job));
+  tstats = calloc((size_t)thread_num, sizeof(ThreadStats));
+  if (!plans || !jobs || !tstats || !timing_queries(&timing, num_queries)) {
+    fprintf(stderr, "Error: out of memory scheduling queries\n");
+    timing_free(&timing);
+    cache_close(qcache);
+    free(tstats);
+    free(jobs);
+    free(plans);
+    free(queries);
+    index_free(index);
+    zone_map_free(zones);
+    if (placed)
+      placement_free(&placement);
+    loaded_table_free(&loaded);
+    column_table_free(table);
+    btree_free(tree);
+    return 1;
+  }
+
+#pragma omp parallel for shared(snap, opts, queries, plans, num_queries)
+  for (int i = 0; i < num_queries; i++) {
+    plan_query(snap.stats, snap.index,
+               snap.table ? QPE_COST_COLUMNAR_SCAN : QPE_COST_ROW_SCAN,
+               &queries[i].where, &plans[i]);
+  }
+  for (int i = 0; i < num_queries; i++) {
+    if (qcache)
+      cache_plan(qcache, &queries[i], &plans[i]);
+    if (opts.explain)
+      plan_explain(stderr, i + 1, &queries[i].where, &plans[i]);
+  }
+
+  Scheduler sched = {.snap = &snap,
+                     .tree = tree,
+                     .batch = NULL,
+                     .chunk_rows = opts.chunk_rows,
+                     .ordered = opts.ordered,
+                     .stats = tstats,
+                     .timing = timing.queries,
+                     .sink = &sink,
+                     .placement = placed,
+                     .queues = NULL,
+                     .parts = &pool};
+
+  /*
+  Every Job takes its Buffers from one pool reserved up front, as it must not
+  grow once tasks run; --batch members are counted as well in case the batch
+  cannot be set up. A failure shows up as the queries' job_init() failing.
+  */
+  for (int i = 0; i < num_queries; i++)
+    num_parts += job_chunks(&snap, opts.chunk_rows, &queries[i], &plans[i]);
+  if (opts.batch)
+    num_parts += (size_t)job_chunks(&snap, opts.chunk_rows, NULL, NULL) *
+                 num_queries;
+  parts_reserve(sched.parts, num_parts);
+
+  if (opts.batch) {
+    int *members = malloc(((size_t)num_queries + 1) * sizeof(int));
+    int num_members = 0;
+    for (int i = 0; members && i < num_queries; i++)
+      if (plans[i].path == PLAN_FULL_SCAN && !queries[i].aggregate &&
+          !queries[i].ordered)
+        members[num_members++] = i;
+    if (members && num_members > 0 &&
+        batch_init(&batch, queries, members, num_members, table)) {
+      batched = job_init(&jobs[num_queries], &snap, opts.chunk_rows, NULL,
+                         NULL, 0, num_queries, sched.parts);
+      if (!batched)
+        batch_free(&batch);
+    }
+    if (!members || (num_members > 0 && !batched))
+      fprintf(stderr, "Warning: out of memory, --batch ignored\n");
+    free(members);
+  }
+
+  sched.batch = batched ? &batch : NULL;
+  LocalQueues queues;
+  mark = timing_lap(&timing, TIME_MATERIALIZE, mark);
+
 /*
 
-Parallel section: #pragma omp parallel for default(none) shared(tree, quieries,
-num_queries)
+Parallel section: #pragma omp parallel / #pragma omp single / #pragma omp task
 
-Parallelizing the process_query function so different threads process different
-queries
+One thread turns every Job into chunk tasks (the batch first, as it is the
+largest) and the whole team, including that thread once it is done, executes
+them. With --numa it first initializes every Job and queues their chunks by
+partition, then spawns one run_local() task per chunk. The implicit barrier
+at the end of the region waits for all tasks.
+Unless --ordered defers it, output is written from inside the region and is
+timed as part of the filter phase.
 
 */
-#pragma omp parallel for default(none) shared(tree, queries, num_queries)
+#pragma omp parallel shared(sched, jobs, queries, plans, num_queries, batched, \
+                                queues)
+  {
+#pragma omp single
+    {
+      if (batched && !placed)
+        for (int c = 0; c < jobs[num_queries].num_chunks; c++) {
+#pragma omp task firstprivate(c)
+          run_chunk(&sched, &jobs[num_queries], c);
+        }
+
+      for (int i = 0; i < num_queries; i++) {
+        if (batched && plans[i].path == PLAN_FULL_SCAN &&
+            !queries[i].aggregate && !queries[i].ordered)
+          continue;
+        if (!job_init(&jobs[i], &snap, opts.chunk_rows, &queries[i], &plans[i],
+                      i + 1, 1, sched.parts)) {
+          fprintf(stderr, "Error: out of memory scheduling query %d\n", i + 1);
+          continue;
+        }
+        if (placed)
+          continue;
+        for (int c = 0; c < jobs[i].num_chunks; c++) {
+#pragma omp task firstprivate(i, c)
+          run_chunk(&sched, &jobs[i], c);
+        }
+      }
+
+      if (placed && local_queues_init(&queues, jobs, num_queries + 1, placed,
+                                      opts.chunk_rows)) {
+        sched.queues = &queues;
+        for (int k = 0; k < queues.end[queues.threads - 1]; k++) {
+#pragma omp task
+          run_local(&sched);
+        }
+      } else if (placed) {
+        fprintf(stderr, "Warning: out of memory, chunks not queued by "
+                        "partition\n");
+        for (int j = 0; j <= num_queries; j++)
+          for (int c = 0; c < jobs[j].num_chunks; c++) {
+#pragma omp task firstprivate(j, c)
+            run_chunk(&sched, &jobs[j], c);
+          }
+      }
+    }
+  }
+  mark = timing_lap(&timing, TIME_FILTER, mark);
+  if (sched.queues)
+    local_queues_free(&queues);
+
   for (int i = 0; i < num_queries; i++) {
-    process_query(tree, &queries[i]);
+    bool in_batch = batched && plans[i].path == PLAN_FULL_SCAN &&
+                    !queries[i].aggregate && !queries[i].ordered;
+    if (opts.ordered)
+      job_write(in_batch ? &jobs[num_queries] : &jobs[i], in_batch ? i : 0,
+                &sink);
+    if (qcache && plans[i].path != PLAN_CACHED)
+      job_store(in_batch ? &jobs[num_queries] : &jobs[i], in_batch ? i : 0,
+                &queries[i], qcache);
+    job_free(&jobs[i]);
+  }
+  if (batched) {
+    job_free(&jobs[num_queries]);
+    batch_free(&batch);
   }
+  parts_free(sched.parts);
+  bool ok = output_close(&sink);
+  timing_lap(&timing, TIME_OUTPUT, mark);
+  if (qcache) {
+    timing.value[COUNT_CACHE_HITS] = (double)qcache->hits;
+    timing.value[COUNT_CACHE_MISSES] = (double)qcache->misses;
+  }
+  for (int t = 0; placed && t < thread_num; t++) {
+    timing.value[COUNT_LOCAL_ROWS] += (double)tstats[t].local_rows;
+    timing.value[COUNT_REMOTE_ROWS] +=
+        (double)(tstats[t].rows - tstats[t].local_rows);
+  }
+  timing_finish(&timing);
+  timing_summary_local(&timing, &summary);
 
+  cache_close(qcache);
+  free(jobs);
+  free(plans);
   free(queries);
+  index_free(index);
+  zone_map_free(zones);
+  loaded_table_free(&loaded);
+  column_table_free(table);
   btree_free(tree);
 
-  double totalPar = omp_get_wtime() - par_start;
-  printf("\nTiming summary (omp_get_wtime):\n");
+  printf("\nTiming summary (wall clock):\n");
   printf("  Number of threads: %d\n", thread_num);
-  printf("  Parallel time: %.6f seconds\n", totalPar);
-
-  return 0;
-}
-
-/*
-Name: to_array_cb():
-Parameters: const void *item, void *udata
-Return: bool
-Description:
-
-btree_ascend callback that copies each CarInventory snapshot into a flat array
-and tracks the next insertion index stored inside ToArrayCtx.
-*/
-static bool to_array_cb(const void *item, void *udata) {
-  ToArrayCtx *ctx = (ToArrayCtx *)udata;
-  ctx->arr[ctx->index++] = *(const CarInventory *)item;
-  return true;
-}
-
-/*
-Name: btree_to_array():
-Parameters: struct btree *tree, size_t *out_count
-Return: CarInventory *
-Description:
+  printf("  Parallel time: %.6f seconds\n", timing.value[TIME_TOTAL]);
+  printf("  Load time: %.6f seconds (%.1f MB/s)\n", loaded.seconds,
+         load_throughput(&loaded));
+  printf("  Chunk size: %zu rows\n", opts.chunk_rows);
+  if (placed)
+    printf("  NUMA placement: %d partitions, %d nodes seen, threads %s\n",
+           placed->threads, placed->num_nodes,
+           numa_binding_name(placed->binding));
+  for (int t = 0; t < thread_num; t++) {
+    printf("  Thread %d: busy %.6f seconds, %ld tasks, %zu rows scanned", t,
+           tstats[t].busy, tstats[t].tasks, tstats[t].rows);
+    if (placed)
+      printf(" (%zu local)", tstats[t].local_rows);
+    printf("\n");
+  }
+  free(tstats);
+  if (placed)
+    placement_free(&placement);
+  timing_print(stdout, &summary);
+
+  if (opts.timing_file) {
+    TimingInfo info = {.engine = "qpe_omp",
+                       .db_file = filename,
+                       .query_file = queryfile,
+                       .layout = opts.layout == LAYOUT_COLUMNAR ? "columnar"
+                                                                : "row",
+                       .mode = NULL,
+                       .processes = 1,
+                       .threads = thread_num,
+                       .tuples = (long long)count};
+    timing_write(opts.timing_file, &info, &summary, timing.queries,
+                 timing.num_queries);
+  }
+  timing_free(&timing);
 
-Materializes the contents of the B-tree into a contiguous array so OpenMP
-threads can process slices without holding tree locks; returns the array pointer
-and count via out_count.
-*/
-CarInventory *btree_to_array(struct btree *tree, size_t *out_count) {
-  size_t count = btree_count(tree);
-  CarInventory *arr = malloc(count * sizeof(CarInventory));
-  if (!arr)
-    return NULL;
-  ToArrayCtx ctx;
-  ctx.arr = arr;
-  ctx.index = 0;
-  btree_ascend(tree, NULL, to_array_cb, &ctx);
-  *out_count = count;
-  return arr;
+  return ok ? 0 : 1;
 }
 
 /*
@@ -187,46 +605,33 @@ int car_compare(const void *a, const void *b, void *udata) {
 
 /*
 Name: load_database():
-Parameters: const char *filename
+Parameters: const char *filename, TableStats *stats, LoadedTable *loaded
 Return: struct btree *
 Description:
 
-Reads the car inventory file, inserts each tuple into a B-tree keyed by ID, and
-returns the populated tree or NULL if an error occurs.
+Parses the car inventory file with load_table(), whose chunks are split
+across the OpenMP threads, then bulk-loads the ID-ordered rows into a B-tree
+for the ID range plans. Returns the tree or NULL if an error occurs; the rows
+left in loaded become the shared Snapshot array.
 */
-struct btree *load_database(const char *filename) {
-  FILE *fp = fopen(filename, "r");
-  if (!fp)
+struct btree *load_database(const char *filename, TableStats *stats,
+                            LoadedTable *loaded) {
+  if (!load_table(filename, stats, loaded))
     return NULL;
 
   struct btree *tree = btree_new(sizeof(CarInventory), 0, car_compare, NULL);
   if (!tree) {
-    fclose(fp);
+    loaded_table_free(loaded);
     return NULL;
   }
 
-  char header_line[256];
-  if (!fgets(header_line, sizeof(header_line), fp)) {
-    btree_free(tree);
-    fclose(fp);
-    return NULL;
-  }
-
-  CarInventory car;
-  while (1) {
-    int scanned = fscanf(fp, "%d %19s %d %19s %d %19s", &car.ID, car.Model,
-                         &car.YearMake, car.Color, &car.Price, car.Dealer);
-    if (scanned == EOF)
-      break;
-    if (scanned != 6)
-      break;
-    if (btree_set(tree, &car) == NULL && btree_oom(tree)) {
+  for (size_t i = 0; i < loaded->count; i++) {
+    if (btree_load(tree, &loaded->rows[i]) == NULL && btree_oom(tree)) {
       btree_free(tree);
-      fclose(fp);
+      loaded_table_free(loaded);
       return NULL;
     }
   }
-  fclose(fp);
   return tree;
 }
 
@@ -261,467 +666,1096 @@ void print_all_tuples(struct btree *tree) {
 }
 
 /*
-Name: skip_ws():
-Parameters: const char *s
-Return: const char *
+Name: scan_rows():
+Parameters: const CarInventory *rows, size_t begin, size_t end, Query *q,
+            Buffer *out
+Return: bool
 Description:
 
-Advances past leading whitespace characters while parsing SQL-like input and
-returns the first non-whitespace position.
+Tests rows [begin, end) of the shared snapshot array on the calling thread and
+formats the matches into out. Returns false if a result could not be
+buffered.
 */
-static const char *skip_ws(const char *s) {
-  while (*s && isspace((unsigned char)*s))
-    s++;
-  return s;
+bool scan_rows(const CarInventory *rows, size_t begin, size_t end, Query *q,
+               Buffer *out) {
+  for (size_t i = begin; i < end; i++)
+    if (match_where(&rows[i], &q->where) && !append_selected(&rows[i], q, out))
+      return false;
+  return true;
 }
 
 /*
-Name: trim_trailing():
-Parameters: char *s
-Return: void
+Name: columnar_emit_cb():
+Parameters: size_t row, void *udata
+Return: bool
 Description:
 
-Removes trailing whitespace and semicolons from strings in-place to simplify
-later comparisons.
+filter_scan() callback that decodes a matching column-store row and formats it
+into the task's Buffer, stopping the scan if that fails.
 */
-static void trim_trailing(char *s) {
-  size_t len = strlen(s);
-  while (len > 0 && isspace((unsigned char)s[len - 1]))
-    s[--len] = '\0';
-  if (len > 0 && s[len - 1] == ';') {
-    s[--len] = '\0';
-    trim_trailing(s);
-  }
+static bool columnar_emit_cb(size_t row, void *udata) {
+  ColumnarCtx *ctx = (ColumnarCtx *)udata;
+  CarInventory car;
+  column_table_get(ctx->table, row, &car);
+  return append_selected(&car, ctx->q, ctx->buf);
 }
 
 /*
-Name: load_queries():
-Parameters: const char *filename, Query **queries, int *num_queries
-Return: void
+Name: scan_columnar():
+Parameters: const ColumnTable *table, const ColumnFilter *filter,
+            size_t begin, size_t end, Query *q, Buffer *out
+Return: bool
 Description:
 
-Parses SELECT attribute lists and WHERE clauses from the query file, storing the
-results inside a dynamically resized array of Query structs.
+Filters rows [begin, end) of the column store with the SIMD bitmap kernels,
+using the WHERE clause already bound in filter and scratch bitmaps of the
+calling task. begin should be a multiple of QPE_FILTER_BLOCK. Returns false
+if the bitmaps or a result could not be allocated.
 */
-void load_queries(const char *filename, Query **queries, int *num_queries) {
-  FILE *fp = fopen(filename, "r");
-  if (!fp) {
-    *queries = NULL;
-    *num_queries = 0;
-    return;
-  }
+bool scan_columnar(const ColumnTable *table, const ColumnFilter *filter,
+                   size_t begin, size_t end, Query *q, Buffer *out) {
+  FilterScratch scratch;
+  ColumnarCtx ctx = {.table = table, .q = q, .buf = out};
+  bool ok = filter_scratch_init(&scratch, filter) &&
+            filter_scan(&scratch, begin, end, columnar_emit_cb, &ctx);
+  filter_scratch_free(&scratch);
+  return ok;
+}
 
-  int capacity = 4;
-  Query *arr = malloc(capacity * sizeof(Query));
-  if (!arr) {
-    fclose(fp);
-    *queries = NULL;
-    *num_queries = 0;
-    return;
-  }
+/*
+Name: run_query():
+Parameters: const Snapshot *snap, struct btree *tree,
+            const QueryPlan *plan, Query *q, Buffer *out, size_t *scanned
+Return: bool
+Description:
 
-  char line[512];
-  *num_queries = 0;
+Runs one ID range, index or cached plan, or an ORDER BY ... LIMIT query
+along any plan but a Price-ordered full scan (topk_query()), on the calling
+thread, formatting the results into out (a cached plan copies its stored
+lines) and setting *scanned to the rows tested. If the index lookup fails
+the query falls back to a full scan of the snapshot on the same thread.
+Returns false if the results could not be buffered.
+*/
+bool run_query(const Snapshot *snap, struct btree *tree,
+               const QueryPlan *plan, Query *q, Buffer *out, size_t *scanned) {
+  *scanned = 0;
+  if (plan->path == PLAN_CACHED)
+    return buffer_append(out, plan->cached, plan->cached_len);
+  if (q->ordered) {
+    TopK top;
+    topk_init(&top, q);
+    if (!topk_query(&top, tree, snap->rows, snap->count, snap->index, plan,
+                    scanned)) {
+      topk_free(&top);
+      return false;
+    }
+    return topk_format(&top, out);
+  }
+  if (plan->path == PLAN_ID_RANGE)
+    return process_query_range(tree, plan, q, out, scanned);
 
-  while (fgets(line, sizeof(line), fp)) {
-    if (line[0] == '\n' || line[0] == '\0')
-      continue;
+  bool done = false;
+  if (plan->path != PLAN_FULL_SCAN &&
+      !process_query_indexed(snap->index, snap->rows, &plan->probe, q, out,
+                             &done, scanned))
+    return false;
+  if (done)
+    return true;
+  *scanned = snap->count;
+  if (!snap->table)
+    return scan_rows(snap->rows, 0, snap->count, q, out);
+
+  ColumnFilter filter;
+  bool ok = column_filter_init(&filter, snap->table, &q->where) &&
+            scan_columnar(snap->table, &filter, 0, snap->count, q, out);
+  column_filter_free(&filter);
+  return ok;
+}
 
-    Query q;
-    memset(&q, 0, sizeof(q));
+/*
+Name: parts_reserve():
+Parameters: PartPool *pool, size_t needed
+Return: bool
+Description:
 
-    char *select_pos = strstr(line, "SELECT");
-    char *from_pos = strstr(line, "FROM");
-    char *where_pos = strstr(line, "WHERE");
+Grows pool to hold at least needed Buffers; the new ones start empty and the
+old ones keep their data. Must not be called while a task may be writing to
+a Buffer of the pool. Returns false on allocation failure, leaving the pool
+unchanged.
+*/
+bool parts_reserve(PartPool *pool, size_t needed) {
+  if (needed <= pool->cap)
+    return true;
+  Buffer *grown = realloc(pool->bufs, needed * sizeof(Buffer));
+  if (!grown)
+    return false;
+  memset(grown + pool->cap, 0, (needed - pool->cap) * sizeof(Buffer));
+  pool->bufs = grown;
+  pool->cap = needed;
+  return true;
+}
 
-    if (!select_pos || !from_pos || !where_pos)
-      continue;
+/*
+Name: parts_take():
+Parameters: PartPool *pool, size_t n
+Return: Buffer *
+Description:
 
-    select_pos += 6;
-    while (*select_pos && isspace((unsigned char)*select_pos))
-      select_pos++;
+Hands out the next n Buffers of pool, emptied but keeping their memory, or
+NULL if fewer than n were reserved.
+*/
+Buffer *parts_take(PartPool *pool, size_t n) {
+  if (n > pool->cap - pool->used)
+    return NULL;
+  Buffer *parts = &pool->bufs[pool->used];
+  for (size_t i = 0; i < n; i++)
+    parts[i].len = 0;
+  pool->used += n;
+  return parts;
+}
 
-    if (from_pos <= select_pos)
-      continue;
+/*
+Name: parts_reset():
+Parameters: PartPool *pool
+Return: void
+Description:
 
-    char select_part[256];
-    memset(select_part, 0, sizeof(select_part));
-    strncpy(select_part, select_pos, (size_t)(from_pos - select_pos));
-    trim_trailing(select_part);
-
-    char *token = strtok(select_part, ",");
-    int idx = 0;
-    while (token && idx < 6) {
-      token = (char *)skip_ws(token);
-      trim_trailing(token);
-      strncpy(q.select_attrs[idx], token, sizeof(q.select_attrs[idx]) - 1);
-      idx++;
-      token = strtok(NULL, ",");
-    }
-    q.num_select_attrs = idx;
-
-    where_pos += 5;
-    while (*where_pos && isspace((unsigned char)*where_pos))
-      where_pos++;
-    strncpy(q.where_raw, where_pos, sizeof(q.where_raw) - 1);
-    trim_trailing(q.where_raw);
-
-    if (*num_queries >= capacity) {
-      capacity *= 2;
-      Query *tmp = realloc(arr, capacity * sizeof(Query));
-      if (!tmp)
-        break;
-      arr = tmp;
-    }
+Makes every Buffer of pool available to parts_take() again, once no Job that
+took them is still read.
+*/
+void parts_reset(PartPool *pool) { pool->used = 0; }
 
-    arr[*num_queries] = q;
-    (*num_queries)++;
-  }
+/*
+Name: parts_free():
+Parameters: PartPool *pool
+Return: void
+Description:
 
-  fclose(fp);
-  *queries = arr;
+Releases every Buffer of pool and the array holding them.
+*/
+void parts_free(PartPool *pool) {
+  for (size_t i = 0; i < pool->cap; i++)
+    buffer_free(&pool->bufs[i]);
+  free(pool->bufs);
+  memset(pool, 0, sizeof(*pool));
 }
+
 /*
-Name: read_identifier():
-Parameters: const char **p, char *out, size_t cap
-Return: bool
+Name: job_chunks():
+Parameters: const Snapshot *snap, size_t chunk_rows, const Query *q,
+            const QueryPlan *plan
+Return: int
 Description:
 
-Consumes an identifier token from the SQL-like query string, writes it to the
-output buffer, and advances the caller pointer.
+The number of chunk tasks job_init() splits query q (or the batch when q is
+NULL) into: one per chunk_rows rows for a full scan, otherwise one. A query
+ordered by ID walks the B-tree and so is never split.
 */
-static bool read_identifier(const char **p, char *out, size_t cap) {
-  const char *s = *p;
-  size_t i = 0;
-  s = skip_ws(s);
-  if (!*s)
-    return false;
-  while (*s && (isalnum((unsigned char)*s) || *s == '_')) {
-    if (i + 1 < cap)
-      out[i++] = *s;
-    s++;
-  }
-  out[i] = '\0';
-  *p = s;
-  return i > 0;
+int job_chunks(const Snapshot *snap, size_t chunk_rows, const Query *q,
+               const QueryPlan *plan) {
+  bool scan = q == NULL || (plan->path == PLAN_FULL_SCAN &&
+                            !(q->ordered && q->order_col == COL_ID));
+  if (scan && snap->count > chunk_rows)
+    return (int)((snap->count + chunk_rows - 1) / chunk_rows);
+  return 1;
 }
 
 /*
-Name: read_value():
-Parameters: const char **p, Value *v
+Name: job_init():
+Parameters: Job *job, const Snapshot *snap, size_t chunk_rows, Query *q,
+            const QueryPlan *plan, int query_no, int width, PartPool *pool
 Return: bool
 Description:
 
-Parses the next literal (integer or quoted string) into a Value structure so
-comparison logic can treat both uniformly.
-*/
-static bool read_value(const char **p, Value *v) {
-  const char *s = skip_ws(*p);
-  if (*s == '"') {
-    size_t i = 0;
-    s++;
-    while (*s && *s != '"' && i + 1 < sizeof(v->s))
-      v->s[i++] = *s++;
-    v->s[i] = '\0';
-    if (*s == '"')
-      s++;
-    v->type = VAL_STR;
-  } else {
-    char *endptr;
-    v->i = (int)strtol(s, &endptr, 10);
-    if (endptr == s)
+Prepares the Job for query q (or the batch when q is NULL): the number of
+chunks, width result Buffers per chunk taken from pool and, for a columnar full
+scan, the WHERE clause bound to the column store (an aggregate query gets one
+AggTable per chunk and a Price-ordered one a TopK per thread instead). A full
+scan of one query also gets its WHERE clause bound to the zone map, so its
+chunks skip the blocks that cannot match, and a row full scan whose WHERE clause
+fits one of QPEKernel.c's templates gets that kernel compiled for its chunks to
+run instead of match_where(). An ID-ordered query is never split: its single
+task walks the B-tree and stops after the k-th match. chunk_rows is a multiple
+of QPE_FILTER_BLOCK. Returns false on allocation failure or when pool has too
+few Buffers left.
+*/
+bool job_init(Job *job, const Snapshot *snap, size_t chunk_rows, Query *q,
+              const QueryPlan *plan, int query_no, int width, PartPool *pool) {
+  bool scan = q == NULL || (plan->path == PLAN_FULL_SCAN &&
+                            !(q->ordered && q->order_col == COL_ID));
+
+  memset(job, 0, sizeof(*job));
+  job->q = q;
+  job->plan = plan;
+  job->query_no = query_no;
+  job->width = width;
+  job->num_chunks = job_chunks(snap, chunk_rows, q, plan);
+  job->remaining = job->num_chunks;
+
+  job->parts = parts_take(pool, (size_t)job->num_chunks * width);
+  if (!job->parts)
+    return false;
+  if (q && q->aggregate && plan->path != PLAN_CACHED) {
+    job->aggs = calloc((size_t)job->num_chunks, sizeof(AggTable));
+    for (int c = 0; job->aggs && c < job->num_chunks; c++)
+      if (!agg_init(&job->aggs[c], q)) {
+        job_free(job);
+        return false;
+      }
+    if (!job->aggs) {
+      job_free(job);
+      return false;
+    }
+  } else if (q && q->ordered && scan) {
+    job->num_tops = omp_get_max_threads();
+    job->tops = calloc((size_t)job->num_tops, sizeof(TopK));
+    if (!job->tops) {
+      job_free(job);
+      return false;
+    }
+    for (int t = 0; t < job->num_tops; t++)
+      topk_init(&job->tops[t], q);
+  } else if (q && scan && snap->table) {
+    job->filter = malloc(sizeof(ColumnFilter));
+    if (!job->filter ||
+        !column_filter_init(job->filter, snap->table, &q->where)) {
+      job_free(job);
       return false;
-    s = endptr;
-    v->type = VAL_INT;
+    }
+  } else if (q && scan) {
+    kernel_compile(&job->kernel, &q->where);
+  }
+  if (q && scan && snap->zones) {
+    job->zones = malloc(sizeof(ZoneFilter));
+    if (!job->zones || !zone_filter_init(job->zones, snap->zones, &q->where)) {
+      free(job->zones);
+      job->zones = NULL;
+      job_free(job);
+      return false;
+    }
   }
-  *p = s;
   return true;
 }
 
 /*
-Name: compare_attr_value():
-Parameters: const CarInventory *car, const char *attr, const Value *v
-Return: int
+Name: job_free():
+Parameters: Job *job
+Return: void
 Description:
 
-Retrieves the specified attribute from a car record, converts it as needed, and
-compares it against the given literal returning -1/0/1.
-*/
-static int compare_attr_value(const CarInventory *car, const char *attr,
-                              const Value *v) {
-  if (strcasecmp(attr, "ID") == 0 || strcasecmp(attr, "YearMake") == 0 ||
-      strcasecmp(attr, "Price") == 0) {
-
-    int lhs = 0;
-    if (strcasecmp(attr, "ID") == 0)
-      lhs = car->ID;
-    else if (strcasecmp(attr, "YearMake") == 0)
-      lhs = car->YearMake;
-    else if (strcasecmp(attr, "Price") == 0)
-      lhs = car->Price;
-
-    int rhs = (v->type == VAL_INT) ? v->i : atoi(v->s);
-    if (lhs < rhs)
-      return -1;
-    if (lhs > rhs)
-      return 1;
-    return 0;
+Releases the Job's AggTables, TopKs, column and zone bindings; its result
+Buffers stay in the PartPool it took them from. Safe on a Job that was never
+initialized (all zero).
+*/
+void job_free(Job *job) {
+  if (job->filter) {
+    column_filter_free(job->filter);
+    free(job->filter);
   }
-
-  const char *lhs = NULL;
-  if (strcasecmp(attr, "Model") == 0)
-    lhs = car->Model;
-  else if (strcasecmp(attr, "Color") == 0)
-    lhs = car->Color;
-  else if (strcasecmp(attr, "Dealer") == 0)
-    lhs = car->Dealer;
-  else
-    return 0;
-
-  const char *rhs = (v->type == VAL_STR) ? v->s : "";
-  return strcasecmp(lhs, rhs);
+  if (job->zones) {
+    zone_filter_free(job->zones);
+    free(job->zones);
+  }
+  for (int c = 0; job->aggs && c < job->num_chunks; c++)
+    agg_free(&job->aggs[c]);
+  free(job->aggs);
+  for (int t = 0; job->tops && t < job->num_tops; t++)
+    topk_free(&job->tops[t]);
+  free(job->tops);
+  memset(job, 0, sizeof(*job));
 }
 
 /*
-Name: eval_comparison():
-Parameters: const CarInventory *car, const char **p
-Return: bool
+Name: job_write():
+Parameters: const Job *job, int j, OutputSink *sink
+Return: void
 Description:
 
-Parses a single comparison (attribute operator literal) from the WHERE clause
-text and immediately evaluates it against the active record.
+Writes the results of the Job's j-th query, chunk by chunk, while holding the
+output lock once, so another Job's output can never land in the middle.
 */
-static bool eval_comparison(const CarInventory *car, const char **p) {
-  char attr[32];
-  char op[3] = {0};
-  Value v;
+void job_write(const Job *job, int j, OutputSink *sink) {
+  int query_no = job->q ? job->query_no : j + 1;
+  if (!job->parts)
+    return;
+  output_lock(sink);
+  for (int c = 0; c < job->num_chunks; c++) {
+    const Buffer *part = &job->parts[(size_t)c * job->width + j];
+    output_write(sink, query_no, part->data, part->len);
+  }
+  output_unlock(sink);
+}
 
-  const char *s = skip_ws(*p);
-  if (!read_identifier(&s, attr, sizeof(attr)))
-    return false;
+/*
+Name: job_store():
+Parameters: const Job *job, int j, const Query *q, QueryCache *cache
+Return: void
+Description:
 
-  s = skip_ws(s);
-  if (*s == '!' && *(s + 1) == '=') {
-    strcpy(op, "!=");
-    s += 2;
-  } else if (*s == '>' && *(s + 1) == '=') {
-    strcpy(op, ">=");
-    s += 2;
-  } else if (*s == '<' && *(s + 1) == '=') {
-    strcpy(op, "<=");
-    s += 2;
-  } else if (*s == '>') {
-    strcpy(op, ">");
-    s++;
-  } else if (*s == '<') {
-    strcpy(op, "<");
-    s++;
-  } else if (*s == '=') {
-    strcpy(op, "=");
-    s++;
-  } else
-    return false;
+Records the results of the Job's j-th query, q, in the --cache result cache,
+its chunks joined in order. A Job that failed to buffer is not cached.
+*/
+void job_store(const Job *job, int j, const Query *q, QueryCache *cache) {
+  size_t total = 0;
+  bool ok = true;
+  Buffer all;
 
-  if (!read_value(&s, &v))
-    return false;
-  *p = s;
-
-  int cmp = compare_attr_value(car, attr, &v);
-
-  if (strcmp(op, "=") == 0)
-    return cmp == 0;
-  if (strcmp(op, "!=") == 0)
-    return cmp != 0;
-  if (strcmp(op, ">") == 0)
-    return cmp > 0;
-  if (strcmp(op, "<") == 0)
-    return cmp < 0;
-  if (strcmp(op, ">=") == 0)
-    return cmp >= 0;
-  if (strcmp(op, "<=") == 0)
-    return cmp <= 0;
-
-  return false;
+  if (!job->parts || job->failed)
+    return;
+  if (job->num_chunks == 1) {
+    cache_store(cache, q, job->parts[j].data, job->parts[j].len);
+    return;
+  }
+  for (int c = 0; c < job->num_chunks; c++)
+    total += job->parts[(size_t)c * job->width + j].len;
+  if (total > QPE_CACHE_MAX_RESULT)
+    return;
+  buffer_init(&all);
+  for (int c = 0; ok && c < job->num_chunks; c++) {
+    const Buffer *part = &job->parts[(size_t)c * job->width + j];
+    ok = buffer_append(&all, part->data, part->len);
+  }
+  if (ok)
+    cache_store(cache, q, all.data, all.len);
+  buffer_free(&all);
 }
 
-static bool eval_expr(const CarInventory *car, const char **p);
-static bool eval_factor(const CarInventory *car, const char **p);
-
 /*
-Name: eval_term():
-Parameters: const CarInventory *car, const char **p
-Return: bool
+Name: run_chunk():
+Parameters: const Scheduler *sched, Job *job, int c
+Return: void
 Description:
 
-Evaluates AND-connected factors, calling eval_factor recursively and combining
-results until an OR or end of input is reached.
+Task body: runs chunk c of job on the calling thread and charges the time to
+that thread's ThreadStats and to the Job. Full-scan chunks cover rows
+[c * chunk_rows, (c + 1) * chunk_rows) with the row (or its specialized
+kernel), columnar or batch scan, or aggregate them into the chunk's
+AggTable or the thread's TopK, reading only the runs of zone map blocks the
+query cannot rule out; any other plan is a single chunk. The last chunk to
+finish calls finish_job().
 */
-static bool eval_term(const CarInventory *car, const char **p) {
-  bool result = eval_factor(car, p);
-  const char *s = skip_ws(*p);
+static void run_chunk(const Scheduler *sched, Job *job, int c) {
+  double start_time = omp_get_wtime();
+  const Snapshot *snap = sched->snap;
+  ThreadStats *ts = &sched->stats[omp_get_thread_num()];
+  Buffer *out = &job->parts[(size_t)c * job->width];
+  size_t begin = (size_t)c * sched->chunk_rows;
+  size_t end = begin + sched->chunk_rows;
+  size_t scanned;
+  size_t stop;
+  double elapsed;
+  bool full = true;
+  bool ok;
+  int left;
+
+  if (end > snap->count)
+    end = snap->count;
+
+  if (job->q == NULL) {
+    ok = true;
+    if (snap->table) {
+      BatchScratch scratch;
+      ok = batch_scratch_init(&scratch, sched->batch) &&
+           batch_scan_columnar(sched->batch, &scratch, begin, end, out);
+      batch_scratch_free(&scratch, sched->batch);
+    } else {
+      for (size_t i = begin; ok && i < end; i++)
+        ok = batch_row(sched->batch, &snap->rows[i], out);
+    }
+    scanned = end - begin;
+  } else if (job->aggs) {
+    AggTable *agg = &job->aggs[c];
+    scanned = 0;
+    if (job->plan->path == PLAN_FULL_SCAN) {
+      ok = true;
+      for (size_t i = zone_next(job->zones, begin, end, &stop); ok && i < end;
+           i = zone_next(job->zones, stop, end, &stop)) {
+        ok = agg_scan(agg, snap->rows, i, stop);
+        scanned += stop - i;
+      }
+    } else {
+      ok = agg_query(agg, snap->rows, snap->count, snap->index, job->plan,
+                     &scanned);
+      full = false;
+    }
+  } else if (job->tops) {
+    TopK *top = &job->tops[omp_get_thread_num()];
+    ok = true;
+    scanned = 0;
+    for (size_t i = zone_next(job->zones, begin, end, &stop); ok && i < end;
+         i = zone_next(job->zones, stop, end, &stop))
+      ok = topk_scan(top, snap->rows, i, stop, &scanned);
+  } else if (job->plan->path == PLAN_FULL_SCAN && !job->q->ordered) {
+    ok = true;
+    scanned = 0;
+    for (size_t i = zone_next(job->zones, begin, end, &stop); ok && i < end;
+         i = zone_next(job->zones, stop, end, &stop)) {
+      if (job->filter)
+        ok = scan_columnar(snap->table, job->filter, i, stop, job->q, out);
+      else if (job->kernel.shape)
+        ok = kernel_scan(&job->kernel, snap->rows, i, stop, job->q, out);
+      else
+        ok = scan_rows(snap->rows, i, stop, job->q, out);
+      scanned += stop - i;
+    }
+  } else {
+    ok = run_query(snap, sched->tree, job->plan, job->q, out, &scanned);
+    full = false;
+  }
+
+  if (full) {
+    ts->rows += scanned;
+    if (sched->placement && numa_local(sched->placement, begin))
+      ts->local_rows += scanned;
+  }
 
-  while (strncasecmp(s, "AND", 3) == 0) {
-    s += 3;
-    *p = s;
-    bool rhs = eval_factor(car, p);
-    result = result && rhs;
-    s = skip_ws(*p);
+  if (!ok) {
+#pragma omp atomic write
+    job->failed = true;
   }
 
-  *p = s;
-  return result;
+  elapsed = omp_get_wtime() - start_time;
+  ts->busy += elapsed;
+  ts->tasks++;
+#pragma omp atomic
+  job->seconds += elapsed;
+#pragma omp atomic
+  job->scanned += scanned;
+
+#pragma omp atomic capture seq_cst
+  left = --job->remaining;
+  if (left == 0)
+    finish_job(sched, job);
 }
 
 /*
-Name: eval_factor():
-Parameters: const CarInventory *car, const char **p
-Return: bool
+Name: finish_job():
+Parameters: const Scheduler *sched, Job *job
+Return: void
 Description:
 
-Handles parenthesized expressions or single comparisons when parsing WHERE
-clauses, serving as the base of the recursive descent parser.
-*/
-static bool eval_factor(const CarInventory *car, const char **p) {
-  const char *s = skip_ws(*p);
-  bool result;
-
-  if (*s == '(') {
-    s++;
-    *p = s;
-    result = eval_expr(car, p);
-    s = skip_ws(*p);
-    if (*s == ')')
-      s++;
-    *p = s;
+Called by the task that completes a Job: merges the chunk AggTables of an
+aggregate query into its groups, or the thread TopKs of an ordered one into
+its result lines, reports a buffering failure, records each
+query's timing, drops the column binding, and (unless --ordered defers
+it) writes every query of the Job. The members of the batch share its scan,
+so each is charged every row and an equal part of its time.
+*/
+static void finish_job(const Scheduler *sched, Job *job) {
+  if (job->aggs) {
+    for (int c = 1; !job->failed && c < job->num_chunks; c++)
+      job->failed = !agg_merge(&job->aggs[0], &job->aggs[c]);
+    if (!job->failed)
+      job->failed = !agg_format(&job->aggs[0], &job->parts[0]);
+    for (int c = 0; c < job->num_chunks; c++)
+      agg_free(&job->aggs[c]);
+    free(job->aggs);
+    job->aggs = NULL;
+  }
+  if (job->tops) {
+    for (int t = 1; !job->failed && t < job->num_tops; t++)
+      job->failed = !topk_merge(&job->tops[0], &job->tops[t]);
+    if (!job->failed)
+      job->failed = !topk_format(&job->tops[0], &job->parts[0]);
+    for (int t = 0; t < job->num_tops; t++)
+      topk_free(&job->tops[t]);
+    free(job->tops);
+    job->tops = NULL;
+  }
+  if (job->failed)
+    fprintf(stderr, "Error: out of memory formatting query %d results\n",
+            job->query_no);
+  if (job->q) {
+    QueryTiming *qt = &sched->timing[job->query_no - 1];
+    qt->seconds = job->seconds;
+    qt->rows_scanned = (double)job->scanned;
+    qt->kernel = job->kernel.shape != 0;
+    for (int c = 0; c < job->num_chunks; c++)
+      timing_output(qt, job->parts[c].data, job->parts[c].len);
   } else {
-    result = eval_comparison(car, &s);
-    *p = s;
+    for (int m = 0; m < sched->batch->num_members; m++) {
+      int j = sched->batch->members[m];
+      QueryTiming *qt = &sched->timing[j];
+      qt->seconds = job->seconds / sched->batch->num_members;
+      qt->rows_scanned = (double)sched->snap->count;
+      for (int c = 0; c < job->num_chunks; c++) {
+        const Buffer *part = &job->parts[(size_t)c * job->width + j];
+        timing_output(qt, part->data, part->len);
+      }
+    }
+  }
+  if (job->filter) {
+    column_filter_free(job->filter);
+    free(job->filter);
+    job->filter = NULL;
   }
+  if (!sched->ordered)
+    for (int j = 0; j < job->width; j++)
+      job_write(job, j, sched->sink);
+}
 
-  return result;
+/*
+Name: chunk_owner():
+Parameters: const Job *job, int c, const Placement *p, size_t chunk_rows,
+            int *turn
+Return: int
+Description:
+
+The thread chunk c of job is queued for: the owner of its first row for a
+full scan, otherwise the next thread in turn.
+*/
+static int chunk_owner(const Job *job, int c, const Placement *p,
+                       size_t chunk_rows, int *turn) {
+  if (job->q == NULL || job->plan->path == PLAN_FULL_SCAN)
+    return numa_owner(p, (size_t)c * chunk_rows);
+  return (*turn)++ % p->threads;
 }
 
 /*
-Name: eval_expr():
-Parameters: const CarInventory *car, const char **p
+Name: local_queues_init():
+Parameters: LocalQueues *lq, Job *jobs, int num_jobs, const Placement *p,
+            size_t chunk_rows
 Return: bool
 Description:
 
-Evaluates OR-connected terms, yielding the overall truthiness of the WHERE
-clause text for a given record.
+Queues every chunk of the initialized jobs (num_chunks > 0) in the group of
+the thread chunk_owner() picks, in job order within each group. Afterwards
+lq->end[lq->threads - 1] is the number of chunks queued. Returns false on
+allocation failure.
 */
-static bool eval_expr(const CarInventory *car, const char **p) {
-  bool result = eval_term(car, p);
-  const char *s = skip_ws(*p);
-
-  while (strncasecmp(s, "OR", 2) == 0) {
-    s += 2;
-    *p = s;
-    bool rhs = eval_term(car, p);
-    result = result || rhs;
-    s = skip_ws(*p);
+bool local_queues_init(LocalQueues *lq, Job *jobs, int num_jobs,
+                       const Placement *p, size_t chunk_rows) {
+  int total = 0;
+  int start = 0;
+  int turn = 0;
+
+  for (int j = 0; j < num_jobs; j++)
+    total += jobs[j].num_chunks;
+  lq->threads = p->threads;
+  lq->chunks = malloc(((size_t)total + 1) * sizeof(ChunkRef));
+  lq->next = calloc((size_t)lq->threads, sizeof(int));
+  lq->end = calloc((size_t)lq->threads, sizeof(int));
+  if (!lq->chunks || !lq->next || !lq->end) {
+    local_queues_free(lq);
+    return false;
   }
 
-  *p = s;
-  return result;
+  /* Count each group, turn the counts into group starts, then fill. */
+  for (int j = 0; j < num_jobs; j++)
+    for (int c = 0; c < jobs[j].num_chunks; c++)
+      lq->end[chunk_owner(&jobs[j], c, p, chunk_rows, &turn)]++;
+  for (int t = 0; t < lq->threads; t++) {
+    int n = lq->end[t];
+    lq->next[t] = start;
+    lq->end[t] = start;
+    start += n;
+  }
+  turn = 0;
+  for (int j = 0; j < num_jobs; j++)
+    for (int c = 0; c < jobs[j].num_chunks; c++) {
+      int t = chunk_owner(&jobs[j], c, p, chunk_rows, &turn);
+      lq->chunks[lq->end[t]++] = (ChunkRef){.job = &jobs[j], .chunk = c};
+    }
+  return true;
 }
 
 /*
-Name: match_where():
-Parameters: const CarInventory *car, const char *where_raw
-Return: int
+Name: local_queues_free():
+Parameters: LocalQueues *lq
+Return: void
 Description:
 
-Trims the clause, invokes the recursive parser, and returns 1 when the record
-satisfies the WHERE expression (0 otherwise).
+Releases the queues; safe after a failed local_queues_init().
 */
-int match_where(const CarInventory *car, const char *where_raw) {
-  const char *p = skip_ws(where_raw);
-  if (*p == '\0')
-    return 1;
-  return eval_expr(car, &p) ? 1 : 0;
+void local_queues_free(LocalQueues *lq) {
+  free(lq->chunks);
+  free(lq->next);
+  free(lq->end);
+  lq->chunks = NULL;
+  lq->next = NULL;
+  lq->end = NULL;
 }
 
 /*
-Name: print_selected():
-Parameters: const CarInventory *car, Query *q
+Name: run_local():
+Parameters: const Scheduler *sched
 Return: void
 Description:
 
-Prints either all fields or the subset requested in the query; since multiple
-threads may print concurrently, the body executes under an OpenMP critical
-section to serialize stdout access.
+Body of a --numa task: claims the next chunk of the calling thread's group,
+or failing that of the groups after it, and runs it with run_chunk(). As
+many tasks are spawned as chunks were queued and a claim only fails on an
+empty group, so every task runs exactly one chunk.
 */
-void print_selected(const CarInventory *car, Query *q) {
-/*
-
-Parallel Section: #pragma omp critical(print_lock)
+static void run_local(const Scheduler *sched) {
+  LocalQueues *lq = sched->queues;
+  int me = omp_get_thread_num() % lq->threads;
+
+  for (int k = 0; k < lq->threads; k++) {
+    int t = (me + k) % lq->threads;
+    int i;
+#pragma omp atomic capture
+    i = lq->next[t]++;
+    if (i < lq->end[t]) {
+      run_chunk(sched, lq->chunks[i].job, lq->chunks[i].chunk);
+      return;
+    }
+  }
+}
 
-This section parallelizing the printing. It will be out of order
-(compared to the sequential portion), but that does not matter
-since the results are the same.
+/*
+Name: serve_queries():
+Parameters: QueryServer *server, Snapshot *snap, ResidentTables *live,
+            size_t chunk_rows, int thread_num, bool explain
+Return: bool
+Description:
 
+The --serve loop of main(), run by one persistent thread team: a single
+thread reads each request with serve_next(), refreshes the tables with
+refresh_tables() and points snap at them, plans it, turns it into a Job
+and spawns its chunk tasks, which the rest of the team (and that thread, at
+the taskwait) execute exactly as for a query file. The finished Job is
+written in order to an in-memory sink, stored in the result cache and sent
+back with serve_reply(). Between requests the idle threads wait at the end
+of the single construct instead of being created again. Prints the number
+of queries served and each thread's share once the server stops; returns
+false if the thread counters cannot be allocated or a refresh failed.
 */
-#pragma omp critical(print_lock)
+bool serve_queries(QueryServer *server, Snapshot *snap, ResidentTables *live,
+                   size_t chunk_rows, int thread_num, bool explain) {
+  ThreadStats *tstats = calloc((size_t)thread_num, sizeof(ThreadStats));
+  QueryCache *qcache = live->cache;
+  PartPool pool = {0};
+  QueryTiming qt;
+  bool ok = true;
+
+  if (!tstats) {
+    fprintf(stderr, "Error: out of memory scheduling queries\n");
+    return false;
+  }
+  Scheduler sched = {.snap = snap,
+                     .tree = live->tree,
+                     .batch = NULL,
+                     .chunk_rows = chunk_rows,
+                     .ordered = true,
+                     .stats = tstats,
+                     .timing = &qt,
+                     .sink = NULL,
+                     .parts = &pool};
+  printf("Serving queries from %s with %d threads\n",
+         server->path ? server->path : "stdin", thread_num);
+  fflush(stdout);
+
+#pragma omp parallel shared(sched, server, qt, ok)
   {
-    if (q->num_select_attrs == 0 ||
-        (q->num_select_attrs == 1 && strcmp(q->select_attrs[0], "*") == 0)) {
-      printf("%d %s %d %s %d %s\n", car->ID, car->Model, car->YearMake,
-             car->Color, car->Price, car->Dealer);
-    } else {
-      bool first = true;
-      for (int i = 0; i < q->num_select_attrs; i++) {
-        const char *attr = q->select_attrs[i];
-        if (!first)
-          printf(" ");
-        if (!strcasecmp(attr, "ID"))
-          printf("%d", car->ID);
-        else if (!strcasecmp(attr, "Model"))
-          printf("%s", car->Model);
-        else if (!strcasecmp(attr, "YearMake"))
-          printf("%d", car->YearMake);
-        else if (!strcasecmp(attr, "Color"))
-          printf("%s", car->Color);
-        else if (!strcasecmp(attr, "Price"))
-          printf("%d", car->Price);
-        else if (!strcasecmp(attr, "Dealer"))
-          printf("%s", car->Dealer);
-        first = false;
+#pragma omp single
+    {
+      Query q;
+      QueryPlan plan;
+      Job job;
+      while (serve_next(server, &q)) {
+        double start = omp_get_wtime();
+        OutputSink reply;
+        char *data = NULL;
+        size_t len = 0;
+
+        if (refresh_tables(live) == REFRESH_FAILED) {
+          serve_error(server, "out of memory");
+          ok = false;
+          break;
+        }
+        snap->rows = live->loaded->rows;
+        snap->count = live->loaded->count;
+        snap->table = live->table;
+        snap->index = live->index;
+        snap->zones = live->zones;
+        plan_query(snap->stats, snap->index,
+                   snap->table ? QPE_COST_COLUMNAR_SCAN : QPE_COST_ROW_SCAN,
+                   &q.where, &plan);
+        if (qcache)
+          cache_plan(qcache, &q, &plan);
+        if (explain)
+          plan_explain(stderr, (int)server->served + 1, &q.where, &plan);
+        parts_reset(sched.parts);
+        if (!parts_reserve(sched.parts, (size_t)job_chunks(snap, chunk_rows,
+                                                           &q, &plan)) ||
+            !job_init(&job, snap, chunk_rows, &q, &plan, 1, 1, sched.parts)) {
+          serve_error(server, "out of memory");
+          continue;
+        }
+        memset(&qt, 0, sizeof(qt));
+        for (int c = 0; c < job.num_chunks; c++) {
+#pragma omp task firstprivate(c) shared(job)
+          run_chunk(&sched, &job, c);
+        }
+#pragma omp taskwait
+
+        if (job.failed || !output_open_memory(&reply, &data, &len)) {
+          serve_error(server, "out of memory");
+        } else {
+          job_write(&job, 0, &reply);
+          if (!output_close(&reply)) {
+            serve_error(server, "out of memory");
+          } else {
+            if (qcache && plan.path != PLAN_CACHED)
+              cache_store(qcache, &q, data, len);
+            serve_reply(server, data, len, omp_get_wtime() - start);
+          }
+        }
+        free(data);
+        job_free(&job);
       }
-      printf("\n");
     }
   }
+
+  printf("\nServed %lld queries in %.6f seconds (%.6f s mean)\n",
+         server->served, server->seconds,
+         server->served > 0 ? server->seconds / server->served : 0.0);
+  printf("  Refreshes: %lld appends (%zu tuples), %lld reloads, %.6f "
+         "seconds\n",
+         live->appends, live->rows_added, live->reloads, live->seconds);
+  if (qcache)
+    printf("  Result cache: %lld hits, %lld misses, %lld dropped\n",
+           qcache->hits, qcache->misses, qcache->dropped);
+  for (int t = 0; t < thread_num; t++)
+    printf("  Thread %d: busy %.6f seconds, %ld tasks, %zu rows scanned\n", t,
+           tstats[t].busy, tstats[t].tasks, tstats[t].rows);
+  parts_free(sched.parts);
+  free(tstats);
+  return ok;
 }
 
 /*
-Name: process_query():
-Parameters: struct btree *tree, Query *q
-Return: void
+Name: range_iter_cb():
+Parameters: const void *item, void *udata
+Return: bool
 Description:
 
-Materializes the B-tree into an array and uses an OpenMP parallel for loop with
-dynamic scheduling so threads evaluate disjoint record ranges concurrently.
+btree_ascend callback for an ID range: formats matching records into the
+context's Buffer and returns false once the ID passes the upper bound (or a
+result cannot be buffered), ending the traversal early.
 */
-void process_query(struct btree *tree, Query *q) {
-  size_t count = 0;
-  CarInventory *arr = btree_to_array(tree, &count);
-  if (!arr || count == 0)
-    return;
+static bool range_iter_cb(const void *item, void *udata) {
+  const CarInventory *car = (const CarInventory *)item;
+  RangeCtx *ctx = (RangeCtx *)udata;
+  if (car->ID > ctx->id_hi)
+    return false;
+  ctx->scanned++;
+  if (match_where(car, &ctx->q->where))
+    ctx->ok = append_selected(car, ctx->q, ctx->buf);
+  return ctx->ok;
+}
 
 /*
+Name: process_query_range():
+Parameters: struct btree *tree, const QueryPlan *plan, Query *q, Buffer *out,
+            size_t *scanned
+Return: bool
+Description:
+
+Runs a PLAN_ID_RANGE plan on the calling thread: btree_ascend() starts from
+the lower ID bound as pivot, so only records inside the range are visited,
+and *scanned is set to their number. Returns false if a result could not be
+buffered.
+*/
+bool process_query_range(struct btree *tree, const QueryPlan *plan, Query *q,
+                         Buffer *out, size_t *scanned) {
+  if (plan->id_lo > plan->id_hi)
+    return true;
+  CarInventory pivot;
+  memset(&pivot, 0, sizeof(pivot));
+  pivot.ID = (int)plan->id_lo;
+  RangeCtx ctx = {.q = q, .id_hi = plan->id_hi, .buf = out, .ok = true};
+  btree_ascend(tree, &pivot, range_iter_cb, &ctx);
+  *scanned = ctx.scanned;
+  return ctx.ok;
+}
+
+/*
+Name: process_query_indexed():
+Parameters: const SecondaryIndex *index, const CarInventory *rows,
+            const IndexProbe *probe, Query *q, Buffer *out, bool *done,
+            size_t *scanned
+Return: bool
+Description:
+
+Tests only the candidate rows index_lookup() returns for probe; the candidate
+lists are short, so the calling thread handles them alone while the outer
+loop keeps other threads busy with other queries. Sets *done once the query
+has been answered, with *scanned the candidates tested; leaves it false if
+the lookup failed and the query needs a full scan. Returns false if a result
+could not be buffered.
+*/
+bool process_query_indexed(const SecondaryIndex *index,
+                           const CarInventory *rows, const IndexProbe *probe,
+                           Query *q, Buffer *out, bool *done, size_t *scanned) {
+  PostingList hits;
+  bool ok = true;
+  if (!index_lookup(index, probe, &hits))
+    return true;
+  *scanned = hits.count;
+
+  for (size_t i = 0; ok && i < hits.count; i++) {
+    const CarInventory *car = &rows[hits.rows[i]];
+    if (match_where(car, &q->where))
+      ok = append_selected(car, q, out);
+  }
 
-Parallel Section: #pragma omp parallel for schedule(dynamic)
+  posting_list_free(&hits);
+  *done = true;
+  return ok;
+}
 
-Parallelizes the for loop and distributes the iterations
-among multiple threads
+/*
+Name: run_stream():
+Parameters: const QPEOptions *opts, RunTiming *timing, int thread_num,
+            OutputSink *sink
+Return: int
+Description:
 
+The --mem-limit path of main(). A StreamReader thread reads the database in
+blocks while the team filters the previous one: each block is cut into
+--chunk row chunks, and every chunk runs the shared QPEBatch.c pass for all
+queries into its own parts. Appending the parts to the StreamOutput in chunk
+order keeps each block's lines in ID order with their tags, and the output
+spills past its budget between blocks. Aggregate queries are left out of the
+batch: every thread folds its rows into its own AggTable per query, and the
+threads' tables are merged after the last block; ORDER BY ... LIMIT queries
+keep a TopK per thread the same way. Prints the same lines as a
+normal run, then the timing summary, and returns the exit status for main().
+Time spent waiting for the reader is charged to the load phase, the rest of
+the pass to filter.
 */
-#pragma omp parallel for schedule(dynamic)
-  for (size_t i = 0; i < count; i++) {
-    if (match_where(&arr[i], q->where_raw)) {
-      print_selected(&arr[i], q);
+int run_stream(const QPEOptions *opts, RunTiming *timing, int thread_num,
+               OutputSink *sink) {
+  TimingSummary summary;
+  StreamReader reader;
+  StreamOutput out;
+  QueryBatch batch;
+  CarInventory first[11];
+  const CarInventory *rows;
+  Query *queries = NULL;
+  AggTable *aggs = NULL; /* thread t, query i: aggs[t * num_queries + i] */
+  TopK *tops = NULL;     /* the same for ORDER BY ... LIMIT queries */
+  int *members = NULL;
+  int num_members = 0;
+  int num_queries = 0;
+  Buffer *parts = NULL;
+  int cap_chunks = 0;
+  size_t count;
+  size_t total = 0;
+  double mark = timing->start;
+  double pass;
+  bool ok;
+
+  memset(&out, 0, sizeof(out));
+  if (opts->layout == LAYOUT_COLUMNAR || opts->use_index || opts->explain ||
+      opts->cache)
+    fprintf(stderr, "Warning: --layout, --index, --explain and --cache are "
+                    "ignored with --mem-limit\n");
+
+  load_queries(opts->query_file, &queries, &num_queries);
+  size_t num_aggs = (size_t)thread_num * num_queries;
+  members = malloc(((size_t)num_queries + 1) * sizeof(int));
+  aggs = calloc(num_aggs + 1, sizeof(AggTable));
+  tops = calloc(num_aggs + 1, sizeof(TopK));
+  if (!members || !aggs || !tops || !timing_queries(timing, num_queries)) {
+    fprintf(stderr, "Error: out of memory scheduling queries\n");
+    free(members);
+    free(aggs);
+    free(tops);
+    free(queries);
+    timing_free(timing);
+    return 1;
+  }
+  ok = true;
+  for (int i = 0; i < num_queries; i++) {
+    if (queries[i].ordered)
+      for (int t = 0; t < thread_num; t++)
+        topk_init(&tops[(size_t)t * num_queries + i], &queries[i]);
+    if (!queries[i].aggregate) {
+      if (!queries[i].ordered)
+        members[num_members++] = i;
+      continue;
     }
+    for (int t = 0; t < thread_num; t++)
+      ok = agg_init(&aggs[(size_t)t * num_queries + i], &queries[i]) && ok;
   }
+  ok = ok && batch_init(&batch, queries, members, num_members, NULL);
+  free(members);
+  if (!ok || !stream_output_init(&out, num_queries,
+                                 stream_output_budget(opts->mem_limit),
+                                 timing->queries)) {
+    fprintf(stderr, "Error: out of memory scheduling queries\n");
+    if (ok)
+      batch_free(&batch);
+    stream_output_free(&out);
+    for (size_t k = 0; k < num_aggs; k++)
+      agg_free(&aggs[k]);
+    free(aggs);
+    free(tops);
+    free(queries);
+    timing_free(timing);
+    return 1;
+  }
+  if (!stream_open(&reader, opts->db_file,
+                   stream_block_bytes(opts->mem_limit))) {
+    fprintf(stderr, "Error: Failed to load database from %s\n",
+            opts->db_file);
+    batch_free(&batch);
+    stream_output_free(&out);
+    for (size_t k = 0; k < num_aggs; k++)
+      agg_free(&aggs[k]);
+    free(aggs);
+    free(tops);
+    free(queries);
+    timing_free(timing);
+    return 1;
+  }
+  mark = timing_lap(timing, TIME_MATERIALIZE, mark);
+
+  while (ok && stream_next(&reader, &rows, &count)) {
+    size_t chunk = opts->chunk_rows;
+    int num_chunks = (int)((count + chunk - 1) / chunk);
+    bool failed = false;
+
+    if (num_chunks > cap_chunks) {
+      size_t width = 2 * (size_t)num_queries;
+      Buffer *grown = realloc(parts, ((size_t)num_chunks * width + 1) *
+                                         sizeof(Buffer));
+      if (!grown) {
+        fprintf(stderr, "Error: out of memory buffering results\n");
+        ok = false;
+        break;
+      }
+      memset(grown + (size_t)cap_chunks * width, 0,
+             ((size_t)(num_chunks - cap_chunks) * width + 1) *
+                 sizeof(Buffer));
+      parts = grown;
+      cap_chunks = num_chunks;
+    }
+
+    /* Parallel section: one chunk of the block per iteration. */
+#pragma omp parallel for schedule(dynamic) reduction(|| : failed)
+    for (int c = 0; c < num_chunks; c++) {
+      Buffer *outs = &parts[(size_t)c * 2 * num_queries];
+      AggTable *mine = &aggs[(size_t)omp_get_thread_num() * num_queries];
+      TopK *kept = &tops[(size_t)omp_get_thread_num() * num_queries];
+      size_t scanned = 0;
+      size_t end = (size_t)(c + 1) * chunk < count ? (size_t)(c + 1) * chunk
+                                                   : count;
+      for (size_t i = (size_t)c * chunk; i < end && !failed; i++)
+        failed = !batch_row_tagged(&batch, &rows[i], outs,
+                                   outs + num_queries);
+      for (int qi = 0; qi < num_queries && !failed; qi++)
+        if (queries[qi].aggregate)
+          failed = !agg_scan(&mine[qi], rows, (size_t)c * chunk, end);
+        else if (queries[qi].ordered)
+          failed = !topk_scan(&kept[qi], rows, (size_t)c * chunk, end,
+                              &scanned);
+    }
+
+    for (int c = 0; c < num_chunks; c++)
+      for (int qi = 0; qi < num_queries; qi++) {
+        Buffer *part = &parts[(size_t)c * 2 * num_queries + qi];
+        Buffer *tags = part + num_queries;
+        if (part->len > 0 && !failed)
+          failed = !buffer_append(&out.bufs[qi], part->data, part->len) ||
+                   !buffer_append(&out.tags[qi], tags->data, tags->len);
+        part->len = 0;
+        tags->len = 0;
+      }
+    for (size_t i = 0; total + i < 11 && i < count; i++)
+      first[total + i] = rows[i];
+    total += count;
+    if (failed)
+      fprintf(stderr, "Error: out of memory buffering results\n");
+    ok = !failed && stream_output_check(&out);
+  }
+  if (reader.failed) {
+    fprintf(stderr, "Error: Failed to load database from %s\n",
+            opts->db_file);
+    ok = false;
+  }
+  mark = timing_lap(timing, TIME_FILTER, mark);
+  pass = timing->value[TIME_FILTER];
+  timing->value[TIME_FILTER] -= reader.wait_seconds;
+  timing->value[TIME_LOAD] += reader.wait_seconds;
+  stream_close(&reader);
+  batch_free(&batch);
+  for (size_t k = 0; k < (size_t)cap_chunks * 2 * num_queries; k++)
+    buffer_free(&parts[k]);
+  free(parts);
+  for (int qi = 0; ok && qi < num_queries; qi++) {
+    if (queries[qi].ordered) {
+      for (int t = 1; ok && t < thread_num; t++)
+        ok = topk_merge(&tops[qi], &tops[(size_t)t * num_queries + qi]);
+      ok = ok && stream_output_top(&out, qi, &tops[qi]);
+      if (!ok)
+        fprintf(stderr, "Error: out of memory buffering results\n");
+    }
+    if (!queries[qi].aggregate)
+      continue;
+    for (int t = 1; ok && t < thread_num; t++)
+      ok = agg_merge(&aggs[qi], &aggs[(size_t)t * num_queries + qi]);
+    ok = ok && stream_output_groups(&out, qi, &aggs[qi]);
+    if (!ok)
+      fprintf(stderr, "Error: out of memory buffering results\n");
+  }
+  for (size_t k = 0; k < num_aggs; k++) {
+    agg_free(&aggs[k]);
+    topk_free(&tops[k]);
+  }
+  free(aggs);
+  free(tops);
+
+  if (ok) {
+    printf("Loaded %zu tuples from %s\n", total, opts->db_file);
+    if (total <= 10) {
+      printf("Printing all tuples for debugging:\n");
+      for (size_t i = 0; i < total; i++)
+        print_iter(&first[i], NULL);
+    }
+    printf("Processing %d queries from %s\n", num_queries, opts->query_file);
+    for (int i = 0; i < num_queries; i++) {
+      timing->queries[i].rows_scanned = (double)total;
+      timing->queries[i].seconds = timing->value[TIME_FILTER] / num_queries;
+    }
+    ok = stream_output_write(&out, sink);
+    ok = output_close(sink) && ok;
+    timing_lap(timing, TIME_OUTPUT, mark);
+  }
+  timing_finish(timing);
+  timing_summary_local(timing, &summary);
+
+  if (ok) {
+    printf("\nTiming summary (wall clock):\n");
+    printf("  Number of threads: %d\n", thread_num);
+    printf("  Parallel time: %.6f seconds\n", timing->value[TIME_TOTAL]);
+    printf("  Streamed %.1f MB in %zu KB blocks (%.1f MB/s), %.1f MB "
+           "spilled\n",
+           reader.bytes_read / 1e6, reader.block_bytes >> 10,
+           pass > 0 ? reader.bytes_read / 1e6 / pass : 0.0,
+           out.spilled / 1e6);
+    printf("  Chunk size: %zu rows\n", opts->chunk_rows);
+    timing_print(stdout, &summary);
+  }
+
+  if (ok && opts->timing_file) {
+    TimingInfo info = {.engine = "qpe_omp",
+                       .db_file = opts->db_file,
+                       .query_file = opts->query_file,
+                       .layout = "stream",
+                       .mode = NULL,
+                       .processes = 1,
+                       .threads = thread_num,
+                       .tuples = (long long)total};
+    timing_write(opts->timing_file, &info, &summary, timing->queries,
+                 timing->num_queries);
+  }
+  stream_output_free(&out);
+  free(queries);
+  timing_free(timing);
 
-  free(arr);
+  return ok ? 0 : 1;
 }
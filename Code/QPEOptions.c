@@ -0,0 +1,180 @@
+/*
+
+QPEOptions.c
+
+Authors:
+    Aidan Levy
+    Maddie Powell
+    Nick Corcoran
+    Austin Phalines
+    Dean Bullock
+
+Creation Date: 10-14-2026
+
+Description:
+
+Parses the command line of qpe_seq, qpe_omp, qpe_mpi and qpe_hybrid into a
+QPEOptions structure. Supported options:
+
+- --layout=row       scan CarInventory records (default)
+- --layout=columnar  scan the dictionary-encoded column store (QPEColumn.c)
+- --index            answer Model/YearMake/Color equalities from secondary
+                     indexes (QPEIndex.c) instead of scanning
+- --explain          print the access path chosen for each query (QPEPlan.c)
+                     on stderr
+- --ordered          qpe_omp only: write results in query order, identical to
+                     qpe_seq, instead of as each thread finishes a query
+- --numa             qpe_omp only: pin the threads and copy the table into
+                     memory each thread first-touches its own partition of
+                     (QPENuma.c), then scan each partition from its thread
+- --batch            answer all full-scan queries with one shared pass over
+                     the table (QPEBatch.c)
+- --chunk=N          qpe_omp and qpe_hybrid only: rows per full-scan task,
+                     rounded up to a multiple of QPE_CHUNK_ALIGN
+- --parallel-io      qpe_mpi and qpe_hybrid only: every rank reads its own
+                     slice of the database with MPI-IO instead of receiving
+                     it from rank 0
+- --mode=data        qpe_mpi and qpe_hybrid only: split the table across the
+                     ranks and run every query on every slice (default)
+- --mode=query       qpe_mpi and qpe_hybrid only: give every rank the whole
+                     table and let rank 0 hand queries out to idle ranks
+- --mode=auto        qpe_mpi and qpe_hybrid only: pick one of the two from the
+                     table size, the number of queries and the number of ranks
+- --timing=FILE      append the run's phase, per-query and counter figures
+                     (QPETiming.c) to FILE as a JSON line, or a CSV row when
+                     FILE ends in .csv
+- --mem-limit=N      qpe_seq and qpe_omp only: stream the database in blocks
+                     (QPEStream.c) so the table and the buffered results stay
+                     within about N bytes; N may end in K, M or G
+- --output=FILE      write the query results to FILE instead of stdout
+                     (QPEOutput.c), as CSV when FILE ends in .csv
+- --cache            answer a query seen before against the same, unchanged
+                     database file from the result cache (QPECache.c) kept
+                     in <database>.qcache
+- --cache=DIR        the same, keeping the cache in DIR
+- --serve            load once, then answer queries read from stdin as they
+                     arrive instead of running the query file (QPEServe.c)
+- --serve=PATH       the same, taking queries from clients of a Unix domain
+                     socket created at PATH
+
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "QPEOptions.h"
+
+/*
+Name: parse_options():
+Parameters: int argc, char **argv, QPEOptions *opts
+Return: const char *
+Description:
+
+Fills opts with defaults, then applies every positional argument and option
+from argv. Returns NULL on success or the first argument that could not be
+understood so the caller can report it.
+*/
+const char *parse_options(int argc, char **argv, QPEOptions *opts) {
+  int positional = 0;
+
+  opts->db_file = "db/db.txt";
+  opts->query_file = "db/sql.txt";
+  opts->num_threads = 0;
+  opts->layout = LAYOUT_ROW;
+  opts->use_index = false;
+  opts->explain = false;
+  opts->ordered = false;
+  opts->numa = false;
+  opts->batch = false;
+  opts->parallel_io = false;
+  opts->chunk_rows = QPE_DEFAULT_CHUNK_ROWS;
+  opts->mode = MODE_DATA;
+  opts->timing_file = NULL;
+  opts->mem_limit = 0;
+  opts->output_file = NULL;
+  opts->cache = false;
+  opts->cache_dir = NULL;
+  opts->serve = false;
+  opts->serve_path = NULL;
+
+  for (int i = 1; i < argc; i++) {
+    const char *arg = argv[i];
+
+    if (strncmp(arg, "--", 2) != 0) {
+      if (positional == 0) {
+        opts->db_file = arg;
+      } else if (positional == 1) {
+        opts->query_file = arg;
+      } else if (positional == 2) {
+        opts->num_threads = atoi(arg);
+      } else {
+        return arg;
+      }
+      positional++;
+    } else if (strcmp(arg, "--layout=row") == 0) {
+      opts->layout = LAYOUT_ROW;
+    } else if (strcmp(arg, "--layout=columnar") == 0) {
+      opts->layout = LAYOUT_COLUMNAR;
+    } else if (strcmp(arg, "--index") == 0) {
+      opts->use_index = true;
+    } else if (strcmp(arg, "--explain") == 0) {
+      opts->explain = true;
+    } else if (strcmp(arg, "--ordered") == 0) {
+      opts->ordered = true;
+    } else if (strcmp(arg, "--numa") == 0) {
+      opts->numa = true;
+    } else if (strcmp(arg, "--batch") == 0) {
+      opts->batch = true;
+    } else if (strcmp(arg, "--parallel-io") == 0) {
+      opts->parallel_io = true;
+    } else if (strcmp(arg, "--mode=data") == 0) {
+      opts->mode = MODE_DATA;
+    } else if (strcmp(arg, "--mode=query") == 0) {
+      opts->mode = MODE_QUERY;
+    } else if (strcmp(arg, "--mode=auto") == 0) {
+      opts->mode = MODE_AUTO;
+    } else if (strncmp(arg, "--timing=", 9) == 0 && arg[9] != '\0') {
+      opts->timing_file = arg + 9;
+    } else if (strncmp(arg, "--output=", 9) == 0 && arg[9] != '\0') {
+      opts->output_file = arg + 9;
+    } else if (strcmp(arg, "--cache") == 0) {
+      opts->cache = true;
+    } else if (strncmp(arg, "--cache=", 8) == 0 && arg[8] != '\0') {
+      opts->cache = true;
+      opts->cache_dir = arg + 8;
+    } else if (strcmp(arg, "--serve") == 0) {
+      opts->serve = true;
+    } else if (strncmp(arg, "--serve=", 8) == 0 && arg[8] != '\0') {
+      opts->serve = true;
+      opts->serve_path = arg + 8;
+    } else if (strncmp(arg, "--mem-limit=", 12) == 0) {
+      char *end;
+      unsigned long long bytes = strtoull(arg + 12, &end, 10);
+      if (*end == 'K' || *end == 'k') {
+        bytes <<= 10;
+        end++;
+      } else if (*end == 'M' || *end == 'm') {
+        bytes <<= 20;
+        end++;
+      } else if (*end == 'G' || *end == 'g') {
+        bytes <<= 30;
+        end++;
+      }
+      if (bytes == 0 || end == arg + 12 || *end != '\0') {
+        return arg;
+      }
+      opts->mem_limit = (size_t)bytes;
+    } else if (strncmp(arg, "--chunk=", 8) == 0) {
+      long rows = atol(arg + 8);
+      if (rows <= 0) {
+        return arg;
+      }
+      opts->chunk_rows = ((size_t)rows + QPE_CHUNK_ALIGN - 1) /
+                         QPE_CHUNK_ALIGN * QPE_CHUNK_ALIGN;
+    } else {
+      return arg;
+    }
+  }
+
+  return NULL;
+}
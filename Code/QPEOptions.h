@@ -0,0 +1,58 @@
+/*
+
+QPEOptions.h
+
+Command line handling shared by the query processing engines. Positional
+arguments keep their historical meaning (database file, query file, and for
+QPEOMP.c and qpe_hybrid the thread count); everything starting with "--" is
+an option.
+
+*/
+
+#ifndef QPE_OPTIONS_H
+#define QPE_OPTIONS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+qpe_omp and qpe_hybrid split full scans into tasks of this many rows
+(--chunk). Chunks are whole column-store filter blocks (QPE_FILTER_BLOCK in
+QPEFilter.h).
+*/
+#define QPE_CHUNK_ALIGN 4096
+#define QPE_DEFAULT_CHUNK_ROWS (4 * QPE_CHUNK_ALIGN)
+
+typedef enum { LAYOUT_ROW, LAYOUT_COLUMNAR } Layout;
+
+/* --mode: how qpe_mpi spreads the work over its ranks. */
+typedef enum { MODE_DATA, MODE_QUERY, MODE_AUTO } Mode;
+
+typedef struct {
+  const char *db_file;
+  const char *query_file;
+  int num_threads; /* third positional argument, 0 when absent */
+  Layout layout;
+  bool use_index; /* --index: build the QPEIndex.c secondary indexes */
+  bool explain;   /* --explain: print each query's plan on stderr */
+  bool ordered;   /* --ordered: qpe_omp writes results in query order */
+  bool numa;      /* --numa: qpe_omp first-touch placement (QPENuma.c) */
+  bool batch;     /* --batch: share one scan among full-scan queries */
+  bool parallel_io;  /* --parallel-io: qpe_mpi ranks read their own slice */
+  size_t chunk_rows; /* --chunk: rows per qpe_omp/qpe_hybrid task */
+  Mode mode;         /* --mode: qpe_mpi data or query parallelism */
+  const char *timing_file; /* --timing: log to append to, else NULL */
+  size_t mem_limit; /* --mem-limit: stream in this many bytes, 0 = load all */
+  const char *output_file; /* --output: results file, else NULL (stdout) */
+  bool cache; /* --cache: reuse results of unchanged queries */
+  const char *cache_dir; /* --cache=DIR, else NULL (next to the database) */
+  bool serve; /* --serve: answer queries as they arrive (QPEServe.c) */
+  const char *serve_path; /* --serve=PATH socket, else NULL (stdin) */
+} QPEOptions;
+
+/*
+Function Prototypes
+*/
+const char *parse_options(int argc, char **argv, QPEOptions *opts);
+
+#endif
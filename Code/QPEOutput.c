@@ -0,0 +1,176 @@
+/*
+
+QPEOutput.c
+
+Authors:
+    Aidan Levy
+    Maddie Powell
+    Nick Corcoran
+    Austin Phalines
+    Dean Bullock
+
+Creation Date: 10-14-2026
+
+Description:
+
+Result sink for --output (see QPEOutput.h). The engines format results into
+Buffers as space-separated lines and hand them to output_write(), which
+writes them unchanged in text mode. In CSV mode the separators become commas
+and every line gets its query number first. The fields never contain spaces
+or commas, so nothing needs quoting. The conversion goes through a small
+stack buffer, so a sink needs no memory of its own.
+
+*/
+
+#include <stdio.h>
+#include <string.h>
+
+#include "QPEOutput.h"
+
+/* Bytes converted at a time in CSV mode. */
+#define QPE_OUTPUT_CHUNK 8192
+
+/*
+Name: output_open():
+Parameters: OutputSink *sink, const char *path
+Return: bool
+Description:
+
+Opens the sink: stdout when path is NULL, otherwise path, truncated, as CSV
+when it ends in .csv and as text otherwise. Returns false, after reporting
+why, if the file cannot be created.
+*/
+bool output_open(OutputSink *sink, const char *path) {
+  size_t len = path ? strlen(path) : 0;
+
+  sink->file = stdout;
+  sink->path = path;
+  sink->format = OUTPUT_TEXT;
+  sink->line_start = true;
+  if (path == NULL) {
+    return true;
+  }
+  if (len >= 4 && strcmp(path + len - 4, ".csv") == 0) {
+    sink->format = OUTPUT_CSV;
+  }
+  sink->file = fopen(path, "w");
+  if (sink->file == NULL) {
+    perror(path);
+    return false;
+  }
+  return true;
+}
+
+/*
+Name: output_open_memory():
+Parameters: OutputSink *sink, char **data, size_t *len
+Return: bool
+Description:
+
+Opens a text sink that collects everything written to it in memory. After
+output_close() *data holds the *len bytes (NUL-terminated, to be freed by
+the caller). Returns false, after reporting why, when out of memory.
+*/
+bool output_open_memory(OutputSink *sink, char **data, size_t *len) {
+  sink->path = "memory";
+  sink->format = OUTPUT_TEXT;
+  sink->line_start = true;
+  sink->file = open_memstream(data, len);
+  if (sink->file == NULL) {
+    perror("open_memstream");
+    return false;
+  }
+  return true;
+}
+
+/*
+Name: output_write():
+Parameters: OutputSink *sink, int query_no, const char *data, size_t len
+Return: void
+Description:
+
+Writes len bytes of query query_no's result lines. data may end in the middle
+of a line; the next call continues it. Write errors are reported by
+output_close().
+*/
+void output_write(OutputSink *sink, int query_no, const char *data,
+                  size_t len) {
+  char chunk[QPE_OUTPUT_CHUNK];
+  char prefix[16];
+  int prefix_len;
+  size_t n = 0;
+
+  if (len == 0) {
+    return;
+  }
+  if (sink->format == OUTPUT_TEXT) {
+    fwrite(data, 1, len, sink->file);
+    return;
+  }
+
+  prefix_len = snprintf(prefix, sizeof(prefix), "%d,", query_no);
+  output_lock(sink);
+  for (size_t i = 0; i < len; i++) {
+    if (n + sizeof(prefix) + 1 > sizeof(chunk)) {
+      fwrite(chunk, 1, n, sink->file);
+      n = 0;
+    }
+    if (sink->line_start) {
+      memcpy(chunk + n, prefix, (size_t)prefix_len);
+      n += (size_t)prefix_len;
+    }
+    chunk[n++] = data[i] == ' ' ? ',' : data[i];
+    sink->line_start = data[i] == '\n';
+  }
+  fwrite(chunk, 1, n, sink->file);
+  output_unlock(sink);
+}
+
+/*
+Name: output_lock():
+Parameters: OutputSink *sink
+Return: void
+Description:
+
+Holds the sink's stream lock, so a thread can write several pieces of one
+query without another thread's output landing between them. The lock is
+recursive, so output_write() can be called while holding it.
+*/
+void output_lock(OutputSink *sink) {
+  flockfile(sink->file);
+}
+
+/*
+Name: output_unlock():
+Parameters: OutputSink *sink
+Return: void
+Description:
+
+Releases the lock taken by output_lock().
+*/
+void output_unlock(OutputSink *sink) {
+  funlockfile(sink->file);
+}
+
+/*
+Name: output_close():
+Parameters: OutputSink *sink
+Return: bool
+Description:
+
+Flushes the sink and closes its file (stdout stays open). Returns false,
+after reporting it, if any write to the file failed.
+*/
+bool output_close(OutputSink *sink) {
+  bool ok = fflush(sink->file) == 0 && !ferror(sink->file);
+
+  if (sink->path != NULL && fclose(sink->file) != 0) {
+    ok = false;
+  }
+  if (!ok) {
+    fprintf(stderr, "Error: failed to write results to %s\n",
+            sink->path ? sink->path : "stdout");
+  }
+  sink->file = NULL;
+  return ok;
+}
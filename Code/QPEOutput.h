@@ -0,0 +1,44 @@
+/*
+
+QPEOutput.h
+
+Where the engines write query results (see QPEOutput.c). By default they go
+to stdout as text, the lines the engines have always printed. --output=FILE
+sends them to FILE instead, leaving stdout with the progress lines and the
+timing summary. If FILE ends in .csv every result line is written as CSV:
+the query number, then the selected columns. output_open_memory() collects
+the text in memory instead, which --serve uses to size each reply.
+
+*/
+
+#ifndef QPE_OUTPUT_H
+#define QPE_OUTPUT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+/*
+Struct Definitions
+*/
+typedef enum { OUTPUT_TEXT, OUTPUT_CSV } OutputFormat;
+
+typedef struct {
+  FILE *file;
+  const char *path; /* NULL for stdout */
+  OutputFormat format;
+  bool line_start; /* CSV: the next byte written starts a line */
+} OutputSink;
+
+/*
+Function Prototypes
+*/
+bool output_open(OutputSink *sink, const char *path);
+bool output_open_memory(OutputSink *sink, char **data, size_t *len);
+void output_write(OutputSink *sink, int query_no, const char *data,
+                  size_t len);
+void output_lock(OutputSink *sink);
+void output_unlock(OutputSink *sink);
+bool output_close(OutputSink *sink);
+
+#endif
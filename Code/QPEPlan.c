@@ -0,0 +1,555 @@
+/*
+
+QPEPlan.c
+
+Authors:
+    Aidan Levy
+    Maddie Powell
+    Nick Corcoran
+    Austin Phalines
+    Dean Bullock
+
+Creation Date: 10-14-2026
+
+Description:
+
+Implements the planner described in QPEPlan.h. Costs are in units of "one row
+tested by a row-layout scan":
+
+- a full scan costs rows * scan_row_cost (cheaper for the columnar layout)
+- an ID range costs one B-tree seek plus one step per row inside the range
+- an index seek costs one B-tree seek per key, merging the posting lists it
+  unions, and a fetch (a random access into the row array) per candidate
+- an intersection additionally merges both lists and only fetches the rows
+  that survive
+
+Conjuncts are reordered by cost / (1 - selectivity), the classic rank for
+ordering independent filters, so that a cheap test that rejects most rows runs
+before a string comparison that rejects few.
+
+*/
+
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "QPEPlan.h"
+
+#define QPE_COST_FETCH 2.0  /* visiting one row through a posting list */
+#define QPE_COST_MERGE 0.25 /* moving one position through a merge */
+#define QPE_COST_INT_TEST 1.0
+#define QPE_COST_STR_TEST 3.0
+
+/*
+Function Prototypes
+*/
+static double node_selectivity(const TableStats *stats, const Predicate *pred,
+                               int idx);
+static double node_cost(const Predicate *pred, int idx);
+static int collect_and_chain(const Predicate *pred, int idx, int *out,
+                             int count);
+static int copy_subtree(const Predicate *src, int idx, Predicate *dst);
+static void reorder_conjuncts(const TableStats *stats, Predicate *pred);
+static bool id_bounds(const Predicate *pred, long long *lo, long long *hi);
+static double seek_cost(double rows);
+static bool consider(QueryPlan *plan, AccessPath path, double candidates,
+                     double cost);
+static void plan_index(const TableStats *stats, const Predicate *pred,
+                       QueryPlan *plan);
+static int format_node(const Predicate *pred, int idx, int parent,
+                       char *buf, size_t len);
+
+static const char *column_names[] = {"ID",    "Model", "YearMake",
+                                     "Color", "Price", "Dealer"};
+static const char *op_names[] = {"=", "!=", ">", "<", ">=", "<="};
+static const char *path_names[] = {"FULL SCAN", "ID RANGE", "INDEX SEEK",
+                                   "INDEX INTERSECT", "CACHED"};
+
+/*
+Name: node_selectivity():
+Parameters: const TableStats *stats, const Predicate *pred, int idx
+Return: double
+Description:
+
+Estimated fraction of rows accepted by the subtree at idx, treating the
+operands of AND/OR as independent.
+*/
+static double node_selectivity(const TableStats *stats, const Predicate *pred,
+                               int idx) {
+  const PredNode *node = &pred->nodes[idx];
+  double l;
+  double r;
+
+  switch (node->kind) {
+  case PRED_INT_CMP:
+    return stats_int_selectivity(stats, (ColumnId)node->column,
+                                 (CompareOp)node->op, node->ival);
+  case PRED_STR_CMP:
+    return stats_str_selectivity(stats, (ColumnId)node->column,
+                                 (CompareOp)node->op,
+                                 pred->strpool + node->str);
+  case PRED_AND:
+    l = node_selectivity(stats, pred, node->left);
+    r = node_selectivity(stats, pred, node->right);
+    return l * r;
+  case PRED_OR:
+    l = node_selectivity(stats, pred, node->left);
+    r = node_selectivity(stats, pred, node->right);
+    return l + r - l * r;
+  default:
+    return node->truth ? 1.0 : 0.0;
+  }
+}
+
+/*
+Name: node_cost():
+Parameters: const Predicate *pred, int idx
+Return: double
+Description:
+
+Worst-case cost of evaluating the subtree at idx on one row.
+*/
+static double node_cost(const Predicate *pred, int idx) {
+  const PredNode *node = &pred->nodes[idx];
+
+  switch (node->kind) {
+  case PRED_INT_CMP:
+    return QPE_COST_INT_TEST;
+  case PRED_STR_CMP:
+    return QPE_COST_STR_TEST;
+  case PRED_AND:
+  case PRED_OR:
+    return node_cost(pred, node->left) + node_cost(pred, node->right);
+  default:
+    return 0.0;
+  }
+}
+
+/*
+Name: collect_and_chain():
+Parameters: const Predicate *pred, int idx, int *out, int count
+Return: int
+Description:
+
+Appends the conjuncts of the AND tree at idx to out (left to right), returning
+the new count.
+*/
+static int collect_and_chain(const Predicate *pred, int idx, int *out,
+                             int count) {
+  const PredNode *node = &pred->nodes[idx];
+
+  if (node->kind == PRED_AND) {
+    count = collect_and_chain(pred, node->left, out, count);
+    return collect_and_chain(pred, node->right, out, count);
+  }
+  out[count] = idx;
+  return count + 1;
+}
+
+/*
+Name: copy_subtree():
+Parameters: const Predicate *src, int idx, Predicate *dst
+Return: int
+Description:
+
+Copies the subtree at src->nodes[idx] into dst, children before parents (the
+order compile_where() produces and column_filter_init() relies on). Returns
+the new index, or -1 when dst is full.
+*/
+static int copy_subtree(const Predicate *src, int idx, Predicate *dst) {
+  PredNode node = src->nodes[idx];
+
+  if (node.kind == PRED_AND || node.kind == PRED_OR) {
+    node.left = (short)copy_subtree(src, node.left, dst);
+    node.right = (short)copy_subtree(src, node.right, dst);
+    if (node.left < 0 || node.right < 0) {
+      return -1;
+    }
+  }
+  if (dst->num_nodes == QPE_MAX_PRED_NODES) {
+    return -1;
+  }
+  dst->nodes[dst->num_nodes] = node;
+  return dst->num_nodes++;
+}
+
+/*
+Name: reorder_conjuncts():
+Parameters: const TableStats *stats, Predicate *pred
+Return: void
+Description:
+
+Rebuilds the top-level AND chain of pred as a left-deep chain whose conjuncts
+appear in ascending cost / (1 - selectivity) order, so match_where() and the
+bitmap filter evaluate the most useful test first. Equal ranks keep their
+written order; the predicate is left untouched if the copy does not fit.
+*/
+static void reorder_conjuncts(const TableStats *stats, Predicate *pred) {
+  int conj[QPE_MAX_PRED_NODES];
+  double rank[QPE_MAX_PRED_NODES];
+  Predicate out;
+  int count;
+  int root;
+
+  if (pred->root < 0 || pred->nodes[pred->root].kind != PRED_AND) {
+    return;
+  }
+  count = collect_and_chain(pred, pred->root, conj, 0);
+  for (int i = 0; i < count; i++) {
+    double sel = node_selectivity(stats, pred, conj[i]);
+    double reject = 1.0 - sel;
+    rank[i] = node_cost(pred, conj[i]) / (reject > 1e-9 ? reject : 1e-9);
+  }
+
+  /* Insertion sort: stable and count is tiny. */
+  for (int i = 1; i < count; i++) {
+    int c = conj[i];
+    double r = rank[i];
+    int j = i - 1;
+    while (j >= 0 && rank[j] > r) {
+      conj[j + 1] = conj[j];
+      rank[j + 1] = rank[j];
+      j--;
+    }
+    conj[j + 1] = c;
+    rank[j + 1] = r;
+  }
+
+  out.num_nodes = 0;
+  memcpy(out.strpool, pred->strpool, sizeof(out.strpool));
+  out.strpool_len = pred->strpool_len;
+  root = copy_subtree(pred, conj[0], &out);
+  for (int i = 1; i < count && root >= 0; i++) {
+    int right = copy_subtree(pred, conj[i], &out);
+    if (right < 0 || out.num_nodes == QPE_MAX_PRED_NODES) {
+      return;
+    }
+    PredNode *and_node = &out.nodes[out.num_nodes];
+    memset(and_node, 0, sizeof(*and_node));
+    and_node->kind = PRED_AND;
+    and_node->left = (short)root;
+    and_node->right = (short)right;
+    root = out.num_nodes++;
+  }
+  if (root < 0) {
+    return;
+  }
+  out.root = root;
+  *pred = out;
+}
+
+/*
+Name: id_bounds():
+Parameters: const Predicate *pred, long long *lo, long long *hi
+Return: bool
+Description:
+
+Intersects every top-level ID =, >, >=, < and <= conjunct into the inclusive
+range [lo, hi]. Returns false when the clause does not bound ID at all.
+*/
+static bool id_bounds(const Predicate *pred, long long *lo, long long *hi) {
+  int conj[QPE_MAX_PRED_NODES];
+  int count;
+  bool found = false;
+
+  *lo = INT_MIN;
+  *hi = INT_MAX;
+  if (pred->root < 0) {
+    return false;
+  }
+  count = collect_and_chain(pred, pred->root, conj, 0);
+  for (int i = 0; i < count; i++) {
+    const PredNode *node = &pred->nodes[conj[i]];
+    long long v = node->ival;
+    if (node->kind != PRED_INT_CMP || node->column != COL_ID ||
+        node->op == OP_NE) {
+      continue;
+    }
+    found = true;
+    if (node->op == OP_EQ || node->op == OP_GE) {
+      *lo = v > *lo ? v : *lo;
+    } else if (node->op == OP_GT) {
+      *lo = v + 1 > *lo ? v + 1 : *lo;
+    }
+    if (node->op == OP_EQ || node->op == OP_LE) {
+      *hi = v < *hi ? v : *hi;
+    } else if (node->op == OP_LT) {
+      *hi = v - 1 < *hi ? v - 1 : *hi;
+    }
+  }
+  return found;
+}
+
+/*
+Name: seek_cost():
+Parameters: double rows
+Return: double
+Description:
+
+Cost of one B-tree descent over rows entries: about log2(rows) comparisons.
+*/
+static double seek_cost(double rows) {
+  double depth = 1.0;
+  while (rows >= 2.0) {
+    rows /= 2.0;
+    depth += 1.0;
+  }
+  return depth;
+}
+
+/*
+Name: consider():
+Parameters: QueryPlan *plan, AccessPath path, double candidates, double cost
+Return: bool
+Description:
+
+Switches plan to path when it is strictly cheaper than the current choice,
+returning true if it did.
+*/
+static bool consider(QueryPlan *plan, AccessPath path, double candidates,
+                     double cost) {
+  if (cost >= plan->cost) {
+    return false;
+  }
+  plan->path = path;
+  plan->candidates = candidates;
+  plan->cost = cost;
+  return true;
+}
+
+/*
+Name: plan_index():
+Parameters: const TableStats *stats, const Predicate *pred, QueryPlan *plan
+Return: void
+Description:
+
+Prices the Model seek, the Color seek and their intersection, keeping the
+cheapest in plan and trimming plan->probe to the sides it uses.
+*/
+static void plan_index(const TableStats *stats, const Predicate *pred,
+                       QueryPlan *plan) {
+  IndexProbe probe;
+  double n = (double)stats->num_rows;
+  double seek = seek_cost(n);
+  double model_rows = 0.0, model_cost = 0.0;
+  double color_rows = 0.0, color_cost = 0.0;
+  bool use_model = false;
+  bool use_colors = false;
+
+  index_probe_init(&probe, pred);
+
+  if (probe.model != NULL) {
+    double sel = stats_str_selectivity(stats, COL_MODEL, OP_EQ, probe.model);
+    double years = 1.0;
+    if (probe.has_year) {
+      sel *= stats_int_selectivity(stats, COL_YEARMAKE, OP_EQ, probe.year);
+    } else if (stats->year_make.num_values > 0) {
+      years = stats->year_make.num_values;
+    }
+    model_rows = n * sel;
+    /* A Model-only seek unions one list per YearMake value. */
+    model_cost = seek + model_rows * QPE_COST_MERGE * (years + 1.0) / 2.0;
+    if (consider(plan, PLAN_INDEX_SEEK, model_rows,
+                 model_cost + model_rows * QPE_COST_FETCH)) {
+      use_model = true;
+    }
+  }
+
+  if (probe.num_colors >= 0) {
+    double sel = 0.0;
+    for (int i = 0; i < probe.num_colors; i++) {
+      sel += stats_str_selectivity(stats, COL_COLOR, OP_EQ, probe.colors[i]);
+    }
+    color_rows = n * (sel < 1.0 ? sel : 1.0);
+    color_cost = seek * probe.num_colors +
+                 color_rows * QPE_COST_MERGE * (probe.num_colors + 1) / 2.0;
+    if (consider(plan, PLAN_INDEX_SEEK, color_rows,
+                 color_cost + color_rows * QPE_COST_FETCH)) {
+      use_model = false;
+      use_colors = true;
+    }
+  }
+
+  if (probe.model != NULL && probe.num_colors >= 0) {
+    double both = n > 0 ? model_rows * color_rows / n : 0.0;
+    if (consider(plan, PLAN_INDEX_INTERSECT, both,
+                 model_cost + color_cost +
+                     (model_rows + color_rows) * QPE_COST_MERGE +
+                     both * QPE_COST_FETCH)) {
+      use_model = true;
+      use_colors = true;
+    }
+  }
+
+  if (!use_model) {
+    probe.model = NULL;
+    probe.has_year = false;
+  }
+  if (!use_colors) {
+    probe.num_colors = -1;
+  }
+  plan->probe = probe;
+}
+
+/*
+Name: plan_query():
+Parameters: const TableStats *stats, const SecondaryIndex *index,
+            double scan_row_cost, Predicate *pred, QueryPlan *plan
+Return: void
+Description:
+
+Reorders the conjuncts of pred in place and fills plan with the cheapest
+access path. Index paths are only considered when index is not NULL;
+scan_row_cost is QPE_COST_ROW_SCAN or QPE_COST_COLUMNAR_SCAN depending on the
+layout the full scan would use.
+*/
+void plan_query(const TableStats *stats, const SecondaryIndex *index,
+                double scan_row_cost, Predicate *pred, QueryPlan *plan) {
+  double n = (double)stats->num_rows;
+  long long lo;
+  long long hi;
+
+  reorder_conjuncts(stats, pred);
+
+  memset(plan, 0, sizeof(*plan));
+  plan->path = PLAN_FULL_SCAN;
+  plan->probe.num_colors = -1;
+  plan->candidates = n;
+  plan->scan_cost = n * scan_row_cost;
+  plan->cost = plan->scan_cost;
+  plan->est_rows = pred->root < 0 ? n : n * node_selectivity(stats, pred,
+                                                            pred->root);
+
+  if (id_bounds(pred, &lo, &hi)) {
+    double rows = 0.0;
+    if (lo <= hi) {
+      rows = n * (stats_int_selectivity(stats, COL_ID, OP_LE, (int)hi) -
+                  stats_int_selectivity(stats, COL_ID, OP_LT, (int)lo));
+      rows = rows > 0.0 ? rows : 0.0;
+    }
+    consider(plan, PLAN_ID_RANGE, rows,
+             seek_cost(n) + rows * QPE_COST_ROW_SCAN);
+    plan->id_lo = lo;
+    plan->id_hi = hi;
+  }
+
+  if (index != NULL) {
+    plan_index(stats, pred, plan);
+  }
+  if (plan->est_rows > plan->candidates) {
+    plan->est_rows = plan->candidates;
+  }
+}
+
+/*
+Name: format_node():
+Parameters: const Predicate *pred, int idx, int parent, char *buf, size_t len
+Return: int
+Description:
+
+Writes the subtree at idx back out as WHERE syntax, parenthesizing an AND/OR
+whose parent (a PredKind, or -1 at the root) is the other connective. Returns
+the number of characters written (truncating at len, like snprintf()).
+*/
+static int format_node(const Predicate *pred, int idx, int parent,
+                       char *buf, size_t len) {
+  const PredNode *node = &pred->nodes[idx];
+  const char *col = node->column < COL_UNKNOWN ? column_names[node->column]
+                                               : "?";
+  size_t used = 0;
+  int n;
+
+#define QPE_APPEND(expr)                                                       \
+  do {                                                                         \
+    n = (expr);                                                                \
+    used += n > 0 ? (size_t)n : 0;                                             \
+    if (used >= len) {                                                         \
+      return (int)len;                                                         \
+    }                                                                          \
+  } while (0)
+
+  switch (node->kind) {
+  case PRED_INT_CMP:
+    QPE_APPEND(snprintf(buf, len, "%s%s%d", col, op_names[node->op],
+                        node->ival));
+    break;
+  case PRED_STR_CMP:
+    QPE_APPEND(snprintf(buf, len, "%s%s\"%s\"", col, op_names[node->op],
+                        pred->strpool + node->str));
+    break;
+  case PRED_AND:
+  case PRED_OR: {
+    bool is_and = node->kind == PRED_AND;
+    bool paren = (parent == PRED_AND || parent == PRED_OR) &&
+                 parent != node->kind;
+    if (paren) {
+      QPE_APPEND(snprintf(buf + used, len - used, "("));
+    }
+    QPE_APPEND(
+        format_node(pred, node->left, node->kind, buf + used, len - used));
+    QPE_APPEND(snprintf(buf + used, len - used, is_and ? " AND " : " OR "));
+    QPE_APPEND(
+        format_node(pred, node->right, node->kind, buf + used, len - used));
+    if (paren) {
+      QPE_APPEND(snprintf(buf + used, len - used, ")"));
+    }
+    break;
+  }
+  default:
+    QPE_APPEND(snprintf(buf, len, node->truth ? "TRUE" : "FALSE"));
+    break;
+  }
+#undef QPE_APPEND
+  return (int)used;
+}
+
+/*
+Name: plan_explain():
+Parameters: FILE *out, int query_no, const Predicate *pred,
+            const QueryPlan *plan
+Return: void
+Description:
+
+Prints one EXPLAIN line for a planned query: the chosen access path (with the
+ID range or index keys it uses), its estimated rows and cost next to the
+full-scan cost, and the WHERE clause in its reordered evaluation order. The
+line is written with a single fputs() so concurrent threads do not interleave.
+*/
+void plan_explain(FILE *out, int query_no, const Predicate *pred,
+                  const QueryPlan *plan) {
+  char where[384] = "TRUE";
+  char access[160] = "";
+  char line[640];
+
+  if (pred->root >= 0) {
+    format_node(pred, pred->root, -1, where, sizeof(where));
+  }
+
+  if (plan->path == PLAN_ID_RANGE) {
+    snprintf(access, sizeof(access), " [%lld, %lld]", plan->id_lo,
+             plan->id_hi);
+  } else if (plan->path == PLAN_CACHED) {
+    snprintf(access, sizeof(access), " %zu bytes", plan->cached_len);
+  } else if (plan->path != PLAN_FULL_SCAN) {
+    size_t used = 0;
+    if (plan->probe.model != NULL) {
+      used += (size_t)snprintf(access, sizeof(access), " Model=\"%s\"",
+                               plan->probe.model);
+      if (plan->probe.has_year && used < sizeof(access)) {
+        used += (size_t)snprintf(access + used, sizeof(access) - used,
+                                 ",YearMake=%d", plan->probe.year);
+      }
+    }
+    if (plan->probe.num_colors >= 0 && used < sizeof(access)) {
+      snprintf(access + used, sizeof(access) - used, " Color IN %d",
+               plan->probe.num_colors);
+    }
+  }
+
+  snprintf(line, sizeof(line),
+           "EXPLAIN query %d: %s%s candidates=%.0f rows=%.0f cost=%.1f "
+           "scan_cost=%.1f WHERE %s\n",
+           query_no, path_names[plan->path], access, plan->candidates,
+           plan->est_rows, plan->cost, plan->scan_cost, where);
+  fputs(line, out);
+}
@@ -0,0 +1,68 @@
+/*
+
+QPEPlan.h
+
+Cost-based choice of access path for one compiled WHERE clause. Using the
+load-time statistics (QPEStats.h), plan_query() estimates the selectivity of
+every conjunct and prices four ways to find the matching rows:
+
+- PLAN_FULL_SCAN: test every row (row or columnar layout)
+- PLAN_ID_RANGE: btree_ascend() from an ID pivot for ID >= x AND ID < y style
+  bounds, stopping past the upper bound
+- PLAN_INDEX_SEEK: one side of the secondary indexes (QPEIndex.h)
+- PLAN_INDEX_INTERSECT: Model and Color posting lists intersected
+
+With --cache the engines then mark every query the result cache (QPECache.h)
+can answer as PLAN_CACHED: its stored lines are written without a scan.
+
+It also reorders the top-level conjuncts so cheap, selective tests run first,
+and plan_explain() prints the decision as one EXPLAIN line.
+
+*/
+
+#ifndef QPE_PLAN_H
+#define QPE_PLAN_H
+
+#include <stdio.h>
+
+#include "QPEIndex.h"
+#include "QPEQuery.h"
+#include "QPEStats.h"
+
+/* Relative cost of testing one row in a full scan, per layout. */
+#define QPE_COST_ROW_SCAN 1.0
+#define QPE_COST_COLUMNAR_SCAN 0.1
+
+/*
+Struct Definitions
+*/
+typedef enum {
+  PLAN_FULL_SCAN,
+  PLAN_ID_RANGE,
+  PLAN_INDEX_SEEK,
+  PLAN_INDEX_INTERSECT,
+  PLAN_CACHED
+} AccessPath;
+
+typedef struct {
+  AccessPath path;
+  long long id_lo;   /* inclusive ID bounds for PLAN_ID_RANGE */
+  long long id_hi;
+  IndexProbe probe;  /* index sides used by the PLAN_INDEX_* paths */
+  double candidates; /* estimated rows the access path visits */
+  double est_rows;   /* estimated rows the whole clause selects */
+  double cost;
+  double scan_cost;  /* cost of PLAN_FULL_SCAN, for comparison */
+  const char *cached; /* PLAN_CACHED: the stored result lines */
+  size_t cached_len;
+} QueryPlan;
+
+/*
+Function Prototypes
+*/
+void plan_query(const TableStats *stats, const SecondaryIndex *index,
+                double scan_row_cost, Predicate *pred, QueryPlan *plan);
+void plan_explain(FILE *out, int query_no, const Predicate *pred,
+                  const QueryPlan *plan);
+
+#endif
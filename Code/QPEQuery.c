@@ -0,0 +1,1295 @@
+/*
+
+QPEQuery.c
+
+Authors:
+    Aidan Levy
+    Maddie Powell
+    Nick Corcoran
+    Austin Phalines
+    Dean Bullock
+
+Creation Date: 10-14-2026
+
+Description:
+
+Query loading and WHERE clause compilation shared by QPESeq.c, QPEOMP.c and
+QPEMPI.c.
+
+load_queries() reads the SQL-like query file and hands every line to
+parse_query() (which --serve also calls for each query it receives), which
+compiles the WHERE clause once with compile_where(). The WHERE clause may be
+left out (every record matches), and a GROUP BY <column> or an ORDER BY <column>
+[ASC|DESC] LIMIT k may follow it; aggregate SELECT entries such as COUNT(*) or
+AVG(Price) are resolved with the rest of the list.
+
+The compiler follows the same recursive descent grammar the engines used to
+interpret per tuple (expr -> term -> factor -> comparison), but instead of
+producing a truth value it emits PredNode entries. Comparisons whose outcome
+does not depend on the record (unknown attributes, unparsable text) are
+folded into constants, so match_where() only touches the fields a query
+actually tests.
+
+query_pack() and query_unpack() move a compiled Query between processes in a
+compact form: a header, the used PredNodes and the used bytes of the string
+pool, all in the sender's byte order (every qpe_mpi rank runs the same
+binary on the same kind of machine).
+
+query_canonical() renders the compiled form back to text, with AND and OR
+chains flattened and their operands sorted, for the result cache.
+
+*/
+
+#include <ctype.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "QPEQuery.h"
+
+typedef enum { VAL_INT, VAL_STR } ValueType;
+
+typedef struct {
+  ValueType type;
+  int i;
+  char s[64];
+} Value;
+
+/* Header of a packed Query; the nodes and string bytes follow it. */
+typedef struct {
+  unsigned char num_select;
+  unsigned char select_all;
+  unsigned char select_cols[6];
+  unsigned char select_aggs[6];
+  unsigned char aggregate;
+  unsigned char group_col;
+  unsigned char ordered;
+  unsigned char order_col;
+  unsigned char order_desc;
+  int limit;
+  short root;
+  unsigned short num_nodes;
+  unsigned short strpool_len;
+} PackedQuery;
+
+/* Canonical spelling of every ColumnId, used to rebuild select_attrs. */
+static const char *const column_names[COL_UNKNOWN] = {
+    "ID", "Model", "YearMake", "Color", "Price", "Dealer"};
+
+/* Spelling of every AggFunc but AGG_NONE, indexed by AggFunc. */
+static const char *const agg_names[AGG_MAX + 1] = {
+    "", "COUNT", "SUM", "AVG", "MIN", "MAX"};
+
+/* Spelling of every CompareOp in query_canonical(). */
+static const char *const op_names[] = {"=", "!=", ">", "<", ">=", "<="};
+
+typedef struct {
+  Predicate *pred;
+  int const_nodes[2]; /* shared PRED_CONST nodes for false / true */
+  bool overflow;
+} CompileCtx;
+
+/* Output of query_canonical(), which stops writing once cap is reached. */
+typedef struct {
+  char *out;
+  size_t cap;
+  size_t len;
+  bool failed; /* out of room or memory */
+} CanonicalText;
+
+/*
+Function Prototypes
+*/
+static const char *skip_ws(const char *s);
+static const char *find_keyword(const char *line, const char *kw);
+static void trim_trailing(char *s);
+static bool read_identifier(const char **p, char *out, size_t cap);
+static bool read_value(const char **p, Value *v);
+static ColumnId lookup_column(const char *attr);
+static bool parse_order(const char *p, Query *q);
+static bool parse_select_entry(const char *attr, AggFunc *func, ColumnId *col);
+static bool resolve_select(Query *q);
+static int new_node(CompileCtx *ctx, PredKind kind);
+static int make_const(CompileCtx *ctx, bool truth);
+static int make_binary(CompileCtx *ctx, PredKind kind, int left, int right);
+static int add_string(CompileCtx *ctx, const char *s);
+static int compile_comparison(CompileCtx *ctx, const char **p);
+static int compile_term(CompileCtx *ctx, const char **p);
+static int compile_factor(CompileCtx *ctx, const char **p);
+static int compile_expr(CompileCtx *ctx, const char **p);
+static bool eval_node(const Predicate *pred, int idx, const CarInventory *car);
+static void canonical_append(CanonicalText *t, const char *s, size_t n);
+static int compare_strings(const void *a, const void *b);
+static void canonical_node(const Predicate *pred, int idx, CanonicalText *t);
+
+/*
+Name: skip_ws():
+Parameters: const char *s
+Return: const char *
+Description:
+
+Advances past leading whitespace characters in the provided string and returns
+the first non-space position, simplifying later parsing logic.
+*/
+static const char *skip_ws(const char *s) {
+  while (*s && isspace((unsigned char)*s)) {
+    s++;
+  }
+  return s;
+}
+
+/*
+Name: find_keyword():
+Parameters: const char *line, const char *kw
+Return: const char *
+Description:
+
+Finds the first kw in line that stands as its own word, skipping text inside
+'...' or "..." literals, so a literal such as "LIMITED" never reads as the
+LIMIT keyword. Returns NULL when there is none.
+*/
+static const char *find_keyword(const char *line, const char *kw) {
+  size_t len = strlen(kw);
+  char quote = '\0';
+
+  for (const char *s = line; *s; s++) {
+    if (quote) {
+      if (*s == quote) {
+        quote = '\0';
+      }
+    } else if (*s == '"' || *s == '\'') {
+      quote = *s;
+    } else if (strncmp(s, kw, len) == 0) {
+      bool starts =
+          s == line || !(isalnum((unsigned char)s[-1]) || s[-1] == '_');
+      bool ends = !(isalnum((unsigned char)s[len]) || s[len] == '_');
+      if (starts && ends) {
+        return s;
+      }
+    }
+  }
+  return NULL;
+}
+
+/*
+Name: trim_trailing():
+Parameters: char *s
+Return: void
+Description:
+
+Removes trailing whitespace and semicolons from the provided buffer in place so
+that tokens parsed from the SQL-like input are sanitized.
+*/
+static void trim_trailing(char *s) {
+  size_t len = strlen(s);
+  while (len > 0 && isspace((unsigned char)s[len - 1])) {
+    s[--len] = '\0';
+  }
+  if (len > 0 && s[len - 1] == ';') {
+    s[--len] = '\0';
+    trim_trailing(s);
+  }
+}
+
+/*
+Name: load_queries():
+Parameters: const char *filename, Query **queries, int *num_queries
+Return: void
+Description:
+
+Parses each SQL-like query from the provided file with parse_query() and
+returns an array of the Query structures, skipping blank and malformed lines.
+Every query is parsed straight into the next free slot, so it is never
+copied; the array doubles when it fills. The file is read once, so it may be
+a pipe or FIFO.
+*/
+void load_queries(const char *filename, Query **queries, int *num_queries) {
+  FILE *fp = fopen(filename, "r");
+  char line[512];
+  int capacity = 4;
+  Query *arr;
+
+  *queries = NULL;
+  *num_queries = 0;
+  if (!fp) {
+    perror("fopen queries");
+    return;
+  }
+
+  arr = malloc(sizeof(Query) * capacity);
+  if (!arr) {
+    fprintf(stderr, "Error: out of memory allocating queries\n");
+    fclose(fp);
+    return;
+  }
+
+  while (fgets(line, sizeof(line), fp) != NULL) {
+    if (*num_queries >= capacity) {
+      Query *tmp = realloc(arr, sizeof(Query) * capacity * 2);
+      if (!tmp) {
+        fprintf(stderr, "Error: out of memory reallocating queries\n");
+        break;
+      }
+      arr = tmp;
+      capacity *= 2;
+    }
+    if (line[0] == '\n' || line[0] == '\0' ||
+        !parse_query(line, &arr[*num_queries])) {
+      continue;
+    }
+    (*num_queries)++;
+  }
+
+  fclose(fp);
+  *queries = arr;
+}
+
+/*
+Name: parse_query():
+Parameters: const char *line, Query *q
+Return: bool
+Description:
+
+Parses one SQL-like query, capturing the SELECT column list, the raw WHERE
+clause, the GROUP BY column and the ORDER BY column and LIMIT, and compiles
+the WHERE clause into a Predicate. GROUP BY, ORDER BY and LIMIT are only
+recognized outside string literals (find_keyword()). Returns false, after a
+warning on stderr, if line is not a valid query.
+*/
+bool parse_query(const char *line, Query *q) {
+  const char *select_pos;
+  const char *from_pos;
+  const char *where_pos;
+  const char *group_pos;
+  const char *order_pos;
+  const char *where_end;
+  char select_part[256];
+  char *token;
+  int idx = 0;
+
+  memset(q, 0, sizeof(Query));
+  q->group_col = COL_UNKNOWN;
+  q->order_col = COL_UNKNOWN;
+
+  select_pos = strstr(line, "SELECT");
+  from_pos = strstr(line, "FROM");
+  where_pos = strstr(line, "WHERE");
+  group_pos = find_keyword(line, "GROUP BY");
+  order_pos = find_keyword(line, "ORDER BY");
+
+  if (!select_pos || !from_pos || (where_pos && where_pos < from_pos) ||
+      (group_pos && (group_pos < from_pos ||
+                     (where_pos && group_pos < where_pos))) ||
+      (order_pos && (order_pos < from_pos ||
+                     (where_pos && order_pos < where_pos) ||
+                     (group_pos && order_pos < group_pos)))) {
+    fprintf(stderr, "Warning: skipping malformed query: %s", line);
+    return false;
+  }
+
+  if (group_pos) {
+    const char *p = group_pos + strlen("GROUP BY");
+    char name[20];
+    if (read_identifier(&p, name, sizeof(name))) {
+      q->group_col = (unsigned char)lookup_column(name);
+    }
+    p = skip_ws(p);
+    while (*p == ';') {
+      p = skip_ws(p + 1);
+    }
+    if (q->group_col == COL_UNKNOWN || (*p != '\0' && p != order_pos)) {
+      fprintf(stderr, "Warning: malformed GROUP BY clause: %s", line);
+      return false;
+    }
+  }
+
+  if (order_pos ? !parse_order(order_pos + strlen("ORDER BY"), q)
+                : find_keyword(line, "LIMIT") != NULL) {
+    fprintf(stderr, "Warning: malformed ORDER BY ... LIMIT clause: %s", line);
+    return false;
+  }
+
+  select_pos += strlen("SELECT");
+  while (*select_pos && isspace((unsigned char)*select_pos)) {
+    select_pos++;
+  }
+
+  if (from_pos <= select_pos) {
+    fprintf(stderr, "Warning: malformed SELECT clause: %s", line);
+    return false;
+  }
+
+  memset(select_part, 0, sizeof(select_part));
+  strncpy(select_part, select_pos, (size_t)(from_pos - select_pos));
+  trim_trailing(select_part);
+
+  token = strtok(select_part, ",");
+  while (token && idx < 6) {
+    token = (char *)skip_ws(token);
+    trim_trailing(token);
+    strncpy(q->select_attrs[idx], token, sizeof(q->select_attrs[idx]) - 1);
+    q->select_attrs[idx][sizeof(q->select_attrs[idx]) - 1] = '\0';
+    idx++;
+    token = strtok(NULL, ",");
+  }
+  q->num_select_attrs = idx;
+  if (!resolve_select(q)) {
+    fprintf(stderr, "Warning: invalid aggregate query, skipping: %s", line);
+    return false;
+  }
+  if (q->aggregate && q->ordered) {
+    fprintf(stderr, "Warning: ORDER BY on an aggregate query, skipping: %s",
+            line);
+    return false;
+  }
+
+  if (where_pos) {
+    where_pos += strlen("WHERE");
+    while (*where_pos && isspace((unsigned char)*where_pos)) {
+      where_pos++;
+    }
+    where_end = group_pos   ? group_pos
+                : order_pos ? order_pos
+                            : where_pos + strlen(where_pos);
+    if ((size_t)(where_end - where_pos) >= sizeof(q->where_raw)) {
+      where_end = where_pos + sizeof(q->where_raw) - 1;
+    }
+    memcpy(q->where_raw, where_pos, (size_t)(where_end - where_pos));
+    q->where_raw[where_end - where_pos] = '\0';
+    trim_trailing(q->where_raw);
+  }
+
+  if (!compile_where(q->where_raw, &q->where)) {
+    fprintf(stderr, "Warning: WHERE clause too complex, skipping: %s", line);
+    return false;
+  }
+  return true;
+}
+
+/*
+Name: read_identifier():
+Parameters: const char **p, char *out, size_t cap
+Return: bool
+Description:
+
+Parses an identifier token (letters, digits, underscores) from the query text,
+stores it into the provided buffer, and advances the caller's pointer if the
+token exists.
+*/
+static bool read_identifier(const char **p, char *out, size_t cap) {
+  const char *s = *p;
+  size_t i = 0;
+  s = skip_ws(s);
+  if (!*s) {
+    return false;
+  }
+  while (*s && (isalnum((unsigned char)*s) || *s == '_')) {
+    if (i + 1 < cap) {
+      out[i++] = *s;
+    }
+    s++;
+  }
+  out[i] = '\0';
+  *p = s;
+  return i > 0;
+}
+
+/*
+Name: read_value():
+Parameters: const char **p, Value *v
+Return: bool
+Description:
+
+Parses either a quoted string or integer literal from the WHERE clause text and
+captures it inside a Value struct so the literal can be typed at compile time.
+*/
+static bool read_value(const char **p, Value *v) {
+  const char *s = skip_ws(*p);
+  if (*s == '"') {
+    size_t i = 0;
+    s++;
+    while (*s && *s != '"' && i + 1 < sizeof(v->s)) {
+      v->s[i++] = *s++;
+    }
+    v->s[i] = '\0';
+    if (*s == '"') {
+      s++;
+    }
+    v->type = VAL_STR;
+  } else {
+    char *endptr;
+    v->i = (int)strtol(s, &endptr, 10);
+    if (endptr == s) {
+      return false;
+    }
+    s = endptr;
+    v->type = VAL_INT;
+  }
+  *p = s;
+  return true;
+}
+
+/*
+Name: lookup_column():
+Parameters: const char *attr
+Return: ColumnId
+Description:
+
+Resolves an attribute name (case-insensitive) to its column, returning
+COL_UNKNOWN for names that are not part of the CarInventory schema.
+*/
+static ColumnId lookup_column(const char *attr) {
+  if (strcasecmp(attr, "ID") == 0) {
+    return COL_ID;
+  } else if (strcasecmp(attr, "YearMake") == 0) {
+    return COL_YEARMAKE;
+  } else if (strcasecmp(attr, "Price") == 0) {
+    return COL_PRICE;
+  } else if (strcasecmp(attr, "Model") == 0) {
+    return COL_MODEL;
+  } else if (strcasecmp(attr, "Color") == 0) {
+    return COL_COLOR;
+  } else if (strcasecmp(attr, "Dealer") == 0) {
+    return COL_DEALER;
+  }
+  return COL_UNKNOWN;
+}
+
+/*
+Name: parse_order():
+Parameters: const char *p, Query *q
+Return: bool
+Description:
+
+Parses what follows ORDER BY: ID or Price, an optional ASC or DESC, then
+LIMIT k with k >= 0 and nothing but semicolons after it, and marks q
+ordered. Returns false if the clause does not have that form.
+*/
+static bool parse_order(const char *p, Query *q) {
+  char word[20];
+  char *end;
+  long limit;
+
+  if (!read_identifier(&p, word, sizeof(word))) {
+    return false;
+  }
+  q->order_col = (unsigned char)lookup_column(word);
+  if ((q->order_col != COL_ID && q->order_col != COL_PRICE) ||
+      !read_identifier(&p, word, sizeof(word))) {
+    return false;
+  }
+  if (strcmp(word, "ASC") == 0 || strcmp(word, "DESC") == 0) {
+    q->order_desc = word[0] == 'D';
+    if (!read_identifier(&p, word, sizeof(word))) {
+      return false;
+    }
+  }
+  if (strcmp(word, "LIMIT") != 0) {
+    return false;
+  }
+  p = skip_ws(p);
+  limit = strtol(p, &end, 10);
+  if (end == p || !isdigit((unsigned char)*p) || limit > INT_MAX) {
+    return false;
+  }
+  p = skip_ws(end);
+  while (*p == ';') {
+    p = skip_ws(p + 1);
+  }
+  q->ordered = true;
+  q->limit = (int)limit;
+  return *p == '\0';
+}
+
+/*
+Name: parse_select_entry():
+Parameters: const char *attr, AggFunc *func, ColumnId *col
+Return: bool
+Description:
+
+Resolves one SELECT entry. A plain attribute gets AGG_NONE and its column.
+FUNC(arg) gets its AggFunc and the argument's column (COL_UNKNOWN for
+COUNT(*)). Returns false for unknown functions, unknown argument columns and
+SUM/AVG/MIN/MAX over a string column.
+*/
+static bool parse_select_entry(const char *attr, AggFunc *func, ColumnId *col) {
+  const char *open = strchr(attr, '(');
+  const char *p = attr;
+  char name[20];
+
+  *func = AGG_NONE;
+  if (!open) {
+    *col = lookup_column(attr);
+    return true;
+  }
+
+  if (!read_identifier(&p, name, sizeof(name)) || skip_ws(p) != open) {
+    return false;
+  }
+  for (int f = AGG_COUNT; f <= AGG_MAX; f++) {
+    if (strcasecmp(name, agg_names[f]) == 0) {
+      *func = (AggFunc)f;
+    }
+  }
+  if (*func == AGG_NONE) {
+    return false;
+  }
+
+  p = skip_ws(open + 1);
+  if (*p == '*') {
+    if (*func != AGG_COUNT) {
+      return false;
+    }
+    *col = COL_UNKNOWN;
+    p++;
+  } else {
+    if (!read_identifier(&p, name, sizeof(name))) {
+      return false;
+    }
+    *col = lookup_column(name);
+    if (*col == COL_UNKNOWN ||
+        (*func != AGG_COUNT && *col != COL_ID && *col != COL_YEARMAKE &&
+         *col != COL_PRICE)) {
+      return false;
+    }
+  }
+  p = skip_ws(p);
+  return *p == ')' && *skip_ws(p + 1) == '\0';
+}
+
+/*
+Name: resolve_select():
+Parameters: Query *q
+Return: bool
+Description:
+
+Resolves the SELECT list once: select_all is set for "*" or an empty list,
+otherwise select_cols[i] is the column of select_attrs[i], COL_UNKNOWN for
+names outside the schema, which print nothing, and select_aggs[i] its
+aggregate. A query with aggregates or a GROUP BY column is marked aggregate;
+returns false if such a query selects "*" or a plain column other than the
+GROUP BY one, or if an aggregate does not parse.
+*/
+static bool resolve_select(Query *q) {
+  bool has_agg = false;
+
+  q->select_all = q->num_select_attrs == 0 ||
+                  (q->num_select_attrs == 1 &&
+                   strcmp(q->select_attrs[0], "*") == 0);
+  for (int i = 0; i < q->num_select_attrs; i++) {
+    AggFunc func;
+    ColumnId col;
+    if (!parse_select_entry(q->select_attrs[i], &func, &col)) {
+      return false;
+    }
+    q->select_aggs[i] = (unsigned char)func;
+    q->select_cols[i] = (unsigned char)col;
+    has_agg = has_agg || func != AGG_NONE;
+  }
+
+  q->aggregate = has_agg || q->group_col != COL_UNKNOWN;
+  if (!q->aggregate) {
+    return true;
+  }
+  if (q->select_all) {
+    return false;
+  }
+  for (int i = 0; i < q->num_select_attrs; i++) {
+    if (q->select_aggs[i] == AGG_NONE && q->select_cols[i] != q->group_col) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/*
+Name: apply_op():
+Parameters: CompareOp op, int cmp
+Return: bool
+Description:
+
+Interprets a tri-state comparison result (negative, zero, positive) under the
+given operator. Also used by QPEColumn.c to pre-evaluate string comparisons
+against dictionary entries.
+*/
+bool apply_op(CompareOp op, int cmp) {
+  switch (op) {
+  case OP_EQ:
+    return cmp == 0;
+  case OP_NE:
+    return cmp != 0;
+  case OP_GT:
+    return cmp > 0;
+  case OP_LT:
+    return cmp < 0;
+  case OP_GE:
+    return cmp >= 0;
+  case OP_LE:
+    return cmp <= 0;
+  }
+  return false;
+}
+
+/*
+Name: new_node():
+Parameters: CompileCtx *ctx, PredKind kind
+Return: int
+Description:
+
+Reserves the next PredNode slot in the predicate being compiled and returns its
+index, or -1 (flagging overflow) once QPE_MAX_PRED_NODES is exhausted.
+*/
+static int new_node(CompileCtx *ctx, PredKind kind) {
+  Predicate *pred = ctx->pred;
+  if (pred->num_nodes >= QPE_MAX_PRED_NODES) {
+    ctx->overflow = true;
+    return -1;
+  }
+  PredNode *n = &pred->nodes[pred->num_nodes];
+  memset(n, 0, sizeof(*n));
+  n->kind = (unsigned char)kind;
+  n->left = -1;
+  n->right = -1;
+  return pred->num_nodes++;
+}
+
+/*
+Name: make_const():
+Parameters: CompileCtx *ctx, bool truth
+Return: int
+Description:
+
+Returns the shared constant node for the given truth value, creating it the
+first time it is needed so repeated unparsable comparisons cost no extra nodes.
+*/
+static int make_const(CompileCtx *ctx, bool truth) {
+  int slot = truth ? 1 : 0;
+  if (ctx->const_nodes[slot] < 0) {
+    int idx = new_node(ctx, PRED_CONST);
+    if (idx < 0) {
+      return -1;
+    }
+    ctx->pred->nodes[idx].truth = truth ? 1 : 0;
+    ctx->const_nodes[slot] = idx;
+  }
+  return ctx->const_nodes[slot];
+}
+
+/*
+Name: make_binary():
+Parameters: CompileCtx *ctx, PredKind kind, int left, int right
+Return: int
+Description:
+
+Combines two compiled subexpressions with PRED_AND or PRED_OR, folding away
+constant operands so the evaluator never visits a node with a fixed outcome.
+*/
+static int make_binary(CompileCtx *ctx, PredKind kind, int left, int right) {
+  if (left < 0 || right < 0) {
+    return -1;
+  }
+
+  const PredNode *l = &ctx->pred->nodes[left];
+  const PredNode *r = &ctx->pred->nodes[right];
+  bool absorbing = (kind == PRED_OR);
+
+  if (l->kind == PRED_CONST) {
+    return ((bool)l->truth == absorbing) ? left : right;
+  }
+  if (r->kind == PRED_CONST) {
+    return ((bool)r->truth == absorbing) ? right : left;
+  }
+
+  int idx = new_node(ctx, kind);
+  if (idx < 0) {
+    return -1;
+  }
+  ctx->pred->nodes[idx].left = (short)left;
+  ctx->pred->nodes[idx].right = (short)right;
+  return idx;
+}
+
+/*
+Name: add_string():
+Parameters: CompileCtx *ctx, const char *s
+Return: int
+Description:
+
+Copies a string literal (including its terminator) into the predicate's string
+pool and returns its offset, or -1 when the pool is full.
+*/
+static int add_string(CompileCtx *ctx, const char *s) {
+  Predicate *pred = ctx->pred;
+  size_t len = strlen(s) + 1;
+  if ((size_t)pred->strpool_len + len > sizeof(pred->strpool)) {
+    ctx->overflow = true;
+    return -1;
+  }
+  int offset = pred->strpool_len;
+  memcpy(pred->strpool + offset, s, len);
+  pred->strpool_len += (int)len;
+  return offset;
+}
+
+/*
+Name: compile_comparison():
+Parameters: CompileCtx *ctx, const char **p
+Return: int
+Description:
+
+Parses a single comparison expression (attr op value) from the WHERE clause and
+emits a typed comparison node with the column resolved to its field offset.
+Text that does not form a comparison compiles to constant false, and unknown
+attributes compare as equal to every literal, matching the interpreter this
+replaces.
+*/
+static int compile_comparison(CompileCtx *ctx, const char **p) {
+  char attr[32];
+  CompareOp op;
+  Value v;
+  const char *s = skip_ws(*p);
+
+  if (!read_identifier(&s, attr, sizeof(attr))) {
+    return make_const(ctx, false);
+  }
+
+  s = skip_ws(s);
+  if (*s == '!' && *(s + 1) == '=') {
+    op = OP_NE;
+    s += 2;
+  } else if (*s == '>' && *(s + 1) == '=') {
+    op = OP_GE;
+    s += 2;
+  } else if (*s == '<' && *(s + 1) == '=') {
+    op = OP_LE;
+    s += 2;
+  } else if (*s == '>') {
+    op = OP_GT;
+    s++;
+  } else if (*s == '<') {
+    op = OP_LT;
+    s++;
+  } else if (*s == '=') {
+    op = OP_EQ;
+    s++;
+  } else {
+    return make_const(ctx, false);
+  }
+
+  if (!read_value(&s, &v)) {
+    return make_const(ctx, false);
+  }
+
+  *p = s;
+
+  ColumnId column = lookup_column(attr);
+  if (column == COL_UNKNOWN) {
+    return make_const(ctx, apply_op(op, 0));
+  }
+
+  int idx;
+  if (column == COL_ID || column == COL_YEARMAKE || column == COL_PRICE) {
+    idx = new_node(ctx, PRED_INT_CMP);
+    if (idx < 0) {
+      return -1;
+    }
+    ctx->pred->nodes[idx].ival = (v.type == VAL_INT) ? v.i : atoi(v.s);
+  } else {
+    int str = add_string(ctx, (v.type == VAL_STR) ? v.s : "");
+    if (str < 0) {
+      return -1;
+    }
+    idx = new_node(ctx, PRED_STR_CMP);
+    if (idx < 0) {
+      return -1;
+    }
+    ctx->pred->nodes[idx].str = (unsigned short)str;
+  }
+
+  PredNode *n = &ctx->pred->nodes[idx];
+  n->op = (unsigned char)op;
+  n->column = (unsigned char)column;
+  switch (column) {
+  case COL_ID:
+    n->offset = offsetof(CarInventory, ID);
+    break;
+  case COL_MODEL:
+    n->offset = offsetof(CarInventory, Model);
+    break;
+  case COL_YEARMAKE:
+    n->offset = offsetof(CarInventory, YearMake);
+    break;
+  case COL_COLOR:
+    n->offset = offsetof(CarInventory, Color);
+    break;
+  case COL_PRICE:
+    n->offset = offsetof(CarInventory, Price);
+    break;
+  default:
+    n->offset = offsetof(CarInventory, Dealer);
+    break;
+  }
+  return idx;
+}
+
+/*
+Name: compile_term():
+Parameters: CompileCtx *ctx, const char **p
+Return: int
+Description:
+
+Compiles a sequence of AND-connected factors into a left-leaning chain of
+PRED_AND nodes, consuming the corresponding text.
+*/
+static int compile_term(CompileCtx *ctx, const char **p) {
+  int result = compile_factor(ctx, p);
+  const char *s = skip_ws(*p);
+
+  while (strncasecmp(s, "AND", 3) == 0) {
+    s += 3;
+    *p = s;
+    int rhs = compile_factor(ctx, p);
+    result = make_binary(ctx, PRED_AND, result, rhs);
+    s = skip_ws(*p);
+  }
+
+  *p = s;
+  return result;
+}
+
+/*
+Name: compile_factor():
+Parameters: CompileCtx *ctx, const char **p
+Return: int
+Description:
+
+Handles either parenthesized expressions or single comparisons, providing the
+building block for AND/OR compilation.
+*/
+static int compile_factor(CompileCtx *ctx, const char **p) {
+  const char *s = skip_ws(*p);
+  int result;
+
+  if (*s == '(') {
+    s++;
+    *p = s;
+    /* compile full expression inside parentheses */
+    result = compile_expr(ctx, p);
+    s = skip_ws(*p);
+    if (*s == ')') {
+      s++;
+    }
+    *p = s;
+  } else {
+    result = compile_comparison(ctx, &s);
+    *p = s;
+  }
+
+  return result;
+}
+
+/*
+Name: compile_expr():
+Parameters: CompileCtx *ctx, const char **p
+Return: int
+Description:
+
+Compiles a series of OR-connected terms into PRED_OR nodes, yielding the root
+of the (sub)expression.
+*/
+static int compile_expr(CompileCtx *ctx, const char **p) {
+  int result = compile_term(ctx, p);
+  const char *s = skip_ws(*p);
+  while (strncasecmp(s, "OR", 2) == 0) {
+    s += 2;
+    *p = s;
+    int rhs = compile_term(ctx, p);
+    result = make_binary(ctx, PRED_OR, result, rhs);
+    s = skip_ws(*p);
+  }
+  *p = s;
+  return result;
+}
+
+/*
+Name: compile_where():
+Parameters: const char *where_raw, Predicate *pred
+Return: bool
+Description:
+
+Compiles the raw WHERE clause text into pred. An empty clause yields root -1,
+which match_where() treats as matching every record. Returns false only if the
+clause exceeds the fixed node or string pool capacity.
+*/
+bool compile_where(const char *where_raw, Predicate *pred) {
+  CompileCtx ctx;
+  const char *p = skip_ws(where_raw);
+
+  memset(pred, 0, sizeof(*pred));
+  pred->root = -1;
+  if (*p == '\0') {
+    return true;
+  }
+
+  ctx.pred = pred;
+  ctx.const_nodes[0] = -1;
+  ctx.const_nodes[1] = -1;
+  ctx.overflow = false;
+
+  int root = compile_expr(&ctx, &p);
+  if (ctx.overflow || root < 0) {
+    return false;
+  }
+  pred->root = root;
+  return true;
+}
+
+/*
+Name: eval_node():
+Parameters: const Predicate *pred, int idx, const CarInventory *car
+Return: bool
+Description:
+
+Evaluates one compiled node against a record, reading comparison operands
+directly at their pre-resolved field offsets and short-circuiting AND/OR.
+*/
+static bool eval_node(const Predicate *pred, int idx, const CarInventory *car) {
+  const PredNode *n = &pred->nodes[idx];
+  const char *base = (const char *)car;
+
+  switch (n->kind) {
+  case PRED_INT_CMP: {
+    int lhs = *(const int *)(base + n->offset);
+    switch (n->op) {
+    case OP_EQ:
+      return lhs == n->ival;
+    case OP_NE:
+      return lhs != n->ival;
+    case OP_GT:
+      return lhs > n->ival;
+    case OP_LT:
+      return lhs < n->ival;
+    case OP_GE:
+      return lhs >= n->ival;
+    default:
+      return lhs <= n->ival;
+    }
+  }
+  case PRED_STR_CMP:
+    return apply_op((CompareOp)n->op,
+                    strcasecmp(base + n->offset, pred->strpool + n->str));
+  case PRED_AND:
+    return eval_node(pred, n->left, car) && eval_node(pred, n->right, car);
+  case PRED_OR:
+    return eval_node(pred, n->left, car) || eval_node(pred, n->right, car);
+  default:
+    return n->truth != 0;
+  }
+}
+
+/*
+Name: match_where():
+Parameters: const CarInventory *car, const Predicate *pred
+Return: int
+Description:
+
+Entry for WHERE clause evaluation that runs the compiled predicate, returning 1
+when the car satisfies it (or the clause was empty) and 0 otherwise.
+*/
+int match_where(const CarInventory *car, const Predicate *pred) {
+  if (pred->root < 0) {
+    return 1;
+  }
+  return eval_node(pred, pred->root, car) ? 1 : 0;
+}
+
+/*
+Name: query_pack():
+Parameters: const Query *q, unsigned char *out
+Return: size_t
+Description:
+
+Writes the compiled form of q to out and returns its length in bytes. With
+out NULL only the length is computed, so callers can size their buffer first.
+*/
+size_t query_pack(const Query *q, unsigned char *out) {
+  PackedQuery hdr;
+  size_t nodes = (size_t)q->where.num_nodes * sizeof(PredNode);
+  size_t bytes = sizeof(hdr) + nodes + (size_t)q->where.strpool_len;
+
+  if (out == NULL) {
+    return bytes;
+  }
+
+  memset(&hdr, 0, sizeof(hdr));
+  hdr.num_select = (unsigned char)q->num_select_attrs;
+  hdr.select_all = q->select_all ? 1 : 0;
+  memcpy(hdr.select_cols, q->select_cols, sizeof(hdr.select_cols));
+  memcpy(hdr.select_aggs, q->select_aggs, sizeof(hdr.select_aggs));
+  hdr.aggregate = q->aggregate ? 1 : 0;
+  hdr.group_col = q->group_col;
+  hdr.ordered = q->ordered ? 1 : 0;
+  hdr.order_col = q->order_col;
+  hdr.order_desc = q->order_desc ? 1 : 0;
+  hdr.limit = q->limit;
+  hdr.root = (short)q->where.root;
+  hdr.num_nodes = (unsigned short)q->where.num_nodes;
+  hdr.strpool_len = (unsigned short)q->where.strpool_len;
+
+  memcpy(out, &hdr, sizeof(hdr));
+  memcpy(out + sizeof(hdr), q->where.nodes, nodes);
+  memcpy(out + sizeof(hdr) + nodes, q->where.strpool,
+         (size_t)q->where.strpool_len);
+  return bytes;
+}
+
+/*
+Name: query_unpack():
+Parameters: const unsigned char *data, size_t len, Query *q
+Return: size_t
+Description:
+
+Rebuilds q from the query_pack() output at the start of data (len bytes
+available). select_attrs get the canonical column names (FUNC(column) for
+aggregates) and where_raw is left empty. Returns the number of bytes
+consumed, or 0 if data is truncated or does not describe a valid Query.
+*/
+size_t query_unpack(const unsigned char *data, size_t len, Query *q) {
+  PackedQuery hdr;
+  size_t nodes;
+
+  if (len < sizeof(hdr)) {
+    return 0;
+  }
+  memcpy(&hdr, data, sizeof(hdr));
+  nodes = (size_t)hdr.num_nodes * sizeof(PredNode);
+  if (hdr.num_select > 6 || hdr.group_col > COL_UNKNOWN ||
+      hdr.order_col > COL_UNKNOWN || hdr.limit < 0 ||
+      hdr.num_nodes > QPE_MAX_PRED_NODES ||
+      hdr.strpool_len > QPE_PRED_STRPOOL_SIZE || hdr.root >= hdr.num_nodes ||
+      len < sizeof(hdr) + nodes + hdr.strpool_len) {
+    return 0;
+  }
+
+  memset(q, 0, sizeof(*q));
+  q->num_select_attrs = hdr.num_select;
+  q->select_all = hdr.select_all != 0;
+  memcpy(q->select_cols, hdr.select_cols, sizeof(q->select_cols));
+  memcpy(q->select_aggs, hdr.select_aggs, sizeof(q->select_aggs));
+  q->aggregate = hdr.aggregate != 0;
+  q->group_col = hdr.group_col;
+  q->ordered = hdr.ordered != 0;
+  q->order_col = hdr.order_col;
+  q->order_desc = hdr.order_desc != 0;
+  q->limit = hdr.limit;
+  for (int i = 0; i < q->num_select_attrs; i++) {
+    const char *col = q->select_cols[i] < COL_UNKNOWN
+                          ? column_names[q->select_cols[i]]
+                          : NULL;
+    if (q->select_aggs[i] > AGG_MAX) {
+      return 0;
+    }
+    if (q->select_aggs[i] != AGG_NONE) {
+      snprintf(q->select_attrs[i], sizeof(q->select_attrs[i]), "%s(%s)",
+               agg_names[q->select_aggs[i]], col ? col : "*");
+    } else if (col) {
+      strcpy(q->select_attrs[i], col);
+    }
+  }
+  if (q->select_all && q->num_select_attrs == 1) {
+    strcpy(q->select_attrs[0], "*");
+  }
+
+  q->where.root = hdr.root;
+  q->where.num_nodes = hdr.num_nodes;
+  q->where.strpool_len = hdr.strpool_len;
+  memcpy(q->where.nodes, data + sizeof(hdr), nodes);
+  memcpy(q->where.strpool, data + sizeof(hdr) + nodes, hdr.strpool_len);
+  return sizeof(hdr) + nodes + hdr.strpool_len;
+}
+
+/*
+Name: canonical_append():
+Parameters: CanonicalText *t, const char *s, size_t n
+Return: void
+Description:
+
+Appends the n bytes at s to t, or marks t failed if they do not fit (the
+text stays NUL-terminated either way).
+*/
+static void canonical_append(CanonicalText *t, const char *s, size_t n) {
+  if (t->failed || t->len + n >= t->cap) {
+    t->failed = true;
+    return;
+  }
+  memcpy(t->out + t->len, s, n);
+  t->len += n;
+  t->out[t->len] = '\0';
+}
+
+/*
+Name: compare_strings():
+Parameters: const void *a, const void *b
+Return: int
+Description:
+
+qsort() comparator for an array of C strings.
+*/
+static int compare_strings(const void *a, const void *b) {
+  return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+/*
+Name: canonical_node():
+Parameters: const Predicate *pred, int idx, CanonicalText *t
+Return: void
+Description:
+
+Appends node idx to t. Comparisons are written as column, operator and
+literal, string literals lower-cased. An AND (or OR) node is flattened into
+every operand of the chain it heads, so grouping does not matter, and the
+operands are written sorted, once each, so neither does their order.
+*/
+static void canonical_node(const Predicate *pred, int idx, CanonicalText *t) {
+  const PredNode *n = &pred->nodes[idx];
+  char text[96];
+
+  if (n->kind == PRED_CONST) {
+    canonical_append(t, n->truth ? "TRUE" : "FALSE", n->truth ? 4 : 5);
+    return;
+  }
+  if (n->kind == PRED_INT_CMP) {
+    int len = snprintf(text, sizeof(text), "%s%s%d", column_names[n->column],
+                       op_names[n->op], n->ival);
+    canonical_append(t, text, (size_t)len);
+    return;
+  }
+  if (n->kind == PRED_STR_CMP) {
+    const char *lit = pred->strpool + n->str;
+    int len = snprintf(text, sizeof(text), "%s%s\"", column_names[n->column],
+                       op_names[n->op]);
+    canonical_append(t, text, (size_t)len);
+    for (; *lit; lit++) {
+      char c = (char)tolower((unsigned char)*lit);
+      canonical_append(t, &c, 1);
+    }
+    canonical_append(t, "\"", 1);
+    return;
+  }
+
+  /* Every push follows a child link, and there are 2 per binary node. */
+  size_t slots = 2 * (size_t)pred->num_nodes + 1;
+  int *stack = malloc(slots * sizeof(int));
+  char **operands = malloc(slots * sizeof(char *));
+  size_t depth = 0;
+  size_t count = 0;
+
+  if (stack == NULL || operands == NULL) {
+    free(stack);
+    free(operands);
+    t->failed = true;
+    return;
+  }
+  stack[depth++] = idx;
+  while (depth > 0 && !t->failed) {
+    int i = stack[--depth];
+    const PredNode *m = &pred->nodes[i];
+    if (m->kind == n->kind) {
+      stack[depth++] = m->left;
+      stack[depth++] = m->right;
+      continue;
+    }
+    CanonicalText sub = {.out = malloc(t->cap), .cap = t->cap};
+    if (sub.out == NULL) {
+      t->failed = true;
+      break;
+    }
+    sub.out[0] = '\0';
+    canonical_node(pred, i, &sub);
+    operands[count++] = sub.out;
+    t->failed = sub.failed;
+  }
+
+  qsort(operands, count, sizeof(char *), compare_strings);
+  canonical_append(t, "(", 1);
+  for (size_t k = 0; k < count; k++) {
+    if (k > 0 && strcmp(operands[k], operands[k - 1]) == 0) {
+      continue;
+    }
+    if (k > 0) {
+      canonical_append(t, n->kind == PRED_AND ? " AND " : " OR ",
+                       n->kind == PRED_AND ? 5 : 4);
+    }
+    canonical_append(t, operands[k], strlen(operands[k]));
+  }
+  canonical_append(t, ")", 1);
+
+  for (size_t k = 0; k < count; k++) {
+    free(operands[k]);
+  }
+  free(operands);
+  free(stack);
+}
+
+/*
+Name: query_canonical():
+Parameters: const Query *q, char *out, size_t cap
+Return: size_t
+Description:
+
+Writes the canonical form of q (projection, WHERE clause, GROUP BY and
+ORDER BY) to out as a NUL-terminated string and returns its length, or 0 if
+it needs more than cap bytes (QPE_QUERY_CANONICAL_MAX is always enough) or
+memory ran out. Two queries with the same canonical form select the same
+lines. An unknown column is written as "?", which no real column or "*"
+can be, since its field is printed empty.
+*/
+size_t query_canonical(const Query *q, char *out, size_t cap) {
+  CanonicalText t = {.out = out, .cap = cap};
+  char text[48];
+
+  if (cap == 0) {
+    return 0;
+  }
+  out[0] = '\0';
+  canonical_append(&t, "SELECT ", 7);
+  if (q->select_all) {
+    canonical_append(&t, "*", 1);
+  }
+  for (int i = 0; !q->select_all && i < q->num_select_attrs; i++) {
+    const char *col = "?";
+    int len;
+    if (q->select_cols[i] < COL_UNKNOWN) {
+      col = column_names[q->select_cols[i]];
+    } else if (q->select_aggs[i] != AGG_NONE) {
+      col = "*"; /* COUNT(*) */
+    }
+    if (q->select_aggs[i] != AGG_NONE) {
+      len = snprintf(text, sizeof(text), "%s%s(%s)", i > 0 ? "," : "",
+                     agg_names[q->select_aggs[i]], col);
+    } else {
+      len = snprintf(text, sizeof(text), "%s%s", i > 0 ? "," : "", col);
+    }
+    canonical_append(&t, text, (size_t)len);
+  }
+  canonical_append(&t, " WHERE ", 7);
+  if (q->where.root >= 0) {
+    canonical_node(&q->where, q->where.root, &t);
+  } else {
+    canonical_append(&t, "TRUE", 4);
+  }
+  if (q->group_col < COL_UNKNOWN) {
+    canonical_append(&t, " GROUP BY ", 10);
+    canonical_append(&t, column_names[q->group_col],
+                     strlen(column_names[q->group_col]));
+  }
+  if (q->ordered) {
+    int len = snprintf(text, sizeof(text), " ORDER BY %s %s LIMIT %d",
+                       column_names[q->order_col],
+                       q->order_desc ? "DESC" : "ASC", q->limit);
+    canonical_append(&t, text, (size_t)len);
+  }
+  return t.failed ? 0 : t.len;
+}
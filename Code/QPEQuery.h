@@ -0,0 +1,143 @@
+/*
+
+QPEQuery.h
+
+Shared schema, query representation, and WHERE clause compiler used by the
+sequential, OpenMP, and MPI query processing engines.
+
+A WHERE clause is parsed exactly once by compile_where() into a Predicate: a
+flat array of nodes linked by index (no pointers), so a Query can still be
+copied or broadcast as raw bytes. Column references are resolved to field
+offsets, operators to CompareOp values, and literals are typed ahead of time,
+so evaluating a record is a short walk over the compiled nodes. The SELECT
+list is resolved the same way, to the ColumnId of every projected attribute.
+
+A SELECT list may instead hold aggregates, COUNT(*) and COUNT, SUM, AVG, MIN
+or MAX over an integer column, optionally with GROUP BY <column>. Such a
+query is aggregate: it yields one row per group (see QPEAggregate.h), and its
+plain SELECT entries must name the GROUP BY column.
+
+A plain query may end in ORDER BY ID or ORDER BY Price, optionally ASC or
+DESC, followed by LIMIT k. Such a query is ordered: it yields only the first
+k matching rows in that order (see QPETopK.h), rows of equal Price by
+ascending ID.
+
+query_pack() writes the compiled form of a Query (projection, PredNodes and
+the used part of the string pool) to a compact byte string that
+query_unpack() turns back into a Query, which is what qpe_mpi broadcasts.
+where_raw is not part of it.
+
+query_canonical() spells a compiled Query in one canonical form, the same for
+every way of writing the same question: operands of AND and OR chains are
+sorted and deduplicated, and string literals are lower-cased because string
+comparisons ignore case. QPECache.c keys its results by it.
+
+*/
+
+#ifndef QPE_QUERY_H
+#define QPE_QUERY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+Struct Definitions
+*/
+typedef struct {
+  int ID;
+  char Model[20];
+  int YearMake;
+  char Color[20];
+  int Price;
+  char Dealer[20];
+} CarInventory;
+
+typedef enum {
+  COL_ID,
+  COL_MODEL,
+  COL_YEARMAKE,
+  COL_COLOR,
+  COL_PRICE,
+  COL_DEALER,
+  COL_UNKNOWN
+} ColumnId;
+
+typedef enum {
+  AGG_NONE,
+  AGG_COUNT,
+  AGG_SUM,
+  AGG_AVG,
+  AGG_MIN,
+  AGG_MAX
+} AggFunc;
+
+typedef enum { OP_EQ, OP_NE, OP_GT, OP_LT, OP_GE, OP_LE } CompareOp;
+
+typedef enum {
+  PRED_CONST,
+  PRED_INT_CMP,
+  PRED_STR_CMP,
+  PRED_AND,
+  PRED_OR
+} PredKind;
+
+/*
+Upper bounds for a compiled WHERE clause. where_raw holds at most 255
+characters and every real comparison needs at least three of them plus a
+two-character OR, so 51 comparisons and 50 connectives is the worst case.
+*/
+#define QPE_MAX_PRED_NODES 128
+#define QPE_PRED_STRPOOL_SIZE 512
+
+/* Room for the query_canonical() form of any Query load_queries() accepts. */
+#define QPE_QUERY_CANONICAL_MAX 2048
+
+typedef struct {
+  unsigned char kind;   /* PredKind */
+  unsigned char op;     /* CompareOp for comparisons */
+  unsigned char column; /* ColumnId for comparisons */
+  unsigned char truth;  /* result of a PRED_CONST node */
+  unsigned short offset; /* offsetof() the field inside CarInventory */
+  unsigned short str;    /* string literal offset inside strpool */
+  short left;            /* child indices for PRED_AND / PRED_OR */
+  short right;
+  int ival; /* integer literal for PRED_INT_CMP */
+} PredNode;
+
+typedef struct {
+  PredNode nodes[QPE_MAX_PRED_NODES];
+  int num_nodes;
+  int root; /* -1 when the clause is empty and every record matches */
+  char strpool[QPE_PRED_STRPOOL_SIZE];
+  int strpool_len;
+} Predicate;
+
+typedef struct {
+  char select_attrs[6][20];
+  int num_select_attrs;
+  unsigned char select_cols[6]; /* ColumnId of every select_attrs entry */
+  bool select_all;              /* SELECT * (or an empty list) */
+  unsigned char select_aggs[6]; /* AggFunc of every entry, AGG_NONE if plain */
+  bool aggregate;               /* aggregates or GROUP BY: a row per group */
+  unsigned char group_col;      /* GROUP BY ColumnId, COL_UNKNOWN for none */
+  bool ordered;                 /* ORDER BY ... LIMIT: the first limit rows */
+  unsigned char order_col;      /* ORDER BY ColumnId (ID or Price) */
+  bool order_desc;              /* ORDER BY ... DESC */
+  int limit;                    /* LIMIT k of an ordered query */
+  char where_raw[256];
+  Predicate where;
+} Query;
+
+/*
+Function Prototypes
+*/
+void load_queries(const char *filename, Query **queries, int *num_queries);
+bool parse_query(const char *line, Query *q);
+bool compile_where(const char *where_raw, Predicate *pred);
+int match_where(const CarInventory *car, const Predicate *pred);
+bool apply_op(CompareOp op, int cmp);
+size_t query_pack(const Query *q, unsigned char *out);
+size_t query_unpack(const unsigned char *data, size_t len, Query *q);
+size_t query_canonical(const Query *q, char *out, size_t cap);
+
+#endif
@@ -0,0 +1,182 @@
+/*
+
+QPERefresh.c
+
+Authors:
+    Aidan Levy
+    Maddie Powell
+    Nick Corcoran
+    Austin Phalines
+    Dean Bullock
+
+Creation Date: 10-14-2026
+
+Description:
+
+Refresh of the resident tables for --serve (see QPERefresh.h). The delta path
+relies on the rows being ID-ordered and the new IDs sorting after the old
+ones: btree_load() then appends to the B-tree's last leaf, the column store
+and the posting lists only grow at their ends, and every row position
+already handed out stays valid. The result cache is told which rows were
+added so it can keep the answers they do not touch.
+
+A full reload builds the new column store and indexes before it lets go of
+the old ones, so if the file cannot be read the server keeps answering from
+what it had. Only running out of memory while the B-tree is refilled, or
+while a delta is applied, leaves nothing to answer from.
+
+*/
+
+#include <stdio.h>
+
+#include "QPERefresh.h"
+#include "QPETiming.h"
+
+/*
+Function Prototypes
+*/
+static bool append_rows(ResidentTables *r, size_t from);
+static RefreshStatus reload_tables(ResidentTables *r, bool intact);
+
+/*
+Name: refresh_tables():
+Parameters: ResidentTables *r
+Return: RefreshStatus
+Description:
+
+Brings every structure in r up to date with r->filename: nothing happens
+while the file is unchanged, rows appended to it are added as a delta, and
+any other change reloads the file.
+*/
+RefreshStatus refresh_tables(ResidentTables *r) {
+  double start = timing_now();
+  size_t from = r->loaded->count;
+  size_t added;
+  RefreshStatus status;
+  TailStatus tail = load_table_tail(r->filename, r->stats, r->loaded, &added);
+
+  if (tail == TAIL_UNCHANGED) {
+    return REFRESH_UNCHANGED;
+  }
+  if (tail == TAIL_APPENDED && append_rows(r, from)) {
+    size_t dropped = 0;
+    if (r->cache != NULL) {
+      dropped = cache_refresh(r->cache, r->loaded, r->loaded->rows + from,
+                              added);
+    }
+    printf("Appended %zu tuples from %s (%zu in all, %zu cached results "
+           "dropped)\n",
+           added, r->filename, r->loaded->count, dropped);
+    r->appends++;
+    r->rows_added += added;
+    status = REFRESH_APPENDED;
+  } else {
+    status = reload_tables(r, tail == TAIL_RELOAD);
+  }
+  fflush(stdout);
+  r->seconds += timing_now() - start;
+  return status;
+}
+
+/*
+Name: append_rows():
+Parameters: ResidentTables *r, size_t from
+Return: bool
+Description:
+
+Adds r->loaded->rows[from .. count), just appended by load_table_tail(), to
+the B-tree, the column store, the secondary indexes and the zone map.
+Returns false when out of memory, with the structures only partly extended.
+*/
+static bool append_rows(ResidentTables *r, size_t from) {
+  const CarInventory *rows = r->loaded->rows;
+  size_t count = r->loaded->count;
+
+  for (size_t i = from; i < count; i++) {
+    if ((btree_load(r->tree, &rows[i]) == NULL && btree_oom(r->tree)) ||
+        (r->table != NULL && !column_table_append(r->table, &rows[i]))) {
+      return false;
+    }
+  }
+  if (r->zones != NULL && !zone_map_append(r->zones, rows, count)) {
+    return false;
+  }
+  return r->index == NULL || index_append(r->index, rows, count);
+}
+
+/*
+Name: reload_tables():
+Parameters: ResidentTables *r, bool intact
+Return: RefreshStatus
+Description:
+
+Replaces everything in r with a fresh load_table() of the file, and empties
+the result cache. intact tells whether r still describes one version of
+the file; if so and the file cannot be loaded (or its column store,
+indexes and zone map cannot be built), r is kept with a warning and
+REFRESH_STALE returned, otherwise the refresh fails.
+*/
+static RefreshStatus reload_tables(ResidentTables *r, bool intact) {
+  LoadedTable fresh;
+  TableStats stats;
+  ColumnTable *table = NULL;
+  SecondaryIndex *index = NULL;
+  ZoneMap *zones = NULL;
+  bool ok = load_table(r->filename, &stats, &fresh);
+
+  if (ok && r->table != NULL) {
+    table = column_table_from_array(fresh.rows, fresh.count);
+    ok = table != NULL;
+  }
+  if (ok && r->index != NULL) {
+    index = index_build(fresh.rows, fresh.count);
+    ok = index != NULL;
+  }
+  if (ok && r->zones != NULL) {
+    zones = zone_map_build(fresh.rows, fresh.count);
+    ok = zones != NULL;
+  }
+  if (!ok) {
+    column_table_free(table);
+    index_free(index);
+    zone_map_free(zones);
+    loaded_table_free(&fresh);
+    if (intact) {
+      fprintf(stderr,
+              "Warning: cannot reload %s, answering from the %zu tuples "
+              "loaded before\n",
+              r->filename, r->loaded->count);
+      return REFRESH_STALE;
+    }
+    fprintf(stderr, "Error: Failed to reload %s\n", r->filename);
+    return REFRESH_FAILED;
+  }
+
+  btree_clear(r->tree);
+  for (size_t i = 0; i < fresh.count; i++) {
+    if (btree_load(r->tree, &fresh.rows[i]) == NULL && btree_oom(r->tree)) {
+      fprintf(stderr, "Error: Out of memory inserting ID=%d\n",
+              fresh.rows[i].ID);
+      column_table_free(table);
+      index_free(index);
+      zone_map_free(zones);
+      loaded_table_free(&fresh);
+      return REFRESH_FAILED;
+    }
+  }
+  loaded_table_free(r->loaded);
+  column_table_free(r->table);
+  index_free(r->index);
+  zone_map_free(r->zones);
+  *r->loaded = fresh;
+  *r->stats = stats;
+  r->table = table;
+  r->index = index;
+  r->zones = zones;
+  if (r->cache != NULL) {
+    cache_refresh(r->cache, r->loaded, NULL, 0);
+  }
+  printf("Reloaded %zu tuples from %s\n", r->loaded->count, r->filename);
+  r->reloads++;
+  return REFRESH_RELOADED;
+}
@@ -0,0 +1,65 @@
+/*
+
+QPERefresh.h
+
+Keeps the tables of a --serve engine in step with a database file that grows
+while it serves (see QPERefresh.c). Before every request the engine calls
+refresh_tables(), which costs one stat() while the file is unchanged. Rows
+appended to a text file with IDs above every loaded one are read on their
+own (load_table_tail(), QPELoad.h) and added to the row array, the primary
+B-tree, the column store, the secondary indexes and the zone map as a
+delta, so a refresh costs time in proportion to the new rows, not the table.
+The result cache drops only the entries those rows can change. Anything else
+(a rewritten, truncated or replaced file, IDs out of order, a binary file)
+rebuilds everything from a full load_table().
+
+Refreshes run between requests, on the thread that reads them, so no query
+ever sees a table half updated.
+
+*/
+
+#ifndef QPE_REFRESH_H
+#define QPE_REFRESH_H
+
+#include <stddef.h>
+
+#include "../btree/btree.h"
+#include "QPECache.h"
+#include "QPEColumn.h"
+#include "QPEIndex.h"
+#include "QPELoad.h"
+#include "QPEStats.h"
+#include "QPEZone.h"
+
+/*
+Struct Definitions
+*/
+typedef enum {
+  REFRESH_UNCHANGED,
+  REFRESH_APPENDED, /* new rows were added to every structure */
+  REFRESH_RELOADED, /* everything was rebuilt from the file */
+  REFRESH_STALE,    /* the file could not be reloaded; the old rows stay */
+  REFRESH_FAILED    /* memory ran out part way; the tables are unusable */
+} RefreshStatus;
+
+typedef struct {
+  const char *filename;
+  LoadedTable *loaded;   /* ID-ordered rows the other structures index */
+  TableStats *stats;
+  struct btree *tree;    /* primary B-tree, refilled in place on a reload */
+  ColumnTable *table;    /* --layout=columnar, else NULL */
+  SecondaryIndex *index; /* --index, else NULL */
+  ZoneMap *zones;        /* block summaries, else NULL */
+  QueryCache *cache;     /* --cache, else NULL */
+  long long appends;     /* refreshes that added rows */
+  long long reloads;     /* refreshes that rebuilt everything */
+  size_t rows_added;     /* rows the appends added */
+  double seconds;        /* time spent in both */
+} ResidentTables;
+
+/*
+Function Prototypes
+*/
+RefreshStatus refresh_tables(ResidentTables *r);
+
+#endif
@@ -31,70 +31,164 @@ If the database contains 10 or fewer tuples,
 the program prints all tuples to the console
 for easy debugging.
 
+With --layout=columnar the tuples are also
+copied into a dictionary-encoded column store
+(QPEColumn.c) and every query scans that instead.
+
+With --index, secondary indexes on (Model,
+YearMake) and Color (QPEIndex.c) are built over
+an ID-ordered snapshot of the tuples, and queries
+that test those columns for equality only visit
+the rows in the matching posting lists.
+
+Column statistics are gathered while loading, and
+a cost-based planner (QPEPlan.c) picks a full
+scan, an ID range scan from a btree_ascend pivot,
+or an index lookup for every query; --explain
+prints its choice on stderr.
+
+With --batch, all queries the planner would
+answer with a full scan share a single pass over
+the tuples (QPEBatch.c); their results are
+buffered and printed in query order.
+
+Aggregate queries (COUNT, SUM, AVG, MIN, MAX,
+GROUP BY) fold their matches into a hash table
+of groups (QPEAggregate.c) along the same plans,
+and only the groups are printed.
+
+With --mem-limit the tuples are never all in
+memory: a reader thread streams the database in
+blocks (QPEStream.c), every query is answered by
+one shared pass over each block, and results
+beyond the limit spill to a temporary file.
+
+With --cache, a query answered before against
+the same unchanged database file is planned as
+PLAN_CACHED and printed from the result cache
+(QPECache.c); every other query's output is
+recorded there for the next run.
+
+With --serve the database is loaded once and
+queries are then answered one at a time as they
+arrive on stdin or a Unix socket (QPEServe.c),
+against the same resident tree, indexes and
+column store. Rows appended to the file while
+it serves are added to all of them before the
+next query is answered (QPERefresh.c).
+
 */
 
-#include <ctype.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <strings.h>
-#include <time.h>
 
 #include "../btree/btree.h"
+#include "QPEAggregate.h"
+#include "QPEBatch.h"
+#include "QPEBuffer.h"
+#include "QPECache.h"
+#include "QPEColumn.h"
+#include "QPEFilter.h"
+#include "QPEIndex.h"
+#include "QPEKernel.h"
+#include "QPELoad.h"
+#include "QPEOptions.h"
+#include "QPEOutput.h"
+#include "QPEPlan.h"
+#include "QPEQuery.h"
+#include "QPERefresh.h"
+#include "QPEServe.h"
+#include "QPEStats.h"
+#include "QPEStream.h"
+#include "QPETiming.h"
+#include "QPETopK.h"
+
+/* Results are formatted into a QueryOutput and written out in this size. */
+#define QPE_SEQ_FLUSH_BYTES ((size_t)1 << 20)
 
 /*
 Struct Definitions
 */
 typedef struct {
-  int ID;
-  char Model[20];
-  int YearMake;
-  char Color[20];
-  int Price;
-  char Dealer[20];
-} CarInventory;
-
+  OutputSink *sink;
+  int query_no;
+  Buffer buf; /* formatted rows not written yet */
+  Buffer *capture; /* --cache: every row written so far, else NULL */
+  QueryTiming *qt;
+} QueryOutput;
+
+/* What a query can be answered from once the database is loaded. */
 typedef struct {
-  char select_attrs[6][20];
-  int num_select_attrs;
-  char where_raw[256];
-} Query;
+  struct btree *tree;
+  const ColumnTable *table;    /* --layout=columnar, else NULL */
+  const SecondaryIndex *index; /* --index, else NULL */
+  const CarInventory *rows;    /* ID-ordered snapshot */
+  size_t count;
+} SeqTables;
 
-typedef enum { VAL_INT, VAL_STR } ValueType;
+typedef struct {
+  Query *q;
+  QueryOutput *out;
+} ProcessCtx;
 
 typedef struct {
-  ValueType type;
-  int i;
-  char s[64];
-} Value;
+  Query *q;
+  long long id_hi;
+  QueryOutput *out;
+} RangeCtx;
 
 typedef struct {
+  const ColumnTable *table;
   Query *q;
-} ProcessCtx;
+  QueryOutput *out;
+} ColumnarCtx;
+
+typedef struct {
+  const QueryBatch *batch;
+  Buffer *outs;
+  bool ok;
+} BatchIterCtx;
 
 /*
 Function Prototypes
 */
 int car_compare(const void *a, const void *b, void *udata);
-struct btree *load_database(const char *filename);
+struct btree *load_database(const char *filename, TableStats *stats,
+                            LoadedTable *loaded);
 bool print_iter(const void *item, void *udata);
 void print_all_tuples(struct btree *tree);
-static const char *skip_ws(const char *s);
-static void trim_trailing(char *s);
-void load_queries(const char *filename, Query **queries, int *num_queries);
-static bool read_identifier(const char **p, char *out, size_t cap);
-static bool read_value(const char **p, Value *v);
-static int compare_attr_value(const CarInventory *car, const char *attr,
-                              const Value *v);
-static bool eval_comparison(const CarInventory *car, const char **p);
-static bool eval_term(const CarInventory *car, const char **p);
-static bool eval_factor(const CarInventory *car, const char **p);
-static bool eval_expr(const CarInventory *car, const char **p);
-int match_where(const CarInventory *car, const char *where_raw);
-void print_selected(const CarInventory *car, Query *q);
+static void flush_output(QueryOutput *out);
+static void print_match(const CarInventory *car, Query *q, QueryOutput *out);
 static bool process_iter_cb(const void *item, void *udata);
-void process_query(struct btree *tree, Query *q);
+static bool columnar_emit_cb(size_t row, void *udata);
+void process_query(struct btree *tree, Query *q, QueryOutput *out);
+void process_query_columnar(const ColumnTable *table, Query *q,
+                            QueryOutput *out);
+void process_query_kernel(const ScanKernel *k, const CarInventory *rows,
+                          size_t count, Query *q, QueryOutput *out);
+static bool range_iter_cb(const void *item, void *udata);
+void process_query_range(struct btree *tree, const QueryPlan *plan, Query *q,
+                         QueryOutput *out);
+bool process_query_indexed(const SecondaryIndex *index,
+                           const CarInventory *rows, const IndexProbe *probe,
+                           Query *q, QueryOutput *out);
+void process_query_aggregate(const CarInventory *rows, size_t count,
+                             const SecondaryIndex *index,
+                             const QueryPlan *plan, Query *q,
+                             QueryOutput *out);
+void process_query_ordered(const SeqTables *t, const QueryPlan *plan,
+                           Query *q, QueryOutput *out);
+static bool batch_iter_cb(const void *item, void *udata);
+Buffer *process_batch(struct btree *tree, const ColumnTable *table,
+                      const Query *queries, const QueryPlan *plans,
+                      int num_queries);
+static void answer_query(const SeqTables *t, const QueryPlan *plan, Query *q,
+                         QueryOutput *out);
+bool serve_queries(QueryServer *server, SeqTables *t, ResidentTables *live,
+                   bool explain);
+int run_stream(const QPEOptions *opts, RunTiming *timing, OutputSink *sink);
 
 /*
 Name: main():
@@ -102,32 +196,76 @@ Parameters: int argc, char **argv
 Return: int
 Description:
 
-Sequential entry point that loads the database, parses queries, and processes
-them against the B-tree while recording total runtime for reporting.
+Sequential entry point that loads the database, parses queries, plans each one
+and runs it against the B-tree, the secondary indexes, or the column store
+(with --layout=columnar) while recording total runtime for reporting. With
+--batch the full-scan queries are answered together by process_batch() first
+and their buffered results printed in their turn. With --serve the queries
+come from serve_queries() instead of the query file.
 */
 int main(int argc, char **argv) {
 
-  clock_t start = clock(), end;
-  double total;
-  const char *filename = "db/db.txt";
-  const char *queryfile = "db/sql.txt";
+  RunTiming timing;
+  TimingSummary summary;
+  double mark;
+  const char *filename;
+  const char *queryfile;
   struct btree *tree;
+  ColumnTable *table = NULL;
+  const CarInventory *rows;
+  SecondaryIndex *index = NULL;
+  TableStats stats;
+  LoadedTable loaded;
+  QPEOptions opts;
+  OutputSink sink;
+  QueryOutput out;
+  QueryCache cache;
+  QueryCache *qcache = NULL;
+  QueryServer server;
+  QueryServer *qserver = NULL;
+  SeqTables tables;
+  ResidentTables live;
+  Buffer captured;
+  const char *bad_arg;
   size_t count;
 
-  if (argc >= 2) {
-    filename = argv[1];
+  timing_init(&timing);
+  mark = timing.start;
+  bad_arg = parse_options(argc, argv, &opts);
+  if (bad_arg != NULL) {
+    fprintf(stderr, "Error: unrecognized argument %s\n", bad_arg);
+    return 1;
+  }
+  filename = opts.db_file;
+  queryfile = opts.query_file;
+  if (opts.serve) {
+    serve_options(&opts);
+    if (!serve_open(&server, opts.serve_path)) {
+      return 1;
+    }
+    qserver = &server;
   }
-  if (argc >= 3) {
-    queryfile = argv[2];
+  if (!output_open(&sink, opts.output_file)) {
+    return 1;
+  }
+  if (opts.mem_limit > 0) {
+    return run_stream(&opts, &timing, &sink);
+  }
+  if (opts.cache && cache_open(&cache, filename, opts.cache_dir)) {
+    qcache = &cache;
   }
 
-  tree = load_database(filename);
+  tree = load_database(filename, &stats, &loaded);
   if (tree == NULL) {
     fprintf(stderr, "Error: Failed to load database from %s\n", filename);
+    serve_close(qserver);
+    cache_close(qcache);
     return 1;
   }
+  mark = timing_lap(&timing, TIME_LOAD, mark);
 
-  count = btree_count(tree);
+  rows = loaded.rows;
+  count = loaded.count;
   printf("Loaded %zu tuples from %s\n", count, filename);
 
   if (count <= 10) {
@@ -135,23 +273,181 @@ int main(int argc, char **argv) {
     print_all_tuples(tree);
   }
 
+  if (opts.layout == LAYOUT_COLUMNAR) {
+    table = column_table_from_array(rows, count);
+    if (table == NULL) {
+      serve_close(qserver);
+      cache_close(qcache);
+      loaded_table_free(&loaded);
+      btree_free(tree);
+      return 1;
+    }
+  }
+
+  if (opts.use_index) {
+    index = index_build(rows, count);
+    if (index == NULL) {
+      fprintf(stderr, "Error: Failed to build secondary indexes\n");
+      serve_close(qserver);
+      cache_close(qcache);
+      loaded_table_free(&loaded);
+      column_table_free(table);
+      btree_free(tree);
+      return 1;
+    }
+  }
+
+  tables.tree = tree;
+  tables.table = table;
+  tables.index = index;
+  tables.rows = rows;
+  tables.count = count;
+  if (qserver != NULL) {
+    bool served;
+    memset(&live, 0, sizeof(live));
+    live.filename = filename;
+    live.loaded = &loaded;
+    live.stats = &stats;
+    live.tree = tree;
+    live.table = table;
+    live.index = index;
+    live.cache = qcache;
+    served = serve_queries(qserver, &tables, &live, opts.explain);
+    serve_close(qserver);
+    cache_close(qcache);
+    index_free(live.index);
+    loaded_table_free(&loaded);
+    column_table_free(live.table);
+    btree_free(tree);
+    timing_free(&timing);
+    return served ? 0 : 1;
+  }
+
   Query *queries = NULL;
+  QueryPlan *plans = NULL;
+  Buffer *batch_outs = NULL;
   int num_queries = 0;
+  bool ok;
   load_queries(queryfile, &queries, &num_queries);
   printf("Processing %d queries from %s\n", num_queries, queryfile);
+
+  plans = malloc(((size_t)num_queries + 1) * sizeof(QueryPlan));
+  if (plans == NULL || !timing_queries(&timing, num_queries)) {
+    fprintf(stderr, "Error: out of memory planning queries\n");
+    free(plans);
+    timing_free(&timing);
+    cache_close(qcache);
+    free(queries);
+    index_free(index);
+    loaded_table_free(&loaded);
+    column_table_free(table);
+    btree_free(tree);
+    return 1;
+  }
   for (int i = 0; i < num_queries; i++) {
-    process_query(tree, &queries[i]);
+    plan_query(&stats, index,
+               table != NULL ? QPE_COST_COLUMNAR_SCAN : QPE_COST_ROW_SCAN,
+               &queries[i].where, &plans[i]);
+    if (qcache != NULL) {
+      cache_plan(qcache, &queries[i], &plans[i]);
+    }
+    if (opts.explain) {
+      plan_explain(stderr, i + 1, &queries[i].where, &plans[i]);
+    }
+  }
+  out.sink = &sink;
+  buffer_init(&out.buf);
+  buffer_init(&captured);
+  mark = timing_lap(&timing, TIME_MATERIALIZE, mark);
+  if (opts.batch) {
+    batch_outs = process_batch(tree, table, queries, plans, num_queries);
+    mark = timing_lap(&timing, TIME_FILTER, mark);
   }
-  end = clock();
-  total = (double)(end - start) / CLOCKS_PER_SEC;
 
+  /*
+  Unbuffered queries print as they filter, so their time is all charged to
+  the filter phase; a batched or cached query's buffer is charged to output.
+  */
+  for (int i = 0; i < num_queries; i++) {
+    Query *q = &queries[i];
+    const QueryPlan *plan = &plans[i];
+    QueryTiming *qt = &timing.queries[i];
+
+    if (batch_outs != NULL && plan->path == PLAN_FULL_SCAN &&
+        !q->aggregate && !q->ordered) {
+      mark = timing_lap(&timing, TIME_FILTER, mark);
+      qt->rows_scanned = (double)count;
+      timing_output(qt, batch_outs[i].data, batch_outs[i].len);
+      output_write(&sink, i + 1, batch_outs[i].data, batch_outs[i].len);
+      if (qcache != NULL) {
+        cache_store(qcache, q, batch_outs[i].data, batch_outs[i].len);
+      }
+      buffer_free(&batch_outs[i]);
+      mark = timing_lap(&timing, TIME_OUTPUT, mark);
+      continue;
+    }
+    if (plan->path == PLAN_CACHED) {
+      mark = timing_lap(&timing, TIME_FILTER, mark);
+      timing_output(qt, plan->cached, plan->cached_len);
+      output_write(&sink, i + 1, plan->cached, plan->cached_len);
+      mark = timing_lap(&timing, TIME_OUTPUT, mark);
+      continue;
+    }
+    out.query_no = i + 1;
+    out.qt = qt;
+    out.capture = qcache != NULL ? &captured : NULL;
+    captured.len = 0;
+    qt->seconds = timing_now();
+    answer_query(&tables, plan, q, &out);
+    flush_output(&out);
+    qt->seconds = timing_now() - qt->seconds;
+    if (out.capture != NULL) {
+      cache_store(qcache, q, captured.data, captured.len);
+    }
+  }
+  mark = timing_lap(&timing, TIME_FILTER, mark);
+  ok = output_close(&sink);
+  timing_lap(&timing, TIME_OUTPUT, mark);
+  if (qcache != NULL) {
+    timing.value[COUNT_CACHE_HITS] = (double)qcache->hits;
+    timing.value[COUNT_CACHE_MISSES] = (double)qcache->misses;
+  }
+  timing_finish(&timing);
+  timing_summary_local(&timing, &summary);
+
+  buffer_free(&out.buf);
+  buffer_free(&captured);
+  cache_close(qcache);
+  free(batch_outs);
+  free(plans);
   free(queries);
+  index_free(index);
+  loaded_table_free(&loaded);
+  column_table_free(table);
   btree_free(tree);
 
-  printf("\nTiming Summary (sequential):\n");
-  printf("  Total time: %.6f seconds\n", total);
+  printf("\nTiming Summary (sequential, wall clock):\n");
+  printf("  Total time: %.6f seconds\n", timing.value[TIME_TOTAL]);
+  printf("  Load time: %.6f seconds (%.1f MB/s)\n", loaded.seconds,
+         load_throughput(&loaded));
+  timing_print(stdout, &summary);
+
+  if (opts.timing_file != NULL) {
+    TimingInfo info = {.engine = "qpe_seq",
+                       .db_file = filename,
+                       .query_file = queryfile,
+                       .layout = opts.layout == LAYOUT_COLUMNAR ? "columnar"
+                                                                : "row",
+                       .mode = NULL,
+                       .processes = 1,
+                       .threads = 1,
+                       .tuples = (long long)count};
+    timing_write(opts.timing_file, &info, &summary, timing.queries,
+                 timing.num_queries);
+  }
+  timing_free(&timing);
 
-  return 0;
+  return ok ? 0 : 1;
 }
 
 /*
@@ -180,62 +476,39 @@ int car_compare(const void *a, const void *b, void *udata) {
 
 /*
 Name: load_database():
-Parameters: const char *filename
+Parameters: const char *filename, TableStats *stats, LoadedTable *loaded
 Return: struct btree *
 Description:
 
-Reads tuples from the flat file database, inserts each CarInventory record into
-the B-tree keyed by ID, and returns the populated tree (or NULL on failure).
+Loads the flat file database with load_table() (QPELoad.c) and bulk-builds the
+B-tree keyed by ID from its ID-ordered rows, returning the tree (or NULL on
+failure). The rows stay in loaded for the secondary indexes and the column
+store; stats describes every distinct tuple for the query planner.
 */
-struct btree *load_database(const char *filename) {
-  FILE *fp;
+struct btree *load_database(const char *filename, TableStats *stats,
+                            LoadedTable *loaded) {
   struct btree *tree;
-  CarInventory car;
-  char header_line[256];
-  int scanned;
 
-  fp = fopen(filename, "r");
-  if (fp == NULL) {
-    perror("fopen");
+  if (!load_table(filename, stats, loaded)) {
     return NULL;
   }
 
   tree = btree_new(sizeof(CarInventory), 0, car_compare, NULL);
   if (tree == NULL) {
     fprintf(stderr, "Error: btree_new failed\n");
-    fclose(fp);
-    return NULL;
-  }
-
-  if (fgets(header_line, sizeof(header_line), fp) == NULL) {
-    fprintf(stderr, "Error: Failed to read header from %s\n", filename);
-    fclose(fp);
-    btree_free(tree);
+    loaded_table_free(loaded);
     return NULL;
   }
 
-  while (1) {
-    scanned = fscanf(fp, "%d %19s %d %19s %d %19s", &car.ID, car.Model,
-                     &car.YearMake, car.Color, &car.Price, car.Dealer);
-
-    if (scanned == EOF) {
-      break;
-    }
-
-    if (scanned != 6) {
-      fprintf(stderr, "Warning: Malformed line encountered in %s\n", filename);
-      break;
-    }
-
-    if (btree_set(tree, &car) == NULL && btree_oom(tree)) {
-      fprintf(stderr, "Error: Out of memory inserting ID=%d\n", car.ID);
-      fclose(fp);
+  for (size_t i = 0; i < loaded->count; i++) {
+    if (btree_load(tree, &loaded->rows[i]) == NULL && btree_oom(tree)) {
+      fprintf(stderr, "Error: Out of memory inserting ID=%d\n",
+              loaded->rows[i].ID);
+      loaded_table_free(loaded);
       btree_free(tree);
       return NULL;
     }
   }
-
-  fclose(fp);
   return tree;
 }
 
@@ -273,493 +546,691 @@ void print_all_tuples(struct btree *tree) {
 }
 
 /*
-Name: skip_ws():
-Parameters: const char *s
-Return: const char *
+Name: flush_output():
+Parameters: QueryOutput *out
+Return: void
 Description:
 
-Advances past leading whitespace characters in the provided string and returns
-the first non-space position, simplifying later parsing logic.
+Writes the rows formatted so far to the sink and charges them to the query's
+timing record. With --cache they are also appended to the capture buffer,
+which is given up (leaving the query uncached) once the result outgrows
+QPE_CACHE_MAX_RESULT or memory runs out.
 */
-static const char *skip_ws(const char *s) {
-  while (*s && isspace((unsigned char)*s)) {
-    s++;
+static void flush_output(QueryOutput *out) {
+  if (out->capture != NULL &&
+      (out->capture->len + out->buf.len > QPE_CACHE_MAX_RESULT ||
+       !buffer_append(out->capture, out->buf.data, out->buf.len))) {
+    out->capture = NULL;
   }
-  return s;
+  timing_output(out->qt, out->buf.data, out->buf.len);
+  output_write(out->sink, out->query_no, out->buf.data, out->buf.len);
+  out->buf.len = 0;
 }
 
 /*
-Name: trim_trailing():
-Parameters: char *s
+Name: print_match():
+Parameters: const CarInventory *car, Query *q, QueryOutput *out
 Return: void
 Description:
 
-Removes trailing whitespace and semicolons from the provided buffer in place so
-that tokens parsed from the SQL-like input are sanitized.
+Formats a record that satisfied q into the query's output with
+append_selected(), writing the output out every QPE_SEQ_FLUSH_BYTES.
 */
-static void trim_trailing(char *s) {
-  size_t len = strlen(s);
-  while (len > 0 && isspace((unsigned char)s[len - 1])) {
-    s[--len] = '\0';
+static void print_match(const CarInventory *car, Query *q, QueryOutput *out) {
+  if (!append_selected(car, q, &out->buf)) {
+    fprintf(stderr, "Error: out of memory formatting results\n");
+    return;
   }
-  if (len > 0 && s[len - 1] == ';') {
-    s[--len] = '\0';
-    trim_trailing(s);
+  if (out->buf.len >= QPE_SEQ_FLUSH_BYTES) {
+    flush_output(out);
   }
 }
 
 /*
-Name: load_queries():
-Parameters: const char *filename, Query **queries, int *num_queries
-Return: void
+Name: process_iter_cb():
+Parameters: const void *item, void *udata
+Return: bool
 Description:
 
-Parses each SQL-like query from the provided file, capturing the SELECT column
-list and raw WHERE clause, and returns a dynamically sized array of Query
-structures.
+btree iterator callback that filters each record via match_where() and prints
+matching tuples for the active query, always continuing the traversal.
 */
-void load_queries(const char *filename, Query **queries, int *num_queries) {
-  FILE *fp = fopen(filename, "r");
-  char line[512];
-  int capacity = 4;
-  Query *arr;
-
-  if (!fp) {
-    perror("fopen queries");
-    *queries = NULL;
-    *num_queries = 0;
-    return;
-  }
-
-  arr = malloc(sizeof(Query) * capacity);
-  if (!arr) {
-    fprintf(stderr, "Error: out of memory allocating queries\n");
-    fclose(fp);
-    *queries = NULL;
-    *num_queries = 0;
-    return;
+static bool process_iter_cb(const void *item, void *udata) {
+  const CarInventory *car = (const CarInventory *)item;
+  ProcessCtx *ctx = (ProcessCtx *)udata;
+  ctx->out->qt->rows_scanned++;
+  if (match_where(car, &ctx->q->where)) {
+    print_match(car, ctx->q, ctx->out);
   }
+  return true;
+}
 
-  *num_queries = 0;
-
-  while (fgets(line, sizeof(line), fp) != NULL) {
-    Query q;
-    char *select_pos;
-    char *from_pos;
-    char *where_pos;
-    char select_part[256];
-    char *token;
-    int idx = 0;
-
-    if (line[0] == '\n' || line[0] == '\0') {
-      continue;
-    }
-
-    memset(&q, 0, sizeof(Query));
-
-    select_pos = strstr(line, "SELECT");
-    from_pos = strstr(line, "FROM");
-    where_pos = strstr(line, "WHERE");
-
-    if (!select_pos || !from_pos || !where_pos) {
-      fprintf(stderr, "Warning: skipping malformed query: %s", line);
-      continue;
-    }
-
-    select_pos += strlen("SELECT");
-    while (*select_pos && isspace((unsigned char)*select_pos)) {
-      select_pos++;
-    }
-
-    if (from_pos <= select_pos) {
-      fprintf(stderr, "Warning: malformed SELECT clause: %s", line);
-      continue;
-    }
-
-    memset(select_part, 0, sizeof(select_part));
-    strncpy(select_part, select_pos, (size_t)(from_pos - select_pos));
-    trim_trailing(select_part);
-
-    token = strtok(select_part, ",");
-    while (token && idx < 6) {
-      token = (char *)skip_ws(token);
-      trim_trailing(token);
-      strncpy(q.select_attrs[idx], token, sizeof(q.select_attrs[idx]) - 1);
-      q.select_attrs[idx][sizeof(q.select_attrs[idx]) - 1] = '\0';
-      idx++;
-      token = strtok(NULL, ",");
-    }
-    q.num_select_attrs = idx;
-
-    where_pos += strlen("WHERE");
-    while (*where_pos && isspace((unsigned char)*where_pos)) {
-      where_pos++;
-    }
-    strncpy(q.where_raw, where_pos, sizeof(q.where_raw) - 1);
-    q.where_raw[sizeof(q.where_raw) - 1] = '\0';
-    trim_trailing(q.where_raw);
-
-    if (*num_queries >= capacity) {
-      capacity *= 2;
-      Query *tmp = realloc(arr, sizeof(Query) * capacity);
-      if (!tmp) {
-        fprintf(stderr, "Error: out of memory reallocating queries\n");
-        break;
-      }
-      arr = tmp;
-    }
-    arr[*num_queries] = q;
-    (*num_queries)++;
-  }
+/*
+Name: process_query():
+Parameters: struct btree *tree, Query *q, QueryOutput *out
+Return: void
+Description:
 
-  fclose(fp);
-  *queries = arr;
+Initializes iterator state and scans the entire B-tree, invoking the callback
+to test each record sequentially against the query's WHERE clause and format
+the matches into out.
+*/
+void process_query(struct btree *tree, Query *q, QueryOutput *out) {
+  ProcessCtx ctx = {.q = q, .out = out};
+  btree_ascend(tree, NULL, process_iter_cb, &ctx);
 }
+
 /*
-Name: read_identifier():
-Parameters: const char **p, char *out, size_t cap
-Return: bool
+Name: process_query_kernel():
+Parameters: const ScanKernel *k, const CarInventory *rows, size_t count,
+            Query *q, QueryOutput *out
+Return: void
 Description:
 
-Parses an identifier token (letters, digits, underscores) from the query text,
-stores it into the provided buffer, and advances the caller's pointer if the
-token exists.
+Full scan of the ID-ordered rows with the specialized kernel compiled from
+q's WHERE clause: kernel_select() picks the matches of each QPE_KERNEL_BLOCK
+rows and only those are printed, in the order process_query() would.
 */
-static bool read_identifier(const char **p, char *out, size_t cap) {
-  const char *s = *p;
-  size_t i = 0;
-  s = skip_ws(s);
-  if (!*s) {
-    return false;
-  }
-  while (*s && (isalnum((unsigned char)*s) || *s == '_')) {
-    if (i + 1 < cap) {
-      out[i++] = *s;
+void process_query_kernel(const ScanKernel *k, const CarInventory *rows,
+                          size_t count, Query *q, QueryOutput *out) {
+  uint32_t sel[QPE_KERNEL_BLOCK];
+
+  for (size_t lo = 0; lo < count; lo += QPE_KERNEL_BLOCK) {
+    size_t hi = count - lo < QPE_KERNEL_BLOCK ? count : lo + QPE_KERNEL_BLOCK;
+    size_t n = kernel_select(k, rows, lo, hi, sel);
+
+    for (size_t j = 0; j < n; j++) {
+      print_match(&rows[lo + sel[j]], q, out);
     }
-    s++;
   }
-  out[i] = '\0';
-  *p = s;
-  return i > 0;
+  out->qt->rows_scanned += (double)count;
+  out->qt->kernel = true;
 }
 
 /*
-Name: read_value():
-Parameters: const char **p, Value *v
+Name: columnar_emit_cb():
+Parameters: size_t row, void *udata
 Return: bool
 Description:
 
-Parses either a quoted string or integer literal from the WHERE clause text and
-captures it inside a Value struct so comparisons can be evaluated uniformly.
+filter_scan() callback that decodes a matching column-store row and prints it
+for the active query, always continuing the scan.
 */
-static bool read_value(const char **p, Value *v) {
-  const char *s = skip_ws(*p);
-  if (*s == '"') {
-    size_t i = 0;
-    s++;
-    while (*s && *s != '"' && i + 1 < sizeof(v->s)) {
-      v->s[i++] = *s++;
-    }
-    v->s[i] = '\0';
-    if (*s == '"') {
-      s++;
-    }
-    v->type = VAL_STR;
-  } else {
-    char *endptr;
-    v->i = (int)strtol(s, &endptr, 10);
-    if (endptr == s) {
-      return false;
-    }
-    s = endptr;
-    v->type = VAL_INT;
-  }
-  *p = s;
+static bool columnar_emit_cb(size_t row, void *udata) {
+  ColumnarCtx *ctx = (ColumnarCtx *)udata;
+  CarInventory car;
+  column_table_get(ctx->table, row, &car);
+  print_match(&car, ctx->q, ctx->out);
   return true;
 }
 
 /*
-Name: compare_attr_value():
-Parameters: const CarInventory *car, const char *attr, const Value *v
-Return: int
+Name: process_query_columnar():
+Parameters: const ColumnTable *table, Query *q, QueryOutput *out
+Return: void
 Description:
 
-Retrieves the named attribute from a CarInventory record, coerces it to the
-proper type, and compares it against the provided literal value returning the
-usual tri-state comparison result.
+Binds the query's compiled WHERE clause to the column store and filters it in
+ID order with the SIMD bitmap kernels, printing only the rows that match.
 */
-static int compare_attr_value(const CarInventory *car, const char *attr,
-                              const Value *v) {
-  if (strcasecmp(attr, "ID") == 0 || strcasecmp(attr, "YearMake") == 0 ||
-      strcasecmp(attr, "Price") == 0) {
-    int lhs = 0;
-    if (strcasecmp(attr, "ID") == 0) {
-      lhs = car->ID;
-    } else if (strcasecmp(attr, "YearMake") == 0) {
-      lhs = car->YearMake;
-    } else if (strcasecmp(attr, "Price") == 0) {
-      lhs = car->Price;
-    }
-    int rhs = (v->type == VAL_INT) ? v->i : atoi(v->s);
-    if (lhs < rhs)
-      return -1;
-    if (lhs > rhs)
-      return 1;
-    return 0;
+void process_query_columnar(const ColumnTable *table, Query *q,
+                            QueryOutput *out) {
+  ColumnFilter filter;
+  FilterScratch scratch;
+  ColumnarCtx ctx = {.table = table, .q = q, .out = out};
+
+  if (!column_filter_init(&filter, table, &q->where)) {
+    fprintf(stderr, "Error: out of memory binding query to column store\n");
+    return;
   }
-
-  const char *lhs = NULL;
-  if (strcasecmp(attr, "Model") == 0) {
-    lhs = car->Model;
-  } else if (strcasecmp(attr, "Color") == 0) {
-    lhs = car->Color;
-  } else if (strcasecmp(attr, "Dealer") == 0) {
-    lhs = car->Dealer;
-  } else {
-    return 0;
+  if (!filter_scratch_init(&scratch, &filter)) {
+    fprintf(stderr, "Error: out of memory allocating filter bitmaps\n");
+    column_filter_free(&filter);
+    return;
   }
 
-  const char *rhs = (v->type == VAL_STR) ? v->s : "";
-  return strcasecmp(lhs, rhs);
+  filter_scan(&scratch, 0, table->count, columnar_emit_cb, &ctx);
+  out->qt->rows_scanned += (double)table->count;
+
+  filter_scratch_free(&scratch);
+  column_filter_free(&filter);
 }
 
 /*
-Name: eval_comparison():
-Parameters: const CarInventory *car, const char **p
+Name: range_iter_cb():
+Parameters: const void *item, void *udata
 Return: bool
 Description:
 
-Parses a single comparison expression (attr op value) from the WHERE clause,
-evaluates it against the provided CarInventory, and returns true if satisfied.
+btree_ascend callback for an ID range scan: prints matching tuples and returns
+false to stop the traversal once the ID passes the upper bound.
 */
-static bool eval_comparison(const CarInventory *car, const char **p) {
-  char attr[32];
-  char op[3] = {0};
-  Value v;
-  const char *s = skip_ws(*p);
-
-  if (!read_identifier(&s, attr, sizeof(attr))) {
-    return false;
-  }
+static bool range_iter_cb(const void *item, void *udata) {
+  const CarInventory *car = (const CarInventory *)item;
+  RangeCtx *ctx = (RangeCtx *)udata;
 
-  s = skip_ws(s);
-  if (*s == '!' && *(s + 1) == '=') {
-    strcpy(op, "!=");
-    s += 2;
-  } else if (*s == '>' && *(s + 1) == '=') {
-    strcpy(op, ">=");
-    s += 2;
-  } else if (*s == '<' && *(s + 1) == '=') {
-    strcpy(op, "<=");
-    s += 2;
-  } else if (*s == '>') {
-    strcpy(op, ">");
-    s++;
-  } else if (*s == '<') {
-    strcpy(op, "<");
-    s++;
-  } else if (*s == '=') {
-    strcpy(op, "=");
-    s++;
-  } else {
+  if (car->ID > ctx->id_hi) {
     return false;
   }
-
-  if (!read_value(&s, &v)) {
-    return false;
+  ctx->out->qt->rows_scanned++;
+  if (match_where(car, &ctx->q->where)) {
+    print_match(car, ctx->q, ctx->out);
   }
+  return true;
+}
 
-  *p = s;
+/*
+Name: process_query_range():
+Parameters: struct btree *tree, const QueryPlan *plan, Query *q,
+            QueryOutput *out
+Return: void
+Description:
 
-  int cmp = compare_attr_value(car, attr, &v);
+Runs a PLAN_ID_RANGE plan: btree_ascend() starts at the lower ID bound as its
+pivot and range_iter_cb() stops past the upper bound, so only the tuples
+inside the range are visited.
+*/
+void process_query_range(struct btree *tree, const QueryPlan *plan, Query *q,
+                         QueryOutput *out) {
+  CarInventory pivot;
+  RangeCtx ctx = {.q = q, .id_hi = plan->id_hi, .out = out};
 
-  if (strcmp(op, "=") == 0) {
-    return cmp == 0;
-  } else if (strcmp(op, "!=") == 0) {
-    return cmp != 0;
-  } else if (strcmp(op, ">") == 0) {
-    return cmp > 0;
-  } else if (strcmp(op, "<") == 0) {
-    return cmp < 0;
-  } else if (strcmp(op, ">=") == 0) {
-    return cmp >= 0;
-  } else if (strcmp(op, "<=") == 0) {
-    return cmp <= 0;
+  if (plan->id_lo > plan->id_hi) {
+    return;
   }
-
-  return false;
+  memset(&pivot, 0, sizeof(pivot));
+  pivot.ID = (int)plan->id_lo;
+  btree_ascend(tree, &pivot, range_iter_cb, &ctx);
 }
 
-static bool eval_expr(const CarInventory *car, const char **p);
-static bool eval_factor(const CarInventory *car, const char **p);
-
 /*
-Name: eval_term():
-Parameters: const CarInventory *car, const char **p
+Name: process_query_indexed():
+Parameters: const SecondaryIndex *index, const CarInventory *rows,
+            const IndexProbe *probe, Query *q, QueryOutput *out
 Return: bool
 Description:
 
-Evaluates a sequence of AND-connected factors by recursively calling
-eval_factor and combining the boolean result, consuming the corresponding text.
+Runs a PLAN_INDEX_SEEK or PLAN_INDEX_INTERSECT plan: only the candidate rows
+index_lookup() returns for probe are tested with match_where(), in ascending
+ID order. Returns false, printing nothing, if the lookup failed and the query
+must fall back to a full scan.
 */
-static bool eval_term(const CarInventory *car, const char **p) {
-  bool result = eval_factor(car, p);
-  const char *s = skip_ws(*p);
+bool process_query_indexed(const SecondaryIndex *index,
+                           const CarInventory *rows, const IndexProbe *probe,
+                           Query *q, QueryOutput *out) {
+  PostingList hits;
 
-  while (strncasecmp(s, "AND", 3) == 0) {
-    s += 3;
-    *p = s;
-    bool rhs = eval_factor(car, p);
-    result = result && rhs;
-    s = skip_ws(*p);
+  if (!index_lookup(index, probe, &hits)) {
+    return false;
   }
-
-  *p = s;
-  return result;
+  out->qt->rows_scanned += (double)hits.count;
+  for (size_t i = 0; i < hits.count; i++) {
+    const CarInventory *car = &rows[hits.rows[i]];
+    if (match_where(car, &q->where)) {
+      print_match(car, q, out);
+    }
+  }
+  posting_list_free(&hits);
+  return true;
 }
 
 /*
-Name: eval_factor():
-Parameters: const CarInventory *car, const char **p
-Return: bool
+Name: process_query_aggregate():
+Parameters: const CarInventory *rows, size_t count,
+            const SecondaryIndex *index, const QueryPlan *plan, Query *q,
+            QueryOutput *out
+Return: void
 Description:
 
-Handles either parenthesized expressions or single comparisons when evaluating
-the WHERE clause, providing the building block for AND/OR parsing.
+Answers an aggregate query: agg_query() folds the rows its plan selects from
+the ID-ordered snapshot into an AggTable, and the groups are formatted into
+the query's output.
 */
-static bool eval_factor(const CarInventory *car, const char **p) {
-  const char *s = skip_ws(*p);
-  bool result;
-
-  if (*s == '(') {
-    s++;
-    *p = s;
-    /* evaluate full expression inside parentheses */
-    result = eval_expr(car, p);
-    s = skip_ws(*p);
-    if (*s == ')') {
-      s++;
-    }
-    *p = s;
-  } else {
-    result = eval_comparison(car, &s);
-    *p = s;
+void process_query_aggregate(const CarInventory *rows, size_t count,
+                             const SecondaryIndex *index,
+                             const QueryPlan *plan, Query *q,
+                             QueryOutput *out) {
+  AggTable agg;
+  size_t scanned = 0;
+
+  if (!agg_init(&agg, q) ||
+      !agg_query(&agg, rows, count, index, plan, &scanned) ||
+      !agg_format(&agg, &out->buf)) {
+    fprintf(stderr, "Error: out of memory aggregating query %d\n",
+            out->query_no);
   }
+  out->qt->rows_scanned += (double)scanned;
+  agg_free(&agg);
+}
 
-  return result;
+/*
+Name: process_query_ordered():
+Parameters: const SeqTables *t, const QueryPlan *plan, Query *q,
+            QueryOutput *out
+Return: void
+Description:
+
+Answers an ORDER BY ... LIMIT query: topk_query() keeps the best limit
+matches its plan selects in a bounded heap, walking the B-tree from the
+matching end with early termination when ordered by ID, and only those rows
+are formatted into the query's output, in order.
+*/
+void process_query_ordered(const SeqTables *t, const QueryPlan *plan,
+                           Query *q, QueryOutput *out) {
+  TopK top;
+  size_t scanned = 0;
+
+  topk_init(&top, q);
+  if (!topk_query(&top, t->tree, t->rows, t->count, t->index, plan,
+                  &scanned) ||
+      !topk_format(&top, &out->buf)) {
+    fprintf(stderr, "Error: out of memory ordering query %d\n",
+            out->query_no);
+  }
+  out->qt->rows_scanned += (double)scanned;
+  topk_free(&top);
 }
 
 /*
-Name: eval_expr():
-Parameters: const CarInventory *car, const char **p
+Name: batch_iter_cb():
+Parameters: const void *item, void *udata
 Return: bool
 Description:
 
-Evaluates a series of OR-connected terms, yielding the overall truth value of
-the WHERE clause for the given CarInventory record.
+btree iterator callback that tests one tuple against every batched query,
+stopping the traversal if a result cannot be buffered.
 */
-static bool eval_expr(const CarInventory *car, const char **p) {
-  bool result = eval_term(car, p);
-  const char *s = skip_ws(*p);
-  while (strncasecmp(s, "OR", 2) == 0) {
-    s += 2;
-    *p = s;
-    bool rhs = eval_term(car, p);
-    result = result || rhs;
-    s = skip_ws(*p);
-  }
-  *p = s;
-  return result;
+static bool batch_iter_cb(const void *item, void *udata) {
+  BatchIterCtx *ctx = (BatchIterCtx *)udata;
+  ctx->ok = batch_row(ctx->batch, (const CarInventory *)item, ctx->outs);
+  return ctx->ok;
 }
 
 /*
-Name: match_where():
-Parameters: const CarInventory *car, const char *where_raw
-Return: int
+Name: process_batch():
+Parameters: struct btree *tree, const ColumnTable *table,
+            const Query *queries, const QueryPlan *plans, int num_queries
+Return: Buffer *
 Description:
 
-Entry for WHERE clause evaluation that trims leading whitespace and runs the
-recursive descent parser, returning 1 when the car satisfies the predicate.
+Answers every non-aggregate query planned as PLAN_FULL_SCAN with one shared
+pass: a single btree_ascend() over the tuples, or one sweep over the column
+store blocks when table is not NULL. Returns num_queries Buffers indexed like
+queries (the non-batched ones stay empty), or NULL if the batch could not be
+run, in which case the caller scans query by query as usual.
 */
-int match_where(const CarInventory *car, const char *where_raw) {
-  const char *p = where_raw;
-  p = skip_ws(p);
-  if (*p == '\0') {
-    return 1;
+Buffer *process_batch(struct btree *tree, const ColumnTable *table,
+                      const Query *queries, const QueryPlan *plans,
+                      int num_queries) {
+  Buffer *outs = calloc((size_t)num_queries + 1, sizeof(Buffer));
+  int *members = malloc(((size_t)num_queries + 1) * sizeof(int));
+  int num_members = 0;
+  QueryBatch batch;
+  bool ok;
+
+  if (outs == NULL || members == NULL) {
+    free(outs);
+    free(members);
+    fprintf(stderr, "Warning: out of memory, --batch ignored\n");
+    return NULL;
   }
-  return eval_expr(car, &p) ? 1 : 0;
+  for (int i = 0; i < num_queries; i++) {
+    if (plans[i].path == PLAN_FULL_SCAN && !queries[i].aggregate &&
+        !queries[i].ordered) {
+      members[num_members++] = i;
+    }
+  }
+  ok = batch_init(&batch, queries, members, num_members, table);
+  free(members);
+
+  if (ok && table != NULL) {
+    BatchScratch scratch;
+    ok = batch_scratch_init(&scratch, &batch) &&
+         batch_scan_columnar(&batch, &scratch, 0, table->count, outs);
+    batch_scratch_free(&scratch, &batch);
+  } else if (ok) {
+    BatchIterCtx ctx = {.batch = &batch, .outs = outs, .ok = true};
+    btree_ascend(tree, NULL, batch_iter_cb, &ctx);
+    ok = ctx.ok;
+  }
+  batch_free(&batch);
+
+  if (!ok) {
+    for (int i = 0; i < num_queries; i++) {
+      buffer_free(&outs[i]);
+    }
+    free(outs);
+    fprintf(stderr, "Warning: out of memory, --batch ignored\n");
+    return NULL;
+  }
+  return outs;
 }
 
 /*
-Name: print_selected():
-Parameters: const CarInventory *car, Query *q
+Name: answer_query():
+Parameters: const SeqTables *t, const QueryPlan *plan, Query *q,
+            QueryOutput *out
 Return: void
 Description:
 
-Prints either every attribute or the requested subset of attributes for a car
-based on the SELECT clause captured in the Query structure.
+Runs q along its plan: aggregates through process_query_aggregate(), ORDER BY
+... LIMIT through process_query_ordered(), an ID range through the tree, an
+index lookup when the plan chose one (falling back to a full scan if it fails),
+and otherwise a full scan of the column store, of the rows with a specialized
+kernel when the WHERE clause fits one, or of the tree. The result is left in out
+for the caller's flush_output().
 */
-void print_selected(const CarInventory *car, Query *q) {
-  int i;
-  bool first = true;
-
-  if (q->num_select_attrs == 0 ||
-      (q->num_select_attrs == 1 && strcmp(q->select_attrs[0], "*") == 0)) {
-    printf("%d %s %d %s %d %s\n", car->ID, car->Model, car->YearMake,
-           car->Color, car->Price, car->Dealer);
-    return;
-  }
-
-  for (i = 0; i < q->num_select_attrs; i++) {
-    const char *attr = q->select_attrs[i];
-    if (!first) {
-      printf(" ");
-    }
-    if (strcasecmp(attr, "ID") == 0) {
-      printf("%d", car->ID);
-    } else if (strcasecmp(attr, "Model") == 0) {
-      printf("%s", car->Model);
-    } else if (strcasecmp(attr, "YearMake") == 0) {
-      printf("%d", car->YearMake);
-    } else if (strcasecmp(attr, "Color") == 0) {
-      printf("%s", car->Color);
-    } else if (strcasecmp(attr, "Price") == 0) {
-      printf("%d", car->Price);
-    } else if (strcasecmp(attr, "Dealer") == 0) {
-      printf("%s", car->Dealer);
+static void answer_query(const SeqTables *t, const QueryPlan *plan, Query *q,
+                         QueryOutput *out) {
+  if (q->aggregate) {
+    process_query_aggregate(t->rows, t->count, t->index, plan, q, out);
+  } else if (q->ordered) {
+    process_query_ordered(t, plan, q, out);
+  } else if (plan->path == PLAN_ID_RANGE) {
+    process_query_range(t->tree, plan, q, out);
+  } else if (plan->path == PLAN_FULL_SCAN ||
+             !process_query_indexed(t->index, t->rows, &plan->probe, q,
+                                    out)) {
+    ScanKernel kernel;
+
+    if (t->table != NULL) {
+      process_query_columnar(t->table, q, out);
+    } else if (kernel_compile(&kernel, &q->where)) {
+      process_query_kernel(&kernel, t->rows, t->count, q, out);
+    } else {
+      process_query(t->tree, q, out);
     }
-    first = false;
   }
-  printf("\n");
 }
+
 /*
-Name: process_iter_cb():
-Parameters: const void *item, void *udata
+Name: serve_queries():
+Parameters: QueryServer *server, SeqTables *t, ResidentTables *live,
+            bool explain
 Return: bool
 Description:
 
-btree iterator callback that filters each record via match_where() and prints
-matching tuples for the active query, always continuing the traversal.
+The --serve loop of main(). Before each query serve_next() returns, the
+tables are refreshed with refresh_tables() and t is pointed at what it left.
+The query is then planned against them, looked up in the result cache,
+answered with answer_query() into an in-memory sink and sent back with
+serve_reply(), so it gets the same lines a query file run would print.
+Prints how many queries were served once the server stops, and returns
+false if a reply could not be buffered at all or a refresh failed.
 */
-static bool process_iter_cb(const void *item, void *udata) {
-  const CarInventory *car = (const CarInventory *)item;
-  ProcessCtx *ctx = (ProcessCtx *)udata;
-  if (match_where(car, ctx->q->where_raw)) {
-    print_selected(car, ctx->q);
+bool serve_queries(QueryServer *server, SeqTables *t, ResidentTables *live,
+                   bool explain) {
+  QueryCache *qcache = live->cache;
+  QueryOutput out;
+  QueryTiming qt;
+  Query q;
+  QueryPlan plan;
+  bool ok = true;
+
+  printf("Serving queries from %s\n",
+         server->path != NULL ? server->path : "stdin");
+  fflush(stdout);
+  buffer_init(&out.buf);
+  out.query_no = 1;
+  out.capture = NULL;
+  out.qt = &qt;
+  while (serve_next(server, &q)) {
+    OutputSink reply;
+    char *data = NULL;
+    size_t len = 0;
+    double start = timing_now();
+
+    if (refresh_tables(live) == REFRESH_FAILED) {
+      serve_error(server, "out of memory");
+      ok = false;
+      break;
+    }
+    t->table = live->table;
+    t->index = live->index;
+    t->rows = live->loaded->rows;
+    t->count = live->loaded->count;
+    memset(&qt, 0, sizeof(qt));
+    plan_query(live->stats, t->index,
+               t->table != NULL ? QPE_COST_COLUMNAR_SCAN : QPE_COST_ROW_SCAN,
+               &q.where, &plan);
+    if (qcache != NULL) {
+      cache_plan(qcache, &q, &plan);
+    }
+    if (explain) {
+      plan_explain(stderr, (int)server->served + 1, &q.where, &plan);
+    }
+    if (!output_open_memory(&reply, &data, &len)) {
+      ok = false;
+      break;
+    }
+    out.sink = &reply;
+    if (plan.path == PLAN_CACHED) {
+      output_write(&reply, 1, plan.cached, plan.cached_len);
+    } else {
+      answer_query(t, &plan, &q, &out);
+      flush_output(&out);
+    }
+    if (!output_close(&reply)) {
+      serve_error(server, "out of memory");
+    } else {
+      if (qcache != NULL && plan.path != PLAN_CACHED) {
+        cache_store(qcache, &q, data, len);
+      }
+      serve_reply(server, data, len, timing_now() - start);
+    }
+    free(data);
   }
-  return true;
+  buffer_free(&out.buf);
+
+  printf("\nServed %lld queries in %.6f seconds (%.6f s mean)\n",
+         server->served, server->seconds,
+         server->served > 0 ? server->seconds / server->served : 0.0);
+  printf("  Refreshes: %lld appends (%zu tuples), %lld reloads, %.6f "
+         "seconds\n",
+         live->appends, live->rows_added, live->reloads, live->seconds);
+  if (qcache != NULL) {
+    printf("  Result cache: %lld hits, %lld misses, %lld dropped\n",
+           qcache->hits, qcache->misses, qcache->dropped);
+  }
+  return ok;
 }
 
 /*
-Name: process_query():
-Parameters: struct btree *tree, Query *q
-Return: void
+Name: run_stream():
+Parameters: const QPEOptions *opts, RunTiming *timing, OutputSink *sink
+Return: int
 Description:
 
-Initializes iterator state and scans the entire B-tree, invoking the callback
-to test each record sequentially against the query's WHERE clause.
+The --mem-limit path of main(). Streams the database through a StreamReader
+and answers every query with one shared pass (QPEBatch.c) over each block,
+keeping the results in a StreamOutput that spills past its budget. Aggregate
+queries fold every block into their own AggTable instead, and ORDER BY ...
+LIMIT queries into their own TopK; their groups and rows join the
+StreamOutput after the last block. Prints the same lines as a normal run,
+then the timing summary, and returns the exit status for main(). Time spent
+waiting for the reader is charged to the load phase, the rest of the pass to
+filter.
 */
-void process_query(struct btree *tree, Query *q) {
-  ProcessCtx ctx = {.q = q};
-  btree_ascend(tree, NULL, process_iter_cb, &ctx);
+int run_stream(const QPEOptions *opts, RunTiming *timing, OutputSink *sink) {
+  TimingSummary summary;
+  StreamReader reader;
+  StreamOutput out;
+  QueryBatch batch;
+  CarInventory first[11];
+  const CarInventory *rows;
+  Query *queries = NULL;
+  AggTable *aggs = NULL;
+  TopK *tops = NULL;
+  int *members = NULL;
+  int num_members = 0;
+  int num_queries = 0;
+  size_t count;
+  size_t total = 0;
+  double mark = timing->start;
+  double pass;
+  bool ok;
+
+  memset(&out, 0, sizeof(out));
+  if (opts->layout == LAYOUT_COLUMNAR || opts->use_index || opts->explain ||
+      opts->cache) {
+    fprintf(stderr, "Warning: --layout, --index, --explain and --cache are "
+                    "ignored with --mem-limit\n");
+  }
+
+  load_queries(opts->query_file, &queries, &num_queries);
+  members = malloc(((size_t)num_queries + 1) * sizeof(int));
+  aggs = calloc((size_t)num_queries + 1, sizeof(AggTable));
+  tops = calloc((size_t)num_queries + 1, sizeof(TopK));
+  if (members == NULL || aggs == NULL || tops == NULL ||
+      !timing_queries(timing, num_queries)) {
+    fprintf(stderr, "Error: out of memory planning queries\n");
+    free(members);
+    free(aggs);
+    free(tops);
+    free(queries);
+    timing_free(timing);
+    return 1;
+  }
+  ok = true;
+  for (int i = 0; i < num_queries; i++) {
+    if (queries[i].aggregate) {
+      ok = agg_init(&aggs[i], &queries[i]) && ok;
+    } else if (queries[i].ordered) {
+      topk_init(&tops[i], &queries[i]);
+    } else {
+      members[num_members++] = i;
+    }
+  }
+  ok = ok && batch_init(&batch, queries, members, num_members, NULL);
+  free(members);
+  if (!ok || !stream_output_init(&out, num_queries,
+                                 stream_output_budget(opts->mem_limit),
+                                 timing->queries)) {
+    fprintf(stderr, "Error: out of memory planning queries\n");
+    if (ok) {
+      batch_free(&batch);
+    }
+    stream_output_free(&out);
+    for (int i = 0; i < num_queries; i++) {
+      agg_free(&aggs[i]);
+    }
+    free(aggs);
+    free(tops);
+    free(queries);
+    timing_free(timing);
+    return 1;
+  }
+  if (!stream_open(&reader, opts->db_file,
+                   stream_block_bytes(opts->mem_limit))) {
+    fprintf(stderr, "Error: Failed to load database from %s\n",
+            opts->db_file);
+    batch_free(&batch);
+    stream_output_free(&out);
+    for (int i = 0; i < num_queries; i++) {
+      agg_free(&aggs[i]);
+    }
+    free(aggs);
+    free(tops);
+    free(queries);
+    timing_free(timing);
+    return 1;
+  }
+  mark = timing_lap(timing, TIME_MATERIALIZE, mark);
+
+  while (ok && stream_next(&reader, &rows, &count)) {
+    for (size_t i = 0; ok && i < count; i++) {
+      ok = batch_row_tagged(&batch, &rows[i], out.bufs, out.tags);
+    }
+    for (int i = 0; ok && i < num_queries; i++) {
+      size_t scanned = 0;
+      if (queries[i].aggregate) {
+        ok = agg_scan(&aggs[i], rows, 0, count);
+      } else if (queries[i].ordered) {
+        ok = topk_scan(&tops[i], rows, 0, count, &scanned);
+      }
+    }
+    for (size_t i = 0; total + i < 11 && i < count; i++) {
+      first[total + i] = rows[i];
+    }
+    total += count;
+    if (!ok) {
+      fprintf(stderr, "Error: out of memory buffering results\n");
+    }
+    ok = ok && stream_output_check(&out);
+  }
+  if (reader.failed) {
+    fprintf(stderr, "Error: Failed to load database from %s\n",
+            opts->db_file);
+    ok = false;
+  }
+  mark = timing_lap(timing, TIME_FILTER, mark);
+  pass = timing->value[TIME_FILTER];
+  timing->value[TIME_FILTER] -= reader.wait_seconds;
+  timing->value[TIME_LOAD] += reader.wait_seconds;
+  stream_close(&reader);
+  batch_free(&batch);
+  for (int i = 0; i < num_queries; i++) {
+    if (ok && queries[i].aggregate &&
+        !stream_output_groups(&out, i, &aggs[i])) {
+      fprintf(stderr, "Error: out of memory buffering results\n");
+      ok = false;
+    }
+    if (ok && queries[i].ordered && !stream_output_top(&out, i, &tops[i])) {
+      fprintf(stderr, "Error: out of memory buffering results\n");
+      ok = false;
+    }
+    agg_free(&aggs[i]);
+    topk_free(&tops[i]);
+  }
+  free(aggs);
+  free(tops);
+
+  if (ok) {
+    printf("Loaded %zu tuples from %s\n", total, opts->db_file);
+    if (total <= 10) {
+      printf("Printing all tuples for debugging:\n");
+      for (size_t i = 0; i < total; i++) {
+        print_iter(&first[i], NULL);
+      }
+    }
+    printf("Processing %d queries from %s\n", num_queries, opts->query_file);
+    for (int i = 0; i < num_queries; i++) {
+      timing->queries[i].rows_scanned = (double)total;
+      timing->queries[i].seconds = timing->value[TIME_FILTER] / num_queries;
+    }
+    ok = stream_output_write(&out, sink);
+    ok = output_close(sink) && ok;
+    timing_lap(timing, TIME_OUTPUT, mark);
+  }
+  timing_finish(timing);
+  timing_summary_local(timing, &summary);
+
+  if (ok) {
+    printf("\nTiming Summary (sequential, wall clock):\n");
+    printf("  Total time: %.6f seconds\n", timing->value[TIME_TOTAL]);
+    printf("  Streamed %.1f MB in %zu KB blocks (%.1f MB/s), %.1f MB "
+           "spilled\n",
+           reader.bytes_read / 1e6, reader.block_bytes >> 10,
+           pass > 0 ? reader.bytes_read / 1e6 / pass : 0.0,
+           out.spilled / 1e6);
+    timing_print(stdout, &summary);
+  }
+
+  if (ok && opts->timing_file != NULL) {
+    TimingInfo info = {.engine = "qpe_seq",
+                       .db_file = opts->db_file,
+                       .query_file = opts->query_file,
+                       .layout = "stream",
+                       .mode = NULL,
+                       .processes = 1,
+                       .threads = 1,
+                       .tuples = (long long)total};
+    timing_write(opts->timing_file, &info, &summary, timing->queries,
+                 timing->num_queries);
+  }
+  stream_output_free(&out);
+  free(queries);
+  timing_free(timing);
+
+  return ok ? 0 : 1;
 }
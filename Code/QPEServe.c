@@ -0,0 +1,322 @@
+/*
+
+QPEServe.c
+
+Authors:
+    Aidan Levy
+    Maddie Powell
+    Nick Corcoran
+    Austin Phalines
+    Dean Bullock
+
+Creation Date: 10-14-2026
+
+Description:
+
+Request loop for --serve (see QPEServe.h). serve_open() picks the endpoint:
+on stdin the replies get their own duplicate of the original stdout and
+stdout itself is pointed at stderr, so the engines' progress lines and
+summaries can never end up inside a reply; with a socket path a Unix domain
+socket is bound there and clients are served one after another. The engine
+then calls serve_next() for each query, answers it with its usual code, and
+hands the lines to serve_reply(). Requests are parsed with parse_query(), so
+the server accepts exactly what a query file may hold.
+
+*/
+
+#include <ctype.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "QPEServe.h"
+
+/*
+Function Prototypes
+*/
+static bool accept_client(QueryServer *s);
+static void drop_client(QueryServer *s);
+static bool is_command(const char *line, const char *word);
+
+/*
+Name: serve_options():
+Parameters: QPEOptions *opts
+Return: void
+Description:
+
+Warns about and switches off the options that only make sense for a query
+file: every reply is written to its client as soon as it is ready, and
+nothing is batched, streamed or logged.
+*/
+void serve_options(QPEOptions *opts) {
+  if (opts->batch || opts->numa || opts->output_file != NULL ||
+      opts->timing_file != NULL || opts->mem_limit > 0) {
+    fprintf(stderr, "Warning: --batch, --numa, --output, --timing and "
+                    "--mem-limit are ignored with --serve\n");
+  }
+  opts->batch = false;
+  opts->numa = false;
+  opts->output_file = NULL;
+  opts->timing_file = NULL;
+  opts->mem_limit = 0;
+}
+
+/*
+Name: serve_open():
+Parameters: QueryServer *s, const char *path
+Return: bool
+Description:
+
+Starts serving on stdin and stdout when path is NULL, or on a Unix domain
+socket bound at path (replacing any file there) otherwise. Call it before
+printing anything, so stdin mode can move stdout aside first. Returns false,
+after reporting why, if the socket cannot be set up.
+*/
+bool serve_open(QueryServer *s, const char *path) {
+  struct sockaddr_un addr;
+
+  memset(s, 0, sizeof(*s));
+  s->path = path;
+  s->listen_fd = -1;
+  if (path == NULL) {
+    int fd;
+    fflush(stdout);
+    fd = dup(STDOUT_FILENO);
+    s->out = fd >= 0 ? fdopen(fd, "w") : NULL;
+    if (s->out == NULL || dup2(STDERR_FILENO, STDOUT_FILENO) < 0) {
+      perror("--serve");
+      return false;
+    }
+    s->in = stdin;
+    return true;
+  }
+
+  if (strlen(path) >= sizeof(addr.sun_path)) {
+    fprintf(stderr, "Error: socket path too long: %s\n", path);
+    return false;
+  }
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, path);
+  /* A client that hangs up mid-reply must not kill the server. */
+  signal(SIGPIPE, SIG_IGN);
+  s->listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (s->listen_fd < 0) {
+    perror("socket");
+    return false;
+  }
+  unlink(path);
+  if (bind(s->listen_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+      listen(s->listen_fd, 8) != 0) {
+    perror(path);
+    close(s->listen_fd);
+    s->listen_fd = -1;
+    return false;
+  }
+  return true;
+}
+
+/*
+Name: accept_client():
+Parameters: QueryServer *s
+Return: bool
+Description:
+
+Waits for the next client of the socket and makes it the current one.
+Returns false if accepting fails for any reason but a signal.
+*/
+static bool accept_client(QueryServer *s) {
+  int fd;
+
+  do {
+    fd = accept(s->listen_fd, NULL, NULL);
+  } while (fd < 0 && errno == EINTR);
+  if (fd < 0) {
+    perror("accept");
+    return false;
+  }
+  s->in = fdopen(fd, "r");
+  s->out = s->in ? fdopen(dup(fd), "w") : NULL;
+  if (s->out == NULL) {
+    perror("fdopen");
+    if (s->in) {
+      fclose(s->in);
+    } else {
+      close(fd);
+    }
+    s->in = NULL;
+    return false;
+  }
+  return true;
+}
+
+/*
+Name: drop_client():
+Parameters: QueryServer *s
+Return: void
+Description:
+
+Closes the current client's connection.
+*/
+static void drop_client(QueryServer *s) {
+  fclose(s->in);
+  fclose(s->out);
+  s->in = NULL;
+  s->out = NULL;
+}
+
+/*
+Name: is_command():
+Parameters: const char *line, const char *word
+Return: bool
+Description:
+
+Whether the request line is word alone, in any case, with optional
+surrounding whitespace and ';'.
+*/
+static bool is_command(const char *line, const char *word) {
+  size_t n = strlen(word);
+
+  while (isspace((unsigned char)*line)) {
+    line++;
+  }
+  if (strncasecmp(line, word, n) != 0) {
+    return false;
+  }
+  for (line += n; *line; line++) {
+    if (!isspace((unsigned char)*line) && *line != ';') {
+      return false;
+    }
+  }
+  return true;
+}
+
+/*
+Name: serve_next():
+Parameters: QueryServer *s, Query *q
+Return: bool
+Description:
+
+Reads requests until one is a valid query, which is parsed into q, and
+returns true. Blank lines are skipped and anything else is answered with an
+ERROR line. On a socket, a client that disconnects or sends QUIT is closed
+and the next one accepted. Returns false once the server should stop: stdin
+ended or sent QUIT, a client sent SHUTDOWN, or accepting failed.
+*/
+bool serve_next(QueryServer *s, Query *q) {
+  char line[QPE_SERVE_LINE_MAX];
+
+  for (;;) {
+    size_t len;
+
+    if (s->in == NULL && !accept_client(s)) {
+      return false;
+    }
+    if (fgets(line, sizeof(line), s->in) == NULL) {
+      if (s->listen_fd < 0) {
+        return false;
+      }
+      drop_client(s);
+      continue;
+    }
+    len = strlen(line);
+    if (len == sizeof(line) - 1 && line[len - 1] != '\n') {
+      int c;
+      while ((c = fgetc(s->in)) != EOF && c != '\n') {
+      }
+      serve_error(s, "request too long");
+      continue;
+    }
+    if (is_command(line, "")) {
+      continue;
+    }
+    if (is_command(line, "SHUTDOWN")) {
+      return false;
+    }
+    if (is_command(line, "QUIT")) {
+      if (s->listen_fd < 0) {
+        return false;
+      }
+      drop_client(s);
+      continue;
+    }
+    if (parse_query(line, q)) {
+      return true;
+    }
+    serve_error(s, "invalid query");
+  }
+}
+
+/*
+Name: serve_reply():
+Parameters: QueryServer *s, const char *data, size_t len, double seconds
+Return: void
+Description:
+
+Answers the query serve_next() returned: the OK header with the row and byte
+counts and the time the engine took, then the len bytes of result lines. A
+socket client that cannot be written to any more is dropped.
+*/
+void serve_reply(QueryServer *s, const char *data, size_t len,
+                 double seconds) {
+  size_t rows = 0;
+
+  for (size_t i = 0; i < len; i++) {
+    rows += data[i] == '\n';
+  }
+  fprintf(s->out, "OK %zu %zu %.6f\n", rows, len, seconds);
+  if (len > 0) {
+    fwrite(data, 1, len, s->out);
+  }
+  s->served++;
+  s->seconds += seconds;
+  if (fflush(s->out) != 0 && s->listen_fd >= 0) {
+    drop_client(s);
+  }
+}
+
+/*
+Name: serve_error():
+Parameters: QueryServer *s, const char *reason
+Return: void
+Description:
+
+Answers the current request with an ERROR line.
+*/
+void serve_error(QueryServer *s, const char *reason) {
+  fprintf(s->out, "ERROR %s\n", reason);
+  if (fflush(s->out) != 0 && s->listen_fd >= 0) {
+    drop_client(s);
+  }
+}
+
+/*
+Name: serve_close():
+Parameters: QueryServer *s
+Return: void
+Description:
+
+Closes the current client and the socket, removing its file, or the reply
+stream of stdin mode. Does nothing when s is NULL.
+*/
+void serve_close(QueryServer *s) {
+  if (s == NULL) {
+    return;
+  }
+  if (s->listen_fd >= 0) {
+    if (s->in != NULL) {
+      drop_client(s);
+    }
+    close(s->listen_fd);
+    unlink(s->path);
+  } else if (s->out != NULL) {
+    fclose(s->out);
+  }
+  memset(s, 0, sizeof(*s));
+  s->listen_fd = -1;
+}
@@ -0,0 +1,60 @@
+/*
+
+QPEServe.h
+
+Request loop for --serve (see QPEServe.c). Instead of answering a query file
+and exiting, an engine loads the database, builds its column store and
+indexes once, and then answers queries as they arrive, one at a time, from
+stdin (--serve) or from clients of a Unix domain socket (--serve=PATH),
+until its input ends or a client sends SHUTDOWN.
+
+The protocol is one request per line. A request is a query in the query file
+syntax, QUIT (close this connection) or SHUTDOWN (stop the server). Every
+query gets a header line
+
+    OK <rows> <bytes> <seconds>
+
+followed by exactly <bytes> bytes of result lines, as the engine would print
+them, or the single line "ERROR <reason>" when the request is not a valid
+query. With --serve on stdin the replies go to stdout and everything the
+engine prints besides them goes to stderr.
+
+*/
+
+#ifndef QPE_SERVE_H
+#define QPE_SERVE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#include "QPEOptions.h"
+#include "QPEQuery.h"
+
+/* Longest request line accepted. */
+#define QPE_SERVE_LINE_MAX 1024
+
+/*
+Struct Definitions
+*/
+typedef struct {
+  const char *path; /* Unix socket path, NULL for stdin/stdout */
+  int listen_fd;    /* listening socket, -1 for stdin/stdout */
+  FILE *in;         /* the current client's requests, NULL between clients */
+  FILE *out;        /* replies to it */
+  long long served; /* queries answered */
+  double seconds;   /* time spent answering them */
+} QueryServer;
+
+/*
+Function Prototypes
+*/
+void serve_options(QPEOptions *opts);
+bool serve_open(QueryServer *s, const char *path);
+bool serve_next(QueryServer *s, Query *q);
+void serve_reply(QueryServer *s, const char *data, size_t len,
+                 double seconds);
+void serve_error(QueryServer *s, const char *reason);
+void serve_close(QueryServer *s);
+
+#endif
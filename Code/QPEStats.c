@@ -0,0 +1,596 @@
+/*
+
+QPEStats.c
+
+Authors:
+    Aidan Levy
+    Maddie Powell
+    Nick Corcoran
+    Austin Phalines
+    Dean Bullock
+
+Creation Date: 10-14-2026
+
+Description:
+
+Collects the column statistics described in QPEStats.h and turns them into
+selectivity estimates (the fraction of rows a single comparison accepts).
+
+- Columns with exact value counts are answered exactly, for every operator,
+  by summing the counts of the values that satisfy the comparison (strings
+  with the same strcasecmp() rule as match_where()).
+- Otherwise integer comparisons interpolate inside the equi-depth histogram,
+  and equality uses the sample frequency (1 / rows for a unique key like ID).
+- Otherwise string comparisons fall back to fixed guesses.
+
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "QPEStats.h"
+
+/* Guesses for string columns whose values were not all counted. */
+#define QPE_DEFAULT_EQ_SEL 0.01
+#define QPE_DEFAULT_RANGE_SEL (1.0 / 3.0)
+
+/*
+Function Prototypes
+*/
+static void int_stats_init(IntColumnStats *col);
+static void int_stats_count(IntColumnStats *col, int value);
+static void str_stats_count(StrColumnStats *col, const char *value);
+static void sample_row(TableStats *stats, const CarInventory *car);
+static void int_stats_merge(IntColumnStats *into, const IntColumnStats *from);
+static void str_stats_merge(StrColumnStats *into, const StrColumnStats *from);
+static uint64_t next_random(TableStats *stats);
+static void merge_samples(TableStats *into, const TableStats *from);
+static int compare_ints(const void *a, const void *b);
+static void int_stats_finish(IntColumnStats *col);
+static double hist_fraction_below(const IntColumnStats *col, long long x);
+static const IntColumnStats *int_column(const TableStats *stats,
+                                        ColumnId column);
+static const StrColumnStats *str_column(const TableStats *stats,
+                                        ColumnId column);
+
+/*
+Name: stats_init():
+Parameters: TableStats *stats
+Return: void
+Description:
+
+Resets stats to an empty table, ready for stats_add().
+*/
+void stats_init(TableStats *stats) {
+  memset(stats, 0, sizeof(*stats));
+  stats->rng = 0x9E3779B97F4A7C15ULL;
+  int_stats_init(&stats->id);
+  int_stats_init(&stats->year_make);
+  int_stats_init(&stats->price);
+}
+
+/*
+Name: int_stats_init():
+Parameters: IntColumnStats *col
+Return: void
+Description:
+
+Starts an integer column with an empty min/max range.
+*/
+static void int_stats_init(IntColumnStats *col) {
+  col->min = 0;
+  col->max = -1;
+  col->sample_unique = true;
+}
+
+/*
+Name: int_stats_count():
+Parameters: IntColumnStats *col, int value
+Return: void
+Description:
+
+Updates min/max and the exact per-value counts (until the column has more than
+QPE_STATS_MAX_VALUES distinct values, after which only min/max are kept).
+*/
+static void int_stats_count(IntColumnStats *col, int value) {
+  if (col->min > col->max) {
+    col->min = value;
+    col->max = value;
+  } else if (value < col->min) {
+    col->min = value;
+  } else if (value > col->max) {
+    col->max = value;
+  }
+
+  if (col->num_values < 0) {
+    return;
+  }
+  for (int i = 0; i < col->num_values; i++) {
+    if (col->values[i] == value) {
+      col->counts[i]++;
+      return;
+    }
+  }
+  if (col->num_values == QPE_STATS_MAX_VALUES) {
+    col->num_values = -1;
+    return;
+  }
+  col->values[col->num_values] = value;
+  col->counts[col->num_values++] = 1;
+}
+
+/*
+Name: str_stats_count():
+Parameters: StrColumnStats *col, const char *value
+Return: void
+Description:
+
+Counts value in a string column, treating values that differ only in case as
+one, until the column exceeds QPE_STATS_MAX_VALUES distinct values.
+*/
+static void str_stats_count(StrColumnStats *col, const char *value) {
+  if (col->num_values < 0) {
+    return;
+  }
+  for (int i = 0; i < col->num_values; i++) {
+    if (strcasecmp(col->values[i], value) == 0) {
+      col->counts[i]++;
+      return;
+    }
+  }
+  if (col->num_values == QPE_STATS_MAX_VALUES) {
+    col->num_values = -1;
+    return;
+  }
+  strncpy(col->values[col->num_values], value, 19);
+  col->values[col->num_values][19] = '\0';
+  col->counts[col->num_values++] = 1;
+}
+
+/*
+Name: sample_row():
+Parameters: TableStats *stats, const CarInventory *car
+Return: void
+Description:
+
+Reservoir sampling (Algorithm R) over the integer columns: the first
+QPE_STATS_SAMPLE rows fill the sample, and row n then replaces a random slot
+with probability QPE_STATS_SAMPLE / n. A fixed-seed xorshift keeps the
+statistics (and so the plans) identical across runs.
+*/
+static void sample_row(TableStats *stats, const CarInventory *car) {
+  size_t slot;
+
+  if (stats->num_rows <= QPE_STATS_SAMPLE) {
+    slot = stats->num_rows - 1;
+    stats->id.sample_len = stats->year_make.sample_len =
+        stats->price.sample_len = (int)stats->num_rows;
+  } else {
+    slot = (size_t)(next_random(stats) % stats->num_rows);
+    if (slot >= QPE_STATS_SAMPLE) {
+      return;
+    }
+  }
+  stats->id.sample[slot] = car->ID;
+  stats->year_make.sample[slot] = car->YearMake;
+  stats->price.sample[slot] = car->Price;
+}
+
+/*
+Name: next_random():
+Parameters: TableStats *stats
+Return: uint64_t
+Description:
+
+Advances the xorshift generator behind the reservoir sample.
+*/
+static uint64_t next_random(TableStats *stats) {
+  stats->rng ^= stats->rng << 13;
+  stats->rng ^= stats->rng >> 7;
+  stats->rng ^= stats->rng << 17;
+  return stats->rng;
+}
+
+/*
+Name: stats_add():
+Parameters: TableStats *stats, const CarInventory *car
+Return: void
+Description:
+
+Accounts for one loaded tuple in every column's statistics.
+*/
+void stats_add(TableStats *stats, const CarInventory *car) {
+  stats->num_rows++;
+  int_stats_count(&stats->id, car->ID);
+  int_stats_count(&stats->year_make, car->YearMake);
+  int_stats_count(&stats->price, car->Price);
+  str_stats_count(&stats->model, car->Model);
+  str_stats_count(&stats->color, car->Color);
+  str_stats_count(&stats->dealer, car->Dealer);
+  sample_row(stats, car);
+}
+
+/*
+Name: int_stats_merge():
+Parameters: IntColumnStats *into, const IntColumnStats *from
+Return: void
+Description:
+
+Folds the min/max and exact value counts of from into into. The result
+gives up exact counts when the two columns together exceed
+QPE_STATS_MAX_VALUES distinct values.
+*/
+static void int_stats_merge(IntColumnStats *into, const IntColumnStats *from) {
+  if (from->min > from->max) {
+    return;
+  }
+  if (into->min > into->max) {
+    into->min = from->min;
+    into->max = from->max;
+  } else {
+    into->min = from->min < into->min ? from->min : into->min;
+    into->max = from->max > into->max ? from->max : into->max;
+  }
+
+  if (into->num_values < 0 || from->num_values < 0) {
+    into->num_values = -1;
+    return;
+  }
+  for (int j = 0; j < from->num_values && into->num_values >= 0; j++) {
+    int i = 0;
+    while (i < into->num_values && into->values[i] != from->values[j]) {
+      i++;
+    }
+    if (i == into->num_values) {
+      if (i == QPE_STATS_MAX_VALUES) {
+        into->num_values = -1;
+        break;
+      }
+      into->values[i] = from->values[j];
+      into->counts[i] = 0;
+      into->num_values++;
+    }
+    into->counts[i] += from->counts[j];
+  }
+}
+
+/*
+Name: str_stats_merge():
+Parameters: StrColumnStats *into, const StrColumnStats *from
+Return: void
+Description:
+
+String column counterpart of int_stats_merge(), matching values with
+strcasecmp() as str_stats_count() does.
+*/
+static void str_stats_merge(StrColumnStats *into, const StrColumnStats *from) {
+  if (into->num_values < 0 || from->num_values < 0) {
+    into->num_values = -1;
+    return;
+  }
+  for (int j = 0; j < from->num_values; j++) {
+    int i = 0;
+    while (i < into->num_values &&
+           strcasecmp(into->values[i], from->values[j]) != 0) {
+      i++;
+    }
+    if (i == into->num_values) {
+      if (i == QPE_STATS_MAX_VALUES) {
+        into->num_values = -1;
+        return;
+      }
+      memcpy(into->values[i], from->values[j], sizeof(into->values[i]));
+      into->counts[i] = 0;
+      into->num_values++;
+    }
+    into->counts[i] += from->counts[j];
+  }
+}
+
+/*
+Name: merge_samples():
+Parameters: TableStats *into, const TableStats *from
+Return: void
+Description:
+
+Combines two row samples into one of at most QPE_STATS_SAMPLE rows. When
+both together fit every row is kept; otherwise each slot is drawn from one
+side with probability proportional to the rows that side stands for, so the
+merged sample stays uniform over both tables. into->num_rows must not yet
+include from.
+*/
+static void merge_samples(TableStats *into, const TableStats *from) {
+  int la = into->id.sample_len;
+  int lb = from->id.sample_len;
+  int ids[QPE_STATS_SAMPLE], years[QPE_STATS_SAMPLE], prices[QPE_STATS_SAMPLE];
+  double wa = (double)into->num_rows;
+  double wb = (double)from->num_rows;
+  int ia = 0;
+  int ib = 0;
+  int n = 0;
+
+  if (la + lb <= QPE_STATS_SAMPLE) {
+    memcpy(into->id.sample + la, from->id.sample, (size_t)lb * sizeof(int));
+    memcpy(into->year_make.sample + la, from->year_make.sample,
+           (size_t)lb * sizeof(int));
+    memcpy(into->price.sample + la, from->price.sample,
+           (size_t)lb * sizeof(int));
+    into->id.sample_len = into->year_make.sample_len =
+        into->price.sample_len = la + lb;
+    return;
+  }
+
+  /* Reservoir slots are interchangeable, so each side is taken in order. */
+  while (n < QPE_STATS_SAMPLE && (ia < la || ib < lb)) {
+    double r = (double)(next_random(into) >> 11) / 9007199254740992.0;
+    bool take_a = ib == lb || (ia < la && r * (wa + wb) < wa);
+    if (take_a) {
+      ids[n] = into->id.sample[ia];
+      years[n] = into->year_make.sample[ia];
+      prices[n] = into->price.sample[ia];
+      ia++;
+    } else {
+      ids[n] = from->id.sample[ib];
+      years[n] = from->year_make.sample[ib];
+      prices[n] = from->price.sample[ib];
+      ib++;
+    }
+    n++;
+  }
+  memcpy(into->id.sample, ids, (size_t)n * sizeof(int));
+  memcpy(into->year_make.sample, years, (size_t)n * sizeof(int));
+  memcpy(into->price.sample, prices, (size_t)n * sizeof(int));
+  into->id.sample_len = into->year_make.sample_len = into->price.sample_len =
+      n;
+}
+
+/*
+Name: stats_merge():
+Parameters: TableStats *into, const TableStats *from
+Return: void
+Description:
+
+Adds the statistics of another part of the table (gathered with stats_add()
+but not yet finished) to into, for loaders that read the table in pieces.
+Counts and min/max are exact; the merged sample is a uniform sample of both
+parts. Call stats_finish() on into once every part is merged.
+*/
+void stats_merge(TableStats *into, const TableStats *from) {
+  if (from->num_rows == 0) {
+    return;
+  }
+  merge_samples(into, from);
+  into->num_rows += from->num_rows;
+  int_stats_merge(&into->id, &from->id);
+  int_stats_merge(&into->year_make, &from->year_make);
+  int_stats_merge(&into->price, &from->price);
+  str_stats_merge(&into->model, &from->model);
+  str_stats_merge(&into->color, &from->color);
+  str_stats_merge(&into->dealer, &from->dealer);
+}
+
+/*
+Name: compare_ints():
+Parameters: const void *a, const void *b
+Return: int
+Description:
+
+qsort() comparator for ascending ints.
+*/
+static int compare_ints(const void *a, const void *b) {
+  int x = *(const int *)a;
+  int y = *(const int *)b;
+  return (x > y) - (x < y);
+}
+
+/*
+Name: int_stats_finish():
+Parameters: IntColumnStats *col
+Return: void
+Description:
+
+Sorts the column's sample and picks QPE_HIST_BUCKETS + 1 equi-depth edges
+from it, pinning the outer edges to the exact min and max.
+*/
+static void int_stats_finish(IntColumnStats *col) {
+  int n = col->sample_len;
+
+  if (n == 0) {
+    return;
+  }
+  qsort(col->sample, (size_t)n, sizeof(int), compare_ints);
+  for (int i = 1; i < n; i++) {
+    if (col->sample[i] == col->sample[i - 1]) {
+      col->sample_unique = false;
+      break;
+    }
+  }
+  for (int b = 0; b <= QPE_HIST_BUCKETS; b++) {
+    col->bounds[b] = col->sample[(long long)b * (n - 1) / QPE_HIST_BUCKETS];
+  }
+  col->bounds[0] = col->min;
+  col->bounds[QPE_HIST_BUCKETS] = col->max;
+}
+
+/*
+Name: stats_finish():
+Parameters: TableStats *stats
+Return: void
+Description:
+
+Builds the histograms once every row has been added.
+*/
+void stats_finish(TableStats *stats) {
+  int_stats_finish(&stats->id);
+  int_stats_finish(&stats->year_make);
+  int_stats_finish(&stats->price);
+}
+
+/*
+Name: hist_fraction_below():
+Parameters: const IntColumnStats *col, long long x
+Return: double
+Description:
+
+Estimates the fraction of rows whose value is < x, assuming values are spread
+evenly inside each equi-depth bucket.
+*/
+static double hist_fraction_below(const IntColumnStats *col, long long x) {
+  if (col->sample_len == 0 || x <= col->min) {
+    return 0.0;
+  }
+  if (x > col->max) {
+    return 1.0;
+  }
+  for (int b = 0; b < QPE_HIST_BUCKETS; b++) {
+    long long lo = col->bounds[b];
+    long long hi = (long long)col->bounds[b + 1] + 1;
+    if (x < hi) {
+      double within = x > lo ? (double)(x - lo) / (double)(hi - lo) : 0.0;
+      return ((double)b + within) / QPE_HIST_BUCKETS;
+    }
+  }
+  return 1.0;
+}
+
+/*
+Name: int_column():
+Parameters: const TableStats *stats, ColumnId column
+Return: const IntColumnStats *
+Description:
+
+Maps an integer ColumnId to its statistics, or NULL for other columns.
+*/
+static const IntColumnStats *int_column(const TableStats *stats,
+                                        ColumnId column) {
+  switch (column) {
+  case COL_ID:
+    return &stats->id;
+  case COL_YEARMAKE:
+    return &stats->year_make;
+  case COL_PRICE:
+    return &stats->price;
+  default:
+    return NULL;
+  }
+}
+
+/*
+Name: str_column():
+Parameters: const TableStats *stats, ColumnId column
+Return: const StrColumnStats *
+Description:
+
+Maps a string ColumnId to its statistics, or NULL for other columns.
+*/
+static const StrColumnStats *str_column(const TableStats *stats,
+                                        ColumnId column) {
+  switch (column) {
+  case COL_MODEL:
+    return &stats->model;
+  case COL_COLOR:
+    return &stats->color;
+  case COL_DEALER:
+    return &stats->dealer;
+  default:
+    return NULL;
+  }
+}
+
+/*
+Name: stats_int_selectivity():
+Parameters: const TableStats *stats, ColumnId column, CompareOp op,
+            int literal
+Return: double
+Description:
+
+Estimated fraction of rows for which "column op literal" holds on an integer
+column.
+*/
+double stats_int_selectivity(const TableStats *stats, ColumnId column,
+                             CompareOp op, int literal) {
+  const IntColumnStats *col = int_column(stats, column);
+  double rows = (double)stats->num_rows;
+  double eq;
+
+  if (col == NULL || stats->num_rows == 0) {
+    return 1.0;
+  }
+
+  if (col->num_values >= 0) {
+    size_t hits = 0;
+    for (int i = 0; i < col->num_values; i++) {
+      int cmp = (col->values[i] > literal) - (col->values[i] < literal);
+      if (apply_op(op, cmp)) {
+        hits += col->counts[i];
+      }
+    }
+    return (double)hits / rows;
+  }
+
+  if (literal < col->min || literal > col->max) {
+    eq = 0.0;
+  } else if (col->sample_unique) {
+    eq = 1.0 / rows;
+  } else {
+    int hits = 0;
+    for (int i = 0; i < col->sample_len; i++) {
+      hits += col->sample[i] == literal;
+    }
+    eq = hits > 0 ? (double)hits / col->sample_len : 1.0 / rows;
+  }
+
+  switch (op) {
+  case OP_EQ:
+    return eq;
+  case OP_NE:
+    return 1.0 - eq;
+  case OP_LT:
+    return hist_fraction_below(col, literal);
+  case OP_LE:
+    return hist_fraction_below(col, (long long)literal + 1);
+  case OP_GT:
+    return 1.0 - hist_fraction_below(col, (long long)literal + 1);
+  default:
+    return 1.0 - hist_fraction_below(col, literal);
+  }
+}
+
+/*
+Name: stats_str_selectivity():
+Parameters: const TableStats *stats, ColumnId column, CompareOp op,
+            const char *literal
+Return: double
+Description:
+
+Estimated fraction of rows for which "column op literal" holds on a string
+column, comparing case-insensitively like match_where().
+*/
+double stats_str_selectivity(const TableStats *stats, ColumnId column,
+                             CompareOp op, const char *literal) {
+  const StrColumnStats *col = str_column(stats, column);
+
+  if (col == NULL || stats->num_rows == 0) {
+    return 1.0;
+  }
+
+  if (col->num_values >= 0) {
+    size_t hits = 0;
+    for (int i = 0; i < col->num_values; i++) {
+      if (apply_op(op, strcasecmp(col->values[i], literal))) {
+        hits += col->counts[i];
+      }
+    }
+    return (double)hits / (double)stats->num_rows;
+  }
+
+  switch (op) {
+  case OP_EQ:
+    return QPE_DEFAULT_EQ_SEL;
+  case OP_NE:
+    return 1.0 - QPE_DEFAULT_EQ_SEL;
+  default:
+    return QPE_DEFAULT_RANGE_SEL;
+  }
+}
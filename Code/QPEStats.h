@@ -0,0 +1,75 @@
+/*
+
+QPEStats.h
+
+Per-column statistics gathered while the database is loaded, used by the
+access-path planner (QPEPlan.c) to estimate how many rows a WHERE clause
+selects.
+
+Every column keeps exact per-value row counts while it has at most
+QPE_STATS_MAX_VALUES distinct values (Model, Color, Dealer and YearMake in
+practice). Integer columns also keep a fixed-size reservoir sample of rows,
+from which stats_finish() builds an equi-depth histogram for the
+high-cardinality ones (ID, Price). TableStats holds no pointers, so MPI rank
+0 can broadcast it as raw bytes.
+
+*/
+
+#ifndef QPE_STATS_H
+#define QPE_STATS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "QPEQuery.h"
+
+#define QPE_STATS_MAX_VALUES 64
+#define QPE_STATS_SAMPLE 1024
+#define QPE_HIST_BUCKETS 32
+
+/*
+Struct Definitions
+*/
+typedef struct {
+  int min;
+  int max;
+  int num_values; /* distinct values counted, -1 once past the limit */
+  int values[QPE_STATS_MAX_VALUES];
+  size_t counts[QPE_STATS_MAX_VALUES];
+  int sample_len;
+  int sample[QPE_STATS_SAMPLE];
+  int bounds[QPE_HIST_BUCKETS + 1]; /* equi-depth bucket edges */
+  bool sample_unique;               /* no value repeats in the sample */
+} IntColumnStats;
+
+typedef struct {
+  int num_values; /* distinct values counted, -1 once past the limit */
+  char values[QPE_STATS_MAX_VALUES][20];
+  size_t counts[QPE_STATS_MAX_VALUES];
+} StrColumnStats;
+
+typedef struct {
+  size_t num_rows;
+  uint64_t rng; /* reservoir sampling state */
+  IntColumnStats id;
+  IntColumnStats year_make;
+  IntColumnStats price;
+  StrColumnStats model;
+  StrColumnStats color;
+  StrColumnStats dealer;
+} TableStats;
+
+/*
+Function Prototypes
+*/
+void stats_init(TableStats *stats);
+void stats_add(TableStats *stats, const CarInventory *car);
+void stats_merge(TableStats *into, const TableStats *from);
+void stats_finish(TableStats *stats);
+double stats_int_selectivity(const TableStats *stats, ColumnId column,
+                             CompareOp op, int literal);
+double stats_str_selectivity(const TableStats *stats, ColumnId column,
+                             CompareOp op, const char *literal);
+
+#endif
@@ -0,0 +1,1064 @@
+/*
+
+QPEStream.c
+
+Authors:
+    Aidan Levy
+    Maddie Powell
+    Nick Corcoran
+    Austin Phalines
+    Dean Bullock
+
+Creation Date: 10-14-2026
+
+Description:
+
+Block reader and result spilling for --mem-limit (see QPEStream.h).
+
+The reader thread and the engine share two StreamBlocks. The reader waits
+until its next block is free. It then reads the block's raw text (after the
+unfinished line carried over from the previous one), parses it with
+parse_text_slice(), sorts it by ID and marks the block full. The engine
+takes full blocks in turn and releases each when it asks for the next, so one
+block is filtered while the other is read. A binary file is read straight
+into the blocks, whole rows at a time.
+
+*/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "QPELoad.h"
+#include "QPEStream.h"
+
+/* Read-ahead of every StreamCursor. */
+#define QPE_STREAM_CURSOR ((size_t)4 << 10)
+
+/*
+Struct Definitions
+*/
+typedef struct {
+  int id;
+  size_t pos;
+} StreamOrder;
+
+/*
+One query's results as one logical stream per kind (lines or tags): its
+spilled segments, in the order they were made, then its in-memory Buffer.
+*/
+typedef struct {
+  const StreamOutput *out;
+  const StreamSegment *segs;
+  size_t num_segs;
+  int query;
+} StreamQuery;
+
+/* Buffered sequential reader over a range of one of those streams. */
+typedef struct {
+  bool tags;
+  size_t pos; /* logical position of buf[0] */
+  size_t end;
+  size_t fill;
+  size_t at;
+  char buf[QPE_STREAM_CURSOR];
+} StreamCursor;
+
+/* An ascending run of a query's lines, one per block, during the merge. */
+typedef struct {
+  StreamCursor tags;
+  StreamCursor text;
+  BatchTag head; /* the run's next line */
+} StreamRun;
+
+/*
+Function Prototypes
+*/
+static bool read_full(int fd, void *data, size_t want, size_t *got);
+static int compare_id_pos(const void *a, const void *b);
+static bool sort_block(StreamBlock *b);
+static bool read_text_block(StreamReader *s, StreamBlock *b, bool *last);
+static bool read_binary_block(StreamReader *s, StreamBlock *b, bool *last);
+static void *reader_main(void *udata);
+static bool tag_final_lines(StreamOutput *out, int query, size_t start);
+static int compare_segments(const void *a, const void *b);
+static bool query_read(const StreamQuery *sq, bool tags, size_t pos,
+                       char *dst, size_t len);
+static void cursor_init(StreamCursor *c, bool tags, size_t begin,
+                        size_t end);
+static bool cursor_take(const StreamQuery *sq, StreamCursor *c, char *dst,
+                        OutputSink *sink, size_t len);
+static bool run_before(const StreamRun *runs, int a, int b);
+static void heap_down(const StreamRun *runs, int *heap, int n, int i);
+static bool run_advance(const StreamQuery *sq, StreamRun *run);
+static bool merge_runs(StreamOutput *out, const StreamQuery *sq,
+                       StreamRun *runs, int num_runs, OutputSink *sink);
+static bool write_query(StreamOutput *out, const StreamQuery *sq,
+                        OutputSink *sink);
+
+/*
+Name: stream_block_bytes():
+Parameters: size_t mem_limit
+Return: size_t
+Description:
+
+Raw text read per block for a --mem-limit of mem_limit bytes: one of the
+QPE_STREAM_SHARES parts, and never less than QPE_STREAM_MIN_BLOCK.
+*/
+size_t stream_block_bytes(size_t mem_limit) {
+  size_t bytes = mem_limit / QPE_STREAM_SHARES;
+  return bytes < QPE_STREAM_MIN_BLOCK ? QPE_STREAM_MIN_BLOCK : bytes;
+}
+
+/*
+Name: stream_output_budget():
+Parameters: size_t mem_limit
+Return: size_t
+Description:
+
+Result bytes kept in memory before spilling: the shares of the limit the
+reader's blocks do not take.
+*/
+size_t stream_output_budget(size_t mem_limit) {
+  return stream_block_bytes(mem_limit) *
+         (QPE_STREAM_SHARES - 1 - 2 * QPE_STREAM_ROW_SHARES);
+}
+
+/*
+Name: read_full():
+Parameters: int fd, void *data, size_t want, size_t *got
+Return: bool
+Description:
+
+Reads until want bytes are in or the file ends, setting *got to the bytes
+read. Returns false on a read error.
+*/
+static bool read_full(int fd, void *data, size_t want, size_t *got) {
+  *got = 0;
+  while (*got < want) {
+    ssize_t n = read(fd, (char *)data + *got, want - *got);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n < 0) {
+      return false;
+    }
+    if (n == 0) {
+      break;
+    }
+    *got += (size_t)n;
+  }
+  return true;
+}
+
+/*
+Name: compare_id_pos():
+Parameters: const void *a, const void *b
+Return: int
+Description:
+
+qsort() comparator ordering StreamOrder entries by ID, then by position in
+the block, so the last copy of a duplicate ID sorts last.
+*/
+static int compare_id_pos(const void *a, const void *b) {
+  const StreamOrder *x = (const StreamOrder *)a;
+  const StreamOrder *y = (const StreamOrder *)b;
+
+  if (x->id != y->id) {
+    return (x->id > y->id) - (x->id < y->id);
+  }
+  return (x->pos > y->pos) - (x->pos < y->pos);
+}
+
+/*
+Name: sort_block():
+Parameters: StreamBlock *b
+Return: bool
+Description:
+
+Sorts a parsed text block by ID in place and keeps the last copy of every
+duplicate ID, as load_table() does for a whole table. A block that is
+already strictly ascending, the usual case, is only checked. Returns false
+when out of memory.
+*/
+static bool sort_block(StreamBlock *b) {
+  StreamOrder *order;
+  size_t n = 0;
+  size_t i = 1;
+
+  while (i < b->count && b->rows[i - 1].ID < b->rows[i].ID) {
+    i++;
+  }
+  if (i >= b->count) {
+    return true;
+  }
+
+  order = malloc(b->count * sizeof(StreamOrder));
+  if (order == NULL) {
+    return false;
+  }
+  for (i = 0; i < b->count; i++) {
+    order[i].id = b->rows[i].ID;
+    order[i].pos = i;
+  }
+  qsort(order, b->count, sizeof(StreamOrder), compare_id_pos);
+
+  /* Apply the permutation cycle by cycle: rows[j] = old rows[order[j].pos]. */
+  for (i = 0; i < b->count; i++) {
+    CarInventory first;
+    size_t j = i;
+
+    if (order[i].pos == SIZE_MAX) {
+      continue;
+    }
+    first = b->rows[i];
+    while (order[j].pos != i) {
+      size_t k = order[j].pos;
+      b->rows[j] = b->rows[k];
+      order[j].pos = SIZE_MAX;
+      j = k;
+    }
+    b->rows[j] = first;
+    order[j].pos = SIZE_MAX;
+  }
+
+  for (i = 0; i < b->count; i++) {
+    if (i + 1 == b->count || b->rows[i + 1].ID != b->rows[i].ID) {
+      b->rows[n++] = b->rows[i];
+    }
+  }
+  b->count = n;
+  free(order);
+  return true;
+}
+
+/*
+Name: read_text_block():
+Parameters: StreamReader *s, StreamBlock *b, bool *last
+Return: bool
+Description:
+
+Reads the next raw block, parses its complete lines into b and keeps the
+unfinished last line for the following block, sorted by ID. The first
+block loses the header line first, and an empty file has none, which is an
+error here as in load_table(). Sets *last at the end of the file or at a
+malformed record, which ends the table with the usual warning. Returns
+false, after reporting why, if the stream cannot go on.
+*/
+static bool read_text_block(StreamReader *s, StreamBlock *b, bool *last) {
+  size_t room = s->block_bytes - s->carry;
+  size_t got;
+  size_t start = 0;
+  size_t cut;
+  ChunkStatus status;
+
+  if (!read_full(s->fd, s->raw + s->carry, room, &got)) {
+    perror(s->filename);
+    return false;
+  }
+  s->bytes_read += got;
+  cut = s->carry + got;
+  *last = got < room;
+
+  if (!s->header_skipped) {
+    if (cut == 0) {
+      fprintf(stderr, "Error: Failed to read header from %s\n", s->filename);
+      return false;
+    }
+    start = text_header_length(s->raw, cut);
+    s->header_skipped = true;
+  }
+  if (!*last) {
+    while (cut > start && s->raw[cut - 1] != '\n') {
+      cut--;
+    }
+    if (cut == start) {
+      fprintf(stderr, "Error: a line of %s is longer than a --mem-limit "
+                      "block\n",
+              s->filename);
+      return false;
+    }
+  }
+
+  status = parse_text_slice(s->raw + start, s->raw + cut, &b->rows,
+                            &b->count);
+  if (status == CHUNK_NOMEM) {
+    fprintf(stderr, "Error: Out of memory loading %s\n", s->filename);
+    return false;
+  }
+  if (status == CHUNK_SPLIT && !*last) {
+    fprintf(stderr, "Error: %s has records spanning lines; run it without "
+                    "--mem-limit\n",
+            s->filename);
+    return false;
+  }
+  if (status != CHUNK_CLEAN) {
+    fprintf(stderr, "Warning: Malformed line encountered in %s\n",
+            s->filename);
+    *last = true;
+  }
+
+  if (!sort_block(b)) {
+    fprintf(stderr, "Error: Out of memory loading %s\n", s->filename);
+    return false;
+  }
+  s->rows_read += b->count;
+
+  s->carry = s->carry + got - cut;
+  memmove(s->raw, s->raw + cut, s->carry);
+  return true;
+}
+
+/*
+Name: read_binary_block():
+Parameters: StreamReader *s, StreamBlock *b, bool *last
+Return: bool
+Description:
+
+Reads the next block_rows rows of a binary database into b; the rows are
+already deduplicated and in ID order. Sets *last with the final rows.
+Returns false, after reporting why, on a read error or a short file.
+*/
+static bool read_binary_block(StreamReader *s, StreamBlock *b, bool *last) {
+  size_t n = s->rows_left < s->block_rows ? s->rows_left : s->block_rows;
+  size_t got;
+
+  b->rows = malloc(n * sizeof(CarInventory) + 1);
+  if (b->rows == NULL) {
+    fprintf(stderr, "Error: Out of memory loading %s\n", s->filename);
+    return false;
+  }
+  if (!read_full(s->fd, b->rows, n * sizeof(CarInventory), &got)) {
+    perror(s->filename);
+    return false;
+  }
+  if (got != n * sizeof(CarInventory)) {
+    fprintf(stderr, "Error: %s is truncated or corrupt\n", s->filename);
+    return false;
+  }
+  b->count = n;
+  s->bytes_read += got;
+  s->rows_read += n;
+  s->rows_left -= n;
+  *last = s->rows_left == 0;
+  return true;
+}
+
+/*
+Name: reader_main():
+Parameters: void *udata
+Return: void *
+Description:
+
+Reader thread: fills the two blocks in turn until the table ends, an error
+stops it, or stream_close() asks it to quit.
+*/
+static void *reader_main(void *udata) {
+  StreamReader *s = (StreamReader *)udata;
+
+  for (;;) {
+    StreamBlock *b = &s->blocks[s->fill];
+    bool last = false;
+    bool stop;
+    bool ok;
+
+    pthread_mutex_lock(&s->lock);
+    while (b->full && !s->stop) {
+      pthread_cond_wait(&s->cond, &s->lock);
+    }
+    stop = s->stop;
+    pthread_mutex_unlock(&s->lock);
+    if (stop) {
+      return NULL;
+    }
+
+    /* The engine has released b, so it belongs to this thread until full. */
+    free(b->rows);
+    b->rows = NULL;
+    b->count = 0;
+    ok = s->binary ? read_binary_block(s, b, &last)
+                   : read_text_block(s, b, &last);
+
+    pthread_mutex_lock(&s->lock);
+    if (ok && b->count > 0) {
+      b->full = true;
+      s->fill ^= 1;
+    }
+    s->failed = !ok;
+    s->done = !ok || last;
+    pthread_cond_broadcast(&s->cond);
+    pthread_mutex_unlock(&s->lock);
+    if (!ok || last) {
+      return NULL;
+    }
+  }
+}
+
+/*
+Name: stream_open():
+Parameters: StreamReader *s, const char *filename, size_t block_bytes
+Return: bool
+Description:
+
+Opens filename, recognizes the binary format by its magic number as
+load_table() does, and starts the reader thread on blocks of block_bytes
+(at least QPE_STREAM_MIN_BLOCK). Returns false, after reporting why, if the
+file cannot be read.
+*/
+bool stream_open(StreamReader *s, const char *filename, size_t block_bytes) {
+  BinaryHeader raw;
+  BinaryHeader header;
+  struct stat st;
+
+  memset(s, 0, sizeof(*s));
+  s->filename = filename;
+  s->block_bytes = block_bytes;
+  s->fd = open(filename, O_RDONLY);
+  if (s->fd < 0 || fstat(s->fd, &st) != 0) {
+    perror(filename);
+    if (s->fd >= 0) {
+      close(s->fd);
+    }
+    return false;
+  }
+
+  if ((size_t)st.st_size >= sizeof(raw) &&
+      pread(s->fd, &raw, sizeof(raw), 0) == (ssize_t)sizeof(raw) &&
+      memcmp(raw.magic, QPE_BIN_MAGIC, sizeof(raw.magic)) == 0) {
+    if (!read_binary_header(filename, &raw, (size_t)st.st_size, &header) ||
+        lseek(s->fd, (off_t)header.rows_offset, SEEK_SET) < 0) {
+      close(s->fd);
+      return false;
+    }
+    s->binary = true;
+    s->rows_left = (size_t)header.row_count;
+    s->block_rows =
+        block_bytes * QPE_STREAM_ROW_SHARES / sizeof(CarInventory) + 1;
+  } else {
+    s->raw = malloc(block_bytes);
+    if (s->raw == NULL) {
+      fprintf(stderr, "Error: Out of memory loading %s\n", filename);
+      close(s->fd);
+      return false;
+    }
+  }
+
+  pthread_mutex_init(&s->lock, NULL);
+  pthread_cond_init(&s->cond, NULL);
+  if (pthread_create(&s->thread, NULL, reader_main, s) != 0) {
+    fprintf(stderr, "Error: failed to start the reader thread\n");
+    pthread_mutex_destroy(&s->lock);
+    pthread_cond_destroy(&s->cond);
+    free(s->raw);
+    close(s->fd);
+    return false;
+  }
+  return true;
+}
+
+/*
+Name: stream_next():
+Parameters: StreamReader *s, const CarInventory **rows, size_t *count
+Return: bool
+Description:
+
+Releases the block returned by the previous call to the reader and waits for
+the next one, which stays valid until the next call. Returns false once the
+table has ended; s->failed then tells whether it ended on an error. Time
+spent waiting adds to s->wait_seconds.
+*/
+bool stream_next(StreamReader *s, const CarInventory **rows, size_t *count) {
+  double start = timing_now();
+  bool got;
+
+  pthread_mutex_lock(&s->lock);
+  if (s->holding) {
+    s->blocks[s->use].full = false;
+    s->use ^= 1;
+    s->holding = false;
+    pthread_cond_broadcast(&s->cond);
+  }
+  while (!s->blocks[s->use].full && !s->done) {
+    pthread_cond_wait(&s->cond, &s->lock);
+  }
+  got = s->blocks[s->use].full;
+  if (got) {
+    *rows = s->blocks[s->use].rows;
+    *count = s->blocks[s->use].count;
+    s->holding = true;
+  }
+  pthread_mutex_unlock(&s->lock);
+  s->wait_seconds += timing_now() - start;
+  return got;
+}
+
+/*
+Name: stream_close():
+Parameters: StreamReader *s
+Return: void
+Description:
+
+Stops and joins the reader thread (also when the table was not read to the
+end) and releases the blocks and the file.
+*/
+void stream_close(StreamReader *s) {
+  pthread_mutex_lock(&s->lock);
+  s->stop = true;
+  pthread_cond_broadcast(&s->cond);
+  pthread_mutex_unlock(&s->lock);
+  pthread_join(s->thread, NULL);
+  pthread_mutex_destroy(&s->lock);
+  pthread_cond_destroy(&s->cond);
+  free(s->blocks[0].rows);
+  free(s->blocks[1].rows);
+  free(s->raw);
+  close(s->fd);
+}
+
+/*
+Name: stream_output_init():
+Parameters: StreamOutput *out, int num_queries, size_t budget,
+            QueryTiming *timing
+Return: bool
+Description:
+
+Prepares one empty Buffer of lines and one of BatchTags per query, spilled
+once they hold more than budget bytes in all. timing, if not NULL, gets
+every query's rows matched and bytes as they are written. Returns false on
+allocation failure.
+*/
+bool stream_output_init(StreamOutput *out, int num_queries, size_t budget,
+                        QueryTiming *timing) {
+  memset(out, 0, sizeof(*out));
+  out->bufs = calloc((size_t)num_queries + 1, sizeof(Buffer));
+  out->tags = calloc((size_t)num_queries + 1, sizeof(Buffer));
+  out->num_queries = num_queries;
+  out->budget = budget;
+  out->timing = timing;
+  return out->bufs != NULL && out->tags != NULL;
+}
+
+/*
+Name: stream_output_groups():
+Parameters: StreamOutput *out, int query, AggTable *agg
+Return: bool
+Description:
+
+Formats the groups of an aggregate query into its results once the last
+block is in. Each line is tagged with its position, so together they form
+one ascending run and are written as agg_format() ordered them. Returns
+false on allocation failure.
+*/
+bool stream_output_groups(StreamOutput *out, int query, AggTable *agg) {
+  size_t start = out->bufs[query].len;
+
+  return agg_format(agg, &out->bufs[query]) &&
+         tag_final_lines(out, query, start);
+}
+
+/*
+Name: stream_output_top():
+Parameters: StreamOutput *out, int query, TopK *top
+Return: bool
+Description:
+
+Formats the rows an ORDER BY ... LIMIT query kept across the blocks into
+its results once the last block is in, tagged like stream_output_groups()
+so they are written in topk_format()'s order. Returns false on allocation
+failure.
+*/
+bool stream_output_top(StreamOutput *out, int query, TopK *top) {
+  size_t start = out->bufs[query].len;
+
+  return topk_format(top, &out->bufs[query]) &&
+         tag_final_lines(out, query, start);
+}
+
+/*
+Name: tag_final_lines():
+Parameters: StreamOutput *out, int query, size_t start
+Return: bool
+Description:
+
+Tags each line of query's results from byte start on with its position, so
+lines formatted after the last block form one ascending run. Returns false
+on allocation failure.
+*/
+static bool tag_final_lines(StreamOutput *out, int query, size_t start) {
+  Buffer *buf = &out->bufs[query];
+  BatchTag tag = {.id = 0, .len = 0};
+
+  for (size_t i = start; i < buf->len; i++) {
+    tag.len++;
+    if (buf->data[i] == '\n') {
+      if (!buffer_append(&out->tags[query], (const char *)&tag,
+                         sizeof(tag))) {
+        return false;
+      }
+      tag.id++;
+      tag.len = 0;
+    }
+  }
+  return true;
+}
+
+/*
+Name: stream_output_check():
+Parameters: StreamOutput *out
+Return: bool
+Description:
+
+Called between blocks: once the buffers hold more than the budget, appends
+every non-empty query's lines and then its tags to the spill file as one
+segment and frees its Buffers, so the memory is really returned. Returns
+false, after reporting why, if the spill file cannot be written.
+*/
+bool stream_output_check(StreamOutput *out) {
+  out->buffered = 0;
+  for (int qi = 0; qi < out->num_queries; qi++) {
+    out->buffered += out->bufs[qi].len + out->tags[qi].len;
+  }
+  if (out->buffered <= out->budget) {
+    return true;
+  }
+
+  if (out->spill == NULL && (out->spill = tmpfile()) == NULL) {
+    perror("tmpfile");
+    return false;
+  }
+  for (int qi = 0; qi < out->num_queries; qi++) {
+    Buffer *buf = &out->bufs[qi];
+    Buffer *tags = &out->tags[qi];
+    StreamSegment *seg;
+
+    if (buf->len == 0) {
+      continue;
+    }
+    if (out->num_segments == out->cap_segments) {
+      size_t cap = out->cap_segments ? 2 * out->cap_segments : 64;
+      StreamSegment *grown =
+          realloc(out->segments, cap * sizeof(StreamSegment));
+      if (grown == NULL) {
+        fprintf(stderr, "Error: out of memory spilling results\n");
+        return false;
+      }
+      out->segments = grown;
+      out->cap_segments = cap;
+    }
+    seg = &out->segments[out->num_segments++];
+    seg->query = qi;
+    seg->offset = out->spilled;
+    seg->len = buf->len;
+    seg->tag_offset = out->spilled + (long long)buf->len;
+    seg->tag_len = tags->len;
+    if (out->timing) {
+      timing_output(&out->timing[qi], buf->data, buf->len);
+    }
+    if (!buffer_flush(buf, out->spill) || !buffer_flush(tags, out->spill)) {
+      perror("spill file");
+      return false;
+    }
+    out->spilled += (long long)(seg->len + seg->tag_len);
+    buffer_free(buf);
+    buffer_free(tags);
+  }
+  out->buffered = 0;
+  return true;
+}
+
+/*
+Name: compare_segments():
+Parameters: const void *a, const void *b
+Return: int
+Description:
+
+qsort() comparator ordering spill segments by query, then by position in the
+spill file (the order they were produced in).
+*/
+static int compare_segments(const void *a, const void *b) {
+  const StreamSegment *x = (const StreamSegment *)a;
+  const StreamSegment *y = (const StreamSegment *)b;
+
+  if (x->query != y->query) {
+    return x->query - y->query;
+  }
+  return (x->offset > y->offset) - (x->offset < y->offset);
+}
+
+/*
+Name: query_read():
+Parameters: const StreamQuery *sq, bool tags, size_t pos, char *dst,
+            size_t len
+Return: bool
+Description:
+
+Copies len bytes from position pos of the query's line stream (or its tag
+stream when tags is set) into dst, from the spill file or memory. Returns
+false, after reporting why, if the spill file cannot be read.
+*/
+static bool query_read(const StreamQuery *sq, bool tags, size_t pos,
+                       char *dst, size_t len) {
+  const Buffer *mem = tags ? &sq->out->tags[sq->query]
+                           : &sq->out->bufs[sq->query];
+
+  for (size_t k = 0; k < sq->num_segs && len > 0; k++) {
+    const StreamSegment *seg = &sq->segs[k];
+    size_t seg_len = tags ? seg->tag_len : seg->len;
+    size_t n;
+
+    if (pos >= seg_len) {
+      pos -= seg_len;
+      continue;
+    }
+    n = seg_len - pos < len ? seg_len - pos : len;
+    if (fseeko(sq->out->spill,
+               (off_t)((tags ? seg->tag_offset : seg->offset) + (long long)pos),
+               SEEK_SET) != 0 ||
+        fread(dst, 1, n, sq->out->spill) != n) {
+      perror("spill file");
+      return false;
+    }
+    dst += n;
+    len -= n;
+    pos = 0;
+  }
+  if (len > 0) {
+    memcpy(dst, mem->data + pos, len);
+  }
+  return true;
+}
+
+/*
+Name: cursor_init():
+Parameters: StreamCursor *c, bool tags, size_t begin, size_t end
+Return: void
+Description:
+
+Positions c at begin of the line (or tag) stream, reading up to end.
+*/
+static void cursor_init(StreamCursor *c, bool tags, size_t begin,
+                        size_t end) {
+  c->tags = tags;
+  c->pos = begin;
+  c->end = end;
+  c->fill = 0;
+  c->at = 0;
+}
+
+/*
+Name: cursor_take():
+Parameters: const StreamQuery *sq, StreamCursor *c, char *dst, OutputSink *sink,
+            size_t len
+Return: bool
+Description:
+
+Consumes the next len bytes of c, copying them to dst and/or writing them to
+sink when those are not NULL. Returns false if the stream ends early or the
+spill file cannot be read.
+*/
+static bool cursor_take(const StreamQuery *sq, StreamCursor *c, char *dst,
+                        OutputSink *sink, size_t len) {
+  while (len > 0) {
+    size_t n;
+
+    if (c->at == c->fill) {
+      c->pos += c->fill;
+      c->fill = c->end - c->pos < QPE_STREAM_CURSOR ? c->end - c->pos
+                                                    : QPE_STREAM_CURSOR;
+      c->at = 0;
+      if (c->fill == 0 || !query_read(sq, c->tags, c->pos, c->buf, c->fill)) {
+        return false;
+      }
+    }
+    n = c->fill - c->at < len ? c->fill - c->at : len;
+    if (dst != NULL) {
+      memcpy(dst, c->buf + c->at, n);
+      dst += n;
+    }
+    if (sink != NULL) {
+      output_write(sink, sq->query + 1, c->buf + c->at, n);
+    }
+    c->at += n;
+    len -= n;
+  }
+  return true;
+}
+
+/*
+Name: run_before():
+Parameters: const StreamRun *runs, int a, int b
+Return: bool
+Description:
+
+Merge order of two runs' next lines: lower ID first, and for the same ID the
+later run (the later block, whose copy wins) first.
+*/
+static bool run_before(const StreamRun *runs, int a, int b) {
+  if (runs[a].head.id != runs[b].head.id) {
+    return runs[a].head.id < runs[b].head.id;
+  }
+  return a > b;
+}
+
+/*
+Name: heap_down():
+Parameters: const StreamRun *runs, int *heap, int n, int i
+Return: void
+Description:
+
+Restores the min-heap of n run indices below position i.
+*/
+static void heap_down(const StreamRun *runs, int *heap, int n, int i) {
+  for (;;) {
+    int best = i;
+    int left = 2 * i + 1;
+    int right = left + 1;
+    int tmp;
+
+    if (left < n && run_before(runs, heap[left], heap[best])) {
+      best = left;
+    }
+    if (right < n && run_before(runs, heap[right], heap[best])) {
+      best = right;
+    }
+    if (best == i) {
+      return;
+    }
+    tmp = heap[i];
+    heap[i] = heap[best];
+    heap[best] = tmp;
+    i = best;
+  }
+}
+
+/*
+Name: run_advance():
+Parameters: const StreamQuery *sq, StreamRun *run
+Return: bool
+Description:
+
+Loads the run's next tag into run->head. Returns false at the end of the
+run.
+*/
+static bool run_advance(const StreamQuery *sq, StreamRun *run) {
+  if (run->tags.pos + run->tags.at == run->tags.end) {
+    return false;
+  }
+  return cursor_take(sq, &run->tags, (char *)&run->head, NULL,
+                     sizeof(BatchTag));
+}
+
+/*
+Name: merge_runs():
+Parameters: StreamOutput *out, const StreamQuery *sq, StreamRun *runs,
+            int num_runs, OutputSink *sink
+Return: bool
+Description:
+
+Writes the query's lines to sink in ID order by merging its runs through a
+min-heap. Of matches with the same ID from different blocks only the last
+is written, with a warning the first time. Returns false, after reporting
+why, on a read error or when out of memory.
+*/
+static bool merge_runs(StreamOutput *out, const StreamQuery *sq,
+                       StreamRun *runs, int num_runs, OutputSink *sink) {
+  int *heap = malloc((size_t)num_runs * sizeof(int));
+  int n = 0;
+  bool ok = true;
+
+  if (heap == NULL) {
+    fprintf(stderr, "Error: out of memory merging results\n");
+    return false;
+  }
+  for (int r = 0; r < num_runs; r++) {
+    if (run_advance(sq, &runs[r])) {
+      heap[n++] = r;
+    }
+  }
+  for (int i = n / 2 - 1; i >= 0; i--) {
+    heap_down(runs, heap, n, i);
+  }
+
+  while (ok && n > 0) {
+    StreamRun *run = &runs[heap[0]];
+    int id = run->head.id;
+    bool first = true;
+
+    /* The first line popped for an ID is written, any other copy skipped. */
+    while (ok && n > 0 && runs[heap[0]].head.id == id) {
+      run = &runs[heap[0]];
+      if (!first && !out->warned) {
+        fprintf(stderr, "Warning: ID %d occurs in more than one --mem-limit "
+                        "block; keeping its last copy\n",
+                id);
+        out->warned = true;
+      }
+      ok = cursor_take(sq, &run->text, NULL, first ? sink : NULL,
+                       (size_t)run->head.len);
+      first = false;
+      if (!run_advance(sq, run)) {
+        heap[0] = heap[--n];
+      }
+      heap_down(runs, heap, n, 0);
+    }
+  }
+  if (!ok) {
+    fprintf(stderr, "Error: failed to read back spilled results\n");
+  }
+  free(heap);
+  return ok;
+}
+
+/*
+Name: write_query():
+Parameters: StreamOutput *out, const StreamQuery *sq, OutputSink *sink
+Return: bool
+Description:
+
+Writes one query's results to sink. A first pass over its tags splits the
+lines into ascending runs. One run (the file was in ID order) is copied as
+it is; more are merged by merge_runs(). Returns false, after reporting why,
+on a read error or when out of memory.
+*/
+static bool write_query(StreamOutput *out, const StreamQuery *sq,
+                        OutputSink *sink) {
+  size_t text_len = out->bufs[sq->query].len;
+  size_t tag_len = out->tags[sq->query].len;
+  StreamRun *runs = NULL;
+  StreamCursor *scan;
+  size_t text_pos = 0;
+  int num_runs = 0;
+  int cap_runs = 0;
+  int prev = 0;
+  bool ok = true;
+
+  for (size_t k = 0; k < sq->num_segs; k++) {
+    text_len += sq->segs[k].len;
+    tag_len += sq->segs[k].tag_len;
+  }
+  scan = malloc(sizeof(StreamCursor));
+  if (scan == NULL) {
+    fprintf(stderr, "Error: out of memory merging results\n");
+    return false;
+  }
+
+  cursor_init(scan, true, 0, tag_len);
+  for (size_t t = 0; ok && t < tag_len / sizeof(BatchTag); t++) {
+    BatchTag tag;
+
+    ok = cursor_take(sq, scan, (char *)&tag, NULL, sizeof(tag));
+    if (ok && (t == 0 || tag.id <= prev)) {
+      if (num_runs == cap_runs) {
+        int cap = cap_runs ? 2 * cap_runs : 8;
+        StreamRun *grown = realloc(runs, (size_t)cap * sizeof(StreamRun));
+        if (grown == NULL) {
+          fprintf(stderr, "Error: out of memory merging results\n");
+          free(runs);
+          free(scan);
+          return false;
+        }
+        runs = grown;
+        cap_runs = cap;
+      }
+      if (num_runs > 0) {
+        runs[num_runs - 1].tags.end = t * sizeof(BatchTag);
+        runs[num_runs - 1].text.end = text_pos;
+      }
+      cursor_init(&runs[num_runs].tags, true, t * sizeof(BatchTag), tag_len);
+      cursor_init(&runs[num_runs].text, false, text_pos, text_len);
+      num_runs++;
+    }
+    prev = tag.id;
+    text_pos += (size_t)tag.len;
+  }
+  free(scan);
+
+  if (!ok) {
+    fprintf(stderr, "Error: failed to read back spilled results\n");
+  } else if (num_runs <= 1) {
+    StreamCursor *copy = malloc(sizeof(StreamCursor));
+    ok = copy != NULL;
+    if (ok) {
+      cursor_init(copy, false, 0, text_len);
+      ok = cursor_take(sq, copy, NULL, sink, text_len);
+    }
+    if (!ok) {
+      fprintf(stderr, "Error: failed to read back spilled results\n");
+    }
+    free(copy);
+  } else {
+    ok = merge_runs(out, sq, runs, num_runs, sink);
+  }
+  free(runs);
+  return ok;
+}
+
+/*
+Name: stream_output_write():
+Parameters: StreamOutput *out, OutputSink *sink
+Return: bool
+Description:
+
+Writes every query's results to sink in query order and, within a query, in
+ID order. Returns false, after reporting why, if the spill file cannot be
+read back or memory runs out.
+*/
+bool stream_output_write(StreamOutput *out, OutputSink *sink) {
+  size_t seg = 0;
+
+  if (out->num_segments > 0) {
+    if (fflush(out->spill) != 0) {
+      perror("spill file");
+      return false;
+    }
+    qsort(out->segments, out->num_segments, sizeof(StreamSegment),
+          compare_segments);
+  }
+
+  for (int qi = 0; qi < out->num_queries; qi++) {
+    StreamQuery sq = {.out = out, .segs = out->segments + seg, .query = qi};
+
+    while (seg < out->num_segments && out->segments[seg].query == qi) {
+      seg++;
+    }
+    sq.num_segs = (size_t)(out->segments + seg - sq.segs);
+    if (out->timing) {
+      timing_output(&out->timing[qi], out->bufs[qi].data, out->bufs[qi].len);
+    }
+    if (!write_query(out, &sq, sink)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/*
+Name: stream_output_free():
+Parameters: StreamOutput *out
+Return: void
+Description:
+
+Releases the Buffers, the segment list and the spill file.
+*/
+void stream_output_free(StreamOutput *out) {
+  for (int qi = 0; qi < out->num_queries; qi++) {
+    if (out->bufs) {
+      buffer_free(&out->bufs[qi]);
+    }
+    if (out->tags) {
+      buffer_free(&out->tags[qi]);
+    }
+  }
+  free(out->bufs);
+  free(out->tags);
+  free(out->segments);
+  if (out->spill) {
+    fclose(out->spill);
+  }
+  memset(out, 0, sizeof(*out));
+}
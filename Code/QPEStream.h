@@ -0,0 +1,128 @@
+/*
+
+QPEStream.h
+
+Bounded-memory streaming for --mem-limit (see QPEStream.c). Instead of
+loading the whole table, a StreamReader reads the database (text or the
+db_convert binary format) in fixed-size blocks on a reader thread. It parses
+each block into one of two row buffers, so the next block loads while the
+engine filters the current one against every query.
+
+The engines keep the results in a StreamOutput of one Buffer per query, with
+a BatchTag (ID and line length) per result line. Whenever they outgrow their
+share of the limit they are spilled to a single temporary file. Each block
+is sorted by ID before it is filtered, so a query's lines form one ascending
+run per block. At the end every query that got more than one run (the file
+was not in ID order) is merged by ID, the way the engines print a loaded
+table. The output is the same as a normal run. Aggregate queries keep an
+AggTable across the blocks instead and add their groups at the end, and
+ORDER BY ... LIMIT queries likewise keep a TopK and add its rows.
+
+Duplicate IDs are resolved within a block as load_table() resolves them (the
+last copy wins). A block cannot see the other blocks, though. When matches
+with the same ID come from different blocks, the merge keeps the last one.
+Records spanning lines are rejected.
+
+*/
+
+#ifndef QPE_STREAM_H
+#define QPE_STREAM_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#include "QPEAggregate.h"
+#include "QPEBatch.h"
+#include "QPEBuffer.h"
+#include "QPEOutput.h"
+#include "QPEQuery.h"
+#include "QPETiming.h"
+#include "QPETopK.h"
+
+/*
+The limit is split into QPE_STREAM_SHARES parts: one raw text block, two
+parsed row blocks of up to QPE_STREAM_ROW_SHARES each (a parsed row takes
+about 2.5 times its text), and the rest for buffered results.
+*/
+#define QPE_STREAM_SHARES 10
+#define QPE_STREAM_ROW_SHARES 3
+#define QPE_STREAM_MIN_BLOCK ((size_t)64 << 10)
+
+/*
+Struct Definitions
+*/
+typedef struct {
+  CarInventory *rows;
+  size_t count;
+  bool full; /* parsed by the reader and not yet released by the engine */
+} StreamBlock;
+
+typedef struct {
+  const char *filename;
+  int fd;
+  bool binary;
+  size_t block_bytes;  /* raw text per block */
+  size_t block_rows;   /* binary rows per block */
+  size_t rows_left;    /* binary rows not read yet */
+  char *raw;           /* text block being read, after the carried tail */
+  size_t carry;        /* bytes of an unfinished line kept for the next block */
+  bool header_skipped; /* text header line already consumed */
+  size_t rows_read;
+  size_t bytes_read;
+
+  StreamBlock blocks[2];
+  int fill; /* block the reader fills next */
+  int use;  /* block the engine gets next */
+  bool holding; /* the engine still holds blocks[use ^ 1] */
+  bool done;    /* the reader has published its last block */
+  bool failed;  /* the reader stopped on an error */
+  bool stop;    /* stream_close() asked the reader to quit */
+  double wait_seconds; /* engine time spent waiting for blocks */
+
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+} StreamReader;
+
+typedef struct {
+  int query;
+  long long offset; /* of the result lines in the spill file */
+  size_t len;
+  long long tag_offset; /* of their BatchTags */
+  size_t tag_len;
+} StreamSegment;
+
+typedef struct {
+  Buffer *bufs; /* one per query */
+  Buffer *tags; /* BatchTags of bufs, one per query */
+  int num_queries;
+  size_t budget;   /* spill once the buffers hold more than this */
+  size_t buffered; /* bytes in bufs, as of the last stream_output_check() */
+  FILE *spill;     /* tmpfile(), created at the first spill */
+  long long spilled;
+  StreamSegment *segments;
+  size_t num_segments;
+  size_t cap_segments;
+  QueryTiming *timing; /* per query, charged as results are written */
+  bool warned; /* duplicate IDs across blocks reported */
+} StreamOutput;
+
+/*
+Function Prototypes
+*/
+size_t stream_block_bytes(size_t mem_limit);
+size_t stream_output_budget(size_t mem_limit);
+bool stream_open(StreamReader *s, const char *filename, size_t block_bytes);
+bool stream_next(StreamReader *s, const CarInventory **rows, size_t *count);
+void stream_close(StreamReader *s);
+bool stream_output_init(StreamOutput *out, int num_queries, size_t budget,
+                        QueryTiming *timing);
+bool stream_output_groups(StreamOutput *out, int query, AggTable *agg);
+bool stream_output_top(StreamOutput *out, int query, TopK *top);
+bool stream_output_check(StreamOutput *out);
+bool stream_output_write(StreamOutput *out, OutputSink *sink);
+void stream_output_free(StreamOutput *out);
+
+#endif
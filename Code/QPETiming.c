@@ -0,0 +1,414 @@
+/*
+
+QPETiming.c
+
+Authors:
+    Aidan Levy
+    Maddie Powell
+    Nick Corcoran
+    Austin Phalines
+    Dean Bullock
+
+Creation Date: 10-14-2026
+
+Description:
+
+Phase and per-query timing for qpe_seq, qpe_omp and qpe_mpi. Every figure is
+wall time from clock_gettime(CLOCK_MONOTONIC), the same clock omp_get_wtime()
+and MPI_Wtime() read on Linux, so the engines can be compared directly; the
+old summaries used clock(), which is the CPU time of one process.
+
+An engine keeps one RunTiming, adds each phase with timing_lap() as it
+passes, and charges every query its time and output with timing_output().
+timing_summary_local() turns it into a TimingSummary (qpe_mpi reduces the
+ranks' values into one instead), which timing_print() adds to the human
+summary and timing_write() appends to the --timing log.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "QPETiming.h"
+
+/* Names of the TimingValue entries in the log and the printed summary. */
+static const char *const value_names[QPE_TIMING_VALUES] = {
+    "total",  "load",         "materialize",  "distribute", "filter",
+    "output", "rows_scanned", "rows_matched", "bytes_emitted", "cache_hits",
+    "cache_misses", "local_rows", "remote_rows", "kernel_queries"};
+
+/*
+Function Prototypes
+*/
+static void write_json_string(FILE *out, const char *s);
+static void write_csv_field(FILE *out, const char *s);
+static bool write_json(FILE *out, const TimingInfo *info,
+                       const TimingSummary *s, const QueryTiming *queries,
+                       int num_queries);
+static bool write_csv(FILE *out, bool header, const TimingInfo *info,
+                      const TimingSummary *s, int num_queries);
+
+/*
+Name: timing_now():
+Parameters: none
+Return: double
+Description:
+
+Seconds on the monotonic clock, for measuring wall-time intervals.
+*/
+double timing_now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+/*
+Name: timing_init():
+Parameters: RunTiming *t
+Return: void
+Description:
+
+Zeroes every phase and counter and starts the run clock.
+*/
+void timing_init(RunTiming *t) {
+  memset(t, 0, sizeof(*t));
+  t->start = timing_now();
+}
+
+/*
+Name: timing_queries():
+Parameters: RunTiming *t, int num_queries
+Return: bool
+Description:
+
+Allocates the zeroed per-query records once the number of queries is known.
+Returns false on allocation failure, in which case only the phases are kept.
+*/
+bool timing_queries(RunTiming *t, int num_queries) {
+  free(t->queries);
+  t->queries = calloc((size_t)num_queries + 1, sizeof(QueryTiming));
+  t->num_queries = t->queries ? num_queries : 0;
+  return t->queries != NULL;
+}
+
+/*
+Name: timing_lap():
+Parameters: RunTiming *t, TimingValue phase, double since
+Return: double
+Description:
+
+Charges the time from since to now to phase and returns now, so consecutive
+phases can be timed as mark = timing_lap(t, phase, mark).
+*/
+double timing_lap(RunTiming *t, TimingValue phase, double since) {
+  double now = timing_now();
+  t->value[phase] += now - since;
+  return now;
+}
+
+/*
+Name: timing_output():
+Parameters: QueryTiming *qt, const char *data, size_t len
+Return: void
+Description:
+
+Adds len bytes of formatted results to qt. Every matching row is formatted as
+exactly one line, so the newlines are its rows matched.
+*/
+void timing_output(QueryTiming *qt, const char *data, size_t len) {
+  const char *end = data + len;
+  size_t lines = 0;
+
+  while (data < end && (data = memchr(data, '\n', (size_t)(end - data)))) {
+    lines++;
+    data++;
+  }
+  qt->rows_matched += (double)lines;
+  qt->bytes += (double)len;
+}
+
+/*
+Name: timing_finish():
+Parameters: RunTiming *t
+Return: void
+Description:
+
+Stops the run clock and totals the per-query counters.
+*/
+void timing_finish(RunTiming *t) {
+  t->value[TIME_TOTAL] = timing_now() - t->start;
+  t->value[COUNT_SCANNED] = 0;
+  t->value[COUNT_MATCHED] = 0;
+  t->value[COUNT_BYTES] = 0;
+  t->value[COUNT_KERNEL_QUERIES] = 0;
+  for (int i = 0; i < t->num_queries; i++) {
+    t->value[COUNT_SCANNED] += t->queries[i].rows_scanned;
+    t->value[COUNT_MATCHED] += t->queries[i].rows_matched;
+    t->value[COUNT_BYTES] += t->queries[i].bytes;
+    t->value[COUNT_KERNEL_QUERIES] += t->queries[i].kernel;
+  }
+}
+
+/*
+Name: timing_summary_local():
+Parameters: const RunTiming *t, TimingSummary *s
+Return: void
+Description:
+
+Summary of a single-process run: min, max and sum are all the process's own
+values.
+*/
+void timing_summary_local(const RunTiming *t, TimingSummary *s) {
+  memcpy(s->min, t->value, sizeof(s->min));
+  memcpy(s->max, t->value, sizeof(s->max));
+  memcpy(s->sum, t->value, sizeof(s->sum));
+  s->processes = 1;
+}
+
+/*
+Name: timing_print():
+Parameters: FILE *out, const TimingSummary *s
+Return: void
+Description:
+
+Appends the phase times and counters to a timing summary. With several
+processes each phase shows the slowest rank, then the fastest and the mean;
+counters are totals over all processes. The cache line only appears when
+--cache was used.
+*/
+void timing_print(FILE *out, const TimingSummary *s) {
+  if (s->processes > 1) {
+    fprintf(out, "  Phases (max across ranks, then min and avg):\n");
+  } else {
+    fprintf(out, "  Phases:\n");
+  }
+  for (int v = TIME_LOAD; v <= TIME_OUTPUT; v++) {
+    fprintf(out, "    %-12s %.6f seconds", value_names[v], s->max[v]);
+    if (s->processes > 1) {
+      fprintf(out, " (min %.6f, avg %.6f)", s->min[v],
+              s->sum[v] / s->processes);
+    }
+    fprintf(out, "\n");
+  }
+  fprintf(out, "  Rows scanned: %.0f, matched: %.0f, bytes emitted: %.0f\n",
+          s->sum[COUNT_SCANNED], s->sum[COUNT_MATCHED], s->sum[COUNT_BYTES]);
+  if (s->sum[COUNT_CACHE_HITS] + s->sum[COUNT_CACHE_MISSES] > 0) {
+    fprintf(out, "  Result cache: %.0f hits, %.0f misses\n",
+            s->sum[COUNT_CACHE_HITS], s->sum[COUNT_CACHE_MISSES]);
+  }
+  if (s->sum[COUNT_LOCAL_ROWS] + s->sum[COUNT_REMOTE_ROWS] > 0) {
+    fprintf(out, "  NUMA rows: %.0f local, %.0f remote\n",
+            s->sum[COUNT_LOCAL_ROWS], s->sum[COUNT_REMOTE_ROWS]);
+  }
+  if (s->sum[COUNT_KERNEL_QUERIES] > 0) {
+    fprintf(out, "  Specialized kernels: %.0f queries\n",
+            s->sum[COUNT_KERNEL_QUERIES]);
+  }
+}
+
+/*
+Name: write_json_string():
+Parameters: FILE *out, const char *s
+Return: void
+Description:
+
+Writes s as a quoted JSON string, escaping quotes, backslashes and control
+characters; NULL becomes null.
+*/
+static void write_json_string(FILE *out, const char *s) {
+  if (s == NULL) {
+    fputs("null", out);
+    return;
+  }
+  fputc('"', out);
+  for (; *s; s++) {
+    unsigned char c = (unsigned char)*s;
+    if (c == '"' || c == '\\') {
+      fprintf(out, "\\%c", c);
+    } else if (c < 0x20) {
+      fprintf(out, "\\u%04x", c);
+    } else {
+      fputc(c, out);
+    }
+  }
+  fputc('"', out);
+}
+
+/*
+Name: write_json():
+Parameters: FILE *out, const TimingInfo *info, const TimingSummary *s,
+            const QueryTiming *queries, int num_queries
+Return: bool
+Description:
+
+Writes the run as one JSON object on one line: the run description, every
+phase as {"min","max","avg"}, the counter totals and a per_query array.
+Returns false on a write error.
+*/
+static bool write_json(FILE *out, const TimingInfo *info,
+                       const TimingSummary *s, const QueryTiming *queries,
+                       int num_queries) {
+  fputs("{\"engine\":", out);
+  write_json_string(out, info->engine);
+  fputs(",\"db_file\":", out);
+  write_json_string(out, info->db_file);
+  fputs(",\"query_file\":", out);
+  write_json_string(out, info->query_file);
+  fputs(",\"layout\":", out);
+  write_json_string(out, info->layout);
+  fputs(",\"mode\":", out);
+  write_json_string(out, info->mode);
+  fprintf(out, ",\"processes\":%d,\"threads\":%d,\"tuples\":%lld,"
+               "\"queries\":%d",
+          s->processes, info->threads, info->tuples, num_queries);
+
+  for (int v = TIME_TOTAL; v <= TIME_OUTPUT; v++) {
+    fprintf(out, ",\"%s\":{\"min\":%.6f,\"max\":%.6f,\"avg\":%.6f}",
+            value_names[v], s->min[v], s->max[v], s->sum[v] / s->processes);
+  }
+  for (int v = COUNT_SCANNED; v < QPE_TIMING_VALUES; v++) {
+    fprintf(out, ",\"%s\":%.0f", value_names[v], s->sum[v]);
+  }
+
+  fputs(",\"per_query\":[", out);
+  for (int i = 0; queries && i < num_queries; i++) {
+    fprintf(out,
+            "%s{\"query\":%d,\"seconds\":%.6f,\"rows_scanned\":%.0f,"
+            "\"rows_matched\":%.0f,\"bytes_emitted\":%.0f}",
+            i > 0 ? "," : "", i + 1, queries[i].seconds,
+            queries[i].rows_scanned, queries[i].rows_matched,
+            queries[i].bytes);
+  }
+  fputs("]}\n", out);
+  return !ferror(out);
+}
+
+/*
+Name: write_csv_field():
+Parameters: FILE *out, const char *s
+Return: void
+Description:
+
+Writes s as one CSV field per RFC 4180: as is, unless it holds a comma, a
+quote or a line break, in which case it is quoted and its quotes doubled.
+NULL becomes an empty field.
+*/
+static void write_csv_field(FILE *out, const char *s) {
+  if (s == NULL) {
+    return;
+  }
+  if (strpbrk(s, ",\"\r\n") == NULL) {
+    fputs(s, out);
+    return;
+  }
+  fputc('"', out);
+  for (; *s; s++) {
+    if (*s == '"') {
+      fputc('"', out);
+    }
+    fputc(*s, out);
+  }
+  fputc('"', out);
+}
+
+/*
+Name: write_csv():
+Parameters: FILE *out, bool header, const TimingInfo *info,
+            const TimingSummary *s, int num_queries
+Return: bool
+Description:
+
+Writes the run as one CSV row, preceded by the column names when header is set.
+The string fields are quoted as needed (write_csv_field()). Per-query figures
+are left to the JSON form. Returns false on a write error.
+*/
+static bool write_csv(FILE *out, bool header, const TimingInfo *info,
+                      const TimingSummary *s, int num_queries) {
+  if (header) {
+    fputs("engine,db_file,query_file,layout,mode,processes,threads,tuples,"
+          "queries",
+          out);
+    for (int v = TIME_TOTAL; v <= TIME_OUTPUT; v++) {
+      fprintf(out, ",%s_min,%s_max,%s_avg", value_names[v], value_names[v],
+              value_names[v]);
+    }
+    for (int v = COUNT_SCANNED; v < QPE_TIMING_VALUES; v++) {
+      fprintf(out, ",%s", value_names[v]);
+    }
+    fputc('\n', out);
+  }
+
+  write_csv_field(out, info->engine);
+  fputc(',', out);
+  write_csv_field(out, info->db_file);
+  fputc(',', out);
+  write_csv_field(out, info->query_file);
+  fputc(',', out);
+  write_csv_field(out, info->layout);
+  fputc(',', out);
+  write_csv_field(out, info->mode);
+  fprintf(out, ",%d,%d,%lld,%d", s->processes, info->threads, info->tuples,
+          num_queries);
+  for (int v = TIME_TOTAL; v <= TIME_OUTPUT; v++) {
+    fprintf(out, ",%.6f,%.6f,%.6f", s->min[v], s->max[v],
+            s->sum[v] / s->processes);
+  }
+  for (int v = COUNT_SCANNED; v < QPE_TIMING_VALUES; v++) {
+    fprintf(out, ",%.0f", s->sum[v]);
+  }
+  fputc('\n', out);
+  return !ferror(out);
+}
+
+/*
+Name: timing_write():
+Parameters: const char *path, const TimingInfo *info, const TimingSummary *s,
+            const QueryTiming *queries, int num_queries
+Return: bool
+Description:
+
+Appends the run to the --timing log at path: a CSV row if path ends in
+".csv" (with a header line when the file is new or empty), otherwise a JSON
+line. queries may be NULL. Returns false, after reporting why, if the log
+could not be written.
+*/
+bool timing_write(const char *path, const TimingInfo *info,
+                  const TimingSummary *s, const QueryTiming *queries,
+                  int num_queries) {
+  size_t len = strlen(path);
+  bool csv = len >= 4 && strcmp(path + len - 4, ".csv") == 0;
+  FILE *out = fopen(path, "a");
+  bool ok;
+
+  if (out == NULL) {
+    perror(path);
+    return false;
+  }
+  if (csv) {
+    fseek(out, 0, SEEK_END);
+    ok = write_csv(out, ftell(out) == 0, info, s, num_queries);
+  } else {
+    ok = write_json(out, info, s, queries, num_queries);
+  }
+  if (fclose(out) != 0 || !ok) {
+    fprintf(stderr, "Error: failed writing timing log %s\n", path);
+    return false;
+  }
+  return true;
+}
+
+/*
+Name: timing_free():
+Parameters: RunTiming *t
+Return: void
+Description:
+
+Releases the per-query records.
+*/
+void timing_free(RunTiming *t) {
+  free(t->queries);
+  t->queries = NULL;
+  t->num_queries = 0;
+}
@@ -0,0 +1,102 @@
+/*
+
+QPETiming.h
+
+Wall-clock instrumentation shared by the engines (see QPETiming.c). A run is
+split into phases:
+
+- load         reading and parsing the database, and the B-tree bulk load
+- materialize  column store, secondary indexes, loading and planning queries
+- distribute   moving rows, statistics and queries between MPI ranks
+- filter       evaluating the queries into result buffers
+- output       writing the results (gathering them to rank 0 under MPI)
+
+Every query also gets its wall time, rows scanned, rows matched and bytes
+emitted, and the run counts its --cache hits and misses and the queries a
+specialized scan kernel answered. A TimingSummary
+holds the min, max and sum of each figure over all processes (one for
+qpe_seq and qpe_omp, every rank for qpe_mpi), so the engines report and log
+the same fields. --timing=FILE appends the summary as
+one JSON line, or one CSV row when FILE ends in ".csv".
+
+*/
+
+#ifndef QPE_TIMING_H
+#define QPE_TIMING_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+/*
+Struct Definitions
+*/
+typedef enum {
+  TIME_TOTAL,
+  TIME_LOAD,
+  TIME_MATERIALIZE,
+  TIME_DISTRIBUTE,
+  TIME_FILTER,
+  TIME_OUTPUT,
+  COUNT_SCANNED,
+  COUNT_MATCHED,
+  COUNT_BYTES,
+  COUNT_CACHE_HITS,
+  COUNT_CACHE_MISSES,
+  COUNT_LOCAL_ROWS,  /* qpe_omp --numa: scanned from the thread's own node */
+  COUNT_REMOTE_ROWS, /* and from another node's memory */
+  COUNT_KERNEL_QUERIES, /* answered by a QPEKernel.c scan kernel */
+  QPE_TIMING_VALUES
+} TimingValue;
+
+typedef struct {
+  double seconds;
+  double rows_scanned;
+  double rows_matched;
+  double bytes;
+  bool kernel; /* the scan ran a specialized kernel (QPEKernel.c) */
+} QueryTiming;
+
+typedef struct {
+  double start; /* timing_now() when the run began */
+  double value[QPE_TIMING_VALUES];
+  QueryTiming *queries; /* one per query, NULL until timing_queries() */
+  int num_queries;
+} RunTiming;
+
+typedef struct {
+  double min[QPE_TIMING_VALUES];
+  double max[QPE_TIMING_VALUES];
+  double sum[QPE_TIMING_VALUES];
+  int processes;
+} TimingSummary;
+
+/* What the run was, for the --timing log. */
+typedef struct {
+  const char *engine;
+  const char *db_file;
+  const char *query_file;
+  const char *layout;
+  const char *mode;
+  int processes;
+  int threads;
+  long long tuples;
+} TimingInfo;
+
+/*
+Function Prototypes
+*/
+double timing_now(void);
+void timing_init(RunTiming *t);
+bool timing_queries(RunTiming *t, int num_queries);
+double timing_lap(RunTiming *t, TimingValue phase, double since);
+void timing_output(QueryTiming *qt, const char *data, size_t len);
+void timing_finish(RunTiming *t);
+void timing_summary_local(const RunTiming *t, TimingSummary *s);
+void timing_print(FILE *out, const TimingSummary *s);
+bool timing_write(const char *path, const TimingInfo *info,
+                  const TimingSummary *s, const QueryTiming *queries,
+                  int num_queries);
+void timing_free(RunTiming *t);
+
+#endif
@@ -0,0 +1,444 @@
+/*
+
+QPETopK.c
+
+Authors:
+    Aidan Levy
+    Maddie Powell
+    Nick Corcoran
+    Austin Phalines
+    Dean Bullock
+
+Creation Date: 10-14-2026
+
+Description:
+
+Bounded top-k selection for ORDER BY ... LIMIT queries (QPETopK.h), shared
+by the engines. topk_add() offers one matching row to the heap; topk_scan()
+and topk_query() feed it the matches of a row range or of a whole plan (ID
+range, index lookup or full scan) over an ID-ordered array, the way
+agg_scan() and agg_query() feed an AggTable. Both layouts select from that
+array: only k rows are ever formatted, so there is nothing for the column
+store's bitmap kernels to save.
+
+The heap starts empty and doubles up to the limit as rows arrive, so a large
+LIMIT costs memory only for the rows that actually match. topk_format()
+heap-sorts it in place, which needs no comparator context (qsort() has
+none), then formats the rows best first.
+
+*/
+
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "QPETopK.h"
+
+/* Rows the heap is first sized for. */
+#define QPE_TOPK_INITIAL 64
+
+/*
+Struct Definitions
+*/
+typedef struct {
+  TopK *t;
+  long long id_lo; /* inclusive ID bounds of the walk */
+  long long id_hi;
+  size_t scanned;
+  bool ok;
+} TreeCtx;
+
+/*
+Function Prototypes
+*/
+static bool topk_before(const Query *q, const CarInventory *a,
+                        const CarInventory *b);
+static bool topk_past(const TopK *t, const CarInventory *car);
+static void sift_up(TopK *t, size_t i);
+static void sift_down(TopK *t, size_t i, size_t count);
+static bool tree_iter_cb(const void *item, void *udata);
+static bool topk_tree(TopK *t, struct btree *tree, const QueryPlan *plan,
+                      size_t *scanned);
+
+/*
+Name: topk_before():
+Parameters: const Query *q, const CarInventory *a, const CarInventory *b
+Return: bool
+Description:
+
+Whether a ranks before b in q's ORDER BY: by the column in its direction,
+and rows of equal Price by ascending ID.
+*/
+static bool topk_before(const Query *q, const CarInventory *a,
+                        const CarInventory *b) {
+  if (q->order_col == COL_PRICE && a->Price != b->Price) {
+    return q->order_desc ? a->Price > b->Price : a->Price < b->Price;
+  }
+  if (q->order_col == COL_ID && q->order_desc) {
+    return a->ID > b->ID;
+  }
+  return a->ID < b->ID;
+}
+
+/*
+Name: sift_up():
+Parameters: TopK *t, size_t i
+Return: void
+Description:
+
+Moves the row at i up the heap until its parent ranks after it.
+*/
+static void sift_up(TopK *t, size_t i) {
+  while (i > 0) {
+    size_t parent = (i - 1) / 2;
+    CarInventory tmp;
+    if (!topk_before(t->q, &t->rows[parent], &t->rows[i])) {
+      return;
+    }
+    tmp = t->rows[parent];
+    t->rows[parent] = t->rows[i];
+    t->rows[i] = tmp;
+    i = parent;
+  }
+}
+
+/*
+Name: sift_down():
+Parameters: TopK *t, size_t i, size_t count
+Return: void
+Description:
+
+Moves the row at i down the heap of the first count rows until no child
+ranks after it.
+*/
+static void sift_down(TopK *t, size_t i, size_t count) {
+  for (;;) {
+    size_t worst = i;
+    size_t left = 2 * i + 1;
+    size_t right = left + 1;
+    CarInventory tmp;
+    if (left < count && topk_before(t->q, &t->rows[worst], &t->rows[left])) {
+      worst = left;
+    }
+    if (right < count &&
+        topk_before(t->q, &t->rows[worst], &t->rows[right])) {
+      worst = right;
+    }
+    if (worst == i) {
+      return;
+    }
+    tmp = t->rows[worst];
+    t->rows[worst] = t->rows[i];
+    t->rows[i] = tmp;
+    i = worst;
+  }
+}
+
+/*
+Name: topk_init():
+Parameters: TopK *t, const Query *q
+Return: void
+Description:
+
+Prepares an empty TopK for the ordered query q. Nothing is allocated until
+the first row is kept.
+*/
+void topk_init(TopK *t, const Query *q) {
+  memset(t, 0, sizeof(*t));
+  t->q = q;
+}
+
+/*
+Name: topk_free():
+Parameters: TopK *t
+Return: void
+Description:
+
+Releases the kept rows.
+*/
+void topk_free(TopK *t) {
+  free(t->rows);
+  t->rows = NULL;
+  t->count = 0;
+  t->cap = 0;
+}
+
+/*
+Name: topk_full():
+Parameters: const TopK *t
+Return: bool
+Description:
+
+Whether t holds its query's limit of rows, so a row must beat rows[0] to
+get in.
+*/
+bool topk_full(const TopK *t) {
+  return t->count >= (size_t)t->q->limit;
+}
+
+/*
+Name: topk_past():
+Parameters: const TopK *t, const CarInventory *car
+Return: bool
+Description:
+
+Whether car cannot get into t because t is full and car does not beat
+rows[0]. Reading an ID-ordered query's rows in its order, every row after
+such a car ranks lower still, so the scan can stop there.
+*/
+static bool topk_past(const TopK *t, const CarInventory *car) {
+  return topk_full(t) &&
+         (t->count == 0 || !topk_before(t->q, car, &t->rows[0]));
+}
+
+/*
+Name: topk_add():
+Parameters: TopK *t, const CarInventory *car
+Return: bool
+Description:
+
+Keeps car if it is among the best limit rows offered so far, dropping the
+row it displaces. car must match the query. Returns false on allocation
+failure.
+*/
+bool topk_add(TopK *t, const CarInventory *car) {
+  if (topk_full(t)) {
+    if (t->count > 0 && topk_before(t->q, car, &t->rows[0])) {
+      t->rows[0] = *car;
+      sift_down(t, 0, t->count);
+    }
+    return true;
+  }
+  if (t->count == t->cap) {
+    size_t cap = t->cap > 0 ? t->cap * 2 : QPE_TOPK_INITIAL;
+    CarInventory *rows;
+    if (cap > (size_t)t->q->limit) {
+      cap = (size_t)t->q->limit;
+    }
+    rows = realloc(t->rows, cap * sizeof(CarInventory));
+    if (rows == NULL) {
+      return false;
+    }
+    t->rows = rows;
+    t->cap = cap;
+  }
+  t->rows[t->count] = *car;
+  sift_up(t, t->count++);
+  return true;
+}
+
+/*
+Name: topk_merge_rows():
+Parameters: TopK *t, const CarInventory *rows, size_t count
+Return: bool
+Description:
+
+Offers another TopK's kept rows (in any order, such as received from
+another rank) to t. Returns false on allocation failure.
+*/
+bool topk_merge_rows(TopK *t, const CarInventory *rows, size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    if (!topk_add(t, &rows[i])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/*
+Name: topk_merge():
+Parameters: TopK *dst, const TopK *src
+Return: bool
+Description:
+
+Adds the rows src kept to dst, both for the same query. Returns false on
+allocation failure.
+*/
+bool topk_merge(TopK *dst, const TopK *src) {
+  return topk_merge_rows(dst, src->rows, src->count);
+}
+
+/*
+Name: topk_scan():
+Parameters: TopK *t, const CarInventory *rows, size_t begin, size_t end,
+            size_t *scanned
+Return: bool
+Description:
+
+Offers the rows of [begin, end) that match t's query, which must be in
+ascending ID order. Ordered by ID the range is read in the query's
+direction, and the scan stops at the first row that cannot beat a full
+heap, since every row after it ranks lower still (at once for LIMIT 0).
+Adds the rows tested to *scanned and returns false on allocation failure.
+*/
+bool topk_scan(TopK *t, const CarInventory *rows, size_t begin, size_t end,
+               size_t *scanned) {
+  const Query *q = t->q;
+  bool by_id = q->order_col == COL_ID;
+  bool ok = true;
+
+  for (size_t n = 0; ok && n < end - begin; n++) {
+    const CarInventory *car =
+        by_id && q->order_desc ? &rows[end - 1 - n] : &rows[begin + n];
+    if ((by_id || q->limit == 0) && topk_past(t, car)) {
+      break;
+    }
+    ++*scanned;
+    if (match_where(car, &q->where)) {
+      ok = topk_add(t, car);
+    }
+  }
+  return ok;
+}
+
+/*
+Name: tree_iter_cb():
+Parameters: const void *item, void *udata
+Return: bool
+Description:
+
+btree_ascend() / btree_descend() callback for an ID-ordered query: offers
+matching records and returns false, ending the walk, once it leaves the ID
+bounds or it cannot beat a full heap (no later record can either).
+*/
+static bool tree_iter_cb(const void *item, void *udata) {
+  const CarInventory *car = (const CarInventory *)item;
+  TreeCtx *ctx = (TreeCtx *)udata;
+
+  if (car->ID < ctx->id_lo || car->ID > ctx->id_hi || topk_past(ctx->t, car)) {
+    return false;
+  }
+  ctx->scanned++;
+  if (match_where(car, &ctx->t->q->where)) {
+    ctx->ok = topk_add(ctx->t, car);
+  }
+  return ctx->ok;
+}
+
+/*
+Name: topk_tree():
+Parameters: TopK *t, struct btree *tree, const QueryPlan *plan,
+            size_t *scanned
+Return: bool
+Description:
+
+Answers an ID-ordered query by walking the B-tree in its direction, from
+the plan's ID bound nearest the start (PLAN_ID_RANGE) or from the end of
+the tree, so the walk visits only the records up to the k-th match. Adds
+the records visited to *scanned and returns false on allocation failure.
+*/
+static bool topk_tree(TopK *t, struct btree *tree, const QueryPlan *plan,
+                      size_t *scanned) {
+  TreeCtx ctx = {.t = t, .id_lo = INT_MIN, .id_hi = INT_MAX, .ok = true};
+  CarInventory pivot;
+  bool range = plan->path == PLAN_ID_RANGE;
+
+  if (range) {
+    ctx.id_lo = plan->id_lo;
+    ctx.id_hi = plan->id_hi;
+  }
+  if (ctx.id_lo > ctx.id_hi) {
+    return true;
+  }
+  memset(&pivot, 0, sizeof(pivot));
+  pivot.ID = (int)(t->q->order_desc ? ctx.id_hi : ctx.id_lo);
+  if (t->q->order_desc) {
+    btree_descend(tree, range ? &pivot : NULL, tree_iter_cb, &ctx);
+  } else {
+    btree_ascend(tree, range ? &pivot : NULL, tree_iter_cb, &ctx);
+  }
+  *scanned += ctx.scanned;
+  return ctx.ok;
+}
+
+/*
+Name: topk_query():
+Parameters: TopK *t, struct btree *tree, const CarInventory *rows,
+            size_t count, const SecondaryIndex *index,
+            const QueryPlan *plan, size_t *scanned
+Return: bool
+Description:
+
+Selects the whole query over the ID-ordered rows along its plan. An
+ID-ordered full scan or ID range walks tree when there is one
+(topk_tree()); otherwise a PLAN_ID_RANGE plan binary searches the lower
+bound and stops past the upper one, an index plan tests only the candidate
+rows (falling back to a full scan if the lookup fails or index is NULL), and
+a full scan tests every row, all stopping early when ordered by ID. Adds
+the rows tested to *scanned and returns false on allocation failure.
+*/
+bool topk_query(TopK *t, struct btree *tree, const CarInventory *rows,
+                size_t count, const SecondaryIndex *index,
+                const QueryPlan *plan, size_t *scanned) {
+  const Query *q = t->q;
+  PostingList hits;
+
+  if (tree != NULL && q->order_col == COL_ID &&
+      (plan->path == PLAN_FULL_SCAN || plan->path == PLAN_ID_RANGE)) {
+    return topk_tree(t, tree, plan, scanned);
+  }
+
+  if (plan->path == PLAN_ID_RANGE) {
+    size_t lo = 0;
+    size_t hi = count;
+    size_t end;
+    while (lo < hi) {
+      size_t mid = lo + (hi - lo) / 2;
+      if (rows[mid].ID < plan->id_lo) {
+        lo = mid + 1;
+      } else {
+        hi = mid;
+      }
+    }
+    for (end = lo; end < count && rows[end].ID <= plan->id_hi; end++) {
+    }
+    return topk_scan(t, rows, lo, end, scanned);
+  }
+
+  if (plan->path != PLAN_FULL_SCAN && index != NULL &&
+      index_lookup(index, &plan->probe, &hits)) {
+    bool by_id = q->order_col == COL_ID;
+    bool ok = true;
+    for (size_t n = 0; ok && n < hits.count; n++) {
+      size_t i = by_id && q->order_desc ? hits.count - 1 - n : n;
+      const CarInventory *car = &rows[hits.rows[i]];
+      if (by_id && topk_past(t, car)) {
+        break;
+      }
+      ++*scanned;
+      if (match_where(car, &q->where)) {
+        ok = topk_add(t, car);
+      }
+    }
+    posting_list_free(&hits);
+    return ok;
+  }
+
+  return topk_scan(t, rows, 0, count, scanned);
+}
+
+/*
+Name: topk_format():
+Parameters: TopK *t, Buffer *out
+Return: bool
+Description:
+
+Sorts the kept rows best first and appends each with append_selected(),
+in the query's order. Sorting breaks the heap, so the rows are dropped
+afterwards. Returns false on allocation failure.
+*/
+bool topk_format(TopK *t, Buffer *out) {
+  bool ok = true;
+
+  for (size_t n = t->count; n > 1; n--) {
+    CarInventory tmp = t->rows[0];
+    t->rows[0] = t->rows[n - 1];
+    t->rows[n - 1] = tmp;
+    sift_down(t, 0, n - 1);
+  }
+  for (size_t i = 0; ok && i < t->count; i++) {
+    ok = append_selected(&t->rows[i], t->q, out);
+  }
+  topk_free(t);
+  return ok;
+}
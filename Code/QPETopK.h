@@ -0,0 +1,61 @@
+/*
+
+QPETopK.h
+
+Evaluation of ORDER BY <column> [ASC|DESC] LIMIT k queries (see QPEQuery.h),
+ordered by ID or Price. Only the k best matches are kept, in a TopK: a
+binary heap of at most k rows with the one ranked last on top, so a match
+that does not beat it costs one comparison and replacing it costs O(log k).
+Rows of equal Price are ranked by ascending ID, which makes the result the
+same however the rows were split up. Like an AggTable, two TopKs combine in
+any order with topk_merge(): the engines give every thread or rank its own
+and merge them at the end, and only topk_format() sorts the survivors into
+result lines.
+
+The rows are in ID order, so a query ordered by ID can stop early: scanning
+in its order, once k rows are kept no later row can beat them.
+topk_scan() and topk_query() stop there, and with a B-tree topk_query()
+walks it with btree_ascend() or btree_descend() and returns false from the
+iterator to end the walk after the k-th kept match.
+
+*/
+
+#ifndef QPE_TOPK_H
+#define QPE_TOPK_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "../btree/btree.h"
+#include "QPEBuffer.h"
+#include "QPEIndex.h"
+#include "QPEPlan.h"
+#include "QPEQuery.h"
+
+/*
+Struct Definitions
+*/
+typedef struct {
+  const Query *q;
+  CarInventory *rows; /* heap: the kept row ranked last at rows[0] */
+  size_t count;
+  size_t cap; /* grown on demand up to q->limit */
+} TopK;
+
+/*
+Function Prototypes
+*/
+void topk_init(TopK *t, const Query *q);
+void topk_free(TopK *t);
+bool topk_full(const TopK *t);
+bool topk_add(TopK *t, const CarInventory *car);
+bool topk_merge_rows(TopK *t, const CarInventory *rows, size_t count);
+bool topk_merge(TopK *dst, const TopK *src);
+bool topk_scan(TopK *t, const CarInventory *rows, size_t begin, size_t end,
+               size_t *scanned);
+bool topk_query(TopK *t, struct btree *tree, const CarInventory *rows,
+                size_t count, const SecondaryIndex *index,
+                const QueryPlan *plan, size_t *scanned);
+bool topk_format(TopK *t, Buffer *out);
+
+#endif
@@ -0,0 +1,383 @@
+/*
+
+QPEZone.c
+
+Authors:
+    Aidan Levy
+    Maddie Powell
+    Nick Corcoran
+    Austin Phalines
+    Dean Bullock
+
+Creation Date: 10-14-2026
+
+Description:
+
+Zone maps over the ID-ordered row array (see QPEZone.h). zone_map_append()
+folds rows into the summary of their block, so a map can follow a table that
+grows at its end. zone_filter_init() first resolves every string comparison
+of the WHERE clause against the map's dictionaries into the set of code bits
+that satisfy it, the way column_filter_init() builds its per-code tables,
+and then walks the compiled tree once per block with the block's ranges and
+code sets. The walk answers "could any row here match": an AND needs both
+sides to be possible, an OR either, so the answer may be a false "yes" but
+never a false "no".
+
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "QPEZone.h"
+
+/*
+Function Prototypes
+*/
+static bool grow_blocks(ZoneMap *map, size_t needed);
+static void zone_block_init(ZoneBlock *block);
+static void zone_int_add(ZoneBlock *block, ZoneInt col, int32_t value);
+static void zone_code_add(ZoneBlock *block, DictId dict, int code);
+static bool int_may_match(const ZoneBlock *block, const PredNode *n);
+static bool block_may_match(const Predicate *pred, int idx,
+                            const ZoneBlock *block,
+                            uint64_t (*masks)[QPE_ZONE_CODE_WORDS]);
+
+/*
+Name: zone_map_build():
+Parameters: const CarInventory *rows, size_t count
+Return: ZoneMap *
+Description:
+
+Summarizes rows[0 .. count) block by block. Returns NULL when out of memory.
+*/
+ZoneMap *zone_map_build(const CarInventory *rows, size_t count) {
+  ZoneMap *map = calloc(1, sizeof(ZoneMap));
+
+  if (map == NULL) {
+    return NULL;
+  }
+  for (int d = 0; d < NUM_DICTS; d++) {
+    if (!dict_init(&map->dicts[d])) {
+      zone_map_free(map);
+      return NULL;
+    }
+  }
+  if (!zone_map_append(map, rows, count)) {
+    zone_map_free(map);
+    return NULL;
+  }
+  return map;
+}
+
+/*
+Name: grow_blocks():
+Parameters: ZoneMap *map, size_t needed
+Return: bool
+Description:
+
+Ensures room for needed block summaries, doubling the array as required.
+*/
+static bool grow_blocks(ZoneMap *map, size_t needed) {
+  size_t cap = map->cap_blocks > 0 ? map->cap_blocks : 16;
+  ZoneBlock *grown;
+
+  if (needed <= map->cap_blocks) {
+    return true;
+  }
+  while (cap < needed) {
+    cap *= 2;
+  }
+  grown = realloc(map->blocks, cap * sizeof(ZoneBlock));
+  if (grown == NULL) {
+    return false;
+  }
+  map->blocks = grown;
+  map->cap_blocks = cap;
+  return true;
+}
+
+/*
+Name: zone_block_init():
+Parameters: ZoneBlock *block
+Return: void
+Description:
+
+Starts an empty block: inverted ranges and no codes.
+*/
+static void zone_block_init(ZoneBlock *block) {
+  memset(block, 0, sizeof(*block));
+  for (int c = 0; c < NUM_ZONE_INTS; c++) {
+    block->min[c] = INT32_MAX;
+    block->max[c] = INT32_MIN;
+  }
+}
+
+/*
+Name: zone_int_add():
+Parameters: ZoneBlock *block, ZoneInt col, int32_t value
+Return: void
+Description:
+
+Widens the block's range of col to take in value.
+*/
+static void zone_int_add(ZoneBlock *block, ZoneInt col, int32_t value) {
+  if (value < block->min[col]) {
+    block->min[col] = value;
+  }
+  if (value > block->max[col]) {
+    block->max[col] = value;
+  }
+}
+
+/*
+Name: zone_code_add():
+Parameters: ZoneBlock *block, DictId dict, int code
+Return: void
+Description:
+
+Marks code as present in the block. A value the dictionary could not encode
+(code -1) marks every code, so the block is never ruled out on that column.
+*/
+static void zone_code_add(ZoneBlock *block, DictId dict, int code) {
+  if (code < 0) {
+    memset(block->codes[dict], 0xff, sizeof(block->codes[dict]));
+    return;
+  }
+  code %= QPE_ZONE_CODE_BITS;
+  block->codes[dict][code / 64] |= (uint64_t)1 << (code % 64);
+}
+
+/*
+Name: zone_map_append():
+Parameters: ZoneMap *map, const CarInventory *rows, size_t count
+Return: bool
+Description:
+
+Adds rows[map->count .. count), the rows appended to the array since the map
+was built or last appended to, to the summaries of their blocks. Returns
+false when out of memory, leaving the map fit only for zone_map_free().
+*/
+bool zone_map_append(ZoneMap *map, const CarInventory *rows, size_t count) {
+  for (size_t i = map->count; i < count; i++) {
+    const CarInventory *car = &rows[i];
+    size_t b = i / QPE_ZONE_ROWS;
+    ZoneBlock *block;
+
+    if (b == map->num_blocks) {
+      if (!grow_blocks(map, b + 1)) {
+        return false;
+      }
+      zone_block_init(&map->blocks[b]);
+      map->num_blocks++;
+    }
+    block = &map->blocks[b];
+    zone_int_add(block, ZONE_ID, car->ID);
+    zone_int_add(block, ZONE_YEARMAKE, car->YearMake);
+    zone_int_add(block, ZONE_PRICE, car->Price);
+    zone_code_add(block, DICT_MODEL,
+                  dict_encode(&map->dicts[DICT_MODEL], car->Model));
+    zone_code_add(block, DICT_COLOR,
+                  dict_encode(&map->dicts[DICT_COLOR], car->Color));
+    zone_code_add(block, DICT_DEALER,
+                  dict_encode(&map->dicts[DICT_DEALER], car->Dealer));
+  }
+  map->count = count;
+  return true;
+}
+
+/*
+Name: zone_map_free():
+Parameters: ZoneMap *map
+Return: void
+Description:
+
+Releases the map and its dictionaries. Accepts NULL.
+*/
+void zone_map_free(ZoneMap *map) {
+  if (map == NULL) {
+    return;
+  }
+  for (int d = 0; d < NUM_DICTS; d++) {
+    dict_free(&map->dicts[d]);
+  }
+  free(map->blocks);
+  free(map);
+}
+
+/*
+Name: int_may_match():
+Parameters: const ZoneBlock *block, const PredNode *n
+Return: bool
+Description:
+
+Whether some value inside the block's range of n's column satisfies the
+integer comparison n.
+*/
+static bool int_may_match(const ZoneBlock *block, const PredNode *n) {
+  ZoneInt col = n->column == COL_ID         ? ZONE_ID
+                : n->column == COL_YEARMAKE ? ZONE_YEARMAKE
+                                            : ZONE_PRICE;
+  int32_t lo = block->min[col];
+  int32_t hi = block->max[col];
+
+  switch (n->op) {
+  case OP_EQ:
+    return lo <= n->ival && n->ival <= hi;
+  case OP_NE:
+    return lo != n->ival || hi != n->ival;
+  case OP_GT:
+    return hi > n->ival;
+  case OP_LT:
+    return lo < n->ival;
+  case OP_GE:
+    return hi >= n->ival;
+  default:
+    return lo <= n->ival;
+  }
+}
+
+/*
+Name: block_may_match():
+Parameters: const Predicate *pred, int idx, const ZoneBlock *block,
+            uint64_t (*masks)[QPE_ZONE_CODE_WORDS]
+Return: bool
+Description:
+
+Whether any row of the block could satisfy node idx, given the code bits
+masks[idx] of every string comparison that make it true.
+*/
+static bool block_may_match(const Predicate *pred, int idx,
+                            const ZoneBlock *block,
+                            uint64_t (*masks)[QPE_ZONE_CODE_WORDS]) {
+  const PredNode *n = &pred->nodes[idx];
+
+  switch (n->kind) {
+  case PRED_INT_CMP:
+    return int_may_match(block, n);
+  case PRED_STR_CMP: {
+    DictId dict = n->column == COL_MODEL   ? DICT_MODEL
+                  : n->column == COL_COLOR ? DICT_COLOR
+                                           : DICT_DEALER;
+    for (int w = 0; w < QPE_ZONE_CODE_WORDS; w++) {
+      if (block->codes[dict][w] & masks[idx][w]) {
+        return true;
+      }
+    }
+    return false;
+  }
+  case PRED_AND:
+    return block_may_match(pred, n->left, block, masks) &&
+           block_may_match(pred, n->right, block, masks);
+  case PRED_OR:
+    return block_may_match(pred, n->left, block, masks) ||
+           block_may_match(pred, n->right, block, masks);
+  default:
+    return n->truth != 0;
+  }
+}
+
+/*
+Name: zone_filter_init():
+Parameters: ZoneFilter *filter, const ZoneMap *map, const Predicate *pred
+Return: bool
+Description:
+
+Decides for every block of map whether pred can rule it out. With no map, an
+empty WHERE clause, or no block ruled out, filter->candidate stays NULL and
+zone_next() hands back whole ranges. Returns false on allocation failure.
+*/
+bool zone_filter_init(ZoneFilter *filter, const ZoneMap *map,
+                      const Predicate *pred) {
+  uint64_t(*masks)[QPE_ZONE_CODE_WORDS];
+
+  memset(filter, 0, sizeof(*filter));
+  if (map == NULL || pred->root < 0 || map->num_blocks == 0) {
+    return true;
+  }
+  masks = calloc(QPE_MAX_PRED_NODES, sizeof(*masks));
+  filter->candidate = malloc(map->num_blocks);
+  if (masks == NULL || filter->candidate == NULL) {
+    free(masks);
+    zone_filter_free(filter);
+    return false;
+  }
+  for (int i = 0; i < pred->num_nodes; i++) {
+    const PredNode *n = &pred->nodes[i];
+    const Dictionary *dict;
+    if (n->kind != PRED_STR_CMP) {
+      continue;
+    }
+    dict = &map->dicts[n->column == COL_MODEL   ? DICT_MODEL
+                       : n->column == COL_COLOR ? DICT_COLOR
+                                                : DICT_DEALER];
+    for (int code = 0; code < dict->count; code++) {
+      int cmp = strcasecmp(dict->values[code], pred->strpool + n->str);
+      if (apply_op((CompareOp)n->op, cmp)) {
+        int bit = code % QPE_ZONE_CODE_BITS;
+        masks[i][bit / 64] |= (uint64_t)1 << (bit % 64);
+      }
+    }
+  }
+
+  filter->num_blocks = map->num_blocks;
+  for (size_t b = 0; b < map->num_blocks; b++) {
+    filter->candidate[b] =
+        block_may_match(pred, pred->root, &map->blocks[b], masks);
+    filter->skipped += !filter->candidate[b];
+  }
+  free(masks);
+  if (filter->skipped == 0) {
+    zone_filter_free(filter);
+  }
+  return true;
+}
+
+/*
+Name: zone_filter_free():
+Parameters: ZoneFilter *filter
+Return: void
+Description:
+
+Releases the per-block verdicts; the filter then skips nothing.
+*/
+void zone_filter_free(ZoneFilter *filter) {
+  free(filter->candidate);
+  memset(filter, 0, sizeof(*filter));
+}
+
+/*
+Name: zone_next():
+Parameters: const ZoneFilter *filter, size_t row, size_t end, size_t *stop
+Return: size_t
+Description:
+
+The first row in [row, end) whose block may hold a match, or end if there is
+none; *stop is set to the end of the run of candidate blocks it starts, so
+the caller scans [result, *stop) and asks again from there. Rows past the
+blocks the filter knows of are always candidates. filter may be NULL.
+*/
+size_t zone_next(const ZoneFilter *filter, size_t row, size_t end,
+                 size_t *stop) {
+  size_t b = row / QPE_ZONE_ROWS;
+
+  *stop = end;
+  if (filter == NULL || filter->candidate == NULL) {
+    return row;
+  }
+  while (row < end && b < filter->num_blocks && !filter->candidate[b]) {
+    b++;
+    row = b * QPE_ZONE_ROWS;
+  }
+  if (row >= end) {
+    return end;
+  }
+  while (b < filter->num_blocks && b * QPE_ZONE_ROWS < end &&
+         filter->candidate[b]) {
+    b++;
+  }
+  if (b < filter->num_blocks && b * QPE_ZONE_ROWS < end) {
+    *stop = b * QPE_ZONE_ROWS;
+  }
+  return row;
+}
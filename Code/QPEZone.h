@@ -0,0 +1,74 @@
+/*
+
+QPEZone.h
+
+Zone maps: min/max summaries of fixed-size blocks of the ID-ordered row
+array, used to skip whole blocks during full scans (see QPEZone.c). Every
+block of QPE_ZONE_ROWS rows records the smallest and largest ID, YearMake and
+Price it holds, and for Model, Color and Dealer a QPE_ZONE_CODE_BITS-bit set
+of the dictionary codes present (code modulo the set size, so a large
+vocabulary only makes the sets less selective, never wrong).
+
+A WHERE clause is bound to a zone map with zone_filter_init(), which decides
+once per query, for every block, whether any row in it could satisfy the
+clause. Scans then ask zone_next() for the next run of candidate blocks.
+Blocks are numbered from row 0 of the array the map was built over, so the
+blocks of a scan chunk are the same whatever the chunk size. The win is on
+files clustered by a column (by Dealer, YearMake or Price ranges, say), where
+a selective comparison rules out most blocks without an index.
+
+*/
+
+#ifndef QPE_ZONE_H
+#define QPE_ZONE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "QPEColumn.h"
+#include "QPEQuery.h"
+
+#define QPE_ZONE_ROWS ((size_t)64 << 10)
+#define QPE_ZONE_CODE_BITS 256
+#define QPE_ZONE_CODE_WORDS (QPE_ZONE_CODE_BITS / 64)
+
+/*
+Struct Definitions
+*/
+typedef enum { ZONE_ID, ZONE_YEARMAKE, ZONE_PRICE, NUM_ZONE_INTS } ZoneInt;
+
+typedef struct {
+  int32_t min[NUM_ZONE_INTS];
+  int32_t max[NUM_ZONE_INTS];
+  uint64_t codes[NUM_DICTS][QPE_ZONE_CODE_WORDS]; /* codes present, by DictId */
+} ZoneBlock;
+
+typedef struct {
+  size_t count; /* rows summarized */
+  size_t num_blocks;
+  size_t cap_blocks;
+  ZoneBlock *blocks;
+  Dictionary dicts[NUM_DICTS]; /* string value of every code */
+} ZoneMap;
+
+typedef struct {
+  unsigned char *candidate; /* per block: 0 when no row can match, NULL when
+                               no block is ruled out */
+  size_t num_blocks;
+  size_t skipped; /* blocks ruled out */
+} ZoneFilter;
+
+/*
+Function Prototypes
+*/
+ZoneMap *zone_map_build(const CarInventory *rows, size_t count);
+bool zone_map_append(ZoneMap *map, const CarInventory *rows, size_t count);
+void zone_map_free(ZoneMap *map);
+bool zone_filter_init(ZoneFilter *filter, const ZoneMap *map,
+                      const Predicate *pred);
+void zone_filter_free(ZoneFilter *filter);
+size_t zone_next(const ZoneFilter *filter, size_t row, size_t end,
+                 size_t *stop);
+
+#endif
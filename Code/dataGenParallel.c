@@ -16,6 +16,8 @@ Description:
 This program generates sample data
 inside of the file: ../db/db.txt
 
+Usage: ./dataGenParallel [--seed=N] <n> [file]
+
 The following colums are:
 - ID
 - Mode
@@ -24,161 +26,346 @@ The following colums are:
 - Price
 - Dealer
 
+Row i gets ID 1000 + i, as in dataGen.c, and its other columns come from a
+counter-based generator: splitmix64 of the seed and the row number. No random
+state is shared between threads, and a row does not depend on which thread
+makes it, so a given --seed writes the same file at any thread count.
+Without --seed the seed comes from the clock.
+
+The rows are made in rounds. In each round every thread formats a block of
+GEN_BLOCK_ROWS rows into its own buffer. One thread then adds up the block
+sizes to get each block's file offset, and every thread writes its block
+there with pwrite(). No thread ever waits on a shared FILE *.
+
 */
 
+#include <fcntl.h>
+#include <limits.h>
+#include <omp.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
-#include <omp.h>
+#include <unistd.h>
+
+#define GEN_BLOCK_ROWS 65536
+#define GEN_MAX_ROW 64 /* longest formatted row, with room to spare */
+#define GEN_HEADER "ID Model YearMake Color Price Dealer\n"
+
+static const char *const models[] = {"Accord", "Corolla", "Civic",
+                                     "Maxima", "Focus",   "Camry"};
+static const int numModels = 6;
+
+static const int years[] = {2000, 2013, 2015, 2016, 2018, 2020, 2021, 2023};
+static const int numYears = 8;
+
+static const char *const colors[] = {"Gray",  "White", "Blue",
+                                     "Red",   "Green", "Black"};
+static const int numColors = 6;
+
+static const char *const dealers[] = {"Pohanka", "AutoNation", "Mitsubishi",
+                                      "Sonic",   "Suburban",   "Atlantic",
+                                      "Ganley",  "Victory",    "GM"};
+static const int numDealers = 9;
 
 /*
 Function Prototypes
 */
-void generate_data(const char *filename, long n);
-int random_price(const char *model, int year);
+int generate_data(const char *filename, long n, uint64_t seed);
+uint64_t row_random(uint64_t seed, long row, int draw);
+int random_price(int model, int year, uint64_t r);
+static size_t append_int(char *out, int value);
+static size_t append_str(char *out, const char *s, char sep);
+size_t format_row(char *out, uint64_t seed, long row);
+size_t format_block(char *out, uint64_t seed, long begin, long end);
+int write_at(int fd, const char *data, size_t len, off_t offset);
 
 int main(int argc, char **argv) {
 
-  long n;
+  long n = 0;
   const char *filename = "../db/db.txt";
-  srand(time(NULL));
+  uint64_t seed = (uint64_t)time(NULL);
+  int positional = 0;
 
-  if (argc < 2) {
-    printf("Usage: ./dataGen <n>\n");
-    return 1;
+  for (int i = 1; i < argc; i++) {
+    if (strncmp(argv[i], "--seed=", 7) == 0) {
+      seed = strtoull(argv[i] + 7, NULL, 10);
+    } else if (positional == 0) {
+      n = atol(argv[i]);
+      positional++;
+    } else if (positional == 1) {
+      filename = argv[i];
+      positional++;
+    } else {
+      positional = -1;
+      break;
+    }
   }
 
-  n = atoi(argv[1]);
-  if (n < 1) {
-    printf("Error: Number of tuples must be > 0\n");
+  if (positional < 1) {
+    printf("Usage: ./dataGenParallel [--seed=N] <n> [file]\n");
+    return 1;
+  }
+  if (n < 1 || n > INT_MAX - 1000) {
+    printf("Error: Number of tuples must be > 0 and IDs must fit an int\n");
     return 1;
   }
 
-  generate_data(filename, n);
-
-  return 0;
+  return generate_data(filename, n, seed) == 0 ? 0 : 1;
 }
 
 /*
 Function: generate_data()
-Parameters: const char *filename, long n
-Return: Void
+Parameters: const char *filename, long n, uint64_t seed
+Return: int
 Description:
 
-Generates n tuples and write them to filename.
-If n <= 10, it also prints all tuples to consolse
-for easy debugging.
+Generates n tuples from seed and writes them to filename, after the same
+header line dataGen.c writes. If n <= 10, it also prints all tuples to the
+console for easy debugging. Returns 0 on success or -1 after reporting an
+error; every exit goes through cleanup, which frees the per-thread arrays
+and closes the file if it is still open.
 */
-void generate_data(const char *filename, long n) 
-{
-	FILE *fp;
-	long i;
-	int printToConsole = 0;
-
-	const char *models[] = {"Accord", "Corolla", "Civic",
-                          "Maxima", "Focus",   "Camry"};
-
-	const int numModels = 6;
-
-	const int years[] = {2000, 2013, 2015, 2016, 2018, 2020, 2021, 2023};
-	const int numYears = 8;
-
-	const char *colors[] = {"Gray", "White", "Blue", "Red", "Green", "Black"};
-	const int numColors = 6;
-
-	const char *dealers[] = {"Pohanka", "AutoNation", "Mitsubishi",
-                           "Sonic",   "Suburban",   "Atlantic",
-                           "Ganley",  "Victory",    "GM"};
-	const int numDealers = 9;
-
-	fp = fopen(filename, "w");
-
-	if (fp == NULL) 
-	{
-    		perror("fopen");
-    		exit(1);
-  	}
-
-  	if (n <= 10) 
-	{
-    		printToConsole = 1;
-  	}
-  	
-	
-  	if (printToConsole) 
-	{
-    		printf("ID Model YearMake Color Price Dealer\n");
-  	}
-	
-	#pragma omp parallel 
-	{
-		int run=1;
-		int endNum=n/omp_get_num_threads();
-			
-		if (n<omp_get_num_threads())
-		{	
-			if (n<omp_get_thread_num()+1)
-			{
-				run=0;
-			}
-			endNum=1;
-		}
-		else
-		{
-			if (n%omp_get_num_threads() > omp_get_thread_num())
-				endNum++;
-		}
-		int numofThreads = omp_get_num_threads();
-		int idtracker = omp_get_thread_num();
-		 
-		if (run==1)
-		{
-		#pragma omp parallel for shared (i, idtracker, n, numofThreads) 
-				for (int i=0; i < endNum; i++) {
-    				int id = 1000 + idtracker;
-    				const char *model = models[rand() % numModels];
-    				int year = years[rand() % numYears];
-    				const char *color = colors[rand() % numColors];
-    				const char *dealer = dealers[rand() % numDealers];
-    				int price = random_price(model, year);	
-    				fprintf(fp, "%d %s %d %s %d %s\n",id, model, year, color, price, dealer);					
-				#pragma omp atomic
-				idtracker+=numofThreads;
-    		if (printToConsole) {
-     	 	printf("Tnum=%d, %d %s %d %s %d %s\n",idtracker, id, model, year, color, price, dealer);
-    				}
-    			}
-		}
-	}
-	fclose(fp);
+int generate_data(const char *filename, long n, uint64_t seed) {
+  int threads = omp_get_max_threads();
+  char **bufs = calloc((size_t)threads, sizeof(char *));
+  size_t *lens = calloc((size_t)threads, sizeof(size_t));
+  off_t *offsets = calloc((size_t)threads, sizeof(off_t));
+  off_t written = (off_t)strlen(GEN_HEADER);
+  int failed = 0;
+  int fd = -1;
+
+  if (!bufs || !lens || !offsets) {
+    fprintf(stderr, "Error: out of memory\n");
+    failed = 1;
+    goto cleanup;
+  }
+  fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    perror(filename);
+    failed = 1;
+    goto cleanup;
+  }
+  if (write_at(fd, GEN_HEADER, strlen(GEN_HEADER), 0) != 0) {
+    perror(filename);
+    failed = 1;
+    goto cleanup;
+  }
+
+  /* Parallel Section: one block per thread per round. */
+#pragma omp parallel num_threads(threads)
+  {
+    int t = omp_get_thread_num();
+    int team = omp_get_num_threads();
+    bufs[t] = malloc((size_t)GEN_BLOCK_ROWS * GEN_MAX_ROW);
+    if (!bufs[t]) {
+#pragma omp atomic write
+      failed = 1;
+    }
+
+    for (long round = 0; round < n; round += (long)team * GEN_BLOCK_ROWS) {
+#pragma omp barrier
+      if (failed) {
+        break;
+      }
+      long begin = round + (long)t * GEN_BLOCK_ROWS;
+      long end = begin + GEN_BLOCK_ROWS < n ? begin + GEN_BLOCK_ROWS : n;
+      lens[t] = begin < n ? format_block(bufs[t], seed, begin, end) : 0;
+
+#pragma omp barrier
+#pragma omp single
+      for (int k = 0; k < team; k++) {
+        offsets[k] = written;
+        written += (off_t)lens[k];
+      }
+
+      if (lens[t] > 0 && write_at(fd, bufs[t], lens[t], offsets[t]) != 0) {
+#pragma omp critical
+        perror(filename);
+#pragma omp atomic write
+        failed = 1;
+      }
+    }
+    free(bufs[t]);
+  }
+
+  if (close(fd) != 0) {
+    perror(filename);
+    failed = 1;
+  }
+  fd = -1;
+  if (failed) {
+    fprintf(stderr, "Error: failed to generate %s\n", filename);
+  } else if (n <= 10) {
+    char row[GEN_MAX_ROW];
+    printf("%s", GEN_HEADER);
+    for (long i = 0; i < n; i++) {
+      fwrite(row, 1, format_row(row, seed, i), stdout);
+    }
+  }
+
+cleanup:
+  if (fd >= 0) {
+    close(fd);
+  }
+  free(bufs);
+  free(lens);
+  free(offsets);
+  return failed ? -1 : 0;
+}
+
+/*
+Function: row_random()
+Parameters: uint64_t seed, long row, int draw
+Return: uint64_t
+Description:
+
+The draw-th random number of row: splitmix64 applied to a counter made from
+the seed and (row, draw). Every value depends on nothing else, so threads
+need no shared state and any thread count gives the same rows.
+*/
+uint64_t row_random(uint64_t seed, long row, int draw) {
+  uint64_t z = seed + ((uint64_t)row * 2 + (uint64_t)draw + 1) *
+                          0x9E3779B97F4A7C15ULL;
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  return z ^ (z >> 31);
 }
 
 /*
 Function: random_price()
-Parameters: const char *model, int year
+Parameters: int model, int year, uint64_t r
 Return: int
 Description:
 
-Estimated price generator based on model and year
+Estimated price generator based on model and year, with the random number r
+picking the +/- 2000 variation.
 */
-int random_price(const char *model, int year) {
+int random_price(int model, int year, uint64_t r) {
+  const char *name = models[model];
   int base;
 
-  if (strcmp(model, "Accord") == 0 || strcmp(model, "Camry") == 0) {
+  if (strcmp(name, "Accord") == 0 || strcmp(name, "Camry") == 0) {
     base = 16000;
-  } else if (strcmp(model, "Civic") == 0 || strcmp(model, "Corolla") == 0) {
+  } else if (strcmp(name, "Civic") == 0 || strcmp(name, "Corolla") == 0) {
     base = 15000;
-  } else if (strcmp(model, "Maxima") == 0) {
+  } else if (strcmp(name, "Maxima") == 0) {
     base = 17000;
   } else {
     base = 14000;
   }
 
   base += (year - 2010) * 500;
-  base += (rand() % 4000) - 2000;
+  base += (int)(r % 4000) - 2000;
   if (base < 5000)
     base = 5000;
 
   return base;
 }
+
+/*
+Function: append_int()
+Parameters: char *out, int value
+Return: size_t
+Description:
+
+Writes the decimal digits of a non-negative value to out and returns how
+many were written.
+*/
+static size_t append_int(char *out, int value) {
+  char digits[12];
+  size_t len = 0;
+
+  do {
+    digits[len++] = (char)('0' + value % 10);
+    value /= 10;
+  } while (value > 0);
+  for (size_t i = 0; i < len; i++) {
+    out[i] = digits[len - 1 - i];
+  }
+  return len;
+}
+
+/*
+Function: append_str()
+Parameters: char *out, const char *s, char sep
+Return: size_t
+Description:
+
+Copies s and then sep to out and returns the number of bytes written.
+*/
+static size_t append_str(char *out, const char *s, char sep) {
+  size_t len = strlen(s);
+  memcpy(out, s, len);
+  out[len] = sep;
+  return len + 1;
+}
+
+/*
+Function: format_row()
+Parameters: char *out, uint64_t seed, long row
+Return: size_t
+Description:
+
+Formats row as "ID Model YearMake Color Price Dealer\n" into out, at most
+GEN_MAX_ROW bytes, and returns its length.
+*/
+size_t format_row(char *out, uint64_t seed, long row) {
+  uint64_t r = row_random(seed, row, 0);
+  int model = (int)(r % numModels);
+  int year = years[(r / numModels) % numYears];
+  int color = (int)((r / numModels / numYears) % numColors);
+  int dealer = (int)((r / numModels / numYears / numColors) % numDealers);
+  int price = random_price(model, year, row_random(seed, row, 1));
+  size_t len = 0;
+
+  len += append_int(out + len, 1000 + (int)row);
+  out[len++] = ' ';
+  len += append_str(out + len, models[model], ' ');
+  len += append_int(out + len, year);
+  out[len++] = ' ';
+  len += append_str(out + len, colors[color], ' ');
+  len += append_int(out + len, price);
+  out[len++] = ' ';
+  len += append_str(out + len, dealers[dealer], '\n');
+  return len;
+}
+
+/*
+Function: format_block()
+Parameters: char *out, uint64_t seed, long begin, long end
+Return: size_t
+Description:
+
+Formats rows [begin, end) into out and returns the number of bytes.
+*/
+size_t format_block(char *out, uint64_t seed, long begin, long end) {
+  size_t len = 0;
+  for (long i = begin; i < end; i++) {
+    len += format_row(out + len, seed, i);
+  }
+  return len;
+}
+
+/*
+Function: write_at()
+Parameters: int fd, const char *data, size_t len, off_t offset
+Return: int
+Description:
+
+Writes len bytes at offset with pwrite(), retrying short writes. Returns 0
+on success or -1 with errno set.
+*/
+int write_at(int fd, const char *data, size_t len, off_t offset) {
+  while (len > 0) {
+    ssize_t n = pwrite(fd, data, len, offset);
+    if (n < 0) {
+      return -1;
+    }
+    data += n;
+    len -= (size_t)n;
+    offset += n;
+  }
+  return 0;
+}
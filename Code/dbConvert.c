@@ -0,0 +1,59 @@
+/*
+
+dbConvert.c
+
+Authors:
+    Aidan Levy
+    Maddie Powell
+    Nick Corcoran
+    Austin Phalines
+    Dean Bullock
+
+Creation Date: 10-14-2026
+
+Description:
+
+One-time converter from the text database (db.txt) to the binary format
+described in QPELoad.h. The text is loaded exactly as the query programs load
+it, so the binary file holds the same deduplicated, ID-ordered tuples and the
+same planner statistics. qpe_seq, qpe_omp and qpe_mpi recognize the result by
+its magic number and map it in place, so it can be passed wherever db.txt was.
+
+Usage: ./db_convert <db.txt> <db.bin>
+
+*/
+
+#include <stdio.h>
+
+#include "QPELoad.h"
+
+/*
+Name: main():
+Parameters: int argc, char **argv
+Return: int
+Description:
+
+Loads argv[1] and writes it to argv[2] in the binary format.
+*/
+int main(int argc, char **argv) {
+  LoadedTable table;
+  TableStats stats;
+
+  if (argc != 3) {
+    fprintf(stderr, "Usage: %s <db.txt> <db.bin>\n", argv[0]);
+    return 1;
+  }
+
+  if (!load_table(argv[1], &stats, &table)) {
+    fprintf(stderr, "Error: Failed to load database from %s\n", argv[1]);
+    return 1;
+  }
+  if (!save_table_binary(argv[2], &table, &stats)) {
+    loaded_table_free(&table);
+    return 1;
+  }
+
+  printf("Wrote %zu tuples from %s to %s\n", table.count, argv[1], argv[2]);
+  loaded_table_free(&table);
+  return 0;
+}
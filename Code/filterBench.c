@@ -0,0 +1,370 @@
+/*
+
+filterBench.c
+
+Authors:
+    Aidan Levy
+    Maddie Powell
+    Nick Corcoran
+    Austin Phalines
+    Dean Bullock
+
+Creation Date: 10-14-2026
+
+Description:
+
+Microbenchmark for the filter kernels in QPEFilter.c. Builds a synthetic
+column store with the same vocabulary as dataGen.c (or loads a db file) and
+reports millions of rows per second for every kernel on every instruction set
+the CPU supports, next to the row-at-a-time column_match() and match_where()
+paths they replace.
+
+Usage: ./filter_bench [rows] [db file]
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "QPEColumn.h"
+#include "QPEFilter.h"
+#include "QPEQuery.h"
+
+#define DEFAULT_ROWS (16L * 1024 * 1024)
+#define MIN_SECONDS 0.5
+
+/*
+Struct Definitions
+*/
+typedef struct {
+  const char *label;
+  const char *where;
+} BenchClause;
+
+/*
+Function Prototypes
+*/
+static double now_sec(void);
+static ColumnTable *synthetic_table(size_t n);
+static ColumnTable *load_table(const char *filename);
+static void report(const char *isa, const char *kernel, size_t rows,
+                   double secs, double scalar_rate, size_t matched);
+static size_t popcount_bits(const uint64_t *bits, size_t n);
+static void bench_kernels(const ColumnTable *table, const FilterKernels *k,
+                          double *scalar_rates);
+static void bench_clause(const ColumnTable *table, CarInventory *rows,
+                         const BenchClause *clause);
+
+static const char *models[] = {"Accord", "Corolla", "Civic",
+                               "Maxima", "Focus",   "Camry"};
+static const int years[] = {2000, 2013, 2015, 2016, 2018, 2020, 2021, 2023};
+static const char *colors[] = {"Gray",  "White", "Blue",
+                               "Red",   "Green", "Black"};
+static const char *dealers[] = {"Pohanka", "AutoNation", "Mitsubishi",
+                                "Sonic",   "Suburban",   "Atlantic",
+                                "Ganley",  "Victory",    "GM"};
+
+static const BenchClause clauses[] = {
+    {"model_eq", "Model=\"Camry\""},
+    {"color_or3", "Color=\"Red\" OR Color=\"Blue\" OR Color=\"Black\""},
+    {"price_range", "Price>15000 AND Price<20000"},
+    {"sql_mixed",
+     "Model=\"Civic\" AND (Color=\"Red\" OR Color=\"Blue\") AND "
+     "YearMake>2015"},
+};
+
+int main(int argc, char **argv) {
+  size_t n = argc > 1 ? (size_t)atol(argv[1]) : (size_t)DEFAULT_ROWS;
+  ColumnTable *table = argc > 2 ? load_table(argv[2]) : synthetic_table(n);
+  double scalar_rates[5] = {0};
+
+  if (table == NULL || table->count == 0) {
+    fprintf(stderr, "Error: no rows to benchmark\n");
+    column_table_free(table);
+    return 1;
+  }
+  n = table->count;
+
+  CarInventory *rows = malloc(n * sizeof(CarInventory));
+  if (rows == NULL) {
+    fprintf(stderr, "Error: out of memory\n");
+    column_table_free(table);
+    return 1;
+  }
+  for (size_t i = 0; i < n; i++) {
+    column_table_get(table, i, &rows[i]);
+  }
+
+  printf("rows=%zu block=%d best=%s\n", n, QPE_FILTER_BLOCK,
+         filter_kernels(filter_best_isa())->name);
+  printf("%-8s %-22s %12s %9s %10s\n", "isa", "kernel", "Mrows/s", "speedup",
+         "matched");
+
+  for (int isa = 0; isa < NUM_ISAS; isa++) {
+    const FilterKernels *k = filter_kernels((FilterIsa)isa);
+    if (k != NULL) {
+      bench_kernels(table, k, scalar_rates);
+    }
+  }
+  for (size_t c = 0; c < sizeof(clauses) / sizeof(clauses[0]); c++) {
+    bench_clause(table, rows, &clauses[c]);
+  }
+
+  free(rows);
+  column_table_free(table);
+  return 0;
+}
+
+/*
+Name: now_sec():
+Parameters: none
+Return: double
+Description:
+
+Monotonic wall clock in seconds.
+*/
+static double now_sec(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+/*
+Name: synthetic_table():
+Parameters: size_t n
+Return: ColumnTable *
+Description:
+
+Builds an n-row column store with dataGen.c's models, colors, dealers, year and
+price ranges, using a fixed seed so runs are comparable.
+*/
+static ColumnTable *synthetic_table(size_t n) {
+  ColumnTable *table = column_table_new(n);
+  CarInventory car;
+
+  if (table == NULL) {
+    return NULL;
+  }
+  srand(420);
+  for (size_t i = 0; i < n; i++) {
+    car.ID = 1000 + (int)i;
+    strcpy(car.Model, models[rand() % 6]);
+    car.YearMake = years[rand() % 8];
+    strcpy(car.Color, colors[rand() % 6]);
+    car.Price = 14000 + (car.YearMake - 2010) * 500 + rand() % 4000 - 2000;
+    strcpy(car.Dealer, dealers[rand() % 9]);
+    if (!column_table_append(table, &car)) {
+      column_table_free(table);
+      return NULL;
+    }
+  }
+  return table;
+}
+
+/*
+Name: load_table():
+Parameters: const char *filename
+Return: ColumnTable *
+Description:
+
+Loads a db.txt-format file (header line skipped, as in the query engines)
+straight into a column store.
+*/
+static ColumnTable *load_table(const char *filename) {
+  FILE *fp = fopen(filename, "r");
+  char line[256];
+  CarInventory car;
+
+  if (fp == NULL) {
+    fprintf(stderr, "Error: cannot open %s\n", filename);
+    return NULL;
+  }
+  ColumnTable *table = column_table_new(1024);
+  if (table == NULL || fgets(line, sizeof(line), fp) == NULL) {
+    fclose(fp);
+    return table;
+  }
+  while (fscanf(fp, "%d %19s %d %19s %d %19s", &car.ID, car.Model,
+                &car.YearMake, car.Color, &car.Price, car.Dealer) == 6) {
+    if (!column_table_append(table, &car)) {
+      break;
+    }
+  }
+  fclose(fp);
+  return table;
+}
+
+/*
+Name: report():
+Parameters: const char *isa, const char *kernel, size_t rows, double secs,
+            double scalar_rate, size_t matched
+Return: void
+Description:
+
+Prints one result row; speedup is relative to scalar_rate when it is known.
+*/
+static void report(const char *isa, const char *kernel, size_t rows,
+                   double secs, double scalar_rate, size_t matched) {
+  double rate = (double)rows / secs / 1e6;
+  if (scalar_rate > 0) {
+    printf("%-8s %-22s %12.1f %8.2fx %10zu\n", isa, kernel, rate,
+           rate / scalar_rate, matched);
+  } else {
+    printf("%-8s %-22s %12.1f %9s %10zu\n", isa, kernel, rate, "-", matched);
+  }
+}
+
+/*
+Name: popcount_bits():
+Parameters: const uint64_t *bits, size_t n
+Return: size_t
+Description:
+
+Counts the set bits among the first n bits of a bitmap.
+*/
+static size_t popcount_bits(const uint64_t *bits, size_t n) {
+  size_t total = 0;
+  for (size_t w = 0; w < (n + 63) / 64; w++) {
+    total += (size_t)__builtin_popcountll(bits[w]);
+  }
+  return total;
+}
+
+/*
+Name: bench_kernels():
+Parameters: const ColumnTable *table, const FilterKernels *k,
+            double *scalar_rates
+Return: void
+Description:
+
+Times each leaf kernel of one instruction set over the whole table, block by
+block, repeating until MIN_SECONDS have passed. The scalar set runs first and
+records its rates in scalar_rates for the speedup column.
+*/
+static void bench_kernels(const ColumnTable *table, const FilterKernels *k,
+                          double *scalar_rates) {
+  static const uint16_t one_code[1] = {0};
+  static const uint16_t three_codes[3] = {0, 1, 2};
+  static const char *names[5] = {"int32_eq", "int32_gt", "code_in(1)",
+                                 "code_in(3)", "code_lut"};
+  static unsigned char lut[QPE_MAX_DICT_CODES];
+  uint64_t bits[QPE_FILTER_WORDS];
+  size_t n = table->count;
+  int scalar = strcmp(k->name, "scalar") == 0;
+
+  for (int c = 0; c < table->dicts[DICT_COLOR].count; c++) {
+    lut[c] = (unsigned char)(c % 3 == 0);
+  }
+
+  for (int kernel = 0; kernel < 5; kernel++) {
+    size_t matched = 0;
+    size_t scanned = 0;
+    double start = now_sec();
+    double secs;
+
+    do {
+      matched = 0;
+      for (size_t row = 0; row < n; row += QPE_FILTER_BLOCK) {
+        size_t len = n - row < QPE_FILTER_BLOCK ? n - row : QPE_FILTER_BLOCK;
+        switch (kernel) {
+        case 0:
+          k->int32_cmp(table->year_make + row, len, OP_EQ, 2015, bits);
+          break;
+        case 1:
+          k->int32_cmp(table->price + row, len, OP_GT, 18000, bits);
+          break;
+        case 2:
+          k->code_in(table->model + row, len, one_code, 1, bits);
+          break;
+        case 3:
+          k->code_in(table->color + row, len, three_codes, 3, bits);
+          break;
+        default:
+          k->code_lut(table->color + row, len, lut, bits);
+          break;
+        }
+        matched += popcount_bits(bits, len);
+      }
+      scanned += n;
+      secs = now_sec() - start;
+    } while (secs < MIN_SECONDS);
+
+    if (scalar) {
+      scalar_rates[kernel] = (double)scanned / secs / 1e6;
+    }
+    report(k->name, names[kernel], scanned, secs,
+           scalar ? 0 : scalar_rates[kernel], matched);
+  }
+}
+
+/*
+Name: bench_clause():
+Parameters: const ColumnTable *table, CarInventory *rows,
+            const BenchClause *clause
+Return: void
+Description:
+
+Times a whole compiled WHERE clause three ways: match_where() over row
+records, column_match() a row at a time, and filter_block() with the kernel set
+filter_best_isa() selects. The speedup column is relative to match_where().
+*/
+static void bench_clause(const ColumnTable *table, CarInventory *rows,
+                         const BenchClause *clause) {
+  Predicate pred;
+  ColumnFilter filter;
+  FilterScratch scratch;
+  size_t n = table->count;
+  char label[64];
+  double row_rate = 0;
+
+  if (!compile_where(clause->where, &pred) ||
+      !column_filter_init(&filter, table, &pred)) {
+    fprintf(stderr, "Error: cannot compile %s\n", clause->where);
+    return;
+  }
+  if (!filter_scratch_init(&scratch, &filter)) {
+    fprintf(stderr, "Error: out of memory\n");
+    column_filter_free(&filter);
+    return;
+  }
+
+  for (int mode = 0; mode < 3; mode++) {
+    size_t matched = 0;
+    size_t scanned = 0;
+    double start = now_sec();
+    double secs;
+
+    do {
+      matched = 0;
+      if (mode == 0) {
+        for (size_t row = 0; row < n; row++) {
+          matched += (size_t)match_where(&rows[row], &pred);
+        }
+      } else if (mode == 1) {
+        for (size_t row = 0; row < n; row++) {
+          matched += (size_t)column_match(&filter, row);
+        }
+      } else {
+        for (size_t row = 0; row < n; row += QPE_FILTER_BLOCK) {
+          size_t len = n - row < QPE_FILTER_BLOCK ? n - row : QPE_FILTER_BLOCK;
+          matched += popcount_bits(filter_block(&scratch, row, len), len);
+        }
+      }
+      scanned += n;
+      secs = now_sec() - start;
+    } while (secs < MIN_SECONDS);
+
+    snprintf(label, sizeof(label), "%s/%s", clause->label,
+             mode == 0 ? "row" : mode == 1 ? "column" : "bitmap");
+    if (mode == 0) {
+      row_rate = (double)scanned / secs / 1e6;
+    }
+    report(mode == 2 ? scratch.kernels->name : "-", label, scanned, secs,
+           mode == 0 ? 0 : row_rate, matched);
+  }
+
+  filter_scratch_free(&scratch);
+  column_filter_free(&filter);
+}
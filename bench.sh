@@ -0,0 +1,233 @@
+#!/bin/bash
+
+# Benchmark sweep for qpe_seq, qpe_omp, qpe_mpi and qpe_hybrid.
+#
+# Generates one dataset per size with dataGenParallel and a fixed seed, runs
+# every engine configuration on it WARMUP + TRIALS times, and takes the
+# median of the trials' total time from each run's --timing log. The first
+# run of every configuration is checked against qpe_seq with the same
+# sort-and-diff as confirm.sh, so a speedup is never reported for wrong
+# results.
+#
+# Results go into $BENCH_DIR:
+#   runs.csv    every run's --timing row, warmups included
+#   strong.csv  fixed table size: speedup and efficiency against qpe_seq
+#   weak.csv    WEAK_ROWS rows per worker: efficiency against qpe_seq
+#
+# Every setting below can be overridden from the environment or the make
+# command line, e.g. make bench SIZES="10000 100000" THREADS="1 2".
+
+SIZES=${SIZES:-"10000 100000 1000000 10000000 100000000"}
+THREADS=${THREADS:-"1 2 4 8"}
+RANKS=${RANKS:-"1 2 4"}
+ENGINES=${ENGINES:-"seq omp mpi hybrid"}
+WEAK_ROWS=${WEAK_ROWS:-1000000}
+WEAK_WORKERS=${WEAK_WORKERS:-"1 2 4 8"}
+MAX_WORKERS=${MAX_WORKERS:-$(nproc)}
+WARMUP=${WARMUP:-1}
+TRIALS=${TRIALS:-3}
+SEED=${SEED:-42}
+SQL=${SQL:-"./db/sql.txt"}
+BENCH_DIR=${BENCH_DIR:-"./bench_out"}
+BENCH_ARGS=${BENCH_ARGS:-""}
+MPIRUN=${MPIRUN:-mpirun}
+MPIRUN_ARGS=${MPIRUN_ARGS:-""}
+DATAGEN=${DATAGEN:-"./data_gen"}
+
+WORK="$BENCH_DIR/work"
+DATA="$BENCH_DIR/data"
+RUNS="$BENCH_DIR/runs.csv"
+STRONG="$BENCH_DIR/strong.csv"
+WEAK="$BENCH_DIR/weak.csv"
+FAILED=false
+
+mkdir -p "$WORK" "$DATA" || exit 1
+rm -f "$RUNS"
+
+# dataset <rows>: path of the seeded dataset, generated on first use.
+dataset() {
+    local db="$DATA/db_$1_$SEED.txt"
+    if [ ! -s "$db" ]; then
+        echo "Generating $1 rows into $db" >&2
+        if ! "$DATAGEN" --seed="$SEED" "$1" "$db" > /dev/null; then
+            echo "ERROR: $DATAGEN failed for $1 rows" >&2
+            exit 1
+        fi
+    fi
+    echo "$db"
+}
+
+# engine_cmd <engine> <ranks> <threads> <db>: sets CMD to the command line.
+engine_cmd() {
+    case $1 in
+        seq) CMD=(./qpe_seq "$4" "$SQL") ;;
+        omp) CMD=(./qpe_omp "$4" "$SQL" "$3") ;;
+        mpi) CMD=("$MPIRUN" $MPIRUN_ARGS -np "$2" ./qpe_mpi "$4" "$SQL") ;;
+        hybrid)
+            CMD=("$MPIRUN" $MPIRUN_ARGS -np "$2" ./qpe_hybrid "$4" "$SQL" \
+                 "$3") ;;
+    esac
+    CMD+=($BENCH_ARGS)
+}
+
+# configs <engine>: the "ranks threads" pairs to run, at most MAX_WORKERS
+# workers each.
+configs() {
+    case $1 in
+        seq) echo "1 1" ;;
+        omp) for t in $THREADS; do echo "1 $t"; done ;;
+        mpi) for r in $RANKS; do echo "$r 1"; done ;;
+        hybrid)
+            for r in $RANKS; do
+                for t in $THREADS; do
+                    (( r > 1 && t > 1 )) && echo "$r $t"
+                done
+            done ;;
+    esac | while read -r r t; do
+        (( r * t <= MAX_WORKERS )) && echo "$r $t"
+    done
+}
+
+# normalize <output> <sorted>: confirm.sh's filter, the results without the
+# timing summary, sorted so the engines' row order does not matter.
+normalize() {
+    awk '/[Tt]iming[[:space:]][Ss]ummary/ {exit} {print}' "$1" | sort > "$2"
+}
+
+# measure <engine> <ranks> <threads> <db> <expected>: runs the configuration
+# and sets MEDIAN to the median total time of the trials and VALID to
+# whether its output matched <expected>. With no expected file yet the first
+# run's output becomes it.
+measure() {
+    local log="$WORK/timing.csv"
+    local out="$WORK/out.txt"
+    local k
+
+    engine_cmd "$@"
+    rm -f "$log"
+    VALID=yes
+    for (( k = 0; k < WARMUP + TRIALS; k++ )); do
+        if ! "${CMD[@]}" --timing="$log" < /dev/null > "$out" \
+            2> "$WORK/err.txt"; then
+            echo "ERROR: ${CMD[*]} failed:" >&2
+            cat "$WORK/err.txt" >&2
+            VALID=no
+            MEDIAN=nan
+            FAILED=true
+            return
+        fi
+        if (( k == 0 )); then
+            normalize "$out" "$WORK/sorted.txt"
+            if [ ! -f "$5" ]; then
+                mv "$WORK/sorted.txt" "$5"
+            elif ! diff -q "$5" "$WORK/sorted.txt" > /dev/null; then
+                echo "ERROR: output of ${CMD[*]} differs from qpe_seq" >&2
+                VALID=no
+                FAILED=true
+            fi
+        fi
+    done
+
+    # Rows after the header: WARMUP warmups, then the trials.
+    awk -F, -v warmup="$WARMUP" -v runs="$RUNS" '
+        NR == 1 {
+            for (i = 1; i <= NF; i++) if ($i == "total_max") col = i
+            if (system("test -s " runs) != 0) print "trial," $0 >> runs
+            next
+        }
+        { print (NR - 1 <= warmup ? "warmup" : NR - 1 - warmup) "," $0 >> runs }
+        NR - 1 > warmup { print $col }' "$log" | sort -g |
+        awk '{ v[NR] = $1 }
+             END {
+                 if (NR == 0) print "nan"
+                 else if (NR % 2) print v[(NR + 1) / 2]
+                 else print (v[NR / 2] + v[NR / 2 + 1]) / 2
+             }' > "$WORK/median.txt"
+    MEDIAN=$(cat "$WORK/median.txt")
+}
+
+# ratio <a> <b>: a / b, or nan.
+ratio() {
+    awk -v a="$1" -v b="$2" \
+        'BEGIN { if (a == "nan" || b == "nan" || b == 0) print "nan";
+                 else printf "%.3f\n", a / b }'
+}
+
+# table <csv>: prints a CSV file as aligned columns.
+table() {
+    awk -F, '{ for (i = 1; i <= NF; i++) { cell[NR, i] = $i
+                   if (length($i) > w[i]) w[i] = length($i) }
+               if (NF > nf) nf = NF }
+             END { for (r = 1; r <= NR; r++) {
+                       for (i = 1; i <= nf; i++)
+                           printf "%-*s%s", w[i], cell[r, i],
+                                  i < nf ? "  " : "\n"
+                   } }' "$1"
+}
+
+echo "rows,engine,ranks,threads,workers,seconds,speedup,efficiency,valid" \
+    > "$STRONG"
+for n in $SIZES; do
+    db=$(dataset "$n") || exit 1
+    expect="$WORK/expect_$n.txt"
+    rm -f "$expect"
+    echo "Running seq on $n rows" >&2
+    measure seq 1 1 "$db" "$expect"
+    base=$MEDIAN
+    echo "$n,seq,1,1,1,$base,1.000,1.000,$VALID" >> "$STRONG"
+    for engine in $ENGINES; do
+        [[ $engine == seq ]] && continue
+        configs "$engine" > "$WORK/configs.txt"
+        while read -r r t; do
+            w=$((r * t))
+            echo "Running $engine ranks=$r threads=$t on $n rows" >&2
+            measure "$engine" "$r" "$t" "$db" "$expect"
+            speedup=$(ratio "$base" "$MEDIAN")
+            eff=$(ratio "$speedup" "$w")
+            echo "$n,$engine,$r,$t,$w,$MEDIAN,$speedup,$eff,$VALID" >> "$STRONG"
+        done < "$WORK/configs.txt"
+    done
+done
+
+header="rows_per_worker,engine,ranks,threads,workers,rows,seconds"
+echo "$header,efficiency,valid" > "$WEAK"
+db=$(dataset "$WEAK_ROWS") || exit 1
+expect="$WORK/expect_weak_1.txt"
+rm -f "$WORK"/expect_weak_*.txt
+echo "Running seq on $WEAK_ROWS rows (weak)" >&2
+measure seq 1 1 "$db" "$expect"
+base=$MEDIAN
+echo "$WEAK_ROWS,seq,1,1,1,$WEAK_ROWS,$base,1.000,$VALID" >> "$WEAK"
+for engine in $ENGINES; do
+    [[ $engine == seq ]] && continue
+    configs "$engine" > "$WORK/configs.txt"
+    while read -r r t; do
+        w=$((r * t))
+        [[ " $WEAK_WORKERS " == *" $w "* ]] || continue
+        rows=$((WEAK_ROWS * w))
+        db=$(dataset "$rows") || exit 1
+        expect="$WORK/expect_weak_$w.txt"
+        if [ ! -f "$expect" ]; then
+            # Only validates: weak efficiency is measured against 1 worker.
+            measure seq 1 1 "$db" "$expect"
+        fi
+        echo "Running $engine ranks=$r threads=$t on $rows rows (weak)" >&2
+        measure "$engine" "$r" "$t" "$db" "$expect"
+        eff=$(ratio "$base" "$MEDIAN")
+        echo "$WEAK_ROWS,$engine,$r,$t,$w,$rows,$MEDIAN,$eff,$VALID" >> "$WEAK"
+    done < "$WORK/configs.txt"
+done
+
+echo
+echo "Strong scaling (median of $TRIALS trials, seconds):"
+table "$STRONG"
+echo
+echo "Weak scaling ($WEAK_ROWS rows per worker):"
+table "$WEAK"
+echo
+echo "CSV files: $STRONG $WEAK $RUNS"
+
+if [ "$FAILED" = true ]; then
+    echo "ERROR: some runs failed or did not match qpe_seq; see above."
+    exit 1
+fi